@@ -0,0 +1,565 @@
+#include "SiCKL.h"
+using namespace SiCKL;
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#if defined(__linux__)
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+// times the CPU backend's execution modes on the Mandelbrot kernel against
+// the same loop written in plain C++, then each instruction set the
+// machine supports, then how the SIMD mode scales with threads when rows
+// are split statically and when tiles are stolen, and last every builtin
+// function at each CPUMathAccuracy against the C library in double, and
+// how each CPUTraversal order does on a box blur that reads 5 rows
+
+class Mandelbrot : public Source
+{
+public:
+	Mandelbrot() : max_iterations(512) {}
+	const int32_t max_iterations;
+
+	BEGIN_SOURCE
+		BEGIN_CONST_DATA
+			CONST_DATA(Float2, min)
+			CONST_DATA(Float2, max)
+			CONST_DATA(Buffer1D<Float3>, color_map)
+		END_CONST_DATA
+
+		BEGIN_OUT_DATA
+			OUT_DATA(Float3, output)
+		END_OUT_DATA
+
+		BEGIN_MAIN
+
+			Float2 val0 = NormalizedIndex() * (max - min) + min;
+			Float x0 = val0.X;
+			Float y0 = val0.Y;
+
+			Float x = 0;
+			Float y = 0;
+
+			Int iteration = 0;
+
+			While(x*x + y*y < 4.0f && iteration < max_iterations)
+				Float xtemp = x*x - y*y + x0;
+				y = 2.0f*x*y + y0;
+
+				x = xtemp;
+
+				iteration = iteration + 1;
+			EndWhile
+
+			// log scale iteration count to 0,1
+			Float norm_val = Log(((Float)iteration + 1.0f))/float(log(max_iterations + 1.0));
+
+			// get color from lookup buffer
+			output = color_map((Int)(norm_val * (float)(max_iterations - 1)));
+
+		END_MAIN
+	END_SOURCE
+};
+
+// one builtin function per element, x and y read from a Float2 buffer
+class MathKernel : public Source
+{
+public:
+	MathKernel(BuiltinFunction::Func f) : function(f) {}
+	const BuiltinFunction::Func function;
+
+	BEGIN_SOURCE
+		BEGIN_CONST_DATA
+			CONST_DATA(Buffer2D<Float2>, arguments)
+		END_CONST_DATA
+
+		BEGIN_OUT_DATA
+			OUT_DATA(Float, output)
+		END_OUT_DATA
+
+		BEGIN_MAIN
+
+			Float2 xy = arguments(Index());
+			switch(function)
+			{
+			case BuiltinFunction::Sin: output = Sin(xy.X); break;
+			case BuiltinFunction::Cos: output = Cos(xy.X); break;
+			case BuiltinFunction::Tan: output = Tan(xy.X); break;
+			case BuiltinFunction::ASin: output = ASin(xy.X); break;
+			case BuiltinFunction::ACos: output = ACos(xy.X); break;
+			case BuiltinFunction::ATan: output = ATan(xy.X); break;
+			case BuiltinFunction::SinH: output = SinH(xy.X); break;
+			case BuiltinFunction::CosH: output = CosH(xy.X); break;
+			case BuiltinFunction::TanH: output = TanH(xy.X); break;
+			case BuiltinFunction::Pow: output = Pow(xy.X, xy.Y); break;
+			case BuiltinFunction::Exp: output = Exp(xy.X); break;
+			case BuiltinFunction::Log: output = Log(xy.X); break;
+			case BuiltinFunction::Exp2: output = Exp2(xy.X); break;
+			case BuiltinFunction::Log2: output = Log2(xy.X); break;
+			default: output = Sqrt(xy.X); break;
+			}
+
+		END_MAIN
+	END_SOURCE
+};
+
+// the average of the 5x5 texels around each element
+class BoxBlur : public Source
+{
+public:
+	BEGIN_SOURCE
+		BEGIN_CONST_DATA
+			CONST_DATA(Buffer2D<Float4>, image)
+		END_CONST_DATA
+
+		BEGIN_OUT_DATA
+			OUT_DATA(Float4, output)
+		END_OUT_DATA
+
+		BEGIN_MAIN
+
+			Int2 index = Index();
+			Float4 sum = Float4(0.0f, 0.0f, 0.0f, 0.0f);
+			ForInRange(j, -2, 3)
+				ForInRange(i, -2, 3)
+					sum = sum + image(index.X + i, index.Y + j);
+				EndFor
+			EndFor
+			output = sum * (1.0f / 25.0f);
+
+		END_MAIN
+	END_SOURCE
+};
+
+const int32_t width = 350;
+const int32_t height = 200;
+// each case reports its fastest run
+const int32_t repeats = 3;
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// counts last level cache misses where the kernel lets us, -1 elsewhere
+class CacheMisses
+{
+public:
+	CacheMisses() : _fd(-1)
+	{
+#if defined(__linux__)
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		// inherit so the pool's threads count too
+		attr.inherit = 1;
+		_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~CacheMisses()
+	{
+#if defined(__linux__)
+		if(_fd >= 0)
+		{
+			close(_fd);
+		}
+#endif
+	}
+
+	void Start()
+	{
+#if defined(__linux__)
+		if(_fd >= 0)
+		{
+			ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+	int64_t Stop()
+	{
+		int64_t count = -1;
+#if defined(__linux__)
+		if(_fd >= 0)
+		{
+			ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(read(_fd, &count, sizeof(count)) != sizeof(count))
+			{
+				count = -1;
+			}
+		}
+#endif
+		return count;
+	}
+private:
+	int _fd;
+};
+
+// the kernel by hand, the best any of the execution modes can hope for
+static double run_native(const float* color_map, int32_t colors, float* result)
+{
+	double best = 0.0;
+	for(int32_t r = 0; r < repeats; r++)
+	{
+		Clock::time_point start = Clock::now();
+		for(int32_t j = 0; j < height; j++)
+		{
+			for(int32_t i = 0; i < width; i++)
+			{
+				const float x0 = (i + 0.5f) / width * 3.5f + -2.5f;
+				const float y0 = (j + 0.5f) / height * 2.0f + -1.0f;
+
+				float x = 0.0f;
+				float y = 0.0f;
+				int32_t iteration = 0;
+				while(x*x + y*y < 4.0f && iteration < colors)
+				{
+					const float xtemp = x*x - y*y + x0;
+					y = 2.0f*x*y + y0;
+					x = xtemp;
+					iteration++;
+				}
+
+				const float norm_val = logf((float)iteration + 1.0f) / float(log(colors + 1.0));
+				int32_t index = (int32_t)(norm_val * (float)(colors - 1));
+				index = index < 0 ? 0 : (index >= colors ? colors - 1 : index);
+				memcpy(result + 3 * (j * width + i), color_map + 3 * index, sizeof(float) * 3);
+			}
+		}
+		const double ms = milliseconds(start, Clock::now());
+		best = (r == 0 || ms < best) ? ms : best;
+	}
+	return best;
+}
+
+// a tile_width of 0 keeps the program's default tiles
+static double run_program(CPUCompiler& compiler, const Mandelbrot& mbrot, const CPUBuffer1D& color_map, float*& result, int32_t tile_width = 0, int32_t tile_height = 0, float* lane_utilization = nullptr)
+{
+	CPUProgram* program = compiler.Build(mbrot);
+	CPUBuffer2D output(width, height, ReturnType::Float3, nullptr);
+
+	program->Initialize(width, height);
+	if(tile_width > 0)
+	{
+		program->SetTileSize(tile_width, tile_height);
+	}
+	program->SetInput(program->GetInputHandle("min"), -2.5f, -1.0f);
+	program->SetInput(program->GetInputHandle("max"), 1.0f, 1.0f);
+	program->SetInput(program->GetInputHandle("color_map"), color_map);
+	program->BindOutput(program->GetOutputHandle("output"), output);
+
+	double best = 0.0;
+	for(int32_t r = 0; r < repeats; r++)
+	{
+		Clock::time_point start = Clock::now();
+		program->Run();
+		const double ms = milliseconds(start, Clock::now());
+		best = (r == 0 || ms < best) ? ms : best;
+	}
+
+	program->GetOutput(program->GetOutputHandle("output"), result);
+	if(lane_utilization != nullptr)
+	{
+		*lane_utilization = program->GetLaneUtilization();
+	}
+
+	delete program;
+	return best;
+}
+
+static void report(const char* name, double ms, double baseline, const float* result, const float* reference)
+{
+	const double elements = (double)width * height;
+	int32_t mismatches = 0;
+	for(int32_t i = 0; i < width * height; i++)
+	{
+		if(memcmp(result + 3 * i, reference + 3 * i, sizeof(float) * 3) != 0)
+		{
+			mismatches++;
+		}
+	}
+
+	printf("%-14s %10.2f ms %10.2f Melem/s %8.2fx   %d mismatches\n", name, ms, elements / (ms * 1000.0), baseline / ms, mismatches);
+}
+
+int main()
+{
+	Mandelbrot mbrot;
+	mbrot.Parse();
+
+	const int32_t colors = mbrot.max_iterations;
+
+	/// Generate the color table (a nice gold)
+	float* color_map_data = new float[3 * colors];
+	for(int32_t i = 0; i < colors; i++)
+	{
+		float x = i/(float)colors;
+		color_map_data[3 * i + 0] = 191.0f / 255.0f * (1.0f - x);
+		color_map_data[3 * i + 1] = 125.0f / 255.0f * (1.0f - x);
+		color_map_data[3 * i + 2] = 37.0f / 255.0f * (1.0f - x);
+	}
+	CPUBuffer1D color_map(colors, ReturnType::Float3, color_map_data);
+
+	printf("Mandelbrot %dx%d, best of %d, %s\n", width, height, repeats, CPURuntime::GetInstructionSetName(CPURuntime::GetInstructionSet()));
+
+	float* reference = new float[3 * width * height];
+	const double native_ms = run_native(color_map_data, colors, reference);
+
+	float* result = nullptr;
+
+	CPUCompiler interpreter(CPUExecutionMode::Interpreter);
+	const double interpreter_ms = run_program(interpreter, mbrot, color_map, result);
+	report("interpreter", interpreter_ms, interpreter_ms, result, reference);
+
+	CPUCompiler bytecode(CPUExecutionMode::Bytecode);
+	report("bytecode", run_program(bytecode, mbrot, color_map, result), interpreter_ms, result, reference);
+
+	// share of the SIMD lanes doing work on each trip through the While
+	float lane_utilization = 0.0f;
+
+	CPUCompiler simd(CPUExecutionMode::SIMD);
+	report("simd", run_program(simd, mbrot, color_map, result, 0, 0, &lane_utilization), interpreter_ms, result, reference);
+	printf("%-14s %10.1f %%\n", "  lanes busy", lane_utilization * 100.0f);
+
+	CPUCompiler simd_refill(CPUExecutionMode::SIMDRefill);
+	report("simd refill", run_program(simd_refill, mbrot, color_map, result, 0, 0, &lane_utilization), interpreter_ms, result, reference);
+	printf("%-14s %10.1f %%\n", "  lanes busy", lane_utilization * 100.0f);
+
+	CPUCompiler native(CPUExecutionMode::Native);
+	report("native kernel", run_program(native, mbrot, color_map, result), interpreter_ms, result, reference);
+
+	CPUCompiler jit(CPUExecutionMode::JIT);
+	report("jit kernel", run_program(jit, mbrot, color_map, result), interpreter_ms, result, reference);
+
+	report("native", native_ms, interpreter_ms, reference, reference);
+
+	/// Instruction Sets
+
+	// every variant this machine can run, oldest first
+	const CPUInstructionSet::Type detected = CPURuntime::GetInstructionSet();
+	printf("\n%-8s %14s %14s\n", "isa", "simd", "native kernel");
+	for(int32_t isa = CPUInstructionSet::Generic; isa <= CPURuntime::GetSupportedInstructionSet(); isa++)
+	{
+		CPURuntime::ForceInstructionSet((CPUInstructionSet::Type)isa);
+		const double simd_ms = run_program(simd, mbrot, color_map, result);
+		const double native_kernel_ms = run_program(native, mbrot, color_map, result);
+		printf("%-8s %11.2f ms %11.2f ms\n", CPURuntime::GetInstructionSetName((CPUInstructionSet::Type)isa), simd_ms, native_kernel_ms);
+	}
+	CPURuntime::ForceInstructionSet(detected);
+
+	/// Thread Scaling
+
+	// one tile of whole rows per thread is the same as splitting the rows
+	// statically, there is nothing left to steal
+	const uint32_t hardware_threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+	printf("\n%-8s %14s %14s %10s %10s\n", "threads", "static rows", "stealing", "speedup", "steals");
+	double single_ms = 0.0;
+	for(uint32_t threads = 1; ; threads = (threads * 2 < hardware_threads) ? threads * 2 : hardware_threads)
+	{
+		CPURuntime::Initialize(threads);
+
+		const double static_ms = run_program(simd, mbrot, color_map, result, width, (height + threads - 1) / threads);
+		const double stealing_ms = run_program(simd, mbrot, color_map, result);
+		const uint32_t steals = CPURuntime::GetStealCount();
+		single_ms = (threads == 1) ? stealing_ms : single_ms;
+		printf("%-8u %11.2f ms %11.2f ms %9.2fx %10u\n", threads, static_ms, stealing_ms, single_ms / stealing_ms, steals);
+
+		CPURuntime::Finalize();
+		if(threads == hardware_threads)
+		{
+			break;
+		}
+	}
+
+	/// Math Library
+
+	// worst error in ulps against the C library evaluated in double, over
+	// the domain a kernel would usually call the function on
+	struct
+	{
+		const char* name;
+		BuiltinFunction::Func function;
+		double (*reference)(double, double);
+		float low, high;
+	}
+	const functions[] =
+	{
+		{"sin", BuiltinFunction::Sin, [](double x, double) { return sin(x); }, -100.0f, 100.0f},
+		{"cos", BuiltinFunction::Cos, [](double x, double) { return cos(x); }, -100.0f, 100.0f},
+		{"tan", BuiltinFunction::Tan, [](double x, double) { return tan(x); }, -1.5f, 1.5f},
+		{"asin", BuiltinFunction::ASin, [](double x, double) { return asin(x); }, -1.0f, 1.0f},
+		{"acos", BuiltinFunction::ACos, [](double x, double) { return acos(x); }, -1.0f, 1.0f},
+		{"atan", BuiltinFunction::ATan, [](double x, double) { return atan(x); }, -100.0f, 100.0f},
+		{"sinh", BuiltinFunction::SinH, [](double x, double) { return sinh(x); }, -20.0f, 20.0f},
+		{"cosh", BuiltinFunction::CosH, [](double x, double) { return cosh(x); }, -20.0f, 20.0f},
+		{"tanh", BuiltinFunction::TanH, [](double x, double) { return tanh(x); }, -10.0f, 10.0f},
+		{"pow", BuiltinFunction::Pow, [](double x, double y) { return pow(x, y); }, 0.01f, 10.0f},
+		{"exp", BuiltinFunction::Exp, [](double x, double) { return exp(x); }, -80.0f, 80.0f},
+		{"log", BuiltinFunction::Log, [](double x, double) { return log(x); }, 1e-10f, 1e10f},
+		{"exp2", BuiltinFunction::Exp2, [](double x, double) { return exp2(x); }, -120.0f, 120.0f},
+		{"log2", BuiltinFunction::Log2, [](double x, double) { return log2(x); }, 1e-10f, 1e10f},
+		{"sqrt", BuiltinFunction::Sqrt, [](double x, double) { return sqrt(x); }, 0.0f, 1e10f},
+	};
+
+	const int32_t math_width = 1024;
+	const int32_t math_height = 256;
+	const int32_t math_elements = math_width * math_height;
+
+	printf("\n%-8s", "function");
+	for(int32_t accuracy = CPUMathAccuracy::Standard; accuracy <= CPUMathAccuracy::Fast; accuracy++)
+	{
+		printf(" %25s", CPURuntime::GetMathAccuracyName((CPUMathAccuracy::Type)accuracy));
+	}
+	printf("\n");
+
+	float* arguments_data = new float[2 * math_elements];
+	float* math_result = nullptr;
+	for(const auto& f : functions)
+	{
+		// x evenly over the domain, y over [-4,4] for pow; wide domains are
+		// spread logarithmically so every binade gets its share
+		const bool logarithmic = f.low > 0.0f && f.high / f.low > 1000.0f;
+		for(int32_t i = 0; i < math_elements; i++)
+		{
+			const double t = (i + 0.5) / math_elements;
+			arguments_data[2 * i + 0] = logarithmic ? (float)(f.low * pow((double)f.high / f.low, t)) : (float)(f.low + (f.high - f.low) * t);
+			arguments_data[2 * i + 1] = (float)(-4.0 + 8.0 * ((i * 7919) % math_elements) / math_elements);
+		}
+		CPUBuffer2D arguments(math_width, math_height, ReturnType::Float2, arguments_data);
+
+		MathKernel kernel(f.function);
+		kernel.Parse();
+
+		printf("%-8s", f.name);
+		for(int32_t accuracy = CPUMathAccuracy::Standard; accuracy <= CPUMathAccuracy::Fast; accuracy++)
+		{
+			CPUCompiler compiler(CPUExecutionMode::SIMD, (CPUMathAccuracy::Type)accuracy);
+			CPUProgram* program = compiler.Build(kernel);
+			CPUBuffer2D output(math_width, math_height, ReturnType::Float, nullptr);
+
+			program->Initialize(math_width, math_height);
+			program->SetInput(program->GetInputHandle("arguments"), arguments);
+			program->BindOutput(program->GetOutputHandle("output"), output);
+
+			double best = 0.0;
+			for(int32_t r = 0; r < repeats; r++)
+			{
+				Clock::time_point start = Clock::now();
+				program->Run();
+				const double ms = milliseconds(start, Clock::now());
+				best = (r == 0 || ms < best) ? ms : best;
+			}
+			program->GetOutput(program->GetOutputHandle("output"), math_result);
+			delete program;
+
+			// a ulp is measured at the float nearest the true result
+			double worst = 0.0;
+			for(int32_t i = 0; i < math_elements; i++)
+			{
+				const double expected = f.reference(arguments_data[2 * i + 0], arguments_data[2 * i + 1]);
+				const float rounded = (float)expected;
+				if(!std::isfinite(rounded) || !std::isfinite(math_result[i]))
+				{
+					continue;
+				}
+				const double ulp = std::max((double)nextafterf(fabsf(rounded), INFINITY) - fabsf(rounded), (double)std::numeric_limits<float>::denorm_min());
+				const double error = fabs(math_result[i] - expected) / ulp;
+				worst = error > worst ? error : worst;
+			}
+			printf(" %6.0f Melem/s %5.1f ulp", math_elements / (best * 1000.0), worst);
+		}
+		printf("\n");
+	}
+
+	/// Traversal
+
+	// an image several times the size of the last level cache, so each
+	// order is measured by how often it has to go back to memory for rows
+	const int32_t blur_width = 4096;
+	const int32_t blur_height = 512;
+	float* image_data = new float[4 * blur_width * blur_height];
+	for(int32_t i = 0; i < 4 * blur_width * blur_height; i++)
+	{
+		image_data[i] = (float)((i * 37) % 1024) / 1024.0f;
+	}
+	CPUBuffer2D image(blur_width, blur_height, ReturnType::Float4, image_data);
+
+	BoxBlur blur;
+	blur.Parse();
+
+	CacheMisses misses;
+	float* blur_reference = nullptr;
+	float* blur_result = nullptr;
+	printf("\nbox blur %dx%d\n%-10s %14s %14s %12s\n", blur_width, blur_height, "traversal", "time", "llc misses", "mismatches");
+	for(int32_t traversal = CPUTraversal::Automatic; traversal <= CPUTraversal::Morton; traversal++)
+	{
+		CPUProgram* program = simd.Build(blur);
+		program->SetTraversal((CPUTraversal::Type)traversal);
+		CPUBuffer2D output(blur_width, blur_height, ReturnType::Float4, nullptr);
+
+		program->Initialize(blur_width, blur_height);
+		program->SetInput(program->GetInputHandle("image"), image);
+		program->BindOutput(program->GetOutputHandle("output"), output);
+
+		double best = 0.0;
+		int64_t fewest = -1;
+		for(int32_t r = 0; r < repeats; r++)
+		{
+			misses.Start();
+			Clock::time_point start = Clock::now();
+			program->Run();
+			const double ms = milliseconds(start, Clock::now());
+			const int64_t count = misses.Stop();
+			best = (r == 0 || ms < best) ? ms : best;
+			fewest = (r == 0 || count < fewest) ? count : fewest;
+		}
+		program->GetOutput(program->GetOutputHandle("output"), traversal == CPUTraversal::Automatic ? blur_reference : blur_result);
+
+		// every order computes the same elements, only when differs
+		int32_t mismatches = 0;
+		if(traversal != CPUTraversal::Automatic)
+		{
+			for(int32_t i = 0; i < 4 * blur_width * blur_height; i++)
+			{
+				mismatches += (blur_result[i] != blur_reference[i]) ? 1 : 0;
+			}
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), traversal == CPUTraversal::Automatic ? "(%s)" : "%s", CPURuntime::GetTraversalName(program->GetTraversal()));
+		char count[32] = "n/a";
+		if(fewest >= 0)
+		{
+			snprintf(count, sizeof(count), "%lld", (long long)fewest);
+		}
+		printf("%-10s %11.2f ms %14s %12d\n", name, best, count, mismatches);
+		delete program;
+	}
+
+	/// Cleanup
+
+	free(blur_result);
+	free(blur_reference);
+	delete[] image_data;
+
+	free(math_result);
+	delete[] arguments_data;
+	free(result);
+	delete[] reference;
+	delete[] color_map_data;
+}
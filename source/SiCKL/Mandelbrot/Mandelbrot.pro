@@ -40,6 +40,8 @@ SOURCES += \
 debug:LIBS += -L$$PWD/../../../bin/Debug -lSiCKLD
 release:LIBS += -L$$PWD/../../../bin/Release -lSiCKL
 
+sickl_llvm: LIBS += $$system(llvm-config --ldflags --libs)
+
 win32 {
     LIBS += -L$$PWD/../../../extern/glew-1.9.0/lib -lglew32s
     LIBS += -L$$PWD/../../../extern/glfw-3.0.4/lib -lglfw3
@@ -63,6 +65,7 @@ win32 {
     LIBS += -lGL
     LIBS += -lX11
     LIBS += -ldl
+    LIBS += -lpthread
     LIBS += -lXext
     LIBS += -lXxf86vm
     LIBS += -lXi
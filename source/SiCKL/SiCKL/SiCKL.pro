@@ -22,6 +22,21 @@ release:TARGET = SiCKL
 unix {
     QMAKE_CXXFLAGS += -std=c++11
     QMAKE_CXXFLAGS += -Wno-invalid-offsetof
+    # the CPU executors built for instruction sets with FMA must give the
+    # same results as the generic ones
+    QMAKE_CXXFLAGS += -ffp-contract=off
+    # nothing reads errno or the floating point exception flags, and keeping
+    # either up to date stops the math library's functions from vectorizing
+    QMAKE_CXXFLAGS += -fno-math-errno -fno-trapping-math
+}
+
+# qmake CONFIG+=sickl_llvm builds the JIT execution mode against the
+# LLVM found by llvm-config, applications link with its libraries
+
+sickl_llvm {
+    DEFINES += SICKL_LLVM
+    QMAKE_CXXFLAGS += -std=c++14
+    INCLUDEPATH += $$system(llvm-config --includedir)
 }
 
 macx {
@@ -61,7 +76,25 @@ HEADERS += \
     include/AST.h \
     include/Backends/OpenGL.h \
     include/Common.h \
-    include/Backends/OpenCL.h
+    include/Backends/OpenCL.h \
+    include/Backends/CPU.h \
+    source/Backends/OpenCL/OpenCL.Cache.h \
+    source/Backends/OpenCL/OpenCL.Internal.h \
+    source/Backends/CPU/CPU.Internal.h \
+    source/Backends/CPU/CPU.Interpreter.h \
+    source/Backends/CPU/CPU.Bytecode.h \
+    source/Backends/CPU/CPU.Math.h \
+    source/Backends/CPU/CPU.Math.inl \
+    source/Backends/CPU/CPU.VirtualMachine.h \
+    source/Backends/CPU/CPU.SIMD.h \
+    source/Backends/CPU/CPU.SIMD.inl \
+    source/Backends/CPU/CPU.Native.h \
+    source/Backends/CPU/CPU.JIT.h \
+    source/Backends/CPU/CPU.Perf.h \
+    source/Backends/CPU/CPU.Scheduler.h \
+    source/Backends/CPU/CPU.Memory.h \
+    source/Backends/CPU/CPU.Analysis.h \
+    source/Backends/CPU/CPU.Traversal.h
 
 # sources
 
@@ -74,7 +107,28 @@ SOURCES += \
     source/Functions.cpp \
     source/AST.cpp \
     source/Backends/OpenCL/OpenCL.Runtime.cpp \
-    source/Backends/OpenCL/OpenCL.Compiler.cpp
+    source/Backends/OpenCL/OpenCL.Compiler.cpp \
+    source/Backends/OpenCL/OpenCL.Cache.cpp \
+    source/Backends/OpenCL/OpenCL.Tuner.cpp \
+    source/Backends/CPU/CPU.Runtime.cpp \
+    source/Backends/CPU/CPU.Program.cpp \
+    source/Backends/CPU/CPU.Compiler.cpp \
+    source/Backends/CPU/CPU.Interpreter.cpp \
+    source/Backends/CPU/CPU.Bytecode.cpp \
+    source/Backends/CPU/CPU.Math.cpp \
+    source/Backends/CPU/CPU.VirtualMachine.cpp \
+    source/Backends/CPU/CPU.SIMD.cpp \
+    source/Backends/CPU/CPU.SIMD.SSE42.cpp \
+    source/Backends/CPU/CPU.SIMD.AVX2.cpp \
+    source/Backends/CPU/CPU.SIMD.AVX512.cpp \
+    source/Backends/CPU/CPU.Native.cpp \
+    source/Backends/CPU/CPU.NativeCompiler.cpp \
+    source/Backends/CPU/CPU.JIT.cpp \
+    source/Backends/CPU/CPU.Perf.cpp \
+    source/Backends/CPU/CPU.Scheduler.cpp \
+    source/Backends/CPU/CPU.Memory.cpp \
+    source/Backends/CPU/CPU.Analysis.cpp \
+    source/Backends/CPU/CPU.Traversal.cpp
 
 # unix {
 #   target.path = /usr/lib
@@ -15,6 +15,16 @@ namespace SiCKL
 		const char* _name;
 	};
 
+	// what running a node cost, for annotating a printed tree; the cycles
+	// include the node's children
+	struct NodeCost
+	{
+		uint64_t count;
+		uint64_t cycles;
+		// read by samples
+		uint64_t bytes;
+	};
+
 	struct ASTNode
 	{
 		ASTNode();
@@ -69,11 +79,22 @@ namespace SiCKL
 		void Print() const;
 		void PrintNode() const;
 		void PrintDot() const;
+		// annotated with a cost for each node in the order Print visits them,
+		// the share of this node's cycles heats each one up from blue to red
+		void Print(const NodeCost* costs) const;
+		void PrintDot(const NodeCost* costs) const;
 	private:
 		static void Print(const ASTNode*, uint32_t indent);
 		static void PrintDot(const ASTNode*, uint32_t& id);
+		static void Print(const ASTNode*, uint32_t indent, const NodeCost* costs, uint64_t total, uint32_t& id);
+		static void PrintDot(const ASTNode*, uint32_t& id, const NodeCost* costs, uint64_t total);
 	};
 
+	// names of the node and return types as ASTNode::Print shows them,
+	// NodeTypes is indexed by type + 1
+	extern const char* NodeTypes[];
+	const char* GetReturnType(ReturnType::Type);
+
 	template<typename T> 
 	inline static bool is_primitive()
 	{
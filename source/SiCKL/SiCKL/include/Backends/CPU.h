@@ -0,0 +1,390 @@
+#pragma once
+
+#include "SiCKL.h"
+
+#include <string>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		class Kernel;
+		class Scheduler;
+		class IndexAnalysis;
+		struct Reach;
+	}
+
+	// how a CPUProgram executes the kernel
+	struct CPUExecutionMode
+	{
+		enum Type
+		{
+			// walks the AST, slow but simple
+			Interpreter,
+			// register bytecode virtual machine
+			Bytecode,
+			// bytecode run on a row of elements at once, one per SIMD lane
+			SIMD,
+			// SIMD where a lane that finishes the first top level While moves
+			// on to the next element instead of idling until the rest of its
+			// row is done; plain SIMD for programs without such a loop
+			SIMDRefill,
+			// C++ source built by the system compiler and loaded as a shared
+			// object, falls back on SIMD if that fails
+			Native,
+			// LLVM IR compiled in process with ORC, needs a library built
+			// with SICKL_LLVM and falls back on SIMD otherwise
+			JIT,
+			// the Interpreter counting how often each AST node runs, the
+			// cycles it takes and the bytes its samples read, see
+			// CPUProgram::PrintProfile
+			Profiler,
+		};
+	};
+
+	// instruction sets the CPU execution modes generate code for, each one
+	// includes the ones before it
+	struct CPUInstructionSet
+	{
+		enum Type
+		{
+			// SSE2 on x86-64, the compiler's default target elsewhere
+			Generic,
+			// SSE4.2 and POPCNT
+			SSE42,
+			// AVX2, FMA and BMI2
+			AVX2,
+			// AVX-512 F, CD, BW, DQ and VL
+			AVX512,
+		};
+	};
+
+	// how closely the CPU execution modes evaluate Sin, Pow, Log and the
+	// other transcendental builtins; errors are in ulps of the float result
+	struct CPUMathAccuracy
+	{
+		enum Type
+		{
+			// the C library's functions
+			Standard,
+			// within about 1 ulp, evaluated in double
+			Precise,
+			// within about 4 ulps
+			Balanced,
+			// about 16 correct bits, for colour mapping and the like
+			Fast,
+		};
+	};
+
+	// the order CPUProgram::Run visits the index domain in, which decides
+	// how well the texels a kernel samples stay in cache
+	struct CPUTraversal
+	{
+		enum Type
+		{
+			// picked by CPUCompiler::Build from the Sample2D indices
+			Automatic,
+			// bands of whole rows, for kernels that only sample their own row
+			Rows,
+			// tiles row by row, prefetching the texel rows of the next tile,
+			// for stencils that sample Index() plus constant offsets
+			Tiles,
+			// tiles along a Morton (Z-order) curve, for gathers from
+			// computed indices
+			Morton,
+		};
+	};
+
+	// what backs the memory of large CPU buffers
+	struct CPUHugePages
+	{
+		enum Type
+		{
+			// only the regular pages
+			None,
+			// regular pages the OS is asked to merge into huge ones, where it
+			// supports that
+			Transparent,
+			// huge pages reserved by the OS, falling back on Transparent when
+			// none are free
+			Explicit,
+		};
+	};
+
+	class CPURuntime
+	{
+	public:
+		// start the threads CPUProgram::Run splits its index domain over;
+		// thread_count includes the calling thread, 0 means one per hardware
+		// thread, and pin_threads binds each worker to a core. Until this is
+		// called programs run on the calling thread alone
+		static bool Initialize(uint32_t thread_count = 0, bool pin_threads = false);
+		// and stop them
+		static bool Finalize();
+		static uint32_t GetThreadCount();
+		// tiles idle threads took from busy ones during the last Run
+		static uint32_t GetStealCount();
+		static uint32_t RequiredBufferSpace(uint32_t width, uint32_t height, ReturnType::Type type);
+		// for the buffers created from then on, Transparent by default; huge
+		// pages cut the TLB misses of walking large images
+		static void SetHugePages(CPUHugePages::Type);
+		static CPUHugePages::Type GetHugePages();
+
+		// the newest instruction set this CPU and OS support, from cpuid
+		static CPUInstructionSet::Type GetSupportedInstructionSet();
+		// the one CPUCompiler::Build generates code for; the supported one
+		// unless the SICKL_CPU_ISA environment variable (generic, sse4.2,
+		// avx2 or avx512) or ForceInstructionSet picks an older one
+		static CPUInstructionSet::Type GetInstructionSet();
+		// for debugging, sets newer than the supported one are clamped to it
+		static void ForceInstructionSet(CPUInstructionSet::Type);
+		static const char* GetInstructionSetName(CPUInstructionSet::Type);
+		static const char* GetMathAccuracyName(CPUMathAccuracy::Type);
+		static const char* GetTraversalName(CPUTraversal::Type);
+	private:
+		friend class CPUProgram;
+		friend struct CPUBuffer1D;
+		friend struct CPUBuffer2D;
+
+		static Internal::Scheduler* _scheduler;
+		static CPUHugePages::Type _huge_pages;
+		// -1 until the first GetInstructionSet
+		static int32_t _instruction_set;
+	};
+
+	// host memory buffers, laid out the same way as the data passed to
+	// and read back from the OpenGL buffers
+
+	struct CPUBuffer1D : public RefCounted<CPUBuffer1D>
+	{
+		REF_COUNTED(CPUBuffer1D)
+
+		CPUBuffer1D();
+		CPUBuffer1D(int32_t length, ReturnType::Type type, const void* data);
+
+		uint32_t GetBufferSize() const;
+
+		template<typename T>
+		inline void GetData(T*& in_out_buffer) const
+		{
+			get_data((void**)&in_out_buffer);
+		}
+
+		void SetData(const void* in_buffer);
+
+		const int32_t Length;
+		const ReturnType::Type Type;
+	private:
+		void get_data(void** in_out_buffer) const;
+		void* _data;
+		friend class CPUProgram;
+	};
+
+	struct CPUBuffer2D : public RefCounted<CPUBuffer2D>
+	{
+		REF_COUNTED(CPUBuffer2D)
+
+		CPUBuffer2D();
+		CPUBuffer2D(int32_t width, int32_t height, ReturnType::Type type, const void* data);
+
+		uint32_t GetBufferSize() const;
+
+		template<typename T>
+		inline void GetData(T*& in_out_buffer) const
+		{
+			get_data((void**)&in_out_buffer);
+		}
+
+		// set data from CPU
+		void SetData(const void* in_buffer);
+		// set data from another buffer
+		void SetData(const CPUBuffer2D& in_buffer);
+
+		const int32_t Width;
+		const int32_t Height;
+		const ReturnType::Type Type;
+	private:
+		void get_data(void** in_out_buffer) const;
+		void* _data;
+		friend class CPUProgram;
+	};
+
+	/// handles for setting inputs and outputs for CPU Programs
+	typedef int32_t input_t;
+	typedef int32_t output_t;
+	class CPUProgram : public Program
+	{
+	public:
+		virtual ~CPUProgram();
+		// sets the index domain the program runs over
+		void Initialize(int32_t width, int32_t height);
+		// size of the blocks of elements handed to threads, smaller tiles
+		// balance uneven kernels better but cost more to hand out
+		void SetTileSize(int32_t width, int32_t height);
+		// overrides the traversal CPUCompiler::Build picked, Automatic goes
+		// back to it
+		void SetTraversal(CPUTraversal::Type);
+		// the traversal Run uses, never Automatic
+		CPUTraversal::Type GetTraversal() const;
+
+		input_t GetInputHandle(const char*);
+		output_t GetOutputHandle(const char*);
+		// inputs to kernel
+		void SetInput(input_t, bool);
+		void SetInput(input_t, int32_t);
+		void SetInput(input_t, uint32_t);
+		void SetInput(input_t, float);
+		// vec2s
+		void SetInput(input_t, int32_t, int32_t);
+		void SetInput(input_t, uint32_t, uint32_t);
+		void SetInput(input_t, float, float);
+		// vec3s
+		void SetInput(input_t, int32_t, int32_t, int32_t);
+		void SetInput(input_t, uint32_t, uint32_t, uint32_t);
+		void SetInput(input_t, float, float, float);
+		// vec4s
+		void SetInput(input_t, int32_t, int32_t, int32_t, int32_t);
+		void SetInput(input_t, uint32_t, uint32_t, uint32_t, uint32_t);
+		void SetInput(input_t, float, float, float, float);
+
+		void SetInput(input_t, const CPUBuffer1D&);
+		void SetInput(input_t, const CPUBuffer2D&);
+		// reads a buffer input in place from the caller's memory instead of
+		// a copy: element (x, y) starts at data + y * row_pitch +
+		// x * element_stride, 0 meaning tightly packed, so padded rows and
+		// interleaved channels need no repacking. Height is 1 for a Buffer1D.
+		// The memory is read by every Run until the input is set again
+		void SetInput(input_t, const void* data, int32_t width, int32_t height, size_t row_pitch = 0, size_t element_stride = 0);
+
+		// outputs
+		void BindOutput(output_t, const CPUBuffer2D&);
+		// writes the output in place to the caller's memory, laid out as
+		// above with the size given to Initialize; it must not overlap the
+		// inputs
+		void BindOutput(output_t, void* data, size_t row_pitch = 0, size_t element_stride = 0);
+
+		// copy output buffer to caller's memory
+		template<typename T>
+		inline void GetOutput(output_t o, T*& in_out_buffer)
+		{
+			get_output(o, 0, 0, _size[0], _size[1], (void**)&in_out_buffer);
+		}
+
+		template<typename T>
+		inline void GetSubOutput(output_t o, int32_t offset_x, int32_t offset_y, int32_t width, int32_t height, T*& in_out_buffer)
+		{
+			get_output(o, offset_x, offset_y, width, height, (void**)&in_out_buffer);
+		}
+
+		virtual void Run();
+		// share of the SIMD lanes kept busy during the last Run, see
+		// CPUExecutionMode::SIMDRefill
+		float GetLaneUtilization() const;
+		// the AST annotated with what each node cost during the last Run,
+		// hotter nodes drawn redder; nothing unless the program was built
+		// with CPUExecutionMode::Profiler
+		void PrintProfile() const;
+		void PrintProfileDot() const;
+
+		// the program the kernel runs, if it has a text form
+		const std::string& GetSource() const {return _source;}
+	private:
+		CPUProgram() {};
+		CPUProgram(const CPUProgram&) {};
+		CPUProgram& operator=(const CPUProgram&) {return *this;};
+		CPUProgram(const ASTNode* uniforms, const ASTNode* outputs, uint32_t symbol_count, Internal::Kernel* kernel, const std::string& source, const Internal::IndexAnalysis& analysis);
+		friend class CPUCompiler;
+
+		void get_output(output_t, int32_t, int32_t, int32_t, int32_t, void**);
+
+		// dimensions of the index domain
+		int32_t _size[2];
+		int32_t _tile_size[2];
+
+		// set with SetTraversal and the one the analysis picked
+		CPUTraversal::Type _traversal;
+		CPUTraversal::Type _automatic_traversal;
+		// texels each regularly sampled buffer reads, for prefetching
+		int32_t _reach_count;
+		Internal::Reach* _reach;
+
+		struct Uniform
+		{
+			std::string _name;
+			ReturnType::Type _type;
+			symbol_id_t _sid;
+
+			// data copied into the symbol table on Run
+			union
+			{
+				int32_t _int;
+				uint32_t _uint;
+				float _float;
+				struct
+				{
+					int32_t x;
+					int32_t y;
+					int32_t z;
+					int32_t w;
+				} _ivec;
+				struct
+				{
+					uint32_t x;
+					uint32_t y;
+					uint32_t z;
+					uint32_t w;
+				} _uvec;
+				struct
+				{
+					float x;
+					float y;
+					float z;
+					float w;
+				} _fvec;
+				// all buffers
+				struct
+				{
+					const void* data;
+					int32_t width;
+					int32_t height;
+					size_t row_pitch;
+					size_t element_stride;
+				} _buffer;
+			};
+		};
+		int32_t _uniform_count;
+		Uniform* _uniforms;
+
+		struct Output
+		{
+			std::string _name;
+			ReturnType::Type _type;
+			symbol_id_t _sid;
+			void* _data;
+			size_t _row_pitch;
+			size_t _element_stride;
+		};
+		int32_t _output_count;
+		Output* _outputs;
+
+		uint32_t _symbol_count;
+		Internal::Kernel* _kernel;
+		std::string _source;
+	};
+
+	// Native and JIT kernels are named sickl_ and the class name of their
+	// Source. With the SICKL_PERF environment variable set they also carry
+	// debug line info pointing at a listing of the AST, a line per node, in
+	// the Native cache directory; JIT kernels are then announced to perf in
+	// /tmp/perf-<pid>.map and in a jitdump under JITDUMPDIR or ~/.debug/jit
+	// for perf inject --jit
+	class CPUCompiler : public Compiler<CPUProgram>
+	{
+	public:
+		CPUCompiler(CPUExecutionMode::Type mode = CPUExecutionMode::Bytecode, CPUMathAccuracy::Type accuracy = CPUMathAccuracy::Standard);
+		virtual CPUProgram* Build(const Source&);
+	private:
+		CPUExecutionMode::Type _mode;
+		CPUMathAccuracy::Type _accuracy;
+	};
+}
@@ -4,6 +4,10 @@
 
 namespace SiCKL
 {
+    namespace Internal
+    {
+        struct BufferEvents;
+    }
     
     template<typename T>
     struct vector2
@@ -40,37 +44,199 @@ namespace SiCKL
     static_assert(sizeof(float3) == 3 * sizeof(float), "");
     static_assert(sizeof(float4) == 4 * sizeof(float), "");
     
+    // an OpenCL device and what it can do
+    struct OpenCLDevice
+    {
+        OpenCLDevice();
+        
+        cl_platform_id Platform;
+        cl_device_id Id;
+        cl_device_type Type;
+        
+        char Name[128];
+        char Vendor[128];
+        char PlatformName[128];
+        char PlatformVendor[128];
+        char Version[64];
+        char DriverVersion[64];
+        
+        cl_uint ComputeUnits;
+        cl_uint ClockFrequency;
+        cl_ulong GlobalMemorySize;
+        cl_ulong LocalMemorySize;
+        cl_ulong MaxAllocationSize;
+        size_t MaxWorkGroupSize;
+        size_t MaxWorkItemSizes[3];
+        // whether the device shares memory with the host, like CPUs and
+        // integrated GPUs
+        bool HostUnifiedMemory;
+    };
+    
+    // picks a device out of every device of every platform
+    struct OpenCLDeviceFilter
+    {
+        OpenCLDeviceFilter();
+        
+        // any of CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU, etc, defaults to all
+        cl_device_type Type;
+        // a case insensitive part of the device or platform vendor, any
+        // vendor if null
+        const char* Vendor;
+        // which of the devices that pass the above, from 0
+        uint32_t Index;
+    };
+    
+    // how a runtime queues commands. With several queues or out of order
+    // ones, buffers keep track of the commands using them and kernels and
+    // transfers wait on the ones they depend on
+    struct OpenCLQueueOptions
+    {
+        OpenCLQueueOptions();
+        
+        static const uint32_t MaxQueueCount = 8;
+        // commands go to each queue in turn, defaults to 1
+        uint32_t QueueCount;
+        // lets the queues run commands in any order, on devices that can;
+        // defaults to false
+        bool OutOfOrder;
+    };
+    
+    // a context and command queues on one device. Buffers and programs use
+    // the runtime they were made with, or the default one Initialize sets
+    // up; either way it has to outlive them
     class OpenCLRuntime
     {
     public:
-        // setup opencl runtime
+        // every device of every platform, in platform order
+        static sickl_int GetDevices(std::vector<OpenCLDevice>& out_devices);
+        // the device filter selects
+        static sickl_int SelectDevice(const OpenCLDeviceFilter& filter, OpenCLDevice& out_device);
+        
+        // setup the default opencl runtime, on the first GPU or the first
+        // device of any type without one
         static sickl_int Initialize();
+        // or on the given device
+        static sickl_int Initialize(const OpenCLDevice& device, const OpenCLQueueOptions& options = OpenCLQueueOptions());
         // tear it down
         static sickl_int Finalize();
+        static OpenCLRuntime& GetDefault() {return _default;}
+        
+        // runtimes beyond the default one
+        OpenCLRuntime();
+        ~OpenCLRuntime();
+        sickl_int Create(const OpenCLDevice& device, const OpenCLQueueOptions& options = OpenCLQueueOptions());
+        sickl_int Release();
+        
+        // blocks until every command enqueued so far is done
+        sickl_int Finish();
+        
+        const OpenCLDevice& GetDevice() const {return _device_info;}
     private:
+        OpenCLRuntime(const OpenCLRuntime&);
+        OpenCLRuntime& operator=(const OpenCLRuntime&);
+        
         friend struct OpenCLBuffer1D;
         friend struct OpenCLBuffer2D;
         friend struct OpenCLProgram;
+        friend class OpenCLCompiler;
+        
+        static OpenCLRuntime _default;
+        
+        // the queue the next command goes to
+        cl_command_queue NextQueue();
         
-        static cl_context _context;
-        static cl_device_id _device;
-        static cl_command_queue _command_queue;
+        OpenCLDevice _device_info;
+        cl_context _context;
+        cl_device_id _device;
+        cl_command_queue _command_queues[OpenCLQueueOptions::MaxQueueCount];
+        uint32_t _queue_count;
+        uint32_t _next_queue;
+        // whether commands can overtake each other, so buffers have to
+        // keep track of theirs
+        bool _track_hazards;
     };
 
+    // where a buffer's memory lives
+    struct OpenCLMemory
+    {
+        enum Type
+        {
+            // allocated by the driver, data (if any) is copied in
+            Device,
+            // the data passed to Initialize is the buffer, it has to outlive
+            // it. Zero-copy on CPUs and integrated GPUs when data is aligned
+            // to a page
+            UseHostPointer,
+            // allocated by the driver where the host can reach it, so Map
+            // is zero-copy on CPUs and integrated GPUs; data (if any) is
+            // copied in
+            AllocHostPointer,
+        };
+    };
+    
+    // how the elements of Int3, UInt3 and Float3 buffers are laid out, in
+    // the device's memory and in the host data SetData, GetData and Map use;
+    // other types ignore it
+    struct OpenCLLayout
+    {
+        enum Type
+        {
+            // 12 bytes per element, like the host int3 and float3
+            Packed,
+            // 16 bytes per element, the 4th component unused
+            Padded,
+            // structure of arrays: every x, then every y, then every z
+            Planar,
+        };
+    };
+    
+    // what the host does with a mapped buffer
+    struct OpenCLMapAccess
+    {
+        enum Type
+        {
+            Read,
+            // the contents the host doesn't overwrite are undefined after
+            // Unmap
+            Write,
+            ReadWrite,
+        };
+    };
+    
+    // Map blocks until the host can use the buffer's memory through the
+    // returned pointer, until Unmap. Kernels must not use a buffer while it
+    // is mapped, and a buffer is mapped once at a time
+
     struct OpenCLBuffer1D : public RefCounted<OpenCLBuffer1D>
     {
         REF_COUNTED(OpenCLBuffer1D)
 
         OpenCLBuffer1D();
-        sickl_int Initialize(size_t length, ReturnType_t, void* data);
+        sickl_int Initialize(size_t length, ReturnType_t, void* data, OpenCLMemory::Type memory = OpenCLMemory::Device, OpenCLLayout::Type layout = OpenCLLayout::Packed);
+        sickl_int Initialize(OpenCLRuntime& runtime, size_t length, ReturnType_t, void* data, OpenCLMemory::Type memory = OpenCLMemory::Device, OpenCLLayout::Type layout = OpenCLLayout::Packed);
         sickl_int SetData(void* in_buffer);
         sickl_int GetData(void* out_buffer);
+        
+        template<typename T>
+        sickl_int Map(OpenCLMapAccess::Type access, T*& out_data)
+        {
+            return map(access, (void**)&out_data);
+        }
+        sickl_int Unmap();
 
         const ReturnType_t Type;
+        const OpenCLLayout::Type Layout;
         const cl_ulong Length;
         const size_t BufferSize;
     private:
+        sickl_int map(OpenCLMapAccess::Type access, void** out_data);
+        
+        OpenCLRuntime* _runtime;
         cl_mem _memory_object;
+        // null unless mapped
+        void* _mapped;
+        // null unless the runtime tracks hazards
+        Internal::BufferEvents* _events;
         
         friend struct OpenCLProgram;
     };
@@ -80,16 +246,53 @@ namespace SiCKL
         REF_COUNTED(OpenCLBuffer2D)
         
         OpenCLBuffer2D();
-        sickl_int Initialize(size_t width, size_t height, ReturnType_t type, void* data);
+        sickl_int Initialize(size_t width, size_t height, ReturnType_t type, void* data, OpenCLMemory::Type memory = OpenCLMemory::Device, OpenCLLayout::Type layout = OpenCLLayout::Packed);
+        sickl_int Initialize(OpenCLRuntime& runtime, size_t width, size_t height, ReturnType_t type, void* data, OpenCLMemory::Type memory = OpenCLMemory::Device, OpenCLLayout::Type layout = OpenCLLayout::Packed);
         sickl_int SetData(void* in_buffer);
         sickl_int GetData(void* out_buffer);
         
+        // row after row, Width elements each
+        template<typename T>
+        sickl_int Map(OpenCLMapAccess::Type access, T*& out_data)
+        {
+            return map(access, (void**)&out_data);
+        }
+        sickl_int Unmap();
+        
         const ReturnType_t Type;
+        const OpenCLLayout::Type Layout;
         const cl_ulong Width;
         const cl_ulong Height;
         const size_t BufferSize;
        private:
+        sickl_int map(OpenCLMapAccess::Type access, void** out_data);
+        
+        OpenCLRuntime* _runtime;
         cl_mem _memory_object;
+        // null unless mapped
+        void* _mapped;
+        // null unless the runtime tracks hazards
+        Internal::BufferEvents* _events;
+        
+        friend struct OpenCLProgram;
+    };
+
+    // a command enqueued on the device, completes when it has run
+    struct OpenCLEvent : public RefCounted<OpenCLEvent>
+    {
+        REF_COUNTED(OpenCLEvent)
+    public:
+        OpenCLEvent();
+        
+        // blocks until the command is done
+        sickl_int Wait() const;
+        // whether the command is done, without waiting
+        bool IsComplete() const;
+    private:
+        // takes a reference to event
+        OpenCLEvent(cl_event event);
+        
+        cl_event _event;
         
         friend struct OpenCLProgram;
     };
@@ -104,41 +307,93 @@ namespace SiCKL
         sickl_int SetWorkDimensions(size_t length, size_t width);
         sickl_int SetWorkDimensions(size_t length, size_t width, size_t height);
         
+        // blocking launches (the default) return once the kernel is done,
+        // others as soon as it is enqueued
+        void SetBlocking(bool blocking);
+        
+        // work group size of launches; 0 (the default) leaves it to the
+        // driver. 2D domains need both or neither set, Run returns
+        // CL_INVALID_WORK_GROUP_SIZE otherwise. Ignored while autotuning
+        void SetLocalWorkSize(size_t x, size_t y);
+        // autotuned programs time how many elements each work item runs and
+        // the work group size the first time they run over new work
+        // dimensions and launch with the fastest from then on; the results
+        // are kept on disk for the next run. The timed launches write the
+        // outputs several times, so kernels must not read their own outputs
+        void SetAutotune(bool autotune);
+        
+        // runs the kernel over the work dimensions with the given args
         template<typename...Args>
         sickl_int operator()(const Args&... args)
         {
-            _param_index = 0;
-            _arg_index = 0;
-            return Run(args...);
+            return Enqueue(nullptr, 0, args...);
         }
+        
+        // as above, but the kernel waits for the wait_count events in
+        // wait_list to complete before it starts
+        template<typename...Args>
+        sickl_int Enqueue(const OpenCLEvent* wait_list, size_t wait_count, const Args&... args)
+        {
+            _wait_list = wait_list;
+            _wait_count = wait_count;
+            // the autotuner switches kernels, which then need the args again
+            do
+            {
+                _param_index = 0;
+                _arg_index = 0;
+                ReturnIfError(Run(args...));
+            } while(_relaunch);
+            return SICKL_SUCCESS;
+        }
+        
+        // completes with the last launch
+        OpenCLEvent GetEvent() const;
+        
+        // the OpenCL C the kernel was built from
+        const char* GetSource() const {return _source;}
 
     private:
+        friend class OpenCLCompiler;
         
         template<typename T>
         sickl_int ValidateArg(const T& arg, const ReturnType_t type);
         
+        // args are checked against the type the kernel takes every time,
+        // even when their value didn't change; it is a compare or two
         template<typename T>
-        sickl_int SetArg(const T& arg)
+        sickl_int SetArg(const T& arg, const ReturnType_t type)
         {
-            return clSetKernelArg(_kernel, _arg_index++, sizeof(T), &arg);
+            ReturnIfError(ValidateArg(arg, type));
+            return SetArgValue(&arg, sizeof(T));
         }
         
-        sickl_int Run()
-        {
-            //return clEnqueueNDRangeKernel()
-            return SICKL_SUCCESS;
-        }
+        // whether the kernel arg at index was last set to value
+        bool HasArgValue(cl_uint index, const void* value, size_t size) const;
+        // sets the next kernel arg, unless it already has this value
+        sickl_int SetArgValue(const void* value, size_t size);
+        // forgets the values, for when _kernel changes
+        void ClearArgValues();
+        
+        // every arg is set, enqueue the kernel
+        sickl_int Run();
+        // enqueue the kernel over the work dimensions with the launch config
+        cl_int Launch(cl_command_queue queue, const cl_event* wait_events, cl_uint wait_count, cl_event* event);
+        // makes the kernel of the given width the active one, false if it
+        // can't run with the given local size
+        sickl_int UseLaunchConfig(uint32_t width, const size_t local_size[2], bool& out_fits);
+        // times the active kernel for the autotuner (unless it is the first
+        // config) and moves on to the next one
+        sickl_int Tune(cl_command_queue queue, const cl_event* wait_events, cl_uint wait_count, bool first);
         
         template<typename Arg, typename...Args>
         sickl_int Run(const Arg& arg, const Args&... args)
-        {;
+        {
+            ReturnErrorIfFalse(_param_index < _type_count, SICKL_INVALID_KERNEL_ARG);
             ReturnType_t type = _types[_param_index];
-            // make sure this arg matches the required type
-            ReturnIfError(ValidateArg(arg, type));
             
-            // pass the arg to our kernel
-            ReturnIfError(SetArg(arg));
-                
+            // pass the arg to our kernel if it matches the required type
+            ReturnIfError(SetArg(arg, type));
+            
             ++_param_index;
             ReturnIfError(Run(args...));
             
@@ -148,21 +403,74 @@ namespace SiCKL
         // used to ensure our passed in args match the required types
         ReturnType_t* _types;
         size_t _type_count;
+        // the last _output_count of them are the outputs
+        size_t _output_count;
+        // the events of the buffers passed to each of them, when the
+        // runtime tracks hazards
+        Internal::BufferEvents** _buffer_events;
         // counter used in Run(...)
         size_t _param_index;
-        // counter used in SetArg
+        // counter used in SetArgValue
         cl_uint _arg_index;
-        // our built kernel
+        // the values last set on the kernel's args, clSetKernelArg is
+        // skipped for those that didn't change
+        struct ArgValue
+        {
+            // 0 until set
+            size_t size;
+            uint8_t value[16];
+        };
+        ArgValue* _arg_values;
+        cl_uint _arg_count;
+        // our built kernel, and the runtime it runs on
+        OpenCLRuntime* _runtime;
         cl_kernel _kernel;
+        // and its source
+        char* _source;
+        // the variants running 1, 2, 4 and 8 elements per work item, built
+        // when first needed; _kernel is one of them
+        cl_kernel _variants[4];
+        // identifies the source and device in the tuning database
+        uint64_t _key;
         
         // work diemnsions
         size_t _work_dimensions[3];
         size_t _dimension_count;
+        
+        // launch settings
+        bool _blocking;
+        uint32_t _width;
+        size_t _local_size[2];
+        size_t _user_local_size[2];
+        
+        // autotuner state
+        bool _autotune;
+        // the work dimensions _width and _local_size were tuned for
+        size_t _tuned_dimensions[2];
+        // true while timing the configs
+        bool _tuning;
+        uint32_t _trial;
+        uint32_t _best_trial;
+        double _best_time;
+        // Run switched kernels and needs the args set again
+        bool _relaunch;
+        const OpenCLEvent* _wait_list;
+        size_t _wait_count;
+        // the last launch
+        cl_event _event;
     };
 
+    // buffers pass their size before their memory
+    template<>
+    sickl_int OpenCLProgram::SetArg<OpenCLBuffer1D>(const OpenCLBuffer1D& buffer, const ReturnType_t type);
+    template<>
+    sickl_int OpenCLProgram::SetArg<OpenCLBuffer2D>(const OpenCLBuffer2D& buffer, const ReturnType_t type);
+
     class OpenCLCompiler
     {
     public:
+        // builds for the default runtime
         static sickl_int Build(SiCKL::Source& source, OpenCLProgram& program);
+        static sickl_int Build(OpenCLRuntime& runtime, SiCKL::Source& source, OpenCLProgram& program);
     };
 }
@@ -12,7 +12,7 @@ FUNC_1(Float, CosH, Float)
 FUNC_1(Float, TanH, Float)
 
 // exponential functions
-FUNC_1(Float, Pow, Float)
+FUNC_2(Float, Pow, Float, Float)
 FUNC_1(Float, Exp, Float)
 FUNC_1(Float, Log, Float)
 FUNC_1(Float, Exp2, Float)
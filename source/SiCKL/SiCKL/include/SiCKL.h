@@ -36,3 +36,4 @@
 // Backends
 #include "Backends/OpenGL.h"
 #include "Backends/OpenCL.h"
+#include "Backends/CPU.h"
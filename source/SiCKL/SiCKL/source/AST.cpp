@@ -296,6 +296,9 @@ namespace SiCKL
 			case ReturnType::Int:
 				printf(", val = %i", *(int32_t*)_u.literal.data);
 				break;
+			case ReturnType::UInt:
+				printf(", val = %u", *(uint32_t*)_u.literal.data);
+				break;
 			case ReturnType::Float:
 				printf(", val = %f", *(float*)_u.literal.data);
 				break;
@@ -356,4 +359,89 @@ namespace SiCKL
 		}
 	}
 
+	// share of total, 0 without any cycles
+	static double share(uint64_t cycles, uint64_t total)
+	{
+		return total > 0 ? (double)cycles / (double)total : 0.0;
+	}
+
+	void ASTNode::Print(const NodeCost* costs) const
+	{
+		uint32_t id = 0;
+		Print(this, 0, costs, costs[0].cycles, id);
+	}
+
+	void ASTNode::Print(const ASTNode* in_node, uint32_t indent, const NodeCost* costs, uint64_t total, uint32_t& id)
+	{
+		const NodeCost& cost = costs[id];
+		const double heat = share(cost.cycles, total);
+
+		// a bar of the node's share ahead of the tree so the hot ones line up
+		char bar[11] = {0};
+		for(uint32_t i = 0; i < 10; i++)
+		{
+			bar[i] = (i < (uint32_t)(heat * 10.0 + 0.5)) ? '#' : ' ';
+		}
+		printf("[%s] %5.1f%% ", bar, heat * 100.0);
+
+		for(uint32_t i = 0; i < indent; i++)
+		{
+			printf(" ");
+		}
+		in_node->PrintNode();
+		if(cost.count > 0)
+		{
+			printf(", runs = %llu, cycles = %llu", (unsigned long long)cost.count, (unsigned long long)cost.cycles);
+		}
+		if(cost.bytes > 0)
+		{
+			printf(", bytes = %llu", (unsigned long long)cost.bytes);
+		}
+		printf("\n");
+
+		for(uint32_t j = 0; j < in_node->_count; j++)
+		{
+			++id;
+			Print(in_node->_children[j], indent + 1, costs, total, id);
+		}
+	}
+
+	void ASTNode::PrintDot(const NodeCost* costs) const
+	{
+		printf("digraph AST\n{\n");
+		printf(" node [fontsize=12, shape=box, style=filled];\n");
+		printf(" rankdir=LR;\n");
+
+		uint32_t id = 0;
+
+		PrintDot(this, id, costs, costs[0].cycles);
+
+		printf("}\n");
+	}
+
+	void ASTNode::PrintDot(const ASTNode* in_node, uint32_t& id, const NodeCost* costs, uint64_t total)
+	{
+		const NodeCost& cost = costs[id];
+		const double heat = share(cost.cycles, total);
+
+		// hue from blue when cold to red when the node takes all the time
+		printf(" node%i [fillcolor=\"%.3f 0.7 1.0\", label=\"", id, (1.0 - heat) * 0.667);
+		in_node->PrintNode();
+		printf("\\n%.1f%%, runs = %llu, cycles = %llu", heat * 100.0, (unsigned long long)cost.count, (unsigned long long)cost.cycles);
+		if(cost.bytes > 0)
+		{
+			printf(", bytes = %llu", (unsigned long long)cost.bytes);
+		}
+		printf("\"];\n");
+
+		const uint32_t my_id = id;
+
+		for(uint32_t j = 0; j < in_node->_count; j++)
+		{
+			++id;
+			printf(" node%i -> node%i;\n", my_id, id);
+
+			PrintDot(in_node->_children[j], id, costs, total);
+		}
+	}
 }
@@ -0,0 +1,692 @@
+#include "CPU.Analysis.h"
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// offsets past this are left non affine rather than risk overflowing
+		static const int64_t AffineLimit = 1 << 24;
+
+		static AffineIndex non_affine()
+		{
+			const AffineIndex result = {false, 0, 0, 0, 0};
+			return result;
+		}
+
+		static AffineIndex affine(int64_t x, int64_t y, int64_t low, int64_t high)
+		{
+			if(x < -AffineLimit || x > AffineLimit || y < -AffineLimit || y > AffineLimit ||
+				low < -AffineLimit || high > AffineLimit)
+			{
+				return non_affine();
+			}
+			const AffineIndex result = {true, (int32_t)x, (int32_t)y, (int32_t)low, (int32_t)high};
+			return result;
+		}
+
+		static bool is_integer(ReturnType::Type type)
+		{
+			return (type & (ReturnType::Int | ReturnType::Int2 | ReturnType::Int3 | ReturnType::Int4 |
+				ReturnType::UInt | ReturnType::UInt2 | ReturnType::UInt3 | ReturnType::UInt4)) != 0 &&
+				(type & (ReturnType::Buffer1D | ReturnType::Buffer2D)) == 0;
+		}
+
+		// the same value in every element
+		static bool is_constant(const AffineIndex& a)
+		{
+			return a.affine && a.x == 0 && a.y == 0 && a.low == a.high;
+		}
+
+		// Index() plus an offset along one axis
+		static bool is_offset(const AffineIndex& a, int32_t x, int32_t y)
+		{
+			return a.affine && a.x == x && a.y == y;
+		}
+
+		static bool is_neighbourhood(const SampleIndex& s)
+		{
+			return is_offset(s.x, 1, 0) && is_offset(s.y, 0, 1);
+		}
+
+		static bool is_fixed(const SampleIndex& s)
+		{
+			return is_offset(s.x, 0, 0) && is_offset(s.y, 0, 0);
+		}
+
+		// x steps by one from one element of a row to the next and y stays
+		// put; ForInRange offsets are the same in every element
+		static bool is_contiguous(const AffineIndex& x, const AffineIndex& y)
+		{
+			return x.affine && x.x == 1 && y.affine && y.x == 0;
+		}
+
+		// assignments to each symbol, ForInRange iterators included
+		static void count_assignments(const ASTNode* node, std::map<symbol_id_t, uint32_t>& assignments)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Assignment:
+				{
+					const ASTNode* dest = node->_children[0];
+					if(dest->_node_type == NodeType::Member)
+					{
+						dest = dest->_children[0];
+					}
+					if(dest->_node_type == NodeType::Var || dest->_node_type == NodeType::OutVar)
+					{
+						assignments[dest->_u.sid]++;
+					}
+				}
+				break;
+			case NodeType::ForInRange:
+				assignments[node->_children[0]->_u.sid]++;
+				break;
+			default:
+				break;
+			}
+
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				count_assignments(node->_children[i], assignments);
+			}
+		}
+
+		IndexAnalysis::IndexAnalysis(const ASTNode* main)
+		{
+			count_assignments(main, _assignments);
+			visit_block(main, 0);
+		}
+
+		void IndexAnalysis::GetReach(std::vector<Reach>& out_reach) const
+		{
+			out_reach.clear();
+
+			std::map<symbol_id_t, Reach> reach;
+			std::map<symbol_id_t, bool> regular;
+			for(size_t i = 0; i < _samples.size(); i++)
+			{
+				const SampleIndex& s = _samples[i];
+				if(!is_neighbourhood(s))
+				{
+					regular[s.buffer] = false;
+					continue;
+				}
+				if(regular.find(s.buffer) == regular.end())
+				{
+					regular[s.buffer] = true;
+					const Reach r = {s.buffer, s.x.low, s.y.low, s.x.high, s.y.high};
+					reach[s.buffer] = r;
+				}
+				Reach& r = reach[s.buffer];
+				r.x0 = s.x.low < r.x0 ? s.x.low : r.x0;
+				r.y0 = s.y.low < r.y0 ? s.y.low : r.y0;
+				r.x1 = s.x.high > r.x1 ? s.x.high : r.x1;
+				r.y1 = s.y.high > r.y1 ? s.y.high : r.y1;
+			}
+
+			for(std::map<symbol_id_t, Reach>::const_iterator it = reach.begin(); it != reach.end(); ++it)
+			{
+				if(regular[it->first])
+				{
+					out_reach.push_back(it->second);
+				}
+			}
+		}
+
+		CPUTraversal::Type IndexAnalysis::GetTraversal() const
+		{
+			bool other_rows = false;
+			for(size_t i = 0; i < _samples.size(); i++)
+			{
+				const SampleIndex& s = _samples[i];
+				if(is_neighbourhood(s))
+				{
+					other_rows = other_rows || s.y.low != 0 || s.y.high != 0;
+				}
+				else if(!is_fixed(s))
+				{
+					// no telling where a gather goes, keep both axes close
+					return CPUTraversal::Morton;
+				}
+			}
+			return other_rows ? CPUTraversal::Tiles : CPUTraversal::Rows;
+		}
+
+		void IndexAnalysis::visit_block(const ASTNode* block, uint32_t first_child)
+		{
+			for(uint32_t i = first_child; i < block->_count; i++)
+			{
+				visit_statement(block->_children[i]);
+			}
+		}
+
+		void IndexAnalysis::visit_statement(const ASTNode* node)
+		{
+			// variables assigned inside a block only hold their value on the
+			// paths through it, so they are forgotten at its end
+			std::map<symbol_id_t, std::vector<AffineIndex> > outer;
+
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+				visit_block(node, 0);
+				break;
+			case NodeType::If:
+			case NodeType::ElseIf:
+			case NodeType::While:
+				visit_expression(node->_children[0]);
+				outer = _forms;
+				visit_block(node, 1);
+				_forms.swap(outer);
+				break;
+			case NodeType::Else:
+				outer = _forms;
+				visit_block(node, 0);
+				_forms.swap(outer);
+				break;
+			case NodeType::ForInRange:
+				{
+					const symbol_id_t it = node->_children[0]->_u.sid;
+					const int32_t from = *(int32_t*)node->_children[1]->_u.literal.data;
+					const int32_t to = *(int32_t*)node->_children[2]->_u.literal.data;
+
+					outer = _forms;
+					if(_assignments[it] == 1)
+					{
+						_forms[it] = std::vector<AffineIndex>(1, affine(0, 0, from, to > from ? to - 1 : from));
+					}
+					visit_block(node, 3);
+					_forms.swap(outer);
+				}
+				break;
+			case NodeType::Assignment:
+				{
+					const ASTNode* dest = node->_children[0];
+					const ASTNode* value = node->_children[1];
+					visit_expression(value);
+
+					if(dest->_node_type == NodeType::Var && is_integer(dest->_return_type) && _assignments[dest->_u.sid] == 1)
+					{
+						const uint32_t count = ComponentCount(dest->_return_type);
+						std::vector<AffineIndex> forms(count);
+						for(uint32_t k = 0; k < count; k++)
+						{
+							forms[k] = evaluate(value, ComponentCount(value->_return_type) == 1 ? 0 : k);
+						}
+						_forms[dest->_u.sid] = forms;
+					}
+				}
+				break;
+			default:
+				visit_expression(node);
+				break;
+			}
+		}
+
+		void IndexAnalysis::visit_expression(const ASTNode* node)
+		{
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				visit_expression(node->_children[i]);
+			}
+
+			if(node->_node_type == NodeType::Sample1D)
+			{
+				if(is_contiguous(evaluate(node->_children[1], 0), affine(0, 0, 0, 0)))
+				{
+					_contiguous.insert(node);
+				}
+			}
+			else if(node->_node_type == NodeType::Sample2D)
+			{
+				SampleIndex s;
+				s.sample = node;
+				s.buffer = node->_children[0]->_u.sid;
+				if(node->_count == 2)
+				{
+					s.x = evaluate(node->_children[1], 0);
+					s.y = evaluate(node->_children[1], 1);
+				}
+				else
+				{
+					s.x = evaluate(node->_children[1], 0);
+					s.y = evaluate(node->_children[2], 0);
+				}
+				_samples.push_back(s);
+
+				if(is_contiguous(s.x, s.y))
+				{
+					_contiguous.insert(node);
+				}
+			}
+		}
+
+		AffineIndex IndexAnalysis::evaluate(const ASTNode* node, uint32_t component) const
+		{
+			if(!is_integer(node->_return_type))
+			{
+				return non_affine();
+			}
+
+			switch(node->_node_type)
+			{
+			case NodeType::Function:
+				if(*(int32_t*)node->_children[0]->_u.literal.data != BuiltinFunction::Index)
+				{
+					break;
+				}
+				// Index() is the element's index
+				// fall through
+			case NodeType::GetIndex:
+				return component == 0 ? affine(1, 0, 0, 0) : affine(0, 1, 0, 0);
+			case NodeType::Literal:
+				{
+					const int32_t value = *(int32_t*)node->_u.literal.data;
+					return affine(0, 0, value, value);
+				}
+			case NodeType::Var:
+				{
+					std::map<symbol_id_t, std::vector<AffineIndex> >::const_iterator it = _forms.find(node->_u.sid);
+					if(it != _forms.end() && component < it->second.size())
+					{
+						return it->second[component];
+					}
+				}
+				break;
+			case NodeType::Member:
+				return evaluate(node->_children[0], *(int32_t*)node->_children[1]->_u.literal.data);
+			case NodeType::Add:
+			case NodeType::Subtract:
+			case NodeType::Multiply:
+				{
+					// scalars are broadcast against vectors
+					const ASTNode* left = node->_children[0];
+					const ASTNode* right = node->_children[1];
+					const AffineIndex a = evaluate(left, ComponentCount(left->_return_type) == 1 ? 0 : component);
+					const AffineIndex b = evaluate(right, ComponentCount(right->_return_type) == 1 ? 0 : component);
+					if(!a.affine || !b.affine)
+					{
+						break;
+					}
+
+					if(node->_node_type == NodeType::Add)
+					{
+						return affine((int64_t)a.x + b.x, (int64_t)a.y + b.y, (int64_t)a.low + b.low, (int64_t)a.high + b.high);
+					}
+					else if(node->_node_type == NodeType::Subtract)
+					{
+						return affine((int64_t)a.x - b.x, (int64_t)a.y - b.y, (int64_t)a.low - b.high, (int64_t)a.high - b.low);
+					}
+
+					// only products with a constant stay affine
+					const AffineIndex& scale = is_constant(a) ? a : b;
+					const AffineIndex& other = is_constant(a) ? b : a;
+					if(!is_constant(scale))
+					{
+						break;
+					}
+					const int64_t k = scale.low;
+					return k < 0 ?
+						affine(other.x * k, other.y * k, other.high * k, other.low * k) :
+						affine(other.x * k, other.y * k, other.low * k, other.high * k);
+				}
+			case NodeType::UnaryMinus:
+				{
+					const AffineIndex a = evaluate(node->_children[0], component);
+					if(a.affine)
+					{
+						return affine(-(int64_t)a.x, -(int64_t)a.y, -(int64_t)a.high, -(int64_t)a.low);
+					}
+				}
+				break;
+			case NodeType::Constructor:
+				{
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						return evaluate(node->_children[0], 0);
+					}
+					// find the child holding the component
+					uint32_t k = component;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const uint32_t count = ComponentCount(node->_children[i]->_return_type);
+						if(k < count)
+						{
+							return evaluate(node->_children[i], k);
+						}
+						k -= count;
+					}
+				}
+				break;
+			case NodeType::Cast:
+				{
+					// between int and uint the bits stay the same
+					const ASTNode* child = node->_children[0];
+					return evaluate(child, ComponentCount(child->_return_type) == 1 ? 0 : component);
+				}
+			default:
+				break;
+			}
+			return non_affine();
+		}
+
+		/// Invariance
+
+		// symbols read anywhere under node
+		static void collect_reads(const ASTNode* node, std::set<symbol_id_t>& reads)
+		{
+			if(node->_node_type == NodeType::Var)
+			{
+				reads.insert(node->_u.sid);
+			}
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				collect_reads(node->_children[i], reads);
+			}
+		}
+
+		// expressions cheaper to recompute than to look up
+		static bool is_trivial(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Literal:
+			case NodeType::Var:
+			case NodeType::ConstVar:
+			case NodeType::GetIndex:
+				return true;
+			case NodeType::Function:
+				return node->_count == 1;
+			case NodeType::Member:
+			case NodeType::Cast:
+				return is_trivial(node->_children[0]);
+			default:
+				return false;
+			}
+		}
+
+		InvarianceAnalysis::InvarianceAnalysis(const ASTNode* uniforms, const ASTNode* main)
+		{
+			for(uint32_t i = 0; i < uniforms->_count; i++)
+			{
+				_uniforms.insert(uniforms->_children[i]->_u.sid);
+			}
+			count_assignments(main, _assignments);
+
+			// a Var read before its assignment is still 0 there
+			std::set<symbol_id_t> read;
+			for(uint32_t i = 0; i < main->_count; i++)
+			{
+				const ASTNode* node = main->_children[i];
+				std::set<symbol_id_t> reads;
+				collect_reads(node, reads);
+
+				bool hoisted = false;
+				if(node->_node_type == NodeType::Assignment && node->_children[0]->_node_type == NodeType::Var)
+				{
+					const symbol_id_t sid = node->_children[0]->_u.sid;
+					const ASTNode* value = node->_children[1];
+					std::set<symbol_id_t> value_reads;
+					collect_reads(value, value_reads);
+
+					if(_assignments[sid] == 1 && read.find(sid) == read.end() && value_reads.find(sid) == value_reads.end())
+					{
+						// scalars are broadcast
+						const uint32_t count = ComponentCount(node->_children[0]->_return_type);
+						std::vector<uint32_t> components(count);
+						uint32_t all = 0;
+						uint32_t column_components = 0;
+						bool separable = true;
+						for(uint32_t k = 0; k < count; k++)
+						{
+							components[k] = depends(value, ComponentCount(value->_return_type) == 1 ? 0 : k);
+							all |= components[k];
+							column_components |= (components[k] & DependsX) ? (1u << k) : 0;
+							separable = separable && (components[k] & (DependsX | DependsY)) != (DependsX | DependsY);
+						}
+
+						if((all & Varies) == 0 && separable)
+						{
+							hoisted = true;
+							_depends[sid] = components;
+							if(all == 0)
+							{
+								add(node, Invariance::Run, 0);
+							}
+							else if(all == DependsY)
+							{
+								add(node, Invariance::Row, 0);
+							}
+							else if(all == DependsX)
+							{
+								add(node, Invariance::Column, 0);
+							}
+							else
+							{
+								add(node, Invariance::Split, column_components);
+							}
+						}
+					}
+				}
+
+				if(!hoisted)
+				{
+					visit_statement(node);
+				}
+				read.insert(reads.begin(), reads.end());
+			}
+		}
+
+		int32_t InvarianceAnalysis::Find(const ASTNode* node) const
+		{
+			std::map<const ASTNode*, int32_t>::const_iterator it = _index.find(node);
+			return it != _index.end() ? it->second : -1;
+		}
+
+		void InvarianceAnalysis::add(const ASTNode* node, Invariance::Type invariance, uint32_t column_components)
+		{
+			const HoistedValue value = {node, invariance, column_components};
+			_index[node] = (int32_t)_hoisted.size();
+			_hoisted.push_back(value);
+		}
+
+		void InvarianceAnalysis::visit_statement(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+			case NodeType::Else:
+				for(uint32_t i = 0; i < node->_count; i++)
+				{
+					visit_statement(node->_children[i]);
+				}
+				break;
+			case NodeType::If:
+			case NodeType::ElseIf:
+			case NodeType::While:
+				visit_expression(node->_children[0]);
+				for(uint32_t i = 1; i < node->_count; i++)
+				{
+					visit_statement(node->_children[i]);
+				}
+				break;
+			case NodeType::ForInRange:
+				for(uint32_t i = 3; i < node->_count; i++)
+				{
+					visit_statement(node->_children[i]);
+				}
+				break;
+			case NodeType::Assignment:
+				visit_expression(node->_children[1]);
+				break;
+			default:
+				visit_expression(node);
+				break;
+			}
+		}
+
+		// hoists the largest invariant expressions; a Split one is left to
+		// its parts, putting it back together would cost as much as computing it
+		void InvarianceAnalysis::visit_expression(const ASTNode* node)
+		{
+			if(!is_trivial(node))
+			{
+				const uint32_t all = depends_all(node);
+				if(all == 0)
+				{
+					add(node, Invariance::Run, 0);
+					return;
+				}
+				else if(all == DependsY)
+				{
+					add(node, Invariance::Row, 0);
+					return;
+				}
+				else if(all == DependsX)
+				{
+					add(node, Invariance::Column, 0);
+					return;
+				}
+			}
+
+			// the buffer of a sample is no expression
+			const uint32_t first = (node->_node_type == NodeType::Sample1D || node->_node_type == NodeType::Sample2D || node->_node_type == NodeType::Function) ? 1 : 0;
+			for(uint32_t i = first; i < node->_count; i++)
+			{
+				visit_expression(node->_children[i]);
+			}
+		}
+
+		uint32_t InvarianceAnalysis::depends_all(const ASTNode* node) const
+		{
+			uint32_t result = 0;
+			for(uint32_t k = 0; k < ComponentCount(node->_return_type); k++)
+			{
+				result |= depends(node, k);
+			}
+			return result;
+		}
+
+		uint32_t InvarianceAnalysis::depends(const ASTNode* node, uint32_t component) const
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Literal:
+			case NodeType::ConstVar:
+				return 0;
+			case NodeType::Var:
+				{
+					if(_uniforms.find(node->_u.sid) != _uniforms.end())
+					{
+						return 0;
+					}
+					std::map<symbol_id_t, std::vector<uint32_t> >::const_iterator it = _depends.find(node->_u.sid);
+					if(it != _depends.end() && component < it->second.size())
+					{
+						return it->second[component];
+					}
+				}
+				return Varies;
+			case NodeType::GetIndex:
+			case NodeType::GetNormalizedIndex:
+				return component == 0 ? DependsX : DependsY;
+			case NodeType::Member:
+				return depends(node->_children[0], *(int32_t*)node->_children[1]->_u.literal.data);
+			case NodeType::Constructor:
+				{
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						return depends(node->_children[0], 0);
+					}
+					// find the child holding the component
+					uint32_t k = component;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const uint32_t count = ComponentCount(node->_children[i]->_return_type);
+						if(k < count)
+						{
+							return depends(node->_children[i], k);
+						}
+						k -= count;
+					}
+				}
+				return Varies;
+			case NodeType::UnaryMinus:
+			case NodeType::Add:
+			case NodeType::Subtract:
+			case NodeType::Multiply:
+			case NodeType::Divide:
+			case NodeType::Modulo:
+			case NodeType::BitwiseAnd:
+			case NodeType::BitwiseOr:
+			case NodeType::BitwiseXor:
+			case NodeType::BitwiseNot:
+			case NodeType::LeftShift:
+			case NodeType::RightShift:
+			case NodeType::Cast:
+				{
+					// component by component, scalars are broadcast
+					uint32_t result = 0;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						result |= depends(child, ComponentCount(child->_return_type) == 1 ? 0 : component);
+					}
+					return result;
+				}
+			case NodeType::Function:
+				{
+					const int32_t func_id = *(int32_t*)node->_children[0]->_u.literal.data;
+					if(func_id == BuiltinFunction::Index || func_id == BuiltinFunction::NormalizedIndex)
+					{
+						return component == 0 ? DependsX : DependsY;
+					}
+
+					// the geometric functions mix the components of their arguments
+					const bool componentwise = func_id != BuiltinFunction::Length &&
+						func_id != BuiltinFunction::Distance &&
+						func_id != BuiltinFunction::Dot &&
+						func_id != BuiltinFunction::Cross &&
+						func_id != BuiltinFunction::Normalize;
+					uint32_t result = 0;
+					for(uint32_t i = 1; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						result |= (componentwise && ComponentCount(child->_return_type) > 1) ? depends(child, component) :
+							(componentwise ? depends(child, 0) : depends_all(child));
+					}
+					return result;
+				}
+			case NodeType::Equal:
+			case NodeType::NotEqual:
+			case NodeType::Greater:
+			case NodeType::GreaterEqual:
+			case NodeType::Less:
+			case NodeType::LessEqual:
+			case NodeType::LogicalAnd:
+			case NodeType::LogicalOr:
+			case NodeType::LogicalNot:
+			case NodeType::Sample1D:
+			case NodeType::Sample2D:
+				{
+					// inputs are never written during a run, so a sample only
+					// depends on where it reads
+					const uint32_t first = (node->_node_type == NodeType::Sample1D || node->_node_type == NodeType::Sample2D) ? 1 : 0;
+					uint32_t result = 0;
+					for(uint32_t i = first; i < node->_count; i++)
+					{
+						result |= depends_all(node->_children[i]);
+					}
+					return result;
+				}
+			default:
+				return Varies;
+			}
+		}
+	}
+}
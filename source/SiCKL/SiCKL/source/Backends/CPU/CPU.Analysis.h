@@ -0,0 +1,146 @@
+#pragma once
+
+#include "CPU.Internal.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// an integer expression of the element's index,
+		// x * Index().X + y * Index().Y plus an offset somewhere in
+		// [low, high]; the offset is a range for expressions of a ForInRange
+		// iterator, which takes the same value in every element
+		struct AffineIndex
+		{
+			bool affine;
+			int32_t x;
+			int32_t y;
+			int32_t low;
+			int32_t high;
+		};
+
+		// the coordinates one Sample2D reads from
+		struct SampleIndex
+		{
+			const ASTNode* sample;
+			symbol_id_t buffer;
+			AffineIndex x;
+			AffineIndex y;
+		};
+
+		// the texels a program reads from one Buffer2D around its element,
+		// as inclusive offsets from the element's index
+		struct Reach
+		{
+			symbol_id_t buffer;
+			int32_t x0;
+			int32_t y0;
+			int32_t x1;
+			int32_t y1;
+		};
+
+		// finds the Sample2D nodes of a program and which texels they read.
+		// Variables are followed through their assignments as long as they
+		// are assigned once; anything else is left non affine
+		class IndexAnalysis
+		{
+		public:
+			IndexAnalysis(const ASTNode* main);
+
+			const std::vector<SampleIndex>& GetSamples() const {return _samples;}
+			// the footprint of every buffer only sampled around the element,
+			// one entry per buffer
+			void GetReach(std::vector<Reach>& out_reach) const;
+			// the traversal that suits the samples: Rows when no sample reads
+			// another row, Tiles for neighbourhoods and Morton for gathers
+			CPUTraversal::Type GetTraversal() const;
+			// whether a Sample1D or Sample2D reads Index().X plus an offset
+			// that is the same all along a row, so neighbouring elements of a
+			// row read neighbouring texels
+			bool IsContiguous(const ASTNode* sample) const {return _contiguous.count(sample) > 0;}
+		private:
+			void visit_block(const ASTNode* block, uint32_t first_child);
+			void visit_statement(const ASTNode*);
+			void visit_expression(const ASTNode*);
+			AffineIndex evaluate(const ASTNode*, uint32_t component) const;
+
+			// assignments to each symbol, ForInRange iterators included
+			std::map<symbol_id_t, uint32_t> _assignments;
+			// the components of the affine variables assigned so far
+			std::map<symbol_id_t, std::vector<AffineIndex> > _forms;
+			std::vector<SampleIndex> _samples;
+			std::set<const ASTNode*> _contiguous;
+		};
+
+		// how often a value that doesn't change from element to element has
+		// to be computed
+		struct Invariance
+		{
+			enum Type
+			{
+				// once for the whole run
+				Run,
+				// once per row, it only depends on Index().Y
+				Row,
+				// once per column into a table, it only depends on Index().X
+				Column,
+				// a vector with components of both, computed as a Row and as a
+				// Column and put together per element
+				Split,
+			};
+		};
+
+		struct HoistedValue
+		{
+			// an Assignment of a Var at the top of Main, or an expression
+			const ASTNode* node;
+			Invariance::Type invariance;
+			// for Split, a bit for each component taken from the column table
+			uint32_t column_components;
+		};
+
+		// finds the values of a program the code generators can compute
+		// outside of the loop over the elements. Every component of an
+		// expression is classified by which of the index components it depends
+		// on; Vars assigned once at the top of Main and not read before carry
+		// their classification to the expressions reading them, anything else
+		// assigned is per element
+		class InvarianceAnalysis
+		{
+		public:
+			InvarianceAnalysis(const ASTNode* uniforms, const ASTNode* main);
+
+			// in program order, each only reads Vars hoisted before it
+			const std::vector<HoistedValue>& GetHoisted() const {return _hoisted;}
+			// the index of node in GetHoisted, -1 if it is computed per element
+			int32_t Find(const ASTNode*) const;
+		private:
+			// dependence bits of a component
+			enum
+			{
+				DependsX = 1,
+				DependsY = 2,
+				// on anything only known inside the element
+				Varies = 4,
+			};
+
+			void visit_statement(const ASTNode*);
+			void visit_expression(const ASTNode*);
+			// the dependence bits of one component of node
+			uint32_t depends(const ASTNode*, uint32_t component) const;
+			uint32_t depends_all(const ASTNode*) const;
+			void add(const ASTNode*, Invariance::Type, uint32_t column_components);
+
+			std::set<symbol_id_t> _uniforms;
+			std::map<symbol_id_t, uint32_t> _assignments;
+			// the dependence of each component of the hoisted Vars
+			std::map<symbol_id_t, std::vector<uint32_t> > _depends;
+			std::vector<HoistedValue> _hoisted;
+			std::map<const ASTNode*, int32_t> _index;
+		};
+	}
+}
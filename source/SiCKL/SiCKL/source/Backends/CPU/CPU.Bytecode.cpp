@@ -0,0 +1,995 @@
+#include "CPU.Bytecode.h"
+#include "CPU.Analysis.h"
+
+#include <stdio.h>
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		/// Opcode tables
+
+#define VECTOR_OPCODE_NAME(NAME, TYPE, FORMAT) #NAME "." TYPE "1", #NAME "." TYPE "2", #NAME "." TYPE "3", #NAME "." TYPE "4",
+#define SCALAR_OPCODE_NAME(NAME, FORMAT) #NAME,
+		static const char* const opcode_names[] =
+		{
+			SICKL_VECTOR_OPCODES(VECTOR_OPCODE_NAME)
+			SICKL_SCALAR_OPCODES(SCALAR_OPCODE_NAME)
+		};
+#undef SCALAR_OPCODE_NAME
+#undef VECTOR_OPCODE_NAME
+
+#define VECTOR_OPCODE_FORMAT(NAME, TYPE, FORMAT) OperandFormat::FORMAT, OperandFormat::FORMAT, OperandFormat::FORMAT, OperandFormat::FORMAT,
+#define SCALAR_OPCODE_FORMAT(NAME, FORMAT) OperandFormat::FORMAT,
+		static const OperandFormat::Type opcode_formats[] =
+		{
+			SICKL_VECTOR_OPCODES(VECTOR_OPCODE_FORMAT)
+			SICKL_SCALAR_OPCODES(SCALAR_OPCODE_FORMAT)
+		};
+#undef SCALAR_OPCODE_FORMAT
+#undef VECTOR_OPCODE_FORMAT
+
+#define VECTOR_OPCODE_WIDTH(NAME, TYPE, FORMAT) 1, 2, 3, 4,
+#define SCALAR_OPCODE_WIDTH(NAME, FORMAT) 1,
+		static const uint8_t opcode_widths[] =
+		{
+			SICKL_VECTOR_OPCODES(VECTOR_OPCODE_WIDTH)
+			SICKL_SCALAR_OPCODES(SCALAR_OPCODE_WIDTH)
+		};
+#undef SCALAR_OPCODE_WIDTH
+#undef VECTOR_OPCODE_WIDTH
+
+		const char* GetOpcodeName(Opcode::Type op)
+		{
+			COMPUTE_ASSERT(op >= 0 && op < Opcode::Count);
+			return opcode_names[op];
+		}
+
+		OperandFormat::Type GetOperandFormat(Opcode::Type op)
+		{
+			COMPUTE_ASSERT(op >= 0 && op < Opcode::Count);
+			return opcode_formats[op];
+		}
+
+		uint32_t GetOpcodeWidth(Opcode::Type op)
+		{
+			COMPUTE_ASSERT(op >= 0 && op < Opcode::Count);
+			return opcode_widths[op];
+		}
+
+		// picks the variant of a vector opcode for the given width
+		static uint32_t vector_op(Opcode::Type op_1, uint32_t count)
+		{
+			COMPUTE_ASSERT(count >= 1 && count <= 4);
+			return op_1 + count - 1;
+		}
+
+		void Disassemble(const Bytecode& bytecode, std::string& out_source)
+		{
+			char line[256];
+
+			out_source.clear();
+			snprintf(line, sizeof(line), "; %u registers, r0-r1 index, r2-r3 normalized index\n", bytecode.register_count);
+			out_source += line;
+			for(size_t i = 0; i < bytecode.uniforms.size(); i++)
+			{
+				const Bytecode::Binding& b = bytecode.uniforms[i];
+				snprintf(line, sizeof(line), "; uniform %u: r%u x%u\n", (uint32_t)b.sid, b.slot, b.count);
+				out_source += line;
+			}
+			for(size_t i = 0; i < bytecode.outputs.size(); i++)
+			{
+				const Bytecode::Binding& b = bytecode.outputs[i];
+				snprintf(line, sizeof(line), "; output %u: r%u x%u\n", (uint32_t)i, b.slot, b.count);
+				out_source += line;
+			}
+			for(size_t i = 0; i < bytecode.constants.size(); i++)
+			{
+				const Bytecode::Constant& c = bytecode.constants[i];
+				snprintf(line, sizeof(line), "; r%u = 0x%08x (%d, %g)\n", c.slot, c.value.u, c.value.i, c.value.f);
+				out_source += line;
+			}
+
+			for(size_t pc = 0; pc < bytecode.code.size(); pc++)
+			{
+				const Instruction& in = bytecode.code[pc];
+				const Opcode::Type op = (Opcode::Type)in.op;
+				int length = snprintf(line, sizeof(line), "%4u: %-14s", (uint32_t)pc, GetOpcodeName(op));
+				char* operands = line + length;
+				const size_t remaining = sizeof(line) - length;
+				switch(GetOperandFormat(op))
+				{
+				case OperandFormat::None:
+					operands[0] = 0;
+					break;
+				case OperandFormat::DestA:
+					snprintf(operands, remaining, "r%u, r%u", in.dst, in.a);
+					break;
+				case OperandFormat::DestAB:
+					snprintf(operands, remaining, "r%u, r%u, r%u", in.dst, in.a, in.b);
+					break;
+				case OperandFormat::DestABC:
+					snprintf(operands, remaining, "r%u, r%u, r%u, r%u", in.dst, in.a, in.b, in.c);
+					break;
+				case OperandFormat::Sample1D:
+					snprintf(operands, remaining, "r%u, buffer %u[r%u]", in.dst, in.c, in.a);
+					break;
+				case OperandFormat::Sample2D:
+					snprintf(operands, remaining, "r%u, buffer %u[r%u, r%u]", in.dst, in.c, in.a, in.b);
+					break;
+				case OperandFormat::Store:
+					snprintf(operands, remaining, "output %u, r%u", in.c, in.a);
+					break;
+				case OperandFormat::Branch:
+					snprintf(operands, remaining, "r%u, %u", in.a, in.c);
+					break;
+				case OperandFormat::Jump:
+					snprintf(operands, remaining, "%u", in.c);
+					break;
+				case OperandFormat::Loop:
+					snprintf(operands, remaining, "%s", in.a ? "while" : "for");
+					break;
+				case OperandFormat::MathA:
+					snprintf(operands, remaining, "r%u, r%u, %s", in.dst, in.a, CPURuntime::GetMathAccuracyName((CPUMathAccuracy::Type)in.c));
+					break;
+				case OperandFormat::MathAB:
+					snprintf(operands, remaining, "r%u, r%u, r%u, %s", in.dst, in.a, in.b, CPURuntime::GetMathAccuracyName((CPUMathAccuracy::Type)in.c));
+					break;
+				}
+				out_source += line;
+				out_source += '\n';
+			}
+		}
+
+		/// Lowering
+
+		BytecodeCompiler::BytecodeCompiler(Bytecode& out_bytecode, CPUMathAccuracy::Type accuracy, const IndexAnalysis& analysis)
+			: _bytecode(out_bytecode)
+			, _accuracy(accuracy)
+			, _analysis(analysis)
+			, _next_slot(ReservedRegister::Count)
+			, _temp_base(0)
+			, _temp_top(0)
+		{ }
+
+		void BytecodeCompiler::Compile(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUMathAccuracy::Type accuracy, Bytecode& out_bytecode)
+		{
+			out_bytecode.code.clear();
+			out_bytecode.constants.clear();
+			out_bytecode.uniforms.clear();
+			out_bytecode.outputs.clear();
+			out_bytecode.register_count = 0;
+			out_bytecode.uses_normalized_index = false;
+
+			const IndexAnalysis analysis(main);
+			BytecodeCompiler bc(out_bytecode, accuracy, analysis);
+
+			// every symbol gets a fixed home in the register file
+			for(uint32_t i = 0; i < uniforms->_count; i++)
+			{
+				const ASTNode* n = uniforms->_children[i];
+				if((n->_return_type & (ReturnType::Buffer1D | ReturnType::Buffer2D)) == 0)
+				{
+					bc.allocate_symbols(n);
+					out_bytecode.uniforms.push_back(bc._symbols[n->_u.sid]);
+				}
+			}
+			for(uint32_t i = 0; i < outputs->_count; i++)
+			{
+				const ASTNode* n = outputs->_children[i];
+				bc.allocate_symbols(n);
+				out_bytecode.outputs.push_back(bc._symbols[n->_u.sid]);
+			}
+			bc.allocate_symbols(main);
+
+			// then the constant pool
+			bc.add_constant(1);
+			bc.allocate_constants(main);
+
+			bc._temp_base = bc._next_slot;
+			bc._temp_top = bc._next_slot;
+			out_bytecode.register_count = bc._next_slot;
+
+			bc.lower_block(main, 0);
+
+			for(size_t i = 0; i < out_bytecode.outputs.size(); i++)
+			{
+				const Bytecode::Binding& b = out_bytecode.outputs[i];
+				bc.emit(vector_op(Opcode::store_1, b.count), 0, b.slot, 0, (uint32_t)i);
+			}
+			bc.emit(Opcode::halt, 0, 0, 0, 0);
+		}
+
+		void BytecodeCompiler::allocate_symbols(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+			case NodeType::ConstVar:
+				if((node->_return_type & (ReturnType::Buffer1D | ReturnType::Buffer2D)) == 0 &&
+					_symbols.find(node->_u.sid) == _symbols.end())
+				{
+					Bytecode::Binding b;
+					b.sid = node->_u.sid;
+					b.slot = (uint16_t)_next_slot;
+					b.count = (uint16_t)ComponentCount(node->_return_type);
+					_symbols[b.sid] = b;
+					_next_slot += b.count;
+					COMPUTE_ASSERT(_next_slot <= 0xFFFF);
+				}
+				break;
+			default:
+				break;
+			}
+
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				allocate_symbols(node->_children[i]);
+			}
+		}
+
+		void BytecodeCompiler::allocate_constants(const ASTNode* node)
+		{
+			if(node->_node_type == NodeType::Literal)
+			{
+				if(node->_return_type == ReturnType::Bool)
+				{
+					add_constant(*(bool*)node->_u.literal.data ? 1 : 0);
+				}
+				else
+				{
+					add_constant(*(uint32_t*)node->_u.literal.data);
+				}
+				return;
+			}
+
+			// function ids and member indices never reach the register file
+			const uint32_t first_child = (node->_node_type == NodeType::Function) ? 1 : 0;
+			const uint32_t child_count = (node->_node_type == NodeType::Member) ? 1 : node->_count;
+			for(uint32_t i = first_child; i < child_count; i++)
+			{
+				allocate_constants(node->_children[i]);
+			}
+		}
+
+		void BytecodeCompiler::add_constant(uint32_t bits)
+		{
+			if(_constants.find(bits) == _constants.end())
+			{
+				Bytecode::Constant c;
+				c.slot = (uint16_t)_next_slot++;
+				c.value.u = bits;
+				COMPUTE_ASSERT(_next_slot <= 0xFFFF);
+
+				_constants[bits] = c.slot;
+				_bytecode.constants.push_back(c);
+			}
+		}
+
+		uint16_t BytecodeCompiler::constant(uint32_t bits) const
+		{
+			std::map<uint32_t, uint16_t>::const_iterator it = _constants.find(bits);
+			COMPUTE_ASSERT(it != _constants.end());
+			return it->second;
+		}
+
+		uint16_t BytecodeCompiler::allocate_temp(uint32_t count)
+		{
+			const uint32_t slot = _temp_top;
+			_temp_top += count;
+			COMPUTE_ASSERT(_temp_top <= 0xFFFF);
+			if(_temp_top > _bytecode.register_count)
+			{
+				_bytecode.register_count = _temp_top;
+			}
+			return (uint16_t)slot;
+		}
+
+		uint16_t BytecodeCompiler::target(int32_t hint, uint32_t count)
+		{
+			return hint >= 0 ? (uint16_t)hint : allocate_temp(count);
+		}
+
+		uint32_t BytecodeCompiler::emit(uint32_t op, uint32_t dst, uint32_t a, uint32_t b, uint32_t c)
+		{
+			COMPUTE_ASSERT(op < Opcode::Count);
+			COMPUTE_ASSERT(_bytecode.code.size() < 0xFFFF);
+
+			Instruction in;
+			in.op = (uint16_t)op;
+			in.dst = (uint16_t)dst;
+			in.a = (uint16_t)a;
+			in.b = (uint16_t)b;
+			in.c = (uint16_t)c;
+			_bytecode.code.push_back(in);
+			return (uint32_t)_bytecode.code.size() - 1;
+		}
+
+		void BytecodeCompiler::patch(uint32_t pc, uint32_t target)
+		{
+			_bytecode.code[pc].c = (uint16_t)target;
+		}
+
+		void BytecodeCompiler::lower_block(const ASTNode* block, uint32_t first_child)
+		{
+			for(uint32_t i = first_child; i < block->_count;)
+			{
+				_temp_top = _temp_base;
+
+				const ASTNode* node = block->_children[i];
+				switch(node->_node_type)
+				{
+				case NodeType::If:
+					i = lower_chain(block, i);
+					break;
+				case NodeType::ElseIf:
+				case NodeType::Else:
+					// these only follow an If
+					COMPUTE_ASSERT(false);
+					i++;
+					break;
+				default:
+					lower_statement(node);
+					i++;
+					break;
+				}
+			}
+		}
+
+		// lowers the If or ElseIf at block->_children[i] along with the rest of
+		// its chain, returns the index of the first statement after the chain
+		uint32_t BytecodeCompiler::lower_chain(const ASTNode* block, uint32_t i)
+		{
+			const ASTNode* node = block->_children[i];
+			COMPUTE_ASSERT(node->_count >= 1);
+
+			_temp_top = _temp_base;
+			const Operand cond = lower_operand(node->_children[0], Kind::Bool, 1);
+			const uint32_t branch = emit(Opcode::if_false, 0, cond.slot, 0, 0);
+
+			lower_block(node, 1);
+
+			uint32_t next = i + 1;
+			const ASTNode* follow = next < block->_count ? block->_children[next] : nullptr;
+			if(follow != nullptr && (follow->_node_type == NodeType::ElseIf || follow->_node_type == NodeType::Else))
+			{
+				const uint32_t jump = emit(Opcode::else_jump, 0, 0, 0, 0);
+				patch(branch, (uint32_t)_bytecode.code.size());
+				if(follow->_node_type == NodeType::ElseIf)
+				{
+					// the rest of the chain nests inside the else
+					next = lower_chain(block, next);
+				}
+				else
+				{
+					lower_block(follow, 0);
+					next++;
+				}
+				patch(jump, (uint32_t)_bytecode.code.size());
+			}
+			else
+			{
+				patch(branch, (uint32_t)_bytecode.code.size());
+			}
+			emit(Opcode::end_if, 0, 0, 0, 0);
+
+			return next;
+		}
+
+		void BytecodeCompiler::lower_statement(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+				lower_block(node, 0);
+				break;
+			case NodeType::While:
+				{
+					COMPUTE_ASSERT(node->_count >= 1);
+					emit(Opcode::loop_begin, 0, 1, 0, 0);
+					const uint32_t top = (uint32_t)_bytecode.code.size();
+					const Operand cond = lower_operand(node->_children[0], Kind::Bool, 1);
+					const uint32_t test = emit(Opcode::loop_test, 0, cond.slot, 0, 0);
+
+					lower_block(node, 1);
+
+					emit(Opcode::loop_end, 0, 0, 0, top);
+					patch(test, (uint32_t)_bytecode.code.size());
+					emit(Opcode::loop_exit, 0, 0, 0, 0);
+				}
+				break;
+			case NodeType::ForInRange:
+				{
+					COMPUTE_ASSERT(node->_count >= 3);
+					COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+					COMPUTE_ASSERT(node->_children[2]->_node_type == NodeType::Literal);
+
+					const uint16_t it = lower(node->_children[0], -1).slot;
+					const uint16_t from = constant(*(uint32_t*)node->_children[1]->_u.literal.data);
+					const uint16_t to = constant(*(uint32_t*)node->_children[2]->_u.literal.data);
+
+					emit(Opcode::mov_1, it, from, 0, 0);
+					emit(Opcode::loop_begin, 0, 0, 0, 0);
+					const uint32_t top = (uint32_t)_bytecode.code.size();
+					const uint16_t cond = allocate_temp(1);
+					emit(Opcode::ilt, cond, it, to, 0);
+					const uint32_t test = emit(Opcode::loop_test, 0, cond, 0, 0);
+
+					lower_block(node, 3);
+
+					emit(Opcode::iadd_1, it, it, constant(1), 0);
+					emit(Opcode::loop_end, 0, 0, 0, top);
+					patch(test, (uint32_t)_bytecode.code.size());
+					emit(Opcode::loop_exit, 0, 0, 0, 0);
+				}
+				break;
+			case NodeType::Assignment:
+				{
+					COMPUTE_ASSERT(node->_count == 2);
+					const ASTNode* dest = node->_children[0];
+					const Kind::Type kind = ComponentKind(dest->_return_type);
+
+					switch(dest->_node_type)
+					{
+					case NodeType::Var:
+					case NodeType::OutVar:
+						lower_into(node->_children[1], kind, ComponentCount(dest->_return_type), lower(dest, -1).slot);
+						break;
+					case NodeType::Member:
+						lower_into(node->_children[1], kind, 1, lower(dest, -1).slot);
+						break;
+					default:
+						// can't assign to this
+						COMPUTE_ASSERT(false);
+					}
+				}
+				break;
+			default:
+				// expression statement
+				lower(node, -1);
+				break;
+			}
+		}
+
+		// evaluates node converted to count components of the given kind
+		BytecodeCompiler::Operand BytecodeCompiler::lower_operand(const ASTNode* node, Kind::Type kind, uint32_t count)
+		{
+			return convert(lower(node, -1), kind, count, -1);
+		}
+
+		// evaluates node converted to count components of the given kind into
+		// the registers at dst
+		void BytecodeCompiler::lower_into(const ASTNode* node, Kind::Type kind, uint32_t count, uint16_t dst)
+		{
+			const bool exact = ComponentKind(node->_return_type) == kind && ComponentCount(node->_return_type) == count;
+			Operand op = convert(lower(node, exact ? dst : -1), kind, count, dst);
+			if(op.slot != dst)
+			{
+				emit(vector_op(Opcode::mov_1, count), dst, op.slot, 0, 0);
+			}
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::convert(Operand op, Kind::Type kind, uint32_t count, int32_t hint)
+		{
+			// bools, ints and uints share a representation
+			if((op.kind == Kind::Float) != (kind == Kind::Float))
+			{
+				Opcode::Type convert_1;
+				if(kind == Kind::Float)
+				{
+					convert_1 = op.kind == Kind::UInt ? Opcode::u2f_1 : Opcode::i2f_1;
+				}
+				else
+				{
+					convert_1 = kind == Kind::UInt ? Opcode::f2u_1 : Opcode::f2i_1;
+				}
+
+				const uint16_t dst = op.count == count ? target(hint, count) : allocate_temp(op.count);
+				emit(vector_op(convert_1, op.count), dst, op.slot, 0, 0);
+				op.slot = dst;
+			}
+			op.kind = kind;
+
+			if(op.count != count)
+			{
+				// only scalars are broadcast
+				COMPUTE_ASSERT(op.count == 1);
+				const uint16_t dst = target(hint, count);
+				emit(vector_op(Opcode::splat_1, count), dst, op.slot, 0, 0);
+				op.slot = dst;
+				op.count = (uint16_t)count;
+			}
+			return op;
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::lower(const ASTNode* node, int32_t hint)
+		{
+			Operand result;
+			result.slot = 0;
+			result.count = 1;
+			result.kind = Kind::Int;
+
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+			case NodeType::ConstVar:
+				{
+					std::map<symbol_id_t, Bytecode::Binding>::const_iterator it = _symbols.find(node->_u.sid);
+					COMPUTE_ASSERT(it != _symbols.end());
+					result.slot = it->second.slot;
+					result.count = it->second.count;
+					result.kind = ComponentKind(node->_return_type);
+				}
+				break;
+			case NodeType::Literal:
+				result.slot = constant(node->_return_type == ReturnType::Bool ? (*(bool*)node->_u.literal.data ? 1 : 0) : *(uint32_t*)node->_u.literal.data);
+				result.kind = ComponentKind(node->_return_type);
+				break;
+			case NodeType::Member:
+				{
+					COMPUTE_ASSERT(node->_count == 2);
+					COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+					const int32_t mid = *(int32_t*)node->_children[1]->_u.literal.data;
+					const Operand parent = lower(node->_children[0], -1);
+					COMPUTE_ASSERT(mid >= 0 && mid < parent.count);
+
+					result.slot = (uint16_t)(parent.slot + mid);
+					result.kind = ComponentKind(node->_return_type);
+				}
+				break;
+			/// Comparison
+			case NodeType::Equal:
+			case NodeType::NotEqual:
+			case NodeType::Greater:
+			case NodeType::GreaterEqual:
+			case NodeType::Less:
+			case NodeType::LessEqual:
+				result = lower_comparison(node, hint);
+				break;
+			/// Logical
+			case NodeType::LogicalAnd:
+			case NodeType::LogicalOr:
+				{
+					// both sides are evaluated, like the GPU would
+					COMPUTE_ASSERT(node->_count == 2);
+					const Operand l = lower_operand(node->_children[0], Kind::Bool, 1);
+					const Operand r = lower_operand(node->_children[1], Kind::Bool, 1);
+					result.slot = target(hint, 1);
+					result.kind = Kind::Bool;
+					emit(node->_node_type == NodeType::LogicalAnd ? Opcode::land : Opcode::lor, result.slot, l.slot, r.slot, 0);
+				}
+				break;
+			case NodeType::LogicalNot:
+				{
+					COMPUTE_ASSERT(node->_count == 1);
+					const Operand a = lower_operand(node->_children[0], Kind::Bool, 1);
+					result.slot = target(hint, 1);
+					result.kind = Kind::Bool;
+					emit(Opcode::lnot, result.slot, a.slot, 0, 0);
+				}
+				break;
+			/// Bitwise and Arithmetic
+			case NodeType::BitwiseAnd:
+			case NodeType::BitwiseOr:
+			case NodeType::BitwiseXor:
+			case NodeType::LeftShift:
+			case NodeType::RightShift:
+			case NodeType::Add:
+			case NodeType::Subtract:
+			case NodeType::Multiply:
+			case NodeType::Divide:
+			case NodeType::Modulo:
+				result = lower_arithmetic(node, hint);
+				break;
+			case NodeType::BitwiseNot:
+			case NodeType::UnaryMinus:
+				{
+					COMPUTE_ASSERT(node->_count == 1);
+					result.kind = ComponentKind(node->_return_type);
+					result.count = (uint16_t)ComponentCount(node->_return_type);
+
+					Opcode::Type op_1 = Opcode::bnot_1;
+					if(node->_node_type == NodeType::UnaryMinus)
+					{
+						op_1 = result.kind == Kind::Float ? Opcode::fneg_1 : Opcode::ineg_1;
+					}
+
+					const Operand a = lower_operand(node->_children[0], result.kind, result.count);
+					result.slot = target(hint, result.count);
+					emit(vector_op(op_1, result.count), result.slot, a.slot, 0, 0);
+				}
+				break;
+			/// Functions
+			case NodeType::Constructor:
+				{
+					const Kind::Type kind = ComponentKind(node->_return_type);
+					const uint32_t count = ComponentCount(node->_return_type);
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						// broadcast a single scalar
+						result = convert(lower(node->_children[0], -1), kind, count, hint);
+						break;
+					}
+
+					// concatenate the components of each child; built in a temporary
+					// so the destination can be one of the children
+					result.slot = allocate_temp(count);
+					result.count = (uint16_t)count;
+					result.kind = kind;
+					uint32_t k = 0;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						const uint32_t child_count = ComponentCount(child->_return_type);
+						COMPUTE_ASSERT(k + child_count <= count);
+						lower_into(child, kind, child_count, (uint16_t)(result.slot + k));
+						k += child_count;
+					}
+					COMPUTE_ASSERT(k == count);
+				}
+				break;
+			case NodeType::Cast:
+				COMPUTE_ASSERT(node->_count == 1);
+				result = convert(lower(node->_children[0], -1), ComponentKind(node->_return_type), ComponentCount(node->_return_type), hint);
+				if(node->_return_type == ReturnType::Bool)
+				{
+					const uint16_t dst = target(hint, 1);
+					emit(Opcode::tobool, dst, result.slot, 0, 0);
+					result.slot = dst;
+				}
+				break;
+			case NodeType::Function:
+				COMPUTE_ASSERT(node->_count >= 1);
+				result = lower_function(node, hint);
+				break;
+			case NodeType::Sample1D:
+			case NodeType::Sample2D:
+				result = lower_sample(node, hint);
+				break;
+			case NodeType::GetIndex:
+				result.slot = ReservedRegister::IndexX;
+				result.count = 2;
+				result.kind = Kind::Int;
+				break;
+			case NodeType::GetNormalizedIndex:
+				_bytecode.uses_normalized_index = true;
+				result.slot = ReservedRegister::NormalizedIndexX;
+				result.count = 2;
+				result.kind = Kind::Float;
+				break;
+			default:
+				// unknown AST node type
+				COMPUTE_ASSERT(false);
+			}
+
+			return result;
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::lower_arithmetic(const ASTNode* node, int32_t hint)
+		{
+			COMPUTE_ASSERT(node->_count == 2);
+
+			Operand result;
+			result.kind = ComponentKind(node->_return_type);
+			result.count = (uint16_t)ComponentCount(node->_return_type);
+			if(result.kind == Kind::Bool)
+			{
+				result.kind = Kind::Int;
+			}
+
+			const ASTNode* left = node->_children[0];
+			const ASTNode* right = node->_children[1];
+
+			// fuse a * b + c, c + a * b and a * b - c
+			if(result.kind == Kind::Float && (node->_node_type == NodeType::Add || node->_node_type == NodeType::Subtract))
+			{
+				const ASTNode* product = nullptr;
+				const ASTNode* addend = nullptr;
+				if(left->_node_type == NodeType::Multiply && left->_return_type == node->_return_type)
+				{
+					product = left;
+					addend = right;
+				}
+				else if(node->_node_type == NodeType::Add && right->_node_type == NodeType::Multiply && right->_return_type == node->_return_type)
+				{
+					product = right;
+					addend = left;
+				}
+
+				if(product != nullptr)
+				{
+					COMPUTE_ASSERT(product->_count == 2);
+					const Operand a = lower_operand(product->_children[0], Kind::Float, result.count);
+					const Operand b = lower_operand(product->_children[1], Kind::Float, result.count);
+					const Operand c = lower_operand(addend, Kind::Float, result.count);
+					result.slot = target(hint, result.count);
+					emit(vector_op(node->_node_type == NodeType::Add ? Opcode::fmuladd_1 : Opcode::fmulsub_1, result.count), result.slot, a.slot, b.slot, c.slot);
+					return result;
+				}
+			}
+
+			const bool is_float = result.kind == Kind::Float;
+			const bool is_int = result.kind == Kind::Int;
+			Opcode::Type op_1 = Opcode::Count;
+			switch(node->_node_type)
+			{
+			case NodeType::BitwiseAnd:
+				op_1 = Opcode::band_1;
+				break;
+			case NodeType::BitwiseOr:
+				op_1 = Opcode::bor_1;
+				break;
+			case NodeType::BitwiseXor:
+				op_1 = Opcode::bxor_1;
+				break;
+			case NodeType::LeftShift:
+				op_1 = Opcode::shl_1;
+				break;
+			case NodeType::RightShift:
+				op_1 = is_int ? Opcode::ishr_1 : Opcode::ushr_1;
+				break;
+			// ints and uints wrap the same way
+			case NodeType::Add:
+				op_1 = is_float ? Opcode::fadd_1 : Opcode::iadd_1;
+				break;
+			case NodeType::Subtract:
+				op_1 = is_float ? Opcode::fsub_1 : Opcode::isub_1;
+				break;
+			case NodeType::Multiply:
+				op_1 = is_float ? Opcode::fmul_1 : Opcode::imul_1;
+				break;
+			case NodeType::Divide:
+				op_1 = is_float ? Opcode::fdiv_1 : (is_int ? Opcode::idiv_1 : Opcode::udiv_1);
+				break;
+			case NodeType::Modulo:
+				op_1 = is_float ? Opcode::fmod_1 : (is_int ? Opcode::imod_1 : Opcode::umod_1);
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+			// no bitwise ops on floats
+			COMPUTE_ASSERT(!is_float || op_1 == Opcode::fadd_1 || op_1 == Opcode::fsub_1 || op_1 == Opcode::fmul_1 || op_1 == Opcode::fdiv_1 || op_1 == Opcode::fmod_1);
+
+			const Operand a = lower_operand(left, result.kind, result.count);
+			const Operand b = lower_operand(right, result.kind, result.count);
+			result.slot = target(hint, result.count);
+			emit(vector_op(op_1, result.count), result.slot, a.slot, b.slot, 0);
+			return result;
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::lower_comparison(const ASTNode* node, int32_t hint)
+		{
+			COMPUTE_ASSERT(node->_count == 2);
+			const ASTNode* left = node->_children[0];
+			const ASTNode* right = node->_children[1];
+			const Kind::Type kind = PromotedKind(ComponentKind(left->_return_type), ComponentKind(right->_return_type));
+
+			Operand a = lower_operand(left, kind, 1);
+			Operand b = lower_operand(right, kind, 1);
+
+			// a > b is b < a
+			if(node->_node_type == NodeType::Greater || node->_node_type == NodeType::GreaterEqual)
+			{
+				const Operand swap = a;
+				a = b;
+				b = swap;
+			}
+
+			Opcode::Type op = Opcode::Count;
+			switch(node->_node_type)
+			{
+			case NodeType::Equal:
+				op = kind == Kind::Float ? Opcode::feq : Opcode::ieq;
+				break;
+			case NodeType::NotEqual:
+				op = kind == Kind::Float ? Opcode::fne : Opcode::ine;
+				break;
+			case NodeType::Greater:
+			case NodeType::Less:
+				op = kind == Kind::Float ? Opcode::flt : (kind == Kind::UInt ? Opcode::ult : Opcode::ilt);
+				break;
+			case NodeType::GreaterEqual:
+			case NodeType::LessEqual:
+				op = kind == Kind::Float ? Opcode::fle : (kind == Kind::UInt ? Opcode::ule : Opcode::ile);
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+
+			Operand result;
+			result.slot = target(hint, 1);
+			result.count = 1;
+			result.kind = Kind::Bool;
+			emit(op, result.slot, a.slot, b.slot, 0);
+			return result;
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::lower_function(const ASTNode* node, int32_t hint)
+		{
+			COMPUTE_ASSERT(node->_children[0]->_node_type == NodeType::Literal);
+			COMPUTE_ASSERT(node->_children[0]->_return_type == ReturnType::Int);
+			const int32_t func_id = (*(int32_t*)node->_children[0]->_u.literal.data);
+
+			// the vector math functions work on the width of their first argument
+			const uint32_t arg_count = node->_count > 1 ? ComponentCount(node->_children[1]->_return_type) : 0;
+
+			Operand result;
+			result.slot = 0;
+			result.count = 1;
+			result.kind = Kind::Float;
+
+			switch(func_id)
+			{
+			case BuiltinFunction::Index:
+				COMPUTE_ASSERT(node->_count == 1);
+				result.slot = ReservedRegister::IndexX;
+				result.count = 2;
+				result.kind = Kind::Int;
+				return result;
+			case BuiltinFunction::NormalizedIndex:
+				COMPUTE_ASSERT(node->_count == 1);
+				_bytecode.uses_normalized_index = true;
+				result.slot = ReservedRegister::NormalizedIndexX;
+				result.count = 2;
+				return result;
+			// integer versions
+			case BuiltinFunction::Abs:
+			case BuiltinFunction::Sign:
+				COMPUTE_ASSERT(node->_count == 2);
+				if(ComponentKind(node->_return_type) == Kind::Int)
+				{
+					const Operand a = lower_operand(node->_children[1], Kind::Int, 1);
+					result.slot = target(hint, 1);
+					result.kind = Kind::Int;
+					emit(func_id == BuiltinFunction::Abs ? Opcode::iabs : Opcode::isign, result.slot, a.slot, 0, 0);
+					return result;
+				}
+				break;
+			default:
+				break;
+			}
+
+			// no builtin returns a bool
+			COMPUTE_ASSERT(ComponentKind(node->_return_type) == Kind::Float);
+
+			// float functions
+			Operand args[3];
+			args[0] = args[1] = args[2] = result;
+			for(uint32_t i = 1; i < node->_count && i <= 3; i++)
+			{
+				args[i - 1] = lower_operand(node->_children[i], Kind::Float, arg_count);
+			}
+
+			uint32_t op = Opcode::Count;
+			switch(func_id)
+			{
+			// trigonometry
+			case BuiltinFunction::Sin: op = Opcode::fsin; break;
+			case BuiltinFunction::Cos: op = Opcode::fcos; break;
+			case BuiltinFunction::Tan: op = Opcode::ftan; break;
+			case BuiltinFunction::ASin: op = Opcode::fasin; break;
+			case BuiltinFunction::ACos: op = Opcode::facos; break;
+			case BuiltinFunction::ATan: op = Opcode::fatan; break;
+			case BuiltinFunction::SinH: op = Opcode::fsinh; break;
+			case BuiltinFunction::CosH: op = Opcode::fcosh; break;
+			case BuiltinFunction::TanH: op = Opcode::ftanh; break;
+			case BuiltinFunction::ASinH: op = Opcode::fasinh; break;
+			case BuiltinFunction::ACosH: op = Opcode::facosh; break;
+			case BuiltinFunction::ATanH: op = Opcode::fatanh; break;
+			// exponential functions
+			case BuiltinFunction::Pow:
+				COMPUTE_ASSERT(node->_count == 3);
+				op = Opcode::fpow;
+				break;
+			case BuiltinFunction::Exp: op = Opcode::fexp; break;
+			case BuiltinFunction::Log: op = Opcode::flog; break;
+			case BuiltinFunction::Exp2: op = Opcode::fexp2; break;
+			case BuiltinFunction::Log2: op = Opcode::flog2; break;
+			case BuiltinFunction::Sqrt: op = Opcode::fsqrt; break;
+			// common
+			case BuiltinFunction::Abs: op = Opcode::fabs; break;
+			case BuiltinFunction::Sign: op = Opcode::fsign; break;
+			case BuiltinFunction::Floor: op = Opcode::ffloor; break;
+			case BuiltinFunction::Ceiling: op = Opcode::fceil; break;
+			case BuiltinFunction::Min:
+				COMPUTE_ASSERT(node->_count == 3);
+				op = Opcode::fmin;
+				break;
+			case BuiltinFunction::Max:
+				COMPUTE_ASSERT(node->_count == 3);
+				op = Opcode::fmax;
+				break;
+			case BuiltinFunction::Clamp:
+				COMPUTE_ASSERT(node->_count == 4);
+				op = Opcode::fclamp;
+				break;
+			case BuiltinFunction::IsNan: op = Opcode::fisnan; break;
+			case BuiltinFunction::IsInf: op = Opcode::fisinf; break;
+			// vector math
+			case BuiltinFunction::Length:
+				op = vector_op(Opcode::length_1, arg_count);
+				break;
+			case BuiltinFunction::Distance:
+				COMPUTE_ASSERT(node->_count == 3);
+				op = vector_op(Opcode::distance_1, arg_count);
+				break;
+			case BuiltinFunction::Dot:
+				COMPUTE_ASSERT(node->_count == 3);
+				op = vector_op(Opcode::dot_1, arg_count);
+				break;
+			case BuiltinFunction::Cross:
+				COMPUTE_ASSERT(node->_count == 3);
+				COMPUTE_ASSERT(arg_count == 3);
+				op = Opcode::cross;
+				result.count = 3;
+				break;
+			case BuiltinFunction::Normalize:
+				op = vector_op(Opcode::normalize_1, arg_count);
+				result.count = (uint16_t)arg_count;
+				break;
+			default:
+				// unknown function
+				COMPUTE_ASSERT(false);
+			}
+
+			result.slot = target(hint, result.count);
+			switch(GetOperandFormat((Opcode::Type)op))
+			{
+			case OperandFormat::MathA:
+			case OperandFormat::MathAB:
+				emit(op, result.slot, args[0].slot, args[1].slot, _accuracy);
+				break;
+			default:
+				emit(op, result.slot, args[0].slot, args[1].slot, args[2].slot);
+				break;
+			}
+			return result;
+		}
+
+		BytecodeCompiler::Operand BytecodeCompiler::lower_sample(const ASTNode* node, int32_t hint)
+		{
+			const ASTNode* source = node->_children[0];
+			COMPUTE_ASSERT(source->_node_type == NodeType::ConstVar);
+			COMPUTE_ASSERT(source->_u.sid <= 0xFFFF);
+
+			Operand result;
+			result.count = (uint16_t)ComponentCount(source->_return_type);
+			result.kind = ComponentKind(source->_return_type);
+
+			// samples reading along the row are loads, the SIMD machine
+			// fetches a row of them at once instead of texel by texel
+			const bool contiguous = _analysis.IsContiguous(node);
+
+			if(node->_node_type == NodeType::Sample1D)
+			{
+				COMPUTE_ASSERT(node->_count == 2);
+				const Operand x = lower_operand(node->_children[1], Kind::Int, 1);
+				result.slot = target(hint, result.count);
+				emit(vector_op(contiguous ? Opcode::load1d_1 : Opcode::sample1d_1, result.count), result.slot, x.slot, 0, source->_u.sid);
+			}
+			else if(node->_count == 2)
+			{
+				COMPUTE_ASSERT(node->_children[1]->_return_type == ReturnType::Int2);
+				const Operand index = lower_operand(node->_children[1], Kind::Int, 2);
+				result.slot = target(hint, result.count);
+				emit(vector_op(contiguous ? Opcode::load2d_1 : Opcode::sample2d_1, result.count), result.slot, index.slot, index.slot + 1, source->_u.sid);
+			}
+			else
+			{
+				COMPUTE_ASSERT(node->_count == 3);
+				const Operand x = lower_operand(node->_children[1], Kind::Int, 1);
+				const Operand y = lower_operand(node->_children[2], Kind::Int, 1);
+				result.slot = target(hint, result.count);
+				emit(vector_op(contiguous ? Opcode::load2d_1 : Opcode::sample2d_1, result.count), result.slot, x.slot, y.slot, source->_u.sid);
+			}
+			return result;
+		}
+	}
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "CPU.Internal.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// one 32 bit component; vectors live in consecutive registers
+		union Register
+		{
+			int32_t i;
+			uint32_t u;
+			float f;
+		};
+
+		// registers the executor fills in before each element
+		struct ReservedRegister
+		{
+			enum Type
+			{
+				IndexX,
+				IndexY,
+				NormalizedIndexX,
+				NormalizedIndexY,
+				Count
+			};
+		};
+
+		// which Instruction fields an opcode reads
+		struct OperandFormat
+		{
+			enum Type
+			{
+				None,
+				DestA,
+				DestAB,
+				DestABC,
+				// c is the symbol id of the buffer
+				Sample1D,
+				Sample2D,
+				// c is the output index
+				Store,
+				// c is the jump target
+				Branch,
+				Jump,
+				// a is 1 for a While, whose trip count can differ from element
+				// to element, and 0 for a ForInRange
+				Loop,
+				// c is the CPUMathAccuracy of the function
+				MathA,
+				MathAB,
+			};
+		};
+
+		/// Opcodes
+		// vector opcodes come in a variant per width (fmul_1 .. fmul_4) and
+		// work on that many consecutive registers starting at dst, a, b and c
+
+#define SICKL_VECTOR_OPCODES(X)\
+		X(mov, "x", DestA)\
+		X(splat, "x", DestA)\
+		X(fadd, "f", DestAB)\
+		X(fsub, "f", DestAB)\
+		X(fmul, "f", DestAB)\
+		X(fdiv, "f", DestAB)\
+		X(fmod, "f", DestAB)\
+		X(fneg, "f", DestA)\
+		X(fmuladd, "f", DestABC)\
+		X(fmulsub, "f", DestABC)\
+		X(iadd, "i", DestAB)\
+		X(isub, "i", DestAB)\
+		X(imul, "i", DestAB)\
+		X(idiv, "i", DestAB)\
+		X(imod, "i", DestAB)\
+		X(udiv, "u", DestAB)\
+		X(umod, "u", DestAB)\
+		X(ineg, "i", DestA)\
+		X(band, "i", DestAB)\
+		X(bor, "i", DestAB)\
+		X(bxor, "i", DestAB)\
+		X(bnot, "i", DestA)\
+		X(shl, "i", DestAB)\
+		X(ishr, "i", DestAB)\
+		X(ushr, "u", DestAB)\
+		X(i2f, "i", DestA)\
+		X(u2f, "u", DestA)\
+		X(f2i, "f", DestA)\
+		X(f2u, "f", DestA)\
+		X(length, "f", DestA)\
+		X(distance, "f", DestAB)\
+		X(dot, "f", DestAB)\
+		X(normalize, "f", DestA)\
+		X(sample1d, "x", Sample1D)\
+		X(sample2d, "x", Sample2D)\
+		X(load1d, "x", Sample1D)\
+		X(load2d, "x", Sample2D)\
+		X(store, "x", Store)
+
+		// comparisons and logical ops write 0 or 1 to an int register
+#define SICKL_SCALAR_OPCODES(X)\
+		X(feq, DestAB)\
+		X(fne, DestAB)\
+		X(flt, DestAB)\
+		X(fle, DestAB)\
+		X(ieq, DestAB)\
+		X(ine, DestAB)\
+		X(ilt, DestAB)\
+		X(ile, DestAB)\
+		X(ult, DestAB)\
+		X(ule, DestAB)\
+		X(land, DestAB)\
+		X(lor, DestAB)\
+		X(lnot, DestA)\
+		X(tobool, DestA)\
+		X(fsin, MathA)\
+		X(fcos, MathA)\
+		X(ftan, MathA)\
+		X(fasin, MathA)\
+		X(facos, MathA)\
+		X(fatan, MathA)\
+		X(fsinh, MathA)\
+		X(fcosh, MathA)\
+		X(ftanh, MathA)\
+		X(fasinh, MathA)\
+		X(facosh, MathA)\
+		X(fatanh, MathA)\
+		X(fpow, MathAB)\
+		X(fexp, MathA)\
+		X(flog, MathA)\
+		X(fexp2, MathA)\
+		X(flog2, MathA)\
+		X(fsqrt, DestA)\
+		X(fabs, DestA)\
+		X(fsign, DestA)\
+		X(iabs, DestA)\
+		X(isign, DestA)\
+		X(ffloor, DestA)\
+		X(fceil, DestA)\
+		X(fmin, DestAB)\
+		X(fmax, DestAB)\
+		X(fclamp, DestABC)\
+		X(fisnan, DestA)\
+		X(fisinf, DestA)\
+		X(cross, DestAB)\
+		X(if_false, Branch)\
+		X(else_jump, Jump)\
+		X(end_if, None)\
+		X(loop_begin, Loop)\
+		X(loop_test, Branch)\
+		X(loop_end, Jump)\
+		X(loop_exit, None)\
+		X(halt, None)
+
+		struct Opcode
+		{
+#define VECTOR_OPCODE_ENUM(NAME, TYPE, FORMAT) NAME##_1, NAME##_2, NAME##_3, NAME##_4,
+#define SCALAR_OPCODE_ENUM(NAME, FORMAT) NAME,
+			enum Type
+			{
+				SICKL_VECTOR_OPCODES(VECTOR_OPCODE_ENUM)
+				SICKL_SCALAR_OPCODES(SCALAR_OPCODE_ENUM)
+				Count
+			};
+#undef SCALAR_OPCODE_ENUM
+#undef VECTOR_OPCODE_ENUM
+		};
+
+		// control flow is kept structured so executors that run several
+		// elements at once can track which of them took a branch:
+		//
+		//     if_false cond, else        loop_begin
+		//     ...                    top: ...
+		//     else_jump end                 loop_test cond, exit
+		// else: ...                         ...
+		// end: end_if                       loop_end top
+		//                              exit: loop_exit
+		//
+		// an If without an Else has its if_false jump straight to end_if
+		struct Instruction
+		{
+			uint16_t op;
+			uint16_t dst;
+			uint16_t a;
+			uint16_t b;
+			// third operand, or the buffer, output or jump target
+			uint16_t c;
+		};
+
+		struct Bytecode
+		{
+			// where a symbol lives in the register file
+			struct Binding
+			{
+				symbol_id_t sid;
+				uint16_t slot;
+				uint16_t count;
+			};
+
+			struct Constant
+			{
+				uint16_t slot;
+				Register value;
+			};
+
+			std::vector<Instruction> code;
+			// copied into the register file before the first element
+			std::vector<Constant> constants;
+			std::vector<Binding> uniforms;
+			// in OutData order
+			std::vector<Binding> outputs;
+			uint32_t register_count;
+			bool uses_normalized_index;
+		};
+
+		const char* GetOpcodeName(Opcode::Type);
+		OperandFormat::Type GetOperandFormat(Opcode::Type);
+		// number of registers a vector opcode works on, 1 for scalar opcodes
+		uint32_t GetOpcodeWidth(Opcode::Type);
+		// human readable listing of the program
+		void Disassemble(const Bytecode&, std::string& out_source);
+
+		class IndexAnalysis;
+
+		// lowers the Main block of the AST to register bytecode
+		class BytecodeCompiler
+		{
+		public:
+			static void Compile(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUMathAccuracy::Type accuracy, Bytecode& out_bytecode);
+		private:
+			BytecodeCompiler(Bytecode&, CPUMathAccuracy::Type, const IndexAnalysis&);
+
+			// a value in the register file
+			struct Operand
+			{
+				uint16_t slot;
+				uint16_t count;
+				Kind::Type kind;
+			};
+
+			void allocate_symbols(const ASTNode*);
+			void allocate_constants(const ASTNode*);
+			void add_constant(uint32_t bits);
+			uint16_t constant(uint32_t bits) const;
+			uint16_t allocate_temp(uint32_t count);
+			uint16_t target(int32_t hint, uint32_t count);
+
+			uint32_t emit(uint32_t op, uint32_t dst, uint32_t a, uint32_t b, uint32_t c);
+			void patch(uint32_t pc, uint32_t target);
+
+			void lower_block(const ASTNode* block, uint32_t first_child);
+			uint32_t lower_chain(const ASTNode* block, uint32_t i);
+			void lower_statement(const ASTNode*);
+			// evaluates a node, writing the result to hint when it has to be
+			// written somewhere and hint is not -1
+			Operand lower(const ASTNode*, int32_t hint);
+			Operand lower_operand(const ASTNode*, Kind::Type, uint32_t count);
+			void lower_into(const ASTNode*, Kind::Type, uint32_t count, uint16_t dst);
+			Operand convert(Operand, Kind::Type, uint32_t count, int32_t hint);
+			Operand lower_arithmetic(const ASTNode*, int32_t hint);
+			Operand lower_comparison(const ASTNode*, int32_t hint);
+			Operand lower_function(const ASTNode*, int32_t hint);
+			Operand lower_sample(const ASTNode*, int32_t hint);
+
+			Bytecode& _bytecode;
+			CPUMathAccuracy::Type _accuracy;
+			// which samples read along the row, they become loads
+			const IndexAnalysis& _analysis;
+			std::map<symbol_id_t, Bytecode::Binding> _symbols;
+			std::map<uint32_t, uint16_t> _constants;
+			uint32_t _next_slot;
+			// temporaries are freed after each statement
+			uint32_t _temp_base;
+			uint32_t _temp_top;
+		};
+	}
+}
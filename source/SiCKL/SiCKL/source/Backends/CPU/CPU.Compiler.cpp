@@ -0,0 +1,114 @@
+#include "Backends/CPU.h"
+#include "CPU.Interpreter.h"
+#include "CPU.VirtualMachine.h"
+#include "CPU.SIMD.h"
+#include "CPU.Native.h"
+#include "CPU.JIT.h"
+#include "CPU.Analysis.h"
+#include "CPU.Perf.h"
+
+namespace SiCKL
+{
+	CPUCompiler::CPUCompiler(CPUExecutionMode::Type mode, CPUMathAccuracy::Type accuracy)
+		: _mode(mode)
+		, _accuracy(accuracy)
+	{ }
+
+	CPUProgram* CPUCompiler::Build(const Source& in_source)
+	{
+		const ASTNode* root = &in_source.GetRoot();
+		const ASTNode* const_data = nullptr;
+		const ASTNode* out_data = nullptr;
+		const ASTNode* main = nullptr;
+
+		// main, const data and out data
+		COMPUTE_ASSERT(root->_count == 3);
+
+		// get the three important nodes here
+		for(uint32_t i = 0; i < root->_count; i++)
+		{
+			switch(root->_children[i]->_node_type)
+			{
+			case NodeType::ConstData:
+				const_data = root->_children[i];
+				break;
+			case NodeType::OutData:
+				out_data = root->_children[i];
+				break;
+			case NodeType::Main:
+				main = root->_children[i];
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+				break;
+			}
+		}
+
+		COMPUTE_ASSERT(const_data != nullptr &&
+			out_data != nullptr &&
+			main != nullptr);
+
+		/// Generate Kernel
+
+		// the code paths built for several instruction sets use the one
+		// picked for this machine
+		const CPUInstructionSet::Type isa = CPURuntime::GetInstructionSet();
+
+		Internal::Kernel* kernel = nullptr;
+		std::string source;
+		Internal::KernelListing listing;
+		switch(_mode)
+		{
+		case CPUExecutionMode::Interpreter:
+		case CPUExecutionMode::Profiler:
+			kernel = new Internal::Interpreter(main, _accuracy, _mode == CPUExecutionMode::Profiler);
+			break;
+		case CPUExecutionMode::Bytecode:
+			{
+				Internal::Bytecode bytecode;
+				Internal::BytecodeCompiler::Compile(const_data, out_data, main, _accuracy, bytecode);
+				Internal::Disassemble(bytecode, source);
+				kernel = new Internal::VirtualMachine(bytecode);
+			}
+			break;
+		case CPUExecutionMode::Native:
+		case CPUExecutionMode::JIT:
+			// named after the Source so profilers can tell kernels apart
+			Internal::ListKernel(in_source, main, listing);
+			if(_mode == CPUExecutionMode::Native)
+			{
+				Internal::NativeCompiler::Print(const_data, out_data, main, _accuracy, listing, source);
+				kernel = Internal::NativeKernel::Load(source, listing.symbol, isa);
+			}
+			else
+			{
+				kernel = Internal::JITKernel::Build(const_data, out_data, main, isa, _accuracy, listing, source);
+			}
+			if(kernel != nullptr)
+			{
+				break;
+			}
+			// no working compiler, run the bytecode instead
+			// fall through
+		case CPUExecutionMode::SIMD:
+		case CPUExecutionMode::SIMDRefill:
+			{
+				Internal::Bytecode bytecode;
+				Internal::BytecodeCompiler::Compile(const_data, out_data, main, _accuracy, bytecode);
+				Internal::Disassemble(bytecode, source);
+				kernel = Internal::NewSIMDMachine(bytecode, _mode == CPUExecutionMode::SIMDRefill, isa);
+			}
+			break;
+		default:
+			COMPUTE_ASSERT(false);
+		}
+
+		/// Generate Program Interface
+
+		// the traversal order and what to prefetch come from the samples
+		const Internal::IndexAnalysis analysis(main);
+		CPUProgram* result = new CPUProgram(const_data, out_data, in_source.GetSymbolCount(), kernel, source, analysis);
+
+		return result;
+	}
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "Backends/CPU.h"
+
+#include <math.h>
+
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// every SiCKL value fits in 4 32 bit components; bools are
+		// stored as 0 or 1 in the first int component
+		union Value
+		{
+			int32_t i[4];
+			uint32_t u[4];
+			float f[4];
+		};
+
+		// host memory bound to a Buffer1D/Buffer2D input or an output
+		struct Buffer
+		{
+			uint8_t* data;
+			int32_t width;
+			int32_t height;
+			// bytes between the starts of consecutive rows and elements, the
+			// memory may be the caller's own padded or interleaved image
+			size_t row_pitch;
+			size_t element_stride;
+			ReturnType::Type type;
+		};
+
+		// everything the kernel needs to know about one Run
+		struct Invocation
+		{
+			int32_t size[2];
+			// symbol table with the scalar uniforms filled in
+			const Value* symbols;
+			uint32_t symbol_count;
+			// buffer inputs indexed by symbol id, data is null for non buffers
+			const Buffer* buffers;
+			// outputs in OutData order
+			const Buffer* outputs;
+			const symbol_id_t* output_symbols;
+			uint32_t output_count;
+		};
+
+		// something that can run a program over part of the index domain
+		class Kernel
+		{
+		public:
+			virtual ~Kernel() {}
+
+			// runs every element in the [x0,x1) x [y0,y1) rectangle of the domain
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const = 0;
+
+			// fraction of the SIMD lanes that did useful work in the runs since
+			// the last ResetStatistics, executors without lanes always use all
+			// of theirs
+			virtual float GetLaneUtilization() const {return 1.0f;}
+			virtual void ResetStatistics() {}
+			// the tree the kernel profiles, with the cost of each node in
+			// preorder; nullptr if it doesn't
+			virtual const ASTNode* GetProfile(std::vector<NodeCost>& out_costs) const {(void)out_costs; return nullptr;}
+		};
+
+		// entry point of a kernel compiled to machine code, runs the
+		// [x0,x1) x [y0,y1) rectangle with the tables from an Invocation
+		typedef void (*CompiledKernel)(const Value* symbols, const Buffer* buffers, const Buffer* outputs, const int32_t* size, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+		/// Type helpers
+
+		struct Kind
+		{
+			enum Type
+			{
+				Bool,
+				Int,
+				UInt,
+				Float,
+			};
+		};
+
+		// strips the buffer bits off a buffer type
+		inline ReturnType::Type ElementType(ReturnType::Type type)
+		{
+			return (ReturnType::Type)(type & ~(ReturnType::Buffer1D | ReturnType::Buffer2D));
+		}
+
+		inline uint32_t ComponentCount(ReturnType::Type type)
+		{
+			switch(ElementType(type))
+			{
+			case ReturnType::Bool:
+			case ReturnType::Int:
+			case ReturnType::UInt:
+			case ReturnType::Float:
+				return 1;
+			case ReturnType::Int2:
+			case ReturnType::UInt2:
+			case ReturnType::Float2:
+				return 2;
+			case ReturnType::Int3:
+			case ReturnType::UInt3:
+			case ReturnType::Float3:
+				return 3;
+			case ReturnType::Int4:
+			case ReturnType::UInt4:
+			case ReturnType::Float4:
+				return 4;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+			return 0;
+		}
+
+		inline Kind::Type ComponentKind(ReturnType::Type type)
+		{
+			switch(ElementType(type))
+			{
+			case ReturnType::Bool:
+				return Kind::Bool;
+			case ReturnType::Int:
+			case ReturnType::Int2:
+			case ReturnType::Int3:
+			case ReturnType::Int4:
+				return Kind::Int;
+			case ReturnType::UInt:
+			case ReturnType::UInt2:
+			case ReturnType::UInt3:
+			case ReturnType::UInt4:
+				return Kind::UInt;
+			case ReturnType::Float:
+			case ReturnType::Float2:
+			case ReturnType::Float3:
+			case ReturnType::Float4:
+				return Kind::Float;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+			return Kind::Float;
+		}
+
+		// the kind two operands are promoted to before comparing them
+		inline Kind::Type PromotedKind(Kind::Type left, Kind::Type right)
+		{
+			if(left == Kind::Float || right == Kind::Float)
+			{
+				return Kind::Float;
+			}
+			else if(left == Kind::UInt || right == Kind::UInt)
+			{
+				return Kind::UInt;
+			}
+			return Kind::Int;
+		}
+
+		// converts count components of in_val from one kind to another
+		inline void Convert(Value& out_val, Kind::Type to, const Value& in_val, Kind::Type from, uint32_t count)
+		{
+			for(uint32_t k = 0; k < count; k++)
+			{
+				switch(to)
+				{
+				case Kind::Bool:
+				case Kind::Int:
+					switch(from)
+					{
+					case Kind::Bool:
+					case Kind::Int:
+					case Kind::UInt:
+						out_val.i[k] = in_val.i[k];
+						break;
+					case Kind::Float:
+						out_val.i[k] = (int32_t)in_val.f[k];
+						break;
+					}
+					break;
+				case Kind::UInt:
+					switch(from)
+					{
+					case Kind::Bool:
+					case Kind::Int:
+					case Kind::UInt:
+						out_val.u[k] = in_val.u[k];
+						break;
+					case Kind::Float:
+						out_val.u[k] = (uint32_t)in_val.f[k];
+						break;
+					}
+					break;
+				case Kind::Float:
+					switch(from)
+					{
+					case Kind::Bool:
+					case Kind::Int:
+						out_val.f[k] = (float)in_val.i[k];
+						break;
+					case Kind::UInt:
+						out_val.f[k] = (float)in_val.u[k];
+						break;
+					case Kind::Float:
+						out_val.f[k] = in_val.f[k];
+						break;
+					}
+					break;
+				}
+			}
+		}
+
+		/// Scalar semantics shared by all the CPU executors
+
+		// integer division and modulo by 0 (and INT_MIN / -1) are undefined in
+		// GLSL; on the CPU they would trap so they are defined to give 0
+		inline int32_t IntDivide(int32_t a, int32_t b)
+		{
+			return (b == 0 || (b == -1 && a == INT32_MIN)) ? 0 : a / b;
+		}
+
+		inline int32_t IntModulo(int32_t a, int32_t b)
+		{
+			return (b == 0 || b == -1) ? 0 : a % b;
+		}
+
+		inline uint32_t UIntDivide(uint32_t a, uint32_t b)
+		{
+			return b == 0 ? 0 : a / b;
+		}
+
+		inline uint32_t UIntModulo(uint32_t a, uint32_t b)
+		{
+			return b == 0 ? 0 : a % b;
+		}
+
+		// shifts are masked to the width of the type like on the GPU
+		inline int32_t IntShiftLeft(int32_t a, int32_t b)
+		{
+			return (int32_t)((uint32_t)a << (b & 31));
+		}
+
+		inline int32_t IntShiftRight(int32_t a, int32_t b)
+		{
+			return a >> (b & 31);
+		}
+
+		// out of range samples are clamped to the edge of the buffer
+		inline int32_t ClampIndex(int32_t i, int32_t count)
+		{
+			return i < 0 ? 0 : (i >= count ? count - 1 : i);
+		}
+
+		inline const uint8_t* SampleAddress(const Buffer& buffer, int32_t x, int32_t y)
+		{
+			x = ClampIndex(x, buffer.width);
+			y = ClampIndex(y, buffer.height);
+			return buffer.data + y * buffer.row_pitch + x * buffer.element_stride;
+		}
+	}
+}
@@ -0,0 +1,795 @@
+#include "CPU.Interpreter.h"
+#include "CPU.Math.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#endif
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// the time stamp counter where there is one, nanoseconds elsewhere
+		static uint64_t cycles()
+		{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		class Interpreter::Measure
+		{
+		public:
+			Measure(Frame& f, const ASTNode* node)
+				: _cost(nullptr)
+				, _start(0)
+			{
+				if(f.costs != nullptr)
+				{
+					_cost = &f.costs[f.ids->find(node)->second];
+					_start = cycles();
+				}
+			}
+
+			~Measure()
+			{
+				if(_cost != nullptr)
+				{
+					_cost->count++;
+					_cost->cycles += cycles() - _start;
+				}
+			}
+		private:
+			NodeCost* _cost;
+			uint64_t _start;
+		};
+
+		// numbers node and its children in the order ASTNode::Print visits them
+		static void number(const ASTNode* node, std::unordered_map<const ASTNode*, uint32_t>& ids)
+		{
+			const uint32_t id = (uint32_t)ids.size();
+			ids[node] = id;
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				number(node->_children[i], ids);
+			}
+		}
+
+		Interpreter::Interpreter(const ASTNode* main, CPUMathAccuracy::Type accuracy, bool profile)
+			: _main(new ASTNode(*main))
+			, _accuracy(accuracy)
+			, _profile(profile)
+		{
+			if(_profile)
+			{
+				number(_main, _ids);
+				_costs.resize(_ids.size());
+				ResetStatistics();
+			}
+		}
+
+		Interpreter::~Interpreter()
+		{
+			delete _main;
+		}
+
+		void Interpreter::Run(const Invocation& invocation, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			Value* symbols = new Value[invocation.symbol_count];
+
+			// each thread counts on its own and adds up at the end
+			std::vector<NodeCost> costs(_profile ? _ids.size() : 0);
+			memset(costs.data(), 0x00, sizeof(NodeCost) * costs.size());
+
+			Frame f;
+			f.invocation = &invocation;
+			f.symbols = symbols;
+			f.accuracy = _accuracy;
+			f.costs = _profile ? costs.data() : nullptr;
+			f.ids = &_ids;
+
+			for(int32_t y = y0; y < y1; y++)
+			{
+				for(int32_t x = x0; x < x1; x++)
+				{
+					// every element starts from the same uniform state
+					memcpy(symbols, invocation.symbols, sizeof(Value) * invocation.symbol_count);
+
+					f.index[0] = x;
+					f.index[1] = y;
+
+					{
+						Measure m(f, _main);
+						exec_block(f, _main, 0);
+					}
+
+					// write out results
+					for(uint32_t i = 0; i < invocation.output_count; i++)
+					{
+						const Buffer& out = invocation.outputs[i];
+						const size_t element_size = sizeof(Value::i[0]) * ComponentCount(out.type);
+						memcpy(out.data + y * out.row_pitch + x * out.element_stride, &symbols[invocation.output_symbols[i]], element_size);
+					}
+				}
+			}
+
+			delete[] symbols;
+
+			if(_profile)
+			{
+				std::lock_guard<std::mutex> guard(_costs_lock);
+				for(size_t i = 0; i < costs.size(); i++)
+				{
+					_costs[i].count += costs[i].count;
+					_costs[i].cycles += costs[i].cycles;
+					_costs[i].bytes += costs[i].bytes;
+				}
+			}
+		}
+
+		void Interpreter::ResetStatistics()
+		{
+			std::lock_guard<std::mutex> guard(_costs_lock);
+			memset(_costs.data(), 0x00, sizeof(NodeCost) * _costs.size());
+		}
+
+		const ASTNode* Interpreter::GetProfile(std::vector<NodeCost>& out_costs) const
+		{
+			if(!_profile)
+			{
+				return nullptr;
+			}
+
+			std::lock_guard<std::mutex> guard(_costs_lock);
+			out_costs = _costs;
+			return _main;
+		}
+
+		void Interpreter::exec_block(Frame& f, const ASTNode* block, uint32_t first_child)
+		{
+			// whether a branch of the current If/ElseIf/Else chain has run
+			bool chain_taken = false;
+			for(uint32_t i = first_child; i < block->_count; i++)
+			{
+				const ASTNode* node = block->_children[i];
+				switch(node->_node_type)
+				{
+				case NodeType::If:
+					COMPUTE_ASSERT(node->_count >= 1);
+					{
+						Measure m(f, node);
+						chain_taken = eval_bool(f, node->_children[0]);
+						if(chain_taken)
+						{
+							exec_block(f, node, 1);
+						}
+					}
+					break;
+				case NodeType::ElseIf:
+					COMPUTE_ASSERT(node->_count >= 1);
+					if(!chain_taken)
+					{
+						Measure m(f, node);
+						chain_taken = eval_bool(f, node->_children[0]);
+						if(chain_taken)
+						{
+							exec_block(f, node, 1);
+						}
+					}
+					break;
+				case NodeType::Else:
+					if(!chain_taken)
+					{
+						Measure m(f, node);
+						exec_block(f, node, 0);
+					}
+					break;
+				default:
+					exec(f, node);
+					break;
+				}
+			}
+		}
+
+		void Interpreter::exec(Frame& f, const ASTNode* node)
+		{
+			Measure m(f, node);
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+				exec_block(f, node, 0);
+				break;
+			case NodeType::While:
+				COMPUTE_ASSERT(node->_count >= 1);
+				while(eval_bool(f, node->_children[0]))
+				{
+					exec_block(f, node, 1);
+				}
+				break;
+			case NodeType::ForInRange:
+				{
+					COMPUTE_ASSERT(node->_count >= 3);
+					COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+					COMPUTE_ASSERT(node->_children[2]->_node_type == NodeType::Literal);
+
+					int32_t& it = f.symbols[node->_children[0]->_u.sid].i[0];
+					const int32_t to = *(int32_t*)node->_children[2]->_u.literal.data;
+					for(it = *(int32_t*)node->_children[1]->_u.literal.data; it < to; ++it)
+					{
+						exec_block(f, node, 3);
+					}
+				}
+				break;
+			case NodeType::Assignment:
+				{
+					COMPUTE_ASSERT(node->_count == 2);
+					const ASTNode* dest = node->_children[0];
+
+					Value val;
+					eval_operand(f, node->_children[1], ComponentKind(dest->_return_type), ComponentCount(dest->_return_type), val);
+
+					switch(dest->_node_type)
+					{
+					case NodeType::Var:
+					case NodeType::OutVar:
+						f.symbols[dest->_u.sid] = val;
+						break;
+					case NodeType::Member:
+						COMPUTE_ASSERT(dest->_children[0]->_node_type == NodeType::Var);
+						COMPUTE_ASSERT(dest->_children[1]->_node_type == NodeType::Literal);
+						f.symbols[dest->_children[0]->_u.sid].i[*(int32_t*)dest->_children[1]->_u.literal.data] = val.i[0];
+						break;
+					default:
+						// can't assign to this
+						COMPUTE_ASSERT(false);
+					}
+				}
+				break;
+			default:
+				// expression statement
+				{
+					Value discard;
+					eval(f, node, discard);
+				}
+				break;
+			}
+		}
+
+		bool Interpreter::eval_bool(Frame& f, const ASTNode* node)
+		{
+			Value val;
+			eval(f, node, val);
+			return val.i[0] != 0;
+		}
+
+		// evaluates node and converts it to count components of the given kind,
+		// broadcasting scalars
+		void Interpreter::eval_operand(Frame& f, const ASTNode* node, Kind::Type kind, uint32_t count, Value& out_val)
+		{
+			Value val;
+			eval(f, node, val);
+
+			const uint32_t node_count = ComponentCount(node->_return_type);
+			if(node_count == 1)
+			{
+				val.i[1] = val.i[2] = val.i[3] = val.i[0];
+			}
+			else
+			{
+				COMPUTE_ASSERT(node_count == count);
+			}
+			Convert(out_val, kind, val, ComponentKind(node->_return_type), count);
+		}
+
+#define COMPONENTWISE(EXPR)\
+		for(uint32_t k = 0; k < count; k++)\
+		{\
+			EXPR;\
+		}
+
+#define EVAL_ARITHMETIC(INT_EXPR, UINT_EXPR, FLOAT_EXPR)\
+		{\
+			COMPUTE_ASSERT(node->_count == 2);\
+			const Kind::Type kind = ComponentKind(node->_return_type);\
+			const uint32_t count = ComponentCount(node->_return_type);\
+			Value l, r;\
+			eval_operand(f, node->_children[0], kind, count, l);\
+			eval_operand(f, node->_children[1], kind, count, r);\
+			switch(kind)\
+			{\
+			case Kind::Int:\
+				COMPONENTWISE(out_val.i[k] = (INT_EXPR))\
+				break;\
+			case Kind::UInt:\
+				COMPONENTWISE(out_val.u[k] = (UINT_EXPR))\
+				break;\
+			case Kind::Float:\
+				COMPONENTWISE(out_val.f[k] = (FLOAT_EXPR))\
+				break;\
+			default:\
+				COMPUTE_ASSERT(false);\
+			}\
+		}
+
+#define EVAL_COMPARISON(OP)\
+		{\
+			COMPUTE_ASSERT(node->_count == 2);\
+			const ASTNode* left = node->_children[0];\
+			const ASTNode* right = node->_children[1];\
+			const Kind::Type kind = PromotedKind(ComponentKind(left->_return_type), ComponentKind(right->_return_type));\
+			Value l, r;\
+			eval_operand(f, left, kind, 1, l);\
+			eval_operand(f, right, kind, 1, r);\
+			switch(kind)\
+			{\
+			case Kind::Int:\
+				out_val.i[0] = l.i[0] OP r.i[0];\
+				break;\
+			case Kind::UInt:\
+				out_val.i[0] = l.u[0] OP r.u[0];\
+				break;\
+			case Kind::Float:\
+				out_val.i[0] = l.f[0] OP r.f[0];\
+				break;\
+			default:\
+				COMPUTE_ASSERT(false);\
+			}\
+		}
+
+		void Interpreter::eval(Frame& f, const ASTNode* node, Value& out_val)
+		{
+			Measure m(f, node);
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+			case NodeType::ConstVar:
+				out_val = f.symbols[node->_u.sid];
+				break;
+			case NodeType::Literal:
+				switch(node->_return_type)
+				{
+				case ReturnType::Bool:
+					out_val.i[0] = *(bool*)node->_u.literal.data ? 1 : 0;
+					break;
+				case ReturnType::Int:
+					out_val.i[0] = *(int32_t*)node->_u.literal.data;
+					break;
+				case ReturnType::UInt:
+					out_val.u[0] = *(uint32_t*)node->_u.literal.data;
+					break;
+				case ReturnType::Float:
+					out_val.f[0] = *(float*)node->_u.literal.data;
+					break;
+				default:
+					COMPUTE_ASSERT(false);
+				}
+				break;
+			case NodeType::Member:
+				{
+					COMPUTE_ASSERT(node->_count == 2);
+					COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+					const int32_t mid = *(int32_t*)node->_children[1]->_u.literal.data;
+					COMPUTE_ASSERT(mid >= 0 && mid < (int32_t)ComponentCount(node->_children[0]->_return_type));
+
+					Value parent;
+					eval(f, node->_children[0], parent);
+					out_val.i[0] = parent.i[mid];
+				}
+				break;
+			/// Comparison
+			case NodeType::Equal:
+				EVAL_COMPARISON(==)
+				break;
+			case NodeType::NotEqual:
+				EVAL_COMPARISON(!=)
+				break;
+			case NodeType::Greater:
+				EVAL_COMPARISON(>)
+				break;
+			case NodeType::GreaterEqual:
+				EVAL_COMPARISON(>=)
+				break;
+			case NodeType::Less:
+				EVAL_COMPARISON(<)
+				break;
+			case NodeType::LessEqual:
+				EVAL_COMPARISON(<=)
+				break;
+			/// Logical
+			case NodeType::LogicalAnd:
+				COMPUTE_ASSERT(node->_count == 2);
+				// both sides are evaluated, like the GPU would
+				{
+					const bool l = eval_bool(f, node->_children[0]);
+					const bool r = eval_bool(f, node->_children[1]);
+					out_val.i[0] = (l && r) ? 1 : 0;
+				}
+				break;
+			case NodeType::LogicalOr:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					const bool l = eval_bool(f, node->_children[0]);
+					const bool r = eval_bool(f, node->_children[1]);
+					out_val.i[0] = (l || r) ? 1 : 0;
+				}
+				break;
+			case NodeType::LogicalNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				out_val.i[0] = eval_bool(f, node->_children[0]) ? 0 : 1;
+				break;
+			/// Bitwise
+			case NodeType::BitwiseAnd:
+				EVAL_ARITHMETIC(l.i[k] & r.i[k], l.u[k] & r.u[k], 0.0f)
+				break;
+			case NodeType::BitwiseOr:
+				EVAL_ARITHMETIC(l.i[k] | r.i[k], l.u[k] | r.u[k], 0.0f)
+				break;
+			case NodeType::BitwiseXor:
+				EVAL_ARITHMETIC(l.i[k] ^ r.i[k], l.u[k] ^ r.u[k], 0.0f)
+				break;
+			case NodeType::BitwiseNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				{
+					const uint32_t count = ComponentCount(node->_return_type);
+					eval(f, node->_children[0], out_val);
+					COMPONENTWISE(out_val.u[k] = ~out_val.u[k])
+				}
+				break;
+			case NodeType::LeftShift:
+				EVAL_ARITHMETIC(IntShiftLeft(l.i[k], r.i[k]), l.u[k] << (r.u[k] & 31), 0.0f)
+				break;
+			case NodeType::RightShift:
+				EVAL_ARITHMETIC(IntShiftRight(l.i[k], r.i[k]), l.u[k] >> (r.u[k] & 31), 0.0f)
+				break;
+			/// Arithmetic
+			case NodeType::UnaryMinus:
+				COMPUTE_ASSERT(node->_count == 1);
+				{
+					const uint32_t count = ComponentCount(node->_return_type);
+					eval(f, node->_children[0], out_val);
+					if(ComponentKind(node->_return_type) == Kind::Float)
+					{
+						COMPONENTWISE(out_val.f[k] = -out_val.f[k])
+					}
+					else
+					{
+						COMPONENTWISE(out_val.u[k] = 0u - out_val.u[k])
+					}
+				}
+				break;
+			// signed overflow wraps like it does on the GPU
+			case NodeType::Add:
+				EVAL_ARITHMETIC((int32_t)(l.u[k] + r.u[k]), l.u[k] + r.u[k], l.f[k] + r.f[k])
+				break;
+			case NodeType::Subtract:
+				EVAL_ARITHMETIC((int32_t)(l.u[k] - r.u[k]), l.u[k] - r.u[k], l.f[k] - r.f[k])
+				break;
+			case NodeType::Multiply:
+				EVAL_ARITHMETIC((int32_t)(l.u[k] * r.u[k]), l.u[k] * r.u[k], l.f[k] * r.f[k])
+				break;
+			case NodeType::Divide:
+				EVAL_ARITHMETIC(IntDivide(l.i[k], r.i[k]), UIntDivide(l.u[k], r.u[k]), l.f[k] / r.f[k])
+				break;
+			case NodeType::Modulo:
+				EVAL_ARITHMETIC(IntModulo(l.i[k], r.i[k]), UIntModulo(l.u[k], r.u[k]), fmodf(l.f[k], r.f[k]))
+				break;
+			/// Functions
+			case NodeType::Constructor:
+				{
+					const Kind::Type kind = ComponentKind(node->_return_type);
+					const uint32_t count = ComponentCount(node->_return_type);
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						// broadcast a single scalar
+						eval_operand(f, node->_children[0], kind, count, out_val);
+						break;
+					}
+					// concatenate the components of each child
+					uint32_t k = 0;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						const uint32_t child_count = ComponentCount(child->_return_type);
+						Value val;
+						eval_operand(f, child, kind, child_count, val);
+						for(uint32_t j = 0; j < child_count && k < count; j++)
+						{
+							out_val.i[k++] = val.i[j];
+						}
+					}
+					COMPUTE_ASSERT(k == count);
+				}
+				break;
+			case NodeType::Cast:
+				COMPUTE_ASSERT(node->_count == 1);
+				eval_operand(f, node->_children[0], ComponentKind(node->_return_type), ComponentCount(node->_return_type), out_val);
+				if(node->_return_type == ReturnType::Bool)
+				{
+					out_val.i[0] = out_val.i[0] != 0 ? 1 : 0;
+				}
+				break;
+			case NodeType::Function:
+				COMPUTE_ASSERT(node->_count >= 1);
+				eval_function(f, node, out_val);
+				break;
+			case NodeType::Sample1D:
+			case NodeType::Sample2D:
+				eval_sample(f, node, out_val);
+				break;
+			case NodeType::GetIndex:
+				out_val.i[0] = f.index[0];
+				out_val.i[1] = f.index[1];
+				break;
+			case NodeType::GetNormalizedIndex:
+				// sampled at the center of each element like the OpenGL backend
+				out_val.f[0] = (f.index[0] + 0.5f) / f.invocation->size[0];
+				out_val.f[1] = (f.index[1] + 0.5f) / f.invocation->size[1];
+				break;
+			default:
+				// unknown AST node type
+				COMPUTE_ASSERT(false);
+			}
+		}
+
+#undef EVAL_COMPARISON
+#undef EVAL_ARITHMETIC
+#undef COMPONENTWISE
+
+		void Interpreter::eval_sample(Frame& f, const ASTNode* node, Value& out_val)
+		{
+			const ASTNode* source = node->_children[0];
+			COMPUTE_ASSERT(source->_node_type == NodeType::ConstVar);
+			const Buffer& buffer = f.invocation->buffers[source->_u.sid];
+			COMPUTE_ASSERT(buffer.data != nullptr);
+
+			int32_t x = 0;
+			int32_t y = 0;
+			if(node->_node_type == NodeType::Sample1D)
+			{
+				COMPUTE_ASSERT(node->_count == 2);
+				Value index;
+				eval_operand(f, node->_children[1], Kind::Int, 1, index);
+				x = index.i[0];
+			}
+			else if(node->_count == 2)
+			{
+				COMPUTE_ASSERT(node->_children[1]->_return_type == ReturnType::Int2);
+				Value index;
+				eval(f, node->_children[1], index);
+				x = index.i[0];
+				y = index.i[1];
+			}
+			else
+			{
+				COMPUTE_ASSERT(node->_count == 3);
+				Value index_x, index_y;
+				eval_operand(f, node->_children[1], Kind::Int, 1, index_x);
+				eval_operand(f, node->_children[2], Kind::Int, 1, index_y);
+				x = index_x.i[0];
+				y = index_y.i[0];
+			}
+
+			const size_t element_size = sizeof(Value::i[0]) * ComponentCount(buffer.type);
+			memcpy(&out_val, SampleAddress(buffer, x, y), element_size);
+			if(f.costs != nullptr)
+			{
+				f.costs[f.ids->find(node)->second].bytes += element_size;
+			}
+		}
+
+		void Interpreter::eval_function(Frame& f, const ASTNode* node, Value& out_val)
+		{
+			COMPUTE_ASSERT(node->_children[0]->_node_type == NodeType::Literal);
+			COMPUTE_ASSERT(node->_children[0]->_return_type == ReturnType::Int);
+			const int32_t func_id = (*(int32_t*)node->_children[0]->_u.literal.data);
+
+			// the vector math functions work on the width of their first argument
+			const uint32_t arg_count = node->_count > 1 ? ComponentCount(node->_children[1]->_return_type) : 0;
+			Value a, b, c;
+
+			switch(func_id)
+			{
+			case BuiltinFunction::Index:
+				COMPUTE_ASSERT(node->_count == 1);
+				out_val.i[0] = f.index[0];
+				out_val.i[1] = f.index[1];
+				return;
+			case BuiltinFunction::NormalizedIndex:
+				COMPUTE_ASSERT(node->_count == 1);
+				out_val.f[0] = (f.index[0] + 0.5f) / f.invocation->size[0];
+				out_val.f[1] = (f.index[1] + 0.5f) / f.invocation->size[1];
+				return;
+			// integer versions
+			case BuiltinFunction::Abs:
+			case BuiltinFunction::Sign:
+				COMPUTE_ASSERT(node->_count == 2);
+				if(ComponentKind(node->_return_type) == Kind::Int)
+				{
+					eval_operand(f, node->_children[1], Kind::Int, 1, a);
+					const int32_t x = a.i[0];
+					out_val.i[0] = func_id == BuiltinFunction::Abs ? (x < 0 ? (int32_t)(0u - (uint32_t)x) : x) : (x > 0) - (x < 0);
+					return;
+				}
+				break;
+			default:
+				break;
+			}
+
+			// float functions
+			if(node->_count > 1)
+			{
+				eval_operand(f, node->_children[1], Kind::Float, arg_count, a);
+			}
+			if(node->_count > 2)
+			{
+				eval_operand(f, node->_children[2], Kind::Float, arg_count, b);
+			}
+			if(node->_count > 3)
+			{
+				eval_operand(f, node->_children[3], Kind::Float, arg_count, c);
+			}
+
+			float result = 0.0f;
+			switch(func_id)
+			{
+			// trigonometry
+			case BuiltinFunction::Sin:
+				result = Math::Sin(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Cos:
+				result = Math::Cos(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Tan:
+				result = Math::Tan(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ASin:
+				result = Math::ASin(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ACos:
+				result = Math::ACos(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ATan:
+				result = Math::ATan(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::SinH:
+				result = Math::SinH(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::CosH:
+				result = Math::CosH(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::TanH:
+				result = Math::TanH(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ASinH:
+				result = Math::ASinH(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ACosH:
+				result = Math::ACosH(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::ATanH:
+				result = Math::ATanH(f.accuracy, a.f[0]);
+				break;
+			// exponential functions
+			case BuiltinFunction::Pow:
+				COMPUTE_ASSERT(node->_count == 3);
+				result = Math::Pow(f.accuracy, a.f[0], b.f[0]);
+				break;
+			case BuiltinFunction::Exp:
+				result = Math::Exp(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Log:
+				result = Math::Log(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Exp2:
+				result = Math::Exp2(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Log2:
+				result = Math::Log2(f.accuracy, a.f[0]);
+				break;
+			case BuiltinFunction::Sqrt:
+				result = sqrtf(a.f[0]);
+				break;
+			// common
+			case BuiltinFunction::Abs:
+				result = fabsf(a.f[0]);
+				break;
+			case BuiltinFunction::Sign:
+				result = (float)((a.f[0] > 0.0f) - (a.f[0] < 0.0f));
+				break;
+			case BuiltinFunction::Floor:
+				result = floorf(a.f[0]);
+				break;
+			case BuiltinFunction::Ceiling:
+				result = ceilf(a.f[0]);
+				break;
+			case BuiltinFunction::Min:
+				COMPUTE_ASSERT(node->_count == 3);
+				result = b.f[0] < a.f[0] ? b.f[0] : a.f[0];
+				break;
+			case BuiltinFunction::Max:
+				COMPUTE_ASSERT(node->_count == 3);
+				result = a.f[0] < b.f[0] ? b.f[0] : a.f[0];
+				break;
+			case BuiltinFunction::Clamp:
+				COMPUTE_ASSERT(node->_count == 4);
+				result = a.f[0] < b.f[0] ? b.f[0] : a.f[0];
+				result = c.f[0] < result ? c.f[0] : result;
+				break;
+			case BuiltinFunction::IsNan:
+				result = isnan(a.f[0]) ? 1.0f : 0.0f;
+				break;
+			case BuiltinFunction::IsInf:
+				result = isinf(a.f[0]) ? 1.0f : 0.0f;
+				break;
+			// vector math
+			case BuiltinFunction::Length:
+				for(uint32_t k = 0; k < arg_count; k++)
+				{
+					result += a.f[k] * a.f[k];
+				}
+				result = sqrtf(result);
+				break;
+			case BuiltinFunction::Distance:
+				COMPUTE_ASSERT(node->_count == 3);
+				for(uint32_t k = 0; k < arg_count; k++)
+				{
+					result += (a.f[k] - b.f[k]) * (a.f[k] - b.f[k]);
+				}
+				result = sqrtf(result);
+				break;
+			case BuiltinFunction::Dot:
+				COMPUTE_ASSERT(node->_count == 3);
+				for(uint32_t k = 0; k < arg_count; k++)
+				{
+					result += a.f[k] * b.f[k];
+				}
+				break;
+			case BuiltinFunction::Cross:
+				COMPUTE_ASSERT(node->_count == 3);
+				COMPUTE_ASSERT(arg_count == 3);
+				out_val.f[0] = a.f[1] * b.f[2] - a.f[2] * b.f[1];
+				out_val.f[1] = a.f[2] * b.f[0] - a.f[0] * b.f[2];
+				out_val.f[2] = a.f[0] * b.f[1] - a.f[1] * b.f[0];
+				return;
+			case BuiltinFunction::Normalize:
+				for(uint32_t k = 0; k < arg_count; k++)
+				{
+					result += a.f[k] * a.f[k];
+				}
+				result = 1.0f / sqrtf(result);
+				for(uint32_t k = 0; k < arg_count; k++)
+				{
+					out_val.f[k] = a.f[k] * result;
+				}
+				return;
+			default:
+				// unknown function
+				COMPUTE_ASSERT(false);
+			}
+
+			if(ComponentKind(node->_return_type) == Kind::Bool)
+			{
+				out_val.i[0] = result != 0.0f ? 1 : 0;
+			}
+			else
+			{
+				out_val.f[0] = result;
+			}
+		}
+	}
+}
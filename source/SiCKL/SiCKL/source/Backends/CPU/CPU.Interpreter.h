@@ -0,0 +1,60 @@
+#pragma once
+
+#include "CPU.Internal.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// reference executor: walks the Main block of the AST once per element;
+		// profiling it also times every node it visits
+		class Interpreter : public Kernel
+		{
+		public:
+			// takes a copy of the main block
+			Interpreter(const ASTNode* main, CPUMathAccuracy::Type accuracy, bool profile = false);
+			virtual ~Interpreter();
+
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+			virtual void ResetStatistics();
+			virtual const ASTNode* GetProfile(std::vector<NodeCost>& out_costs) const;
+		private:
+			// per thread evaluation state
+			struct Frame
+			{
+				const Invocation* invocation;
+				Value* symbols;
+				int32_t index[2];
+				CPUMathAccuracy::Type accuracy;
+				// the thread's costs and where each node keeps its own, when
+				// profiling
+				NodeCost* costs;
+				const std::unordered_map<const ASTNode*, uint32_t>* ids;
+			};
+			// charges the time until it goes out of scope to node
+			class Measure;
+
+			static void exec_block(Frame&, const ASTNode* block, uint32_t first_child);
+			static void exec(Frame&, const ASTNode*);
+			static void eval(Frame&, const ASTNode*, Value&);
+			static bool eval_bool(Frame&, const ASTNode*);
+			static void eval_operand(Frame&, const ASTNode*, Kind::Type, uint32_t count, Value&);
+			static void eval_function(Frame&, const ASTNode*, Value&);
+			static void eval_sample(Frame&, const ASTNode*, Value&);
+
+			ASTNode* _main;
+			CPUMathAccuracy::Type _accuracy;
+
+			bool _profile;
+			// preorder number of each node of _main
+			std::unordered_map<const ASTNode*, uint32_t> _ids;
+			// summed over the threads since the last ResetStatistics
+			mutable std::mutex _costs_lock;
+			mutable std::vector<NodeCost> _costs;
+		};
+	}
+}
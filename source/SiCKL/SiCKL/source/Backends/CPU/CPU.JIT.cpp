@@ -0,0 +1,1455 @@
+#include "CPU.JIT.h"
+#include "CPU.Analysis.h"
+#include "CPU.Math.h"
+
+#include <stdio.h>
+
+#if defined(SICKL_LLVM)
+#	include <string.h>
+#	include <map>
+#	include <vector>
+#	include <llvm/ExecutionEngine/JITEventListener.h>
+#	include <llvm/ExecutionEngine/Orc/Core.h>
+#	include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#	include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#	include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#	include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#	include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#	include <llvm/IR/DIBuilder.h>
+#	include <llvm/IR/IRBuilder.h>
+#	include <llvm/IR/Intrinsics.h>
+#	include <llvm/IR/LLVMContext.h>
+#	include <llvm/IR/Module.h>
+#	include <llvm/IR/Verifier.h>
+#	include <llvm/Object/SymbolSize.h>
+#	include <llvm/Passes/PassBuilder.h>
+#	include <llvm/Support/TargetSelect.h>
+#	include <llvm/Support/raw_ostream.h>
+#	include <llvm/Target/TargetMachine.h>
+#endif
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+#if defined(SICKL_LLVM)
+		// builds the kernel function: a loop over the rows and elements of
+		// the domain around the lowered Main block. Values are LLVM scalars or
+		// vectors of i32 and float, bools are i32 0 or 1 and every variable is
+		// an alloca that mem2reg turns into registers. The values of an
+		// InvarianceAnalysis are computed up front, per row and in a table
+		// per column, ahead of the loop over the elements
+		class IRCompiler
+		{
+		public:
+			IRCompiler(llvm::Module& module, CPUMathAccuracy::Type accuracy, const KernelListing& listing);
+
+			void Compile(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main);
+			// the math library functions the module calls, by symbol
+			const std::map<std::string, llvm::JITTargetAddress>& LibrarySymbols() const {return _library_symbols;}
+		private:
+			// host memory bound to a buffer, loaded once before the loops
+			struct BufferFields
+			{
+				llvm::Value* data;
+				llvm::Value* width;
+				llvm::Value* height;
+				llvm::Value* row_pitch;
+				llvm::Value* element_stride;
+			};
+
+			llvm::Type* type(Kind::Type, uint32_t count);
+			llvm::Type* type(ReturnType::Type);
+			llvm::Value* splat(llvm::Value* scalar, uint32_t count);
+			llvm::Value* constant(Kind::Type, uint32_t count, uint32_t bits);
+			llvm::Value* component(llvm::Value*, uint32_t count, uint32_t k);
+			BufferFields load_buffer(llvm::Value* buffer);
+			llvm::Value* address(const BufferFields&, llvm::Value* x, llvm::Value* y);
+
+			// the listing line of node becomes the debug location of what is
+			// lowered next
+			void locate(const ASTNode*);
+			void allocate_variables(const ASTNode*);
+			// computes GetHoisted()[index], Vars are stored to their alloca too
+			llvm::Value* lower_hoisted(uint32_t index);
+			void lower_block(const ASTNode* block, uint32_t first_child);
+			// lowers the If at first through the rest of its chain
+			uint32_t lower_chain(const ASTNode* block, uint32_t first);
+			void lower_statement(const ASTNode*);
+
+			llvm::Value* lower(const ASTNode*);
+			// lowers node converted to count components of the given kind
+			llvm::Value* lower_operand(const ASTNode*, Kind::Type, uint32_t count);
+			llvm::Value* convert(llvm::Value*, Kind::Type from, uint32_t from_count, Kind::Type to, uint32_t count);
+			// the truth of the bits of the first component, as an i1
+			llvm::Value* truth(const ASTNode*);
+			llvm::Value* lower_arithmetic(const ASTNode*);
+			llvm::Value* lower_division(llvm::Value* a, llvm::Value* b, Kind::Type, uint32_t count, bool modulo);
+			llvm::Value* lower_comparison(const ASTNode*);
+			llvm::Value* lower_function(const ASTNode*);
+			llvm::Value* lower_sample(const ASTNode*);
+			llvm::Value* intrinsic(llvm::Intrinsic::ID, llvm::Value*);
+			llvm::Value* libm(const char* name, llvm::Value* a, llvm::Value* b = nullptr);
+			llvm::Value* call_library(BuiltinFunction::Func, llvm::Value* a, llvm::Value* b);
+
+			llvm::LLVMContext& _context;
+			llvm::Module& _module;
+			llvm::IRBuilder<> _builder;
+			llvm::Function* _function;
+			llvm::StructType* _buffer_type;
+			CPUMathAccuracy::Type _accuracy;
+			const KernelListing& _listing;
+			// null without a listing path
+			llvm::DISubprogram* _subprogram;
+			std::map<std::string, llvm::JITTargetAddress> _library_symbols;
+
+			// allocas of Vars and OutVars
+			std::map<symbol_id_t, llvm::Value*> _variables;
+			// uniform values and buffers
+			std::map<symbol_id_t, llvm::Value*> _uniforms;
+			std::map<symbol_id_t, BufferFields> _buffers;
+			const InvarianceAnalysis* _invariance;
+			// the hoisted expressions as seen by the current element
+			std::map<const ASTNode*, llvm::Value*> _hoisted_values;
+
+			llvm::Value* _x;
+			llvm::Value* _y;
+			llvm::Value* _width;
+			llvm::Value* _height;
+		};
+
+		IRCompiler::IRCompiler(llvm::Module& module, CPUMathAccuracy::Type accuracy, const KernelListing& listing)
+			: _context(module.getContext())
+			, _module(module)
+			, _builder(module.getContext())
+			, _function(nullptr)
+			, _buffer_type(nullptr)
+			, _accuracy(accuracy)
+			, _listing(listing)
+			, _subprogram(nullptr)
+			, _invariance(nullptr)
+			, _x(nullptr)
+			, _y(nullptr)
+			, _width(nullptr)
+			, _height(nullptr)
+		{ }
+
+		llvm::Type* IRCompiler::type(Kind::Type kind, uint32_t count)
+		{
+			llvm::Type* element = (kind == Kind::Float) ? _builder.getFloatTy() : _builder.getInt32Ty();
+			return count == 1 ? element : llvm::FixedVectorType::get(element, count);
+		}
+
+		llvm::Type* IRCompiler::type(ReturnType::Type type)
+		{
+			return this->type(ComponentKind(type), ComponentCount(type));
+		}
+
+		llvm::Value* IRCompiler::splat(llvm::Value* scalar, uint32_t count)
+		{
+			return count == 1 ? scalar : _builder.CreateVectorSplat(count, scalar);
+		}
+
+		llvm::Value* IRCompiler::constant(Kind::Type kind, uint32_t count, uint32_t bits)
+		{
+			llvm::Value* scalar = nullptr;
+			if(kind == Kind::Float)
+			{
+				float f;
+				memcpy(&f, &bits, sizeof(f));
+				scalar = llvm::ConstantFP::get(_builder.getFloatTy(), f);
+			}
+			else
+			{
+				scalar = _builder.getInt32(bits);
+			}
+			return splat(scalar, count);
+		}
+
+		llvm::Value* IRCompiler::component(llvm::Value* value, uint32_t count, uint32_t k)
+		{
+			return count == 1 ? value : _builder.CreateExtractElement(value, k);
+		}
+
+		IRCompiler::BufferFields IRCompiler::load_buffer(llvm::Value* buffer)
+		{
+			BufferFields result;
+			result.data = _builder.CreateLoad(_builder.getInt8PtrTy(), _builder.CreateStructGEP(_buffer_type, buffer, 0));
+			result.width = _builder.CreateLoad(_builder.getInt32Ty(), _builder.CreateStructGEP(_buffer_type, buffer, 1));
+			result.height = _builder.CreateLoad(_builder.getInt32Ty(), _builder.CreateStructGEP(_buffer_type, buffer, 2));
+			result.row_pitch = _builder.CreateLoad(_builder.getInt64Ty(), _builder.CreateStructGEP(_buffer_type, buffer, 3));
+			result.element_stride = _builder.CreateLoad(_builder.getInt64Ty(), _builder.CreateStructGEP(_buffer_type, buffer, 4));
+			return result;
+		}
+
+		// pointer to the element at x, y
+		llvm::Value* IRCompiler::address(const BufferFields& buffer, llvm::Value* x, llvm::Value* y)
+		{
+			llvm::Value* offset = _builder.CreateAdd(
+				_builder.CreateMul(_builder.CreateSExt(y, _builder.getInt64Ty()), buffer.row_pitch),
+				_builder.CreateMul(_builder.CreateSExt(x, _builder.getInt64Ty()), buffer.element_stride));
+			return _builder.CreateGEP(_builder.getInt8Ty(), buffer.data, offset);
+		}
+
+		void IRCompiler::Compile(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main)
+		{
+			// same layout as Internal::Buffer
+			_buffer_type = llvm::StructType::create(_context,
+				{_builder.getInt8PtrTy(), _builder.getInt32Ty(), _builder.getInt32Ty(), _builder.getInt64Ty(), _builder.getInt64Ty(), _builder.getInt32Ty()},
+				"buffer");
+			llvm::Type* i32 = _builder.getInt32Ty();
+			llvm::Type* buffer_pointer = _buffer_type->getPointerTo();
+			llvm::FunctionType* function_type = llvm::FunctionType::get(_builder.getVoidTy(),
+				{_builder.getInt8PtrTy(), buffer_pointer, buffer_pointer, i32->getPointerTo(), i32, i32, i32, i32},
+				false);
+			_function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, _listing.symbol, _module);
+			for(llvm::Argument& arg : _function->args())
+			{
+				if(arg.getType()->isPointerTy())
+				{
+					arg.addAttr(llvm::Attribute::NoAlias);
+				}
+			}
+
+			llvm::Function::arg_iterator args = _function->arg_begin();
+			llvm::Value* symbols = &*args++;
+			llvm::Value* buffers = &*args++;
+			llvm::Value* output_buffers = &*args++;
+			llvm::Value* size = &*args++;
+			llvm::Value* x0 = &*args++;
+			llvm::Value* y0 = &*args++;
+			llvm::Value* x1 = &*args++;
+			llvm::Value* y1 = &*args++;
+
+			llvm::BasicBlock* entry = llvm::BasicBlock::Create(_context, "entry", _function);
+			_builder.SetInsertPoint(entry);
+
+			// the listing is the kernel's source file
+			std::unique_ptr<llvm::DIBuilder> debug_info;
+			if(!_listing.path.empty())
+			{
+				_module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+				debug_info.reset(new llvm::DIBuilder(_module));
+				const size_t slash = _listing.path.rfind('/');
+				llvm::DIFile* file = debug_info->createFile(_listing.path.substr(slash + 1), _listing.path.substr(0, slash));
+				debug_info->createCompileUnit(llvm::dwarf::DW_LANG_C_plus_plus, file, "SiCKL", true, "", 0);
+				_subprogram = debug_info->createFunction(file, _listing.symbol, _listing.symbol, file, 1,
+					debug_info->createSubroutineType(debug_info->getOrCreateTypeArray({})), 1,
+					llvm::DINode::FlagZero, llvm::DISubprogram::SPFlagDefinition | llvm::DISubprogram::SPFlagOptimized);
+				_function->setSubprogram(_subprogram);
+			}
+			// the loops and loads belong to main as a whole
+			locate(main);
+
+			/// Allocate
+
+			// uniforms and buffers stay put for the whole run
+			for(uint32_t i = 0; i < uniforms->_count; i++)
+			{
+				const ASTNode* n = uniforms->_children[i];
+				if(n->_return_type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+				{
+					_buffers[n->_u.sid] = load_buffer(_builder.CreateConstGEP1_32(_buffer_type, buffers, n->_u.sid));
+				}
+				else
+				{
+					llvm::Type* t = type(n->_return_type);
+					llvm::Value* slot = _builder.CreateConstGEP1_32(_builder.getInt8Ty(), symbols, n->_u.sid * sizeof(Value));
+					_uniforms[n->_u.sid] = _builder.CreateAlignedLoad(t, _builder.CreateBitCast(slot, t->getPointerTo()), llvm::MaybeAlign(4));
+				}
+			}
+			std::vector<BufferFields> output_fields;
+			for(uint32_t i = 0; i < outputs->_count; i++)
+			{
+				output_fields.push_back(load_buffer(_builder.CreateConstGEP1_32(_buffer_type, output_buffers, i)));
+			}
+			_width = _builder.CreateLoad(i32, _builder.CreateConstGEP1_32(i32, size, 0));
+			_height = _builder.CreateLoad(i32, _builder.CreateConstGEP1_32(i32, size, 1));
+
+			allocate_variables(outputs);
+			allocate_variables(main);
+			llvm::Value* x = _builder.CreateAlloca(i32, nullptr, "x");
+			llvm::Value* y = _builder.CreateAlloca(i32, nullptr, "y");
+
+			/// Hoist
+
+			InvarianceAnalysis invariance(uniforms, main);
+			const std::vector<HoistedValue>& hoisted = invariance.GetHoisted();
+			_invariance = &invariance;
+			// Run and Row values, and the column tables
+			std::vector<llvm::Value*> values(hoisted.size(), nullptr);
+			std::vector<llvm::Value*> tables(hoisted.size(), nullptr);
+			std::vector<llvm::Type*> types(hoisted.size(), nullptr);
+			bool columns = false;
+			bool rows = false;
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				const ASTNode* node = hoisted[k].node;
+				types[k] = type(node->_node_type == NodeType::Assignment ? node->_children[0]->_return_type : node->_return_type);
+				columns |= hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split;
+				rows |= hoisted[k].invariance == Invariance::Row || hoisted[k].invariance == Invariance::Split;
+			}
+
+			// values the same in every element
+			_x = x0;
+			_y = y0;
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				if(hoisted[k].invariance == Invariance::Run)
+				{
+					values[k] = lower_hoisted(k);
+				}
+			}
+
+			// values of Index().X alone go into a table with an entry per column
+			// on the heap, a tile may be as wide as the domain
+			llvm::FunctionCallee malloc_function = _module.getOrInsertFunction("malloc", _builder.getInt8PtrTy(), _builder.getInt64Ty());
+			llvm::FunctionCallee free_function = _module.getOrInsertFunction("free", _builder.getVoidTy(), _builder.getInt8PtrTy());
+			if(columns)
+			{
+				llvm::Value* column_count = _builder.CreateSExt(_builder.CreateSub(x1, x0), _builder.getInt64Ty());
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					if(hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split)
+					{
+						llvm::Value* bytes = _builder.CreateMul(column_count, _builder.getInt64(_module.getDataLayout().getTypeAllocSize(types[k])));
+						tables[k] = _builder.CreateBitCast(_builder.CreateCall(malloc_function, {bytes}), types[k]->getPointerTo());
+					}
+				}
+
+				llvm::BasicBlock* column_test = llvm::BasicBlock::Create(_context, "column_test", _function);
+				llvm::BasicBlock* column_body = llvm::BasicBlock::Create(_context, "column_body", _function);
+				llvm::BasicBlock* column_end = llvm::BasicBlock::Create(_context, "column_end", _function);
+
+				_builder.CreateStore(x0, x);
+				_builder.CreateBr(column_test);
+
+				_builder.SetInsertPoint(column_test);
+				_x = _builder.CreateLoad(i32, x);
+				_builder.CreateCondBr(_builder.CreateICmpSLT(_x, x1), column_body, column_end);
+
+				// the Vars they read are computed along
+				_builder.SetInsertPoint(column_body);
+				llvm::Value* column = _builder.CreateSub(_x, x0);
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					const bool column_value = hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split;
+					if(hoisted[k].invariance != Invariance::Run && (column_value || hoisted[k].node->_node_type == NodeType::Assignment))
+					{
+						llvm::Value* value = lower_hoisted(k);
+						if(column_value)
+						{
+							_builder.CreateStore(value, _builder.CreateGEP(types[k], tables[k], column));
+						}
+					}
+				}
+				_builder.CreateStore(_builder.CreateAdd(_x, _builder.getInt32(1)), x);
+				_builder.CreateBr(column_test);
+
+				_builder.SetInsertPoint(column_end);
+			}
+
+			/// Loop over the domain
+
+			llvm::BasicBlock* y_test = llvm::BasicBlock::Create(_context, "y_test", _function);
+			llvm::BasicBlock* y_body = llvm::BasicBlock::Create(_context, "y_body", _function);
+			llvm::BasicBlock* x_test = llvm::BasicBlock::Create(_context, "x_test", _function);
+			llvm::BasicBlock* x_body = llvm::BasicBlock::Create(_context, "x_body", _function);
+			llvm::BasicBlock* y_next = llvm::BasicBlock::Create(_context, "y_next", _function);
+			llvm::BasicBlock* exit = llvm::BasicBlock::Create(_context, "exit", _function);
+
+			_builder.CreateStore(y0, y);
+			_builder.CreateBr(y_test);
+
+			_builder.SetInsertPoint(y_test);
+			_y = _builder.CreateLoad(i32, y);
+			_builder.CreateCondBr(_builder.CreateICmpSLT(_y, y1), y_body, exit);
+
+			_builder.SetInsertPoint(y_body);
+			// and the values of Index().Y alone once per row
+			if(rows)
+			{
+				_x = x0;
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					if(hoisted[k].invariance != Invariance::Run && (hoisted[k].invariance != Invariance::Column || hoisted[k].node->_node_type == NodeType::Assignment))
+					{
+						values[k] = lower_hoisted(k);
+					}
+				}
+			}
+			_builder.CreateStore(x0, x);
+			_builder.CreateBr(x_test);
+
+			_builder.SetInsertPoint(x_test);
+			_x = _builder.CreateLoad(i32, x);
+			_builder.CreateCondBr(_builder.CreateICmpSLT(_x, x1), x_body, y_next);
+
+			_builder.SetInsertPoint(x_body);
+			// every element starts with its variables and outputs at 0
+			for(std::map<symbol_id_t, llvm::Value*>::iterator it = _variables.begin(); it != _variables.end(); ++it)
+			{
+				llvm::AllocaInst* alloca = llvm::cast<llvm::AllocaInst>(it->second);
+				_builder.CreateStore(llvm::Constant::getNullValue(alloca->getAllocatedType()), alloca);
+			}
+			// but the hoisted values, the zeroes of hoisted Vars are overwritten
+			// right away
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				locate(hoisted[k].node);
+				llvm::Value* value = values[k];
+				if(tables[k] != nullptr)
+				{
+					value = _builder.CreateLoad(types[k], _builder.CreateGEP(types[k], tables[k], _builder.CreateSub(_x, x0)));
+				}
+				if(hoisted[k].invariance == Invariance::Split)
+				{
+					const uint32_t count = llvm::cast<llvm::FixedVectorType>(types[k])->getNumElements();
+					std::vector<llvm::Constant*> mask;
+					for(uint32_t i = 0; i < count; i++)
+					{
+						mask.push_back(_builder.getInt1(((hoisted[k].column_components >> i) & 1) != 0));
+					}
+					value = _builder.CreateSelect(llvm::ConstantVector::get(mask), value, values[k]);
+				}
+
+				const ASTNode* node = hoisted[k].node;
+				if(node->_node_type == NodeType::Assignment)
+				{
+					_builder.CreateStore(value, _variables[node->_children[0]->_u.sid]);
+				}
+				else
+				{
+					_hoisted_values[node] = value;
+				}
+			}
+
+			lower_block(main, 0);
+
+			locate(main);
+			for(uint32_t i = 0; i < outputs->_count; i++)
+			{
+				const ASTNode* n = outputs->_children[i];
+				llvm::Type* t = type(n->_return_type);
+				llvm::Value* dest = address(output_fields[i], _x, _y);
+				_builder.CreateAlignedStore(_builder.CreateLoad(t, _variables[n->_u.sid]), _builder.CreateBitCast(dest, t->getPointerTo()), llvm::MaybeAlign(4));
+			}
+			_builder.CreateStore(_builder.CreateAdd(_x, _builder.getInt32(1)), x);
+			_builder.CreateBr(x_test);
+
+			_builder.SetInsertPoint(y_next);
+			_builder.CreateStore(_builder.CreateAdd(_y, _builder.getInt32(1)), y);
+			_builder.CreateBr(y_test);
+
+			_builder.SetInsertPoint(exit);
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				if(tables[k] != nullptr)
+				{
+					_builder.CreateCall(free_function, {_builder.CreateBitCast(tables[k], _builder.getInt8PtrTy())});
+				}
+			}
+			_builder.CreateRetVoid();
+
+			if(debug_info)
+			{
+				debug_info->finalize();
+			}
+		}
+
+		void IRCompiler::locate(const ASTNode* node)
+		{
+			if(_subprogram != nullptr)
+			{
+				_builder.SetCurrentDebugLocation(llvm::DILocation::get(_context, _listing.Line(node), 0, _subprogram));
+			}
+		}
+
+		llvm::Value* IRCompiler::lower_hoisted(uint32_t index)
+		{
+			const ASTNode* node = _invariance->GetHoisted()[index].node;
+			locate(node);
+			if(node->_node_type != NodeType::Assignment)
+			{
+				return lower(node);
+			}
+
+			const ASTNode* dest = node->_children[0];
+			llvm::Value* value = lower_operand(node->_children[1], ComponentKind(dest->_return_type), ComponentCount(dest->_return_type));
+			_builder.CreateStore(value, _variables[dest->_u.sid]);
+			return value;
+		}
+
+		void IRCompiler::allocate_variables(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+				// uniforms are read through Vars too
+				if(_variables.find(node->_u.sid) == _variables.end() &&
+					_uniforms.find(node->_u.sid) == _uniforms.end() &&
+					_buffers.find(node->_u.sid) == _buffers.end())
+				{
+					_variables[node->_u.sid] = _builder.CreateAlloca(type(node->_return_type));
+				}
+				break;
+			default:
+				break;
+			}
+
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				allocate_variables(node->_children[i]);
+			}
+		}
+
+		void IRCompiler::lower_block(const ASTNode* block, uint32_t first_child)
+		{
+			for(uint32_t i = first_child; i < block->_count; i++)
+			{
+				if(block->_children[i]->_node_type == NodeType::If)
+				{
+					i = lower_chain(block, i);
+				}
+				else if(block->_children[i]->_node_type == NodeType::Assignment && _invariance->Find(block->_children[i]) >= 0)
+				{
+					// hoisted Vars are already set
+					continue;
+				}
+				else
+				{
+					// ElseIf and Else only follow an If
+					COMPUTE_ASSERT(block->_children[i]->_node_type != NodeType::ElseIf);
+					COMPUTE_ASSERT(block->_children[i]->_node_type != NodeType::Else);
+					lower_statement(block->_children[i]);
+				}
+			}
+		}
+
+		// returns the index of the last node in the chain
+		uint32_t IRCompiler::lower_chain(const ASTNode* block, uint32_t first)
+		{
+			llvm::BasicBlock* end = llvm::BasicBlock::Create(_context, "end_if", _function);
+
+			uint32_t i = first;
+			for(; i < block->_count; i++)
+			{
+				const ASTNode* node = block->_children[i];
+				if(i > first && node->_node_type != NodeType::ElseIf && node->_node_type != NodeType::Else)
+				{
+					break;
+				}
+
+				if(node->_node_type == NodeType::Else)
+				{
+					lower_block(node, 0);
+					_builder.CreateBr(end);
+					_builder.SetInsertPoint(end);
+					return i;
+				}
+
+				COMPUTE_ASSERT(node->_count >= 1);
+				locate(node);
+				llvm::BasicBlock* then_block = llvm::BasicBlock::Create(_context, "then", _function);
+				llvm::BasicBlock* next_block = llvm::BasicBlock::Create(_context, "next", _function);
+				_builder.CreateCondBr(truth(node->_children[0]), then_block, next_block);
+
+				_builder.SetInsertPoint(then_block);
+				lower_block(node, 1);
+				_builder.CreateBr(end);
+
+				_builder.SetInsertPoint(next_block);
+			}
+
+			// no Else, fall out of the last test
+			_builder.CreateBr(end);
+			_builder.SetInsertPoint(end);
+			return i - 1;
+		}
+
+		void IRCompiler::lower_statement(const ASTNode* node)
+		{
+			locate(node);
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+				lower_block(node, 0);
+				break;
+			case NodeType::While:
+				COMPUTE_ASSERT(node->_count >= 1);
+				{
+					llvm::BasicBlock* test = llvm::BasicBlock::Create(_context, "while", _function);
+					llvm::BasicBlock* body = llvm::BasicBlock::Create(_context, "while_body", _function);
+					llvm::BasicBlock* end = llvm::BasicBlock::Create(_context, "end_while", _function);
+
+					_builder.CreateBr(test);
+					_builder.SetInsertPoint(test);
+					_builder.CreateCondBr(truth(node->_children[0]), body, end);
+
+					_builder.SetInsertPoint(body);
+					lower_block(node, 1);
+					_builder.CreateBr(test);
+
+					_builder.SetInsertPoint(end);
+				}
+				break;
+			case NodeType::ForInRange:
+				COMPUTE_ASSERT(node->_count >= 3);
+				COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+				COMPUTE_ASSERT(node->_children[2]->_node_type == NodeType::Literal);
+				{
+					llvm::Value* it = _variables[node->_children[0]->_u.sid];
+					llvm::BasicBlock* test = llvm::BasicBlock::Create(_context, "for", _function);
+					llvm::BasicBlock* body = llvm::BasicBlock::Create(_context, "for_body", _function);
+					llvm::BasicBlock* end = llvm::BasicBlock::Create(_context, "end_for", _function);
+
+					_builder.CreateStore(_builder.getInt32(*(int32_t*)node->_children[1]->_u.literal.data), it);
+					_builder.CreateBr(test);
+					_builder.SetInsertPoint(test);
+					llvm::Value* i = _builder.CreateLoad(_builder.getInt32Ty(), it);
+					_builder.CreateCondBr(_builder.CreateICmpSLT(i, _builder.getInt32(*(int32_t*)node->_children[2]->_u.literal.data)), body, end);
+
+					_builder.SetInsertPoint(body);
+					lower_block(node, 3);
+					i = _builder.CreateLoad(_builder.getInt32Ty(), it);
+					_builder.CreateStore(_builder.CreateAdd(i, _builder.getInt32(1)), it);
+					_builder.CreateBr(test);
+
+					_builder.SetInsertPoint(end);
+				}
+				break;
+			case NodeType::Assignment:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					const ASTNode* dest = node->_children[0];
+					const Kind::Type kind = ComponentKind(dest->_return_type);
+					switch(dest->_node_type)
+					{
+					case NodeType::Var:
+					case NodeType::OutVar:
+						_builder.CreateStore(lower_operand(node->_children[1], kind, ComponentCount(dest->_return_type)), _variables[dest->_u.sid]);
+						break;
+					case NodeType::Member:
+						COMPUTE_ASSERT(dest->_children[0]->_node_type == NodeType::Var);
+						COMPUTE_ASSERT(dest->_children[1]->_node_type == NodeType::Literal);
+						{
+							const ASTNode* parent = dest->_children[0];
+							llvm::Value* var = _variables[parent->_u.sid];
+							llvm::Value* val = lower_operand(node->_children[1], kind, 1);
+							if(ComponentCount(parent->_return_type) > 1)
+							{
+								llvm::Value* vec = _builder.CreateLoad(type(parent->_return_type), var);
+								val = _builder.CreateInsertElement(vec, val, *(int32_t*)dest->_children[1]->_u.literal.data);
+							}
+							_builder.CreateStore(val, var);
+						}
+						break;
+					default:
+						// can't assign to this
+						COMPUTE_ASSERT(false);
+					}
+				}
+				break;
+			default:
+				// expression statement
+				lower(node);
+				break;
+			}
+		}
+
+		llvm::Value* IRCompiler::lower_operand(const ASTNode* node, Kind::Type kind, uint32_t count)
+		{
+			return convert(lower(node), ComponentKind(node->_return_type), ComponentCount(node->_return_type), kind, count);
+		}
+
+		llvm::Value* IRCompiler::convert(llvm::Value* value, Kind::Type from, uint32_t from_count, Kind::Type to, uint32_t count)
+		{
+			COMPUTE_ASSERT(from_count == 1 || from_count == count);
+
+			llvm::Type* t = type(to, from_count);
+			if(from == Kind::Float && to != Kind::Float)
+			{
+				value = (to == Kind::UInt) ? _builder.CreateFPToUI(value, t) : _builder.CreateFPToSI(value, t);
+			}
+			else if(from != Kind::Float && to == Kind::Float)
+			{
+				value = (from == Kind::UInt) ? _builder.CreateUIToFP(value, t) : _builder.CreateSIToFP(value, t);
+			}
+
+			// broadcast scalars
+			if(from_count != count)
+			{
+				value = splat(value, count);
+			}
+			return value;
+		}
+
+		llvm::Value* IRCompiler::truth(const ASTNode* node)
+		{
+			llvm::Value* first = component(lower(node), ComponentCount(node->_return_type), 0);
+			if(first->getType()->isFloatTy())
+			{
+				first = _builder.CreateBitCast(first, _builder.getInt32Ty());
+			}
+			return _builder.CreateICmpNE(first, _builder.getInt32(0));
+		}
+
+		llvm::Value* IRCompiler::lower(const ASTNode* node)
+		{
+			std::map<const ASTNode*, llvm::Value*>::iterator hoisted = _hoisted_values.find(node);
+			if(hoisted != _hoisted_values.end())
+			{
+				return hoisted->second;
+			}
+
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+			case NodeType::ConstVar:
+				{
+					std::map<symbol_id_t, llvm::Value*>::iterator it = _uniforms.find(node->_u.sid);
+					if(it != _uniforms.end())
+					{
+						return it->second;
+					}
+					it = _variables.find(node->_u.sid);
+					COMPUTE_ASSERT(it != _variables.end());
+					return _builder.CreateLoad(type(node->_return_type), it->second);
+				}
+			case NodeType::Literal:
+				switch(node->_return_type)
+				{
+				case ReturnType::Bool:
+					return _builder.getInt32(*(bool*)node->_u.literal.data ? 1 : 0);
+				case ReturnType::Int:
+				case ReturnType::UInt:
+				case ReturnType::Float:
+					return constant(ComponentKind(node->_return_type), 1, *(uint32_t*)node->_u.literal.data);
+				default:
+					COMPUTE_ASSERT(false);
+				}
+				break;
+			case NodeType::Member:
+				COMPUTE_ASSERT(node->_count == 2);
+				COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+				return component(lower(node->_children[0]), ComponentCount(node->_children[0]->_return_type), *(int32_t*)node->_children[1]->_u.literal.data);
+			/// Comparison
+			case NodeType::Equal:
+			case NodeType::NotEqual:
+			case NodeType::Greater:
+			case NodeType::GreaterEqual:
+			case NodeType::Less:
+			case NodeType::LessEqual:
+				return lower_comparison(node);
+			/// Logical, both sides are evaluated like the GPU would
+			case NodeType::LogicalAnd:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					llvm::Value* l = truth(node->_children[0]);
+					llvm::Value* r = truth(node->_children[1]);
+					return _builder.CreateZExt(_builder.CreateAnd(l, r), _builder.getInt32Ty());
+				}
+			case NodeType::LogicalOr:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					llvm::Value* l = truth(node->_children[0]);
+					llvm::Value* r = truth(node->_children[1]);
+					return _builder.CreateZExt(_builder.CreateOr(l, r), _builder.getInt32Ty());
+				}
+			case NodeType::LogicalNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				return _builder.CreateZExt(_builder.CreateNot(truth(node->_children[0])), _builder.getInt32Ty());
+			/// Bitwise and arithmetic
+			case NodeType::BitwiseAnd:
+			case NodeType::BitwiseOr:
+			case NodeType::BitwiseXor:
+			case NodeType::LeftShift:
+			case NodeType::RightShift:
+			case NodeType::Add:
+			case NodeType::Subtract:
+			case NodeType::Multiply:
+			case NodeType::Divide:
+			case NodeType::Modulo:
+				COMPUTE_ASSERT(node->_count == 2);
+				return lower_arithmetic(node);
+			case NodeType::BitwiseNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				return _builder.CreateNot(lower(node->_children[0]));
+			case NodeType::UnaryMinus:
+				COMPUTE_ASSERT(node->_count == 1);
+				{
+					llvm::Value* val = lower(node->_children[0]);
+					return val->getType()->isFPOrFPVectorTy() ? _builder.CreateFNeg(val) : _builder.CreateNeg(val);
+				}
+			/// Functions
+			case NodeType::Constructor:
+				{
+					const Kind::Type kind = ComponentKind(node->_return_type);
+					const uint32_t count = ComponentCount(node->_return_type);
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						// broadcast a single scalar
+						return lower_operand(node->_children[0], kind, count);
+					}
+					// concatenate the components of each child
+					llvm::Value* result = llvm::UndefValue::get(type(kind, count));
+					uint32_t k = 0;
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						const uint32_t child_count = ComponentCount(child->_return_type);
+						llvm::Value* val = lower_operand(child, kind, child_count);
+						for(uint32_t j = 0; j < child_count && k < count; j++)
+						{
+							result = _builder.CreateInsertElement(result, component(val, child_count, j), k++);
+						}
+					}
+					COMPUTE_ASSERT(k == count);
+					return result;
+				}
+			case NodeType::Cast:
+				COMPUTE_ASSERT(node->_count == 1);
+				if(node->_return_type == ReturnType::Bool)
+				{
+					llvm::Value* val = lower_operand(node->_children[0], Kind::Bool, 1);
+					return _builder.CreateZExt(_builder.CreateICmpNE(val, _builder.getInt32(0)), _builder.getInt32Ty());
+				}
+				return lower_operand(node->_children[0], ComponentKind(node->_return_type), ComponentCount(node->_return_type));
+			case NodeType::Function:
+				COMPUTE_ASSERT(node->_count >= 1);
+				return lower_function(node);
+			case NodeType::Sample1D:
+			case NodeType::Sample2D:
+				return lower_sample(node);
+			case NodeType::GetIndex:
+				{
+					llvm::Value* result = llvm::UndefValue::get(type(Kind::Int, 2));
+					result = _builder.CreateInsertElement(result, _x, (uint64_t)0);
+					return _builder.CreateInsertElement(result, _y, 1);
+				}
+			case NodeType::GetNormalizedIndex:
+				{
+					// sampled at the center of each element like the OpenGL backend
+					llvm::Value* half = llvm::ConstantFP::get(_builder.getFloatTy(), 0.5f);
+					llvm::Value* nx = _builder.CreateFDiv(_builder.CreateFAdd(_builder.CreateSIToFP(_x, _builder.getFloatTy()), half), _builder.CreateSIToFP(_width, _builder.getFloatTy()));
+					llvm::Value* ny = _builder.CreateFDiv(_builder.CreateFAdd(_builder.CreateSIToFP(_y, _builder.getFloatTy()), half), _builder.CreateSIToFP(_height, _builder.getFloatTy()));
+					llvm::Value* result = llvm::UndefValue::get(type(Kind::Float, 2));
+					result = _builder.CreateInsertElement(result, nx, (uint64_t)0);
+					return _builder.CreateInsertElement(result, ny, 1);
+				}
+			default:
+				// unknown AST node type
+				COMPUTE_ASSERT(false);
+			}
+			return llvm::UndefValue::get(type(node->_return_type));
+		}
+
+		llvm::Value* IRCompiler::lower_arithmetic(const ASTNode* node)
+		{
+			const Kind::Type kind = ComponentKind(node->_return_type);
+			const uint32_t count = ComponentCount(node->_return_type);
+			llvm::Value* a = lower_operand(node->_children[0], kind, count);
+			llvm::Value* b = lower_operand(node->_children[1], kind, count);
+
+			if(kind == Kind::Float)
+			{
+				switch(node->_node_type)
+				{
+				case NodeType::Add:
+					return _builder.CreateFAdd(a, b);
+				case NodeType::Subtract:
+					return _builder.CreateFSub(a, b);
+				case NodeType::Multiply:
+					return _builder.CreateFMul(a, b);
+				case NodeType::Divide:
+					return _builder.CreateFDiv(a, b);
+				case NodeType::Modulo:
+					// frem has fmodf semantics
+					return _builder.CreateFRem(a, b);
+				default:
+					// bitwise operations on floats give 0
+					return constant(kind, count, 0);
+				}
+			}
+
+			// signed overflow wraps like it does on the GPU
+			switch(node->_node_type)
+			{
+			case NodeType::Add:
+				return _builder.CreateAdd(a, b);
+			case NodeType::Subtract:
+				return _builder.CreateSub(a, b);
+			case NodeType::Multiply:
+				return _builder.CreateMul(a, b);
+			case NodeType::Divide:
+				return lower_division(a, b, kind, count, false);
+			case NodeType::Modulo:
+				return lower_division(a, b, kind, count, true);
+			case NodeType::BitwiseAnd:
+				return _builder.CreateAnd(a, b);
+			case NodeType::BitwiseOr:
+				return _builder.CreateOr(a, b);
+			case NodeType::BitwiseXor:
+				return _builder.CreateXor(a, b);
+			// shifts are masked to the width of the type
+			case NodeType::LeftShift:
+				return _builder.CreateShl(a, _builder.CreateAnd(b, constant(kind, count, 31)));
+			case NodeType::RightShift:
+				b = _builder.CreateAnd(b, constant(kind, count, 31));
+				return kind == Kind::UInt ? _builder.CreateLShr(a, b) : _builder.CreateAShr(a, b);
+			default:
+				COMPUTE_ASSERT(false);
+			}
+			return a;
+		}
+
+		// integer division and modulo by 0 (and INT_MIN / -1) give 0 instead
+		// of trapping
+		llvm::Value* IRCompiler::lower_division(llvm::Value* a, llvm::Value* b, Kind::Type kind, uint32_t count, bool modulo)
+		{
+			llvm::Value* zero = constant(kind, count, 0);
+			llvm::Value* bad = _builder.CreateICmpEQ(b, zero);
+			if(kind != Kind::UInt)
+			{
+				llvm::Value* minus_one = _builder.CreateICmpEQ(b, constant(kind, count, 0xFFFFFFFF));
+				if(!modulo)
+				{
+					minus_one = _builder.CreateAnd(minus_one, _builder.CreateICmpEQ(a, constant(kind, count, 0x80000000)));
+				}
+				bad = _builder.CreateOr(bad, minus_one);
+			}
+
+			llvm::Value* divisor = _builder.CreateSelect(bad, constant(kind, count, 1), b);
+			llvm::Value* result = nullptr;
+			if(kind == Kind::UInt)
+			{
+				result = modulo ? _builder.CreateURem(a, divisor) : _builder.CreateUDiv(a, divisor);
+			}
+			else
+			{
+				result = modulo ? _builder.CreateSRem(a, divisor) : _builder.CreateSDiv(a, divisor);
+			}
+			return _builder.CreateSelect(bad, zero, result);
+		}
+
+		llvm::Value* IRCompiler::lower_comparison(const ASTNode* node)
+		{
+			COMPUTE_ASSERT(node->_count == 2);
+			const ASTNode* left = node->_children[0];
+			const ASTNode* right = node->_children[1];
+			const Kind::Type kind = PromotedKind(ComponentKind(left->_return_type), ComponentKind(right->_return_type));
+			llvm::Value* a = lower_operand(left, kind, 1);
+			llvm::Value* b = lower_operand(right, kind, 1);
+
+			// ordered float comparisons are false for NaN like in C, except !=
+			llvm::CmpInst::Predicate predicate = llvm::CmpInst::BAD_ICMP_PREDICATE;
+			switch(node->_node_type)
+			{
+			case NodeType::Equal:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_OEQ : llvm::CmpInst::ICMP_EQ;
+				break;
+			case NodeType::NotEqual:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_UNE : llvm::CmpInst::ICMP_NE;
+				break;
+			case NodeType::Greater:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_OGT : (kind == Kind::UInt ? llvm::CmpInst::ICMP_UGT : llvm::CmpInst::ICMP_SGT);
+				break;
+			case NodeType::GreaterEqual:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_OGE : (kind == Kind::UInt ? llvm::CmpInst::ICMP_UGE : llvm::CmpInst::ICMP_SGE);
+				break;
+			case NodeType::Less:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_OLT : (kind == Kind::UInt ? llvm::CmpInst::ICMP_ULT : llvm::CmpInst::ICMP_SLT);
+				break;
+			case NodeType::LessEqual:
+				predicate = kind == Kind::Float ? llvm::CmpInst::FCMP_OLE : (kind == Kind::UInt ? llvm::CmpInst::ICMP_ULE : llvm::CmpInst::ICMP_SLE);
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+
+			llvm::Value* result = (kind == Kind::Float) ? _builder.CreateFCmp(predicate, a, b) : _builder.CreateICmp(predicate, a, b);
+			return _builder.CreateZExt(result, _builder.getInt32Ty());
+		}
+
+		llvm::Value* IRCompiler::intrinsic(llvm::Intrinsic::ID id, llvm::Value* a)
+		{
+			return _builder.CreateUnaryIntrinsic(id, a);
+		}
+
+		// float functions without an intrinsic are called straight from libm
+		llvm::Value* IRCompiler::libm(const char* name, llvm::Value* a, llvm::Value* b)
+		{
+			llvm::Type* f32 = _builder.getFloatTy();
+			llvm::FunctionCallee callee = b ? _module.getOrInsertFunction(name, f32, f32, f32) : _module.getOrInsertFunction(name, f32, f32);
+			llvm::Function* f = llvm::cast<llvm::Function>(callee.getCallee());
+			f->setDoesNotThrow();
+			f->setDoesNotAccessMemory();
+			return b ? _builder.CreateCall(callee, {a, b}) : _builder.CreateCall(callee, {a});
+		}
+
+		// and the math library's ones at other accuracies from this process
+		llvm::Value* IRCompiler::call_library(BuiltinFunction::Func func, llvm::Value* a, llvm::Value* b)
+		{
+			// in BuiltinFunction order from Sin to Log2
+			static const char* const names[] =
+			{
+				"sin", "cos", "tan", "asin", "acos", "atan",
+				"sinh", "cosh", "tanh", "asinh", "acosh", "atanh",
+				"pow", "exp", "log", "exp2", "log2",
+			};
+			COMPUTE_ASSERT(func >= BuiltinFunction::Sin && func < BuiltinFunction::Sqrt);
+
+			const std::string name = std::string("sickl_") + names[func - BuiltinFunction::Sin] + "_" + CPURuntime::GetMathAccuracyName(_accuracy);
+			_library_symbols[name] = (func == BuiltinFunction::Pow) ?
+				llvm::pointerToJITTargetAddress(Math::GetFunction2(func, _accuracy)) :
+				llvm::pointerToJITTargetAddress(Math::GetFunction1(func, _accuracy));
+			return libm(name.c_str(), a, b);
+		}
+
+		llvm::Value* IRCompiler::lower_function(const ASTNode* node)
+		{
+			COMPUTE_ASSERT(node->_children[0]->_node_type == NodeType::Literal);
+			COMPUTE_ASSERT(node->_children[0]->_return_type == ReturnType::Int);
+			const int32_t func_id = (*(int32_t*)node->_children[0]->_u.literal.data);
+
+			// the vector math functions work on the width of their first argument
+			const uint32_t arg_count = node->_count > 1 ? ComponentCount(node->_children[1]->_return_type) : 0;
+			llvm::Type* f32 = _builder.getFloatTy();
+			llvm::Value* zero = llvm::ConstantFP::get(f32, 0.0f);
+			llvm::Value* one = llvm::ConstantFP::get(f32, 1.0f);
+
+			switch(func_id)
+			{
+			case BuiltinFunction::Index:
+			case BuiltinFunction::NormalizedIndex:
+				{
+					COMPUTE_ASSERT(node->_count == 1);
+					ASTNode index(func_id == BuiltinFunction::Index ? NodeType::GetIndex : NodeType::GetNormalizedIndex, node->_return_type);
+					return lower(&index);
+				}
+			// integer versions
+			case BuiltinFunction::Abs:
+			case BuiltinFunction::Sign:
+				COMPUTE_ASSERT(node->_count == 2);
+				if(ComponentKind(node->_return_type) == Kind::Int)
+				{
+					llvm::Value* a = lower_operand(node->_children[1], Kind::Int, 1);
+					llvm::Value* negative = _builder.CreateICmpSLT(a, _builder.getInt32(0));
+					if(func_id == BuiltinFunction::Abs)
+					{
+						return _builder.CreateSelect(negative, _builder.CreateNeg(a), a);
+					}
+					llvm::Value* positive = _builder.CreateICmpSGT(a, _builder.getInt32(0));
+					return _builder.CreateSub(_builder.CreateZExt(positive, _builder.getInt32Ty()), _builder.CreateZExt(negative, _builder.getInt32Ty()));
+				}
+				break;
+			default:
+				break;
+			}
+
+			// float functions
+			llvm::Value* a = node->_count > 1 ? lower_operand(node->_children[1], Kind::Float, arg_count) : nullptr;
+			llvm::Value* b = node->_count > 2 ? lower_operand(node->_children[2], Kind::Float, arg_count) : nullptr;
+			llvm::Value* c = node->_count > 3 ? lower_operand(node->_children[3], Kind::Float, arg_count) : nullptr;
+
+			// other accuracies than Standard call the math library, whose sqrt
+			// is the correctly rounded one at all of them
+			if(_accuracy != CPUMathAccuracy::Standard && func_id >= BuiltinFunction::Sin && func_id < BuiltinFunction::Sqrt)
+			{
+				return call_library((BuiltinFunction::Func)func_id, a, b);
+			}
+
+			switch(func_id)
+			{
+			// trigonometry
+			case BuiltinFunction::Sin:
+				return intrinsic(llvm::Intrinsic::sin, a);
+			case BuiltinFunction::Cos:
+				return intrinsic(llvm::Intrinsic::cos, a);
+			case BuiltinFunction::Tan:
+				return libm("tanf", a);
+			case BuiltinFunction::ASin:
+				return libm("asinf", a);
+			case BuiltinFunction::ACos:
+				return libm("acosf", a);
+			case BuiltinFunction::ATan:
+				return libm("atanf", a);
+			case BuiltinFunction::SinH:
+				return libm("sinhf", a);
+			case BuiltinFunction::CosH:
+				return libm("coshf", a);
+			case BuiltinFunction::TanH:
+				return libm("tanhf", a);
+			case BuiltinFunction::ASinH:
+				return libm("asinhf", a);
+			case BuiltinFunction::ACosH:
+				return libm("acoshf", a);
+			case BuiltinFunction::ATanH:
+				return libm("atanhf", a);
+			// exponential functions
+			case BuiltinFunction::Pow:
+				COMPUTE_ASSERT(node->_count == 3);
+				return _builder.CreateBinaryIntrinsic(llvm::Intrinsic::pow, a, b);
+			case BuiltinFunction::Exp:
+				return intrinsic(llvm::Intrinsic::exp, a);
+			case BuiltinFunction::Log:
+				return intrinsic(llvm::Intrinsic::log, a);
+			case BuiltinFunction::Exp2:
+				return intrinsic(llvm::Intrinsic::exp2, a);
+			case BuiltinFunction::Log2:
+				return intrinsic(llvm::Intrinsic::log2, a);
+			case BuiltinFunction::Sqrt:
+				return intrinsic(llvm::Intrinsic::sqrt, a);
+			// common
+			case BuiltinFunction::Abs:
+				return intrinsic(llvm::Intrinsic::fabs, a);
+			case BuiltinFunction::Sign:
+				{
+					llvm::Value* positive = _builder.CreateZExt(_builder.CreateFCmpOGT(a, zero), _builder.getInt32Ty());
+					llvm::Value* negative = _builder.CreateZExt(_builder.CreateFCmpOLT(a, zero), _builder.getInt32Ty());
+					return _builder.CreateSIToFP(_builder.CreateSub(positive, negative), f32);
+				}
+			case BuiltinFunction::Floor:
+				return intrinsic(llvm::Intrinsic::floor, a);
+			case BuiltinFunction::Ceiling:
+				return intrinsic(llvm::Intrinsic::ceil, a);
+			// min and max keep the operand order of the other executors rather
+			// than using minnum/maxnum, which treat NaN differently
+			case BuiltinFunction::Min:
+				COMPUTE_ASSERT(node->_count == 3);
+				return _builder.CreateSelect(_builder.CreateFCmpOLT(b, a), b, a);
+			case BuiltinFunction::Max:
+				COMPUTE_ASSERT(node->_count == 3);
+				return _builder.CreateSelect(_builder.CreateFCmpOLT(a, b), b, a);
+			case BuiltinFunction::Clamp:
+				COMPUTE_ASSERT(node->_count == 4);
+				{
+					llvm::Value* v = _builder.CreateSelect(_builder.CreateFCmpOLT(a, b), b, a);
+					return _builder.CreateSelect(_builder.CreateFCmpOLT(c, v), c, v);
+				}
+			case BuiltinFunction::IsNan:
+				return _builder.CreateSelect(_builder.CreateFCmpUNO(a, a), one, zero);
+			case BuiltinFunction::IsInf:
+				return _builder.CreateSelect(_builder.CreateFCmpOEQ(intrinsic(llvm::Intrinsic::fabs, a), llvm::ConstantFP::getInfinity(f32)), one, zero);
+			// vector math, summed in the same order as the other executors
+			case BuiltinFunction::Length:
+			case BuiltinFunction::Distance:
+			case BuiltinFunction::Dot:
+			case BuiltinFunction::Normalize:
+				{
+					llvm::Value* sum = zero;
+					for(uint32_t k = 0; k < arg_count; k++)
+					{
+						llvm::Value* ak = component(a, arg_count, k);
+						switch(func_id)
+						{
+						case BuiltinFunction::Distance:
+							ak = _builder.CreateFSub(ak, component(b, arg_count, k));
+							sum = _builder.CreateFAdd(sum, _builder.CreateFMul(ak, ak));
+							break;
+						case BuiltinFunction::Dot:
+							sum = _builder.CreateFAdd(sum, _builder.CreateFMul(ak, component(b, arg_count, k)));
+							break;
+						default:
+							sum = _builder.CreateFAdd(sum, _builder.CreateFMul(ak, ak));
+							break;
+						}
+					}
+					switch(func_id)
+					{
+					case BuiltinFunction::Dot:
+						return sum;
+					case BuiltinFunction::Normalize:
+						return _builder.CreateFMul(a, splat(_builder.CreateFDiv(one, intrinsic(llvm::Intrinsic::sqrt, sum)), arg_count));
+					default:
+						return intrinsic(llvm::Intrinsic::sqrt, sum);
+					}
+				}
+			case BuiltinFunction::Cross:
+				COMPUTE_ASSERT(node->_count == 3);
+				COMPUTE_ASSERT(arg_count == 3);
+				{
+					llvm::Value* result = llvm::UndefValue::get(type(Kind::Float, 3));
+					for(uint32_t k = 0; k < 3; k++)
+					{
+						const uint32_t i = (k + 1) % 3;
+						const uint32_t j = (k + 2) % 3;
+						llvm::Value* l = _builder.CreateFMul(component(a, 3, i), component(b, 3, j));
+						llvm::Value* r = _builder.CreateFMul(component(a, 3, j), component(b, 3, i));
+						result = _builder.CreateInsertElement(result, _builder.CreateFSub(l, r), k);
+					}
+					return result;
+				}
+			default:
+				// unknown function
+				COMPUTE_ASSERT(false);
+			}
+			return zero;
+		}
+
+		llvm::Value* IRCompiler::lower_sample(const ASTNode* node)
+		{
+			const ASTNode* source = node->_children[0];
+			COMPUTE_ASSERT(source->_node_type == NodeType::ConstVar);
+			std::map<symbol_id_t, BufferFields>::iterator it = _buffers.find(source->_u.sid);
+			COMPUTE_ASSERT(it != _buffers.end());
+			const BufferFields& buffer = it->second;
+
+			llvm::Value* x = nullptr;
+			llvm::Value* y = _builder.getInt32(0);
+			if(node->_node_type == NodeType::Sample1D)
+			{
+				COMPUTE_ASSERT(node->_count == 2);
+				x = lower_operand(node->_children[1], Kind::Int, 1);
+			}
+			else if(node->_count == 2)
+			{
+				COMPUTE_ASSERT(node->_children[1]->_return_type == ReturnType::Int2);
+				llvm::Value* index = lower(node->_children[1]);
+				x = component(index, 2, 0);
+				y = component(index, 2, 1);
+			}
+			else
+			{
+				COMPUTE_ASSERT(node->_count == 3);
+				x = lower_operand(node->_children[1], Kind::Int, 1);
+				y = lower_operand(node->_children[2], Kind::Int, 1);
+			}
+
+			// out of range samples are clamped to the edge of the buffer
+			llvm::Value* zero = _builder.getInt32(0);
+			llvm::Value* last_x = _builder.CreateSub(buffer.width, _builder.getInt32(1));
+			llvm::Value* last_y = _builder.CreateSub(buffer.height, _builder.getInt32(1));
+			x = _builder.CreateSelect(_builder.CreateICmpSLT(x, zero), zero, _builder.CreateSelect(_builder.CreateICmpSGE(x, buffer.width), last_x, x));
+			y = _builder.CreateSelect(_builder.CreateICmpSLT(y, zero), zero, _builder.CreateSelect(_builder.CreateICmpSGE(y, buffer.height), last_y, y));
+
+			const ReturnType::Type element = ElementType(source->_return_type);
+			llvm::Type* t = type(element);
+			llvm::Value* src = _builder.CreateBitCast(address(buffer, x, y), t->getPointerTo());
+			return _builder.CreateAlignedLoad(t, src, llvm::MaybeAlign(4));
+		}
+
+		// writes the functions of every object loaded to the perf map, which
+		// perf reads without the perf inject step a jitdump needs
+		class PerfMapListener : public llvm::JITEventListener
+		{
+		public:
+			virtual void notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info)
+			{
+				// the debug copy has the addresses the sections were loaded at
+				llvm::object::OwningBinary<llvm::object::ObjectFile> loaded = info.getObjectForDebug(object);
+				if(loaded.getBinary() == nullptr)
+				{
+					return;
+				}
+
+				std::vector<std::pair<llvm::object::SymbolRef, uint64_t>> sizes = llvm::object::computeSymbolSizes(*loaded.getBinary());
+				for(size_t i = 0; i < sizes.size(); i++)
+				{
+					const llvm::object::SymbolRef& symbol = sizes[i].first;
+					llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+					llvm::Expected<llvm::StringRef> name = symbol.getName();
+					llvm::Expected<uint64_t> address = symbol.getAddress();
+					if(!type || !name || !address)
+					{
+						llvm::consumeError(type.takeError());
+						llvm::consumeError(name.takeError());
+						llvm::consumeError(address.takeError());
+						continue;
+					}
+					if(*type == llvm::object::SymbolRef::ST_Function)
+					{
+						AddPerfMapSymbol(*address, sizes[i].second, name->str());
+					}
+				}
+			}
+		};
+#endif
+
+		JITKernel* JITKernel::Build(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUInstructionSet::Type isa, CPUMathAccuracy::Type accuracy, const KernelListing& listing, std::string& out_ir)
+		{
+#if defined(SICKL_LLVM)
+			static bool initialized = false;
+			if(!initialized)
+			{
+				llvm::InitializeNativeTarget();
+				llvm::InitializeNativeTargetAsmPrinter();
+				initialized = true;
+			}
+
+			// the host's CPU and features, like -march=native
+			llvm::Expected<llvm::orc::JITTargetMachineBuilder> jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+			if(!jtmb)
+			{
+				printf("Failed to detect host: %s\n", llvm::toString(jtmb.takeError()).c_str());
+				return nullptr;
+			}
+			// a forced older instruction set gets the generic CPU of that set
+			// with none of the host's features
+			if(isa < CPURuntime::GetSupportedInstructionSet() && jtmb->getTargetTriple().isX86())
+			{
+				static const char* const cpus[] = {"x86-64", "nehalem", "haswell", "skylake-avx512"};
+				llvm::orc::JITTargetMachineBuilder target(jtmb->getTargetTriple());
+				target.setCPU(cpus[isa]);
+				*jtmb = std::move(target);
+			}
+			jtmb->setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+			// a * b + c is not contracted so the results match the other
+			// executors bit for bit
+			jtmb->getOptions().AllowFPOpFusion = llvm::FPOpFusion::Strict;
+
+			llvm::Expected<std::unique_ptr<llvm::TargetMachine>> target_machine = jtmb->createTargetMachine();
+			if(!target_machine)
+			{
+				printf("Failed to create target machine: %s\n", llvm::toString(target_machine.takeError()).c_str());
+				return nullptr;
+			}
+
+			std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext());
+			std::unique_ptr<llvm::Module> module(new llvm::Module("sickl", *context));
+			module->setDataLayout((*target_machine)->createDataLayout());
+			module->setTargetTriple((*target_machine)->getTargetTriple().str());
+
+			IRCompiler compiler(*module, accuracy, listing);
+			compiler.Compile(uniforms, outputs, main);
+
+			std::string errors;
+			llvm::raw_string_ostream error_stream(errors);
+			if(llvm::verifyModule(*module, &error_stream))
+			{
+				printf("Failed to Compile:\n\n%s\n", error_stream.str().c_str());
+				return nullptr;
+			}
+
+			// the same pipeline clang runs at -O3, which vectorizes the loop
+			// over x where the body allows it
+			{
+				llvm::LoopAnalysisManager lam;
+				llvm::FunctionAnalysisManager fam;
+				llvm::CGSCCAnalysisManager cgam;
+				llvm::ModuleAnalysisManager mam;
+
+				llvm::PassBuilder pb(target_machine->get());
+				pb.registerModuleAnalyses(mam);
+				pb.registerCGSCCAnalyses(cgam);
+				pb.registerFunctionAnalyses(fam);
+				pb.registerLoopAnalyses(lam);
+				pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+				llvm::ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+				mpm.run(*module, mam);
+			}
+
+			out_ir.clear();
+			llvm::raw_string_ostream ir_stream(out_ir);
+			module->print(ir_stream, nullptr);
+			ir_stream.flush();
+
+			llvm::orc::LLJITBuilder builder;
+			builder.setJITTargetMachineBuilder(std::move(*jtmb));
+			if(PerfEnabled())
+			{
+				// objects loaded by RuntimeDyld can be handed to event listeners
+				builder.setObjectLinkingLayerCreator([](llvm::orc::ExecutionSession& session, const llvm::Triple&) -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>>
+				{
+					std::unique_ptr<llvm::orc::RTDyldObjectLinkingLayer> layer(new llvm::orc::RTDyldObjectLinkingLayer(session, []()
+					{
+						return std::unique_ptr<llvm::RuntimeDyld::MemoryManager>(new llvm::SectionMemoryManager());
+					}));
+					static PerfMapListener perf_map;
+					layer->registerJITEventListener(perf_map);
+					// null where LLVM is built without LLVM_USE_PERF
+					if(llvm::JITEventListener* jitdump = llvm::JITEventListener::createPerfJITEventListener())
+					{
+						layer->registerJITEventListener(*jitdump);
+					}
+					return std::unique_ptr<llvm::orc::ObjectLayer>(std::move(layer));
+				});
+			}
+			llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit = builder.create();
+			if(!jit)
+			{
+				printf("Failed to create JIT: %s\n", llvm::toString(jit.takeError()).c_str());
+				return nullptr;
+			}
+
+			// libm functions resolve to the ones in this process
+			const char prefix = (*jit)->getDataLayout().getGlobalPrefix();
+			llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix);
+			if(!generator)
+			{
+				printf("Failed to search process: %s\n", llvm::toString(generator.takeError()).c_str());
+				return nullptr;
+			}
+			(*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+			// and so do the math library functions
+			if(!compiler.LibrarySymbols().empty())
+			{
+				llvm::orc::SymbolMap symbols;
+				for(std::map<std::string, llvm::JITTargetAddress>::const_iterator it = compiler.LibrarySymbols().begin(); it != compiler.LibrarySymbols().end(); ++it)
+				{
+					symbols[(*jit)->mangleAndIntern(it->first)] = llvm::JITEvaluatedSymbol(it->second, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+				}
+				llvm::Error error = (*jit)->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(symbols)));
+				if(error)
+				{
+					printf("Failed to define math library: %s\n", llvm::toString(std::move(error)).c_str());
+					return nullptr;
+				}
+			}
+
+			llvm::Error error = (*jit)->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)));
+			if(error)
+			{
+				printf("Failed to add module: %s\n", llvm::toString(std::move(error)).c_str());
+				return nullptr;
+			}
+
+			llvm::Expected<llvm::JITEvaluatedSymbol> symbol = (*jit)->lookup(listing.symbol);
+			if(!symbol)
+			{
+				printf("Failed to Compile:\n\n%s\n", llvm::toString(symbol.takeError()).c_str());
+				return nullptr;
+			}
+
+			CompiledKernel entry_point = (CompiledKernel)symbol->getAddress();
+			return new JITKernel(jit->release(), entry_point);
+#else
+			(void)uniforms;
+			(void)outputs;
+			(void)main;
+			(void)isa;
+			(void)accuracy;
+			(void)listing;
+			(void)out_ir;
+			printf("LLVM support is not built in, build with SICKL_LLVM defined\n");
+			return nullptr;
+#endif
+		}
+
+		JITKernel::JITKernel(llvm::orc::LLJIT* jit, CompiledKernel entry_point)
+			: _jit(jit)
+			, _entry_point(entry_point)
+		{ }
+
+		JITKernel::~JITKernel()
+		{
+#if defined(SICKL_LLVM)
+			delete _jit;
+#endif
+		}
+
+		void JITKernel::Run(const Invocation& invocation, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			_entry_point(invocation.symbols, invocation.buffers, invocation.outputs, invocation.size, x0, y0, x1, y1);
+		}
+	}
+}
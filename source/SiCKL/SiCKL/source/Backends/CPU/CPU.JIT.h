@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CPU.Perf.h"
+
+#include <string>
+
+namespace llvm
+{
+	namespace orc
+	{
+		class LLJIT;
+	}
+}
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// lowers the AST straight to LLVM IR and compiles it in process with
+		// ORC; only available when the library is built with SICKL_LLVM
+		class JITKernel : public Kernel
+		{
+		public:
+			// compiles for the host, or for isa if that is older than what the
+			// host supports; returns null if LLVM support isn't built in or
+			// compilation failed, otherwise out_ir gets the optimized module.
+			// Functions at another accuracy than Standard are calls into the
+			// math library of this process. The kernel function is named
+			// after the listing; with perf enabled it has the listing's lines
+			// as debug info and is announced to perf in a jitdump file and in
+			// /tmp/perf-<pid>.map
+			static JITKernel* Build(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUInstructionSet::Type isa, CPUMathAccuracy::Type accuracy, const KernelListing& listing, std::string& out_ir);
+			virtual ~JITKernel();
+
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+		private:
+			JITKernel(llvm::orc::LLJIT* jit, CompiledKernel entry_point);
+
+			llvm::orc::LLJIT* _jit;
+			CompiledKernel _entry_point;
+		};
+	}
+}
@@ -0,0 +1,48 @@
+#include "CPU.Math.h"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		namespace Math
+		{
+			static_assert((int)Standard == CPUMathAccuracy::Standard && (int)Precise == CPUMathAccuracy::Precise &&
+				(int)Balanced == CPUMathAccuracy::Balanced && (int)Fast == CPUMathAccuracy::Fast, "tiers out of order");
+
+#define SICKL_MATH_SOURCE(...) #__VA_ARGS__
+			const char* const Source =
+#include "CPU.Math.inl"
+				;
+#undef SICKL_MATH_SOURCE
+
+#define TIERS(NAME) {&NAME<Standard>, &NAME<Precise>, &NAME<Balanced>, &NAME<Fast>}
+
+			Function1 GetFunction1(BuiltinFunction::Func func, CPUMathAccuracy::Type accuracy)
+			{
+				// in BuiltinFunction order from Sin to Sqrt
+				static const Function1 functions[][4] =
+				{
+					TIERS(Sin), TIERS(Cos), TIERS(Tan), TIERS(ASin), TIERS(ACos), TIERS(ATan),
+					TIERS(SinH), TIERS(CosH), TIERS(TanH), TIERS(ASinH), TIERS(ACosH), TIERS(ATanH),
+					{nullptr, nullptr, nullptr, nullptr},
+					TIERS(Exp), TIERS(Log), TIERS(Exp2), TIERS(Log2), TIERS(Sqrt),
+				};
+				static_assert(sizeof(functions) / sizeof(functions[0]) == BuiltinFunction::Sqrt - BuiltinFunction::Sin + 1, "functions out of order");
+
+				if(func < BuiltinFunction::Sin || func > BuiltinFunction::Sqrt)
+				{
+					return nullptr;
+				}
+				return functions[func - BuiltinFunction::Sin][accuracy];
+			}
+
+			Function2 GetFunction2(BuiltinFunction::Func func, CPUMathAccuracy::Type accuracy)
+			{
+				static const Function2 functions[] = TIERS(Pow);
+				return func == BuiltinFunction::Pow ? functions[accuracy] : nullptr;
+			}
+
+#undef TIERS
+		}
+	}
+}
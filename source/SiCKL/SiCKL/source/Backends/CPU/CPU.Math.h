@@ -0,0 +1,78 @@
+#pragma once
+
+#include "CPU.Internal.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// the builtin float functions at every CPUMathAccuracy, as templates on
+		// the accuracy: Math::Sin<Math::Fast>(x)
+		namespace Math
+		{
+#define SICKL_MATH_SOURCE(...) __VA_ARGS__
+#include "CPU.Math.inl"
+#undef SICKL_MATH_SOURCE
+
+			// the accuracy picked at run time, for the executors that look it up
+			// per call
+#define SICKL_MATH_DISPATCH(NAME)\
+			inline float NAME(int accuracy, float x)\
+			{\
+				switch(accuracy)\
+				{\
+				case Precise: return NAME<Precise>(x);\
+				case Balanced: return NAME<Balanced>(x);\
+				case Fast: return NAME<Fast>(x);\
+				default: return NAME<Standard>(x);\
+				}\
+			}
+
+			SICKL_MATH_DISPATCH(Sin)
+			SICKL_MATH_DISPATCH(Cos)
+			SICKL_MATH_DISPATCH(Tan)
+			SICKL_MATH_DISPATCH(ASin)
+			SICKL_MATH_DISPATCH(ACos)
+			SICKL_MATH_DISPATCH(ATan)
+			SICKL_MATH_DISPATCH(SinH)
+			SICKL_MATH_DISPATCH(CosH)
+			SICKL_MATH_DISPATCH(TanH)
+			SICKL_MATH_DISPATCH(ASinH)
+			SICKL_MATH_DISPATCH(ACosH)
+			SICKL_MATH_DISPATCH(ATanH)
+			SICKL_MATH_DISPATCH(Exp)
+			SICKL_MATH_DISPATCH(Log)
+			SICKL_MATH_DISPATCH(Exp2)
+			SICKL_MATH_DISPATCH(Log2)
+			SICKL_MATH_DISPATCH(Sqrt)
+
+#undef SICKL_MATH_DISPATCH
+
+			inline float Pow(int accuracy, float x, float y)
+			{
+				switch(accuracy)
+				{
+				case Precise: return Pow<Precise>(x, y);
+				case Balanced: return Pow<Balanced>(x, y);
+				case Fast: return Pow<Fast>(x, y);
+				default: return Pow<Standard>(x, y);
+				}
+			}
+
+			typedef float (*Function1)(float);
+			typedef float (*Function2)(float, float);
+			// the builtin at an accuracy, for code that calls it through a
+			// pointer; null for the functions that aren't part of the library
+			// or take the other number of arguments
+			Function1 GetFunction1(BuiltinFunction::Func, CPUMathAccuracy::Type);
+			Function2 GetFunction2(BuiltinFunction::Func, CPUMathAccuracy::Type);
+
+			// the library as C++ source, for the prelude of native kernels
+			extern const char* const Source;
+		}
+	}
+}
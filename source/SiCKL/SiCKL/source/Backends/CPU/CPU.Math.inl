@@ -0,0 +1,621 @@
+// the float functions of the CPU executors at each CPUMathAccuracy.
+//
+// The library is compiled twice: as C++ by CPU.Math.h, and as text by
+// CPU.Math.cpp, which the native kernels paste into their prelude. So the
+// body is one SICKL_MATH_SOURCE argument and can't hold any preprocessor
+// directive, and it only uses <cmath>, <cstdint> and <cstring>.
+//
+// Every function but the Standard ones is branch free, with selects for
+// the special cases, so a loop that calls one per lane vectorizes. Precise
+// evaluates its polynomials in double and rounds once at the end, Balanced
+// and Fast work in float, Fast with shorter polynomials. Arguments of the
+// trigonometric functions are reduced with a three part pi / 2 in float and
+// a two part one in double, which stays accurate for |x| below about 1e5 and
+// 1e6.
+
+SICKL_MATH_SOURCE(
+
+	// tiers, in CPUMathAccuracy order
+	enum { Standard, Precise, Balanced, Fast };
+
+	/// Bits
+
+	inline uint32_t Bits(float x) { uint32_t u; std::memcpy(&u, &x, sizeof(u)); return u; }
+	inline uint64_t Bits(double x) { uint64_t u; std::memcpy(&u, &x, sizeof(u)); return u; }
+	inline float FromBits(uint32_t u) { float x; std::memcpy(&x, &u, sizeof(x)); return x; }
+	inline double FromBits(uint64_t u) { double x; std::memcpy(&x, &u, sizeof(x)); return x; }
+
+	inline float Infinity() { return FromBits((uint32_t)0x7F800000); }
+	inline float NaN() { return FromBits((uint32_t)0x7FC00000); }
+	// the magnitude of x with the sign of y
+	inline float CopySign(float x, float y) { return FromBits((Bits(x) & 0x7FFFFFFF) | (Bits(y) & 0x80000000)); }
+	inline double CopySign(double x, float y) { return FromBits((Bits(x) & (uint64_t)0x7FFFFFFFFFFFFFFF) | ((uint64_t)(Bits(y) & 0x80000000) << 32)); }
+	// NaN passes through
+	inline float Clamp(float x, float lo, float hi) { return x < lo ? lo : (x > hi ? hi : x); }
+	inline double Clamp(double x, double lo, double hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+	// x + RoundingShift has x rounded to an integer n in its low mantissa bits,
+	// for |x| < 2^22 and 2^51
+	inline float RoundingShift(float) { return 12582912.0f; }
+	inline double RoundingShift(double) { return 6755399441055744.0; }
+
+	// x * 2^n for n in [-252, 254], in two steps so neither factor overflows
+	// and a subnormal result is only rounded once
+	inline float Scale(float x, int32_t n)
+	{
+		const int32_t h = n / 2;
+		return x * FromBits((uint32_t)(h + 127) << 23) * FromBits((uint32_t)(n - h + 127) << 23);
+	}
+	// 2^n for n in [-1022, 1023]
+	inline double Pow2(int64_t n) { return FromBits((uint64_t)(n + 1023) << 52); }
+
+	/// Kernels, on reduced arguments
+
+	// e^r for |r| <= ln(2) / 2
+	inline double ExpKernel(double r)
+	{
+		return 1.0 + r + r * r * (0.5 + r * (0.16666666666650079 + r * (0.041666666667206434 + r * (0.0083333333532424961 + r * (0.0013888888709847327
+			+ r * (0.00019841209059199045 + r * (2.4801756769505624e-05 + r * (2.7625077270339944e-06 + r * 2.7534034563083897e-07))))))));
+	}
+	inline float ExpKernel(float r)
+	{
+		return 1.0f + r + r * r * (0.5f + r * (0.166665770f + r * (0.0416665547f + r * (0.00836317307f + r * 0.00139261761f))));
+	}
+	// 2^f for |f| <= 1 / 2
+	inline float Exp2FastKernel(float f)
+	{
+		return 1.0f + f * (0.693121045f + f * (0.240223490f + f * (0.0559219758f + f * 0.00966636852f)));
+	}
+
+	// ln(1 + f) for 1 + f in [sqrt(1/2), sqrt(2)), from the series of
+	// 2 atanh(s) in s = f / (2 + f), written so the exact f is added last
+	inline double LogKernel(double f)
+	{
+		const double s = f / (2.0 + f);
+		const double z = s * s;
+		const double p = z * (1.0 / 3 + z * (1.0 / 5 + z * (1.0 / 7 + z * (1.0 / 9 + z * (1.0 / 11 + z * (1.0 / 13 + z * (1.0 / 15)))))));
+		return f - s * (f - 2.0 * p);
+	}
+	inline float LogKernel(float f)
+	{
+		const float s = f / (2.0f + f);
+		const float z = s * s;
+		const float p = z * (0.333333333f + z * (0.200000381f + z * (0.142772117f + z * 0.116290537f)));
+		return f - s * (f - 2.0f * p);
+	}
+	inline float LogFastKernel(float f)
+	{
+		return f * (1.00000374f + f * (-0.499894802f + f * (0.332659058f + f * (-0.254333564f + f * (0.219657085f + f * -0.140216233f)))));
+	}
+
+	// x = 2^e m with m in [sqrt(1/2), sqrt(2)), for positive finite x
+	inline float Decompose(float x, int32_t& e)
+	{
+		// subnormals are scaled into the normal range first
+		const bool subnormal = x < 1.17549435e-38f;
+		const uint32_t u = Bits(subnormal ? x * 8388608.0f : x);
+		const uint32_t t = u - 0x3F3504F3;
+		e = ((int32_t)t >> 23) - (subnormal ? 23 : 0);
+		return FromBits(u - (t & 0xFF800000));
+	}
+	inline double Decompose(double x, int64_t& e)
+	{
+		const uint64_t u = Bits(x);
+		const uint64_t t = u - (uint64_t)0x3FE6A09E667F3BCD;
+		e = (int64_t)t >> 52;
+		return FromBits(u - (t & (uint64_t)0xFFF0000000000000));
+	}
+
+	// what log gives for x <= 0, infinity and NaN, r otherwise
+	inline float LogSpecial(float x, float r) { return x < 0.0f ? NaN() : (x == 0.0f ? -Infinity() : (x < Infinity() ? r : x)); }
+	inline double LogSpecial(double x, double r) { return x < 0.0 ? (double)NaN() : (x == 0.0 ? -(double)Infinity() : (x < (double)Infinity() ? r : x)); }
+
+	// x - q pi / 2 for the integer q nearest to x 2 / pi, whose last two bits
+	// end up in quadrant
+	inline float ReduceHalfPi(float x, uint32_t& quadrant)
+	{
+		const float t = x * 0.636619772f + RoundingShift(x);
+		const float q = t - RoundingShift(x);
+		quadrant = Bits(t);
+		return ((x - q * 1.5703125f) - q * 4.83751296997e-4f) - q * 7.54978995489e-8f;
+	}
+	inline double ReduceHalfPi(double x, uint32_t& quadrant)
+	{
+		const double t = x * 0.63661977236758138 + RoundingShift(x);
+		const double q = t - RoundingShift(x);
+		quadrant = (uint32_t)Bits(t);
+		return (x - q * 1.57079632673412561417) - q * 6.07710050650619224932e-11;
+	}
+
+	// sin and cos of r for |r| <= pi / 4
+	inline double SinKernel(double r)
+	{
+		const double z = r * r;
+		return r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04
+			+ z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+	}
+	inline double CosKernel(double r)
+	{
+		const double z = r * r;
+		return 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05
+			+ z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+	}
+	inline float SinKernel(float r)
+	{
+		const float z = r * r;
+		return r + r * z * (-0.166666647f + z * (0.00833274827f + z * -0.000195878909f));
+	}
+	inline float CosKernel(float r)
+	{
+		const float z = r * r;
+		return 1.0f - 0.5f * z + z * z * (0.0416666647f + z * (-0.00138883030f + z * 2.45479419e-05f));
+	}
+	inline float SinFastKernel(float r)
+	{
+		const float z = r * r;
+		return r + r * z * (-0.166657310f + z * 0.00821185551f);
+	}
+	inline float CosFastKernel(float r)
+	{
+		const float z = r * r;
+		return 1.0f - 0.5f * z + z * z * (0.0416654951f + z * -0.00137368141f);
+	}
+
+	// atan(y) for |y| <= tan(pi / 8), and for |y| <= 1 in the fast kernel
+	inline double ATanKernel(double y)
+	{
+		const double z = y * y;
+		return y + y * z * (-0.33333333333272702 + z * (0.19999999950856132 + z * (-0.14285708161865762 + z * (0.11110820968720068
+			+ z * (-0.090841181281145475 + z * (0.07604915401664375 + z * (-0.060277312304941912 + z * 0.032963086660853798)))))));
+	}
+	inline float ATanKernel(float y)
+	{
+		const float z = y * y;
+		return y + y * z * (-0.333333318f + z * (0.199995405f + z * (-0.142639556f + z * (0.107437315f + z * -0.0645192817f))));
+	}
+	inline float ATanFastKernel(float y)
+	{
+		const float z = y * y;
+		return y + y * z * (-0.333329017f + z * (0.199685498f + z * (-0.138961257f + z * (0.0922929958f + z * (-0.0448663915f + z * 0.0105786698f)))));
+	}
+
+	// asin(y) for 0 <= y <= 1 / 2, with z = y^2
+	inline double ASinKernel(double y, double z)
+	{
+		return y + y * z * (0.16666666666735508 + z * (0.074999999537340489 + z * (0.044642906359942273 + z * (0.030379947424143908
+			+ z * (0.022412393317232489 + z * (0.016902843664421491 + z * (0.016863476048458021 + z * (0.0010687871858649526 + z * 0.028345626848955304))))))));
+	}
+	inline float ASinKernel(float y, float z)
+	{
+		return y + y * z * (0.166666724f + z * (0.0749885507f + z * (0.0450013801f + z * (0.0265545422f + z * 0.0380850235f))));
+	}
+	inline float ASinFastKernel(float y, float z)
+	{
+		return y + y * z * (0.166686721f + z * (0.0735710923f + z * 0.0589756389f));
+	}
+
+	// sinh(a) for |a| <= 1 / 2 and 1, and tanh(a) for |a| <= 0.625
+	inline double SinHKernel(double a)
+	{
+		const double z = a * a;
+		return a + a * z * (0.16666666666666172 + z * (0.008333333333380254 + z * (0.00019841269952825338 + z * (2.7557123119994807e-06 + z * 2.5151278294105596e-08))));
+	}
+	inline float SinHKernel(float a)
+	{
+		const float z = a * a;
+		return a + a * z * (0.166666666f + z * (0.00833333968f + z * (0.000198381020f + z * 2.80628026e-06f)));
+	}
+	inline double TanHKernel(double a)
+	{
+		const double z = a * a;
+		return a + a * z * (-0.33333333333326365 + z * (0.13333333330129077 + z * (-0.053968251724521722 + z * (0.021869428568095161
+			+ z * (-0.0088624312048245068 + z * (0.0035860245975781989 + z * (-0.0014282432191298879 + z * (0.00051522800498724581 + z * -0.0001219426525044465))))))));
+	}
+	inline float TanHKernel(float a)
+	{
+		const float z = a * a;
+		return a + a * z * (-0.333333289f + z * (0.133327697f + z * (-0.0538509096f + z * (0.0209971790f + z * -0.00609671416f))));
+	}
+
+	/// Double precision building blocks of Precise
+
+	// e^x and 2^x, x is clamped to where a float result over- or underflows
+	inline double ExpD(double x)
+	{
+		x = Clamp(x, -104.0, 104.0);
+		const double t = x * 1.4426950408889634 + RoundingShift(x);
+		const double n = t - RoundingShift(x);
+		return ExpKernel(x - n * 0.69314718055994531) * Pow2((int64_t)(Bits(t) - Bits(RoundingShift(x))));
+	}
+	inline double Exp2D(double x)
+	{
+		x = Clamp(x, -160.0, 160.0);
+		const double t = x + RoundingShift(x);
+		const double n = t - RoundingShift(x);
+		return ExpKernel((x - n) * 0.69314718055994531) * Pow2((int64_t)(Bits(t) - Bits(RoundingShift(x))));
+	}
+	// ln(x) for any x, the double of a float is never subnormal
+	inline double LogD(double x)
+	{
+		int64_t e;
+		const double m = Decompose(x, e);
+		return LogSpecial(x, (double)e * 0.69314718055994531 + LogKernel(m - 1.0));
+	}
+	// ln(1 + v) without the rounding of 1 + v
+	inline double Log1pD(double v)
+	{
+		const double u = 1.0 + v;
+		const double r = LogD(u) * (v / (u - 1.0));
+		return u == 1.0 ? v : (v < (double)Infinity() ? r : v);
+	}
+
+	/// Exponential functions
+
+	template<int A> inline float Exp(float x);
+	template<> inline float Exp<Standard>(float x) { return std::exp(x); }
+	template<> inline float Exp<Precise>(float x) { return (float)ExpD(x); }
+	template<> inline float Exp<Balanced>(float x)
+	{
+		x = Clamp(x, -104.0f, 89.0f);
+		const float t = x * 1.44269504f + RoundingShift(x);
+		const float n = t - RoundingShift(x);
+		// ln(2) in two parts, the first one short enough for n * it to be exact
+		const float r = (x - n * 0.693359375f) - n * -2.12194440e-4f;
+		return Scale(ExpKernel(r), (int32_t)(Bits(t) - Bits(RoundingShift(x))));
+	}
+
+	template<int A> inline float Exp2(float x);
+	template<> inline float Exp2<Standard>(float x) { return std::exp2(x); }
+	template<> inline float Exp2<Precise>(float x) { return (float)Exp2D(x); }
+	template<> inline float Exp2<Balanced>(float x)
+	{
+		x = Clamp(x, -151.0f, 129.0f);
+		const float t = x + RoundingShift(x);
+		const float n = t - RoundingShift(x);
+		return Scale(ExpKernel((x - n) * 0.693147181f), (int32_t)(Bits(t) - Bits(RoundingShift(x))));
+	}
+	template<> inline float Exp2<Fast>(float x)
+	{
+		x = Clamp(x, -151.0f, 129.0f);
+		const float t = x + RoundingShift(x);
+		const float n = t - RoundingShift(x);
+		return Scale(Exp2FastKernel(x - n), (int32_t)(Bits(t) - Bits(RoundingShift(x))));
+	}
+	template<> inline float Exp<Fast>(float x) { return Exp2<Fast>(x * 1.44269504f); }
+
+	template<int A> inline float Log(float x);
+	template<> inline float Log<Standard>(float x) { return std::log(x); }
+	template<> inline float Log<Precise>(float x) { return (float)LogD(x); }
+	template<> inline float Log<Balanced>(float x)
+	{
+		int32_t e;
+		const float m = Decompose(x, e);
+		const float n = (float)e;
+		return LogSpecial(x, n * 0.693359375f + (LogKernel(m - 1.0f) + n * -2.12194440e-4f));
+	}
+	template<> inline float Log<Fast>(float x)
+	{
+		int32_t e;
+		const float m = Decompose(x, e);
+		return LogSpecial(x, (float)e * 0.693147181f + LogFastKernel(m - 1.0f));
+	}
+
+	template<int A> inline float Log2(float x);
+	template<> inline float Log2<Standard>(float x) { return std::log2(x); }
+	template<> inline float Log2<Precise>(float x) { return (float)(LogD(x) * 1.4426950408889634); }
+	template<> inline float Log2<Balanced>(float x)
+	{
+		int32_t e;
+		const float m = Decompose(x, e);
+		const float l = LogKernel(m - 1.0f);
+		// log2(e) in two parts
+		return LogSpecial(x, (float)e + (l * 1.44269502f + l * 1.92596303e-8f));
+	}
+	template<> inline float Log2<Fast>(float x)
+	{
+		int32_t e;
+		const float m = Decompose(x, e);
+		return LogSpecial(x, (float)e + LogFastKernel(m - 1.0f) * 1.44269504f);
+	}
+
+	// x^y as 2^(y log2(x)) on |x|, with the signs and special cases of pow.
+	// log2 needs more bits than a float has for the product to stay within a
+	// few ulps, so Balanced works in double like Precise
+	inline float PowSpecial(float x, float y, float r)
+	{
+		const float ax = CopySign(x, 1.0f);
+		const float ay = CopySign(y, 1.0f);
+		const bool integer = ay >= 8388608.0f || y == (y + RoundingShift(y)) - RoundingShift(y);
+		const bool odd = integer && ay < 16777216.0f && ((int32_t)(ay < 16777216.0f ? y : 0.0f) & 1);
+		// a negative base only has a real power if y is an integer
+		const float signed_r = odd ? -r : r;
+		r = (Bits(x) & 0x80000000) ? (integer || x == 0.0f || ax == Infinity() ? signed_r : NaN()) : r;
+		return (y == 0.0f || x == 1.0f || (ax == 1.0f && ay == Infinity())) ? 1.0f : r;
+	}
+	template<int A> inline float Pow(float x, float y);
+	template<> inline float Pow<Standard>(float x, float y) { return std::pow(x, y); }
+	template<> inline float Pow<Precise>(float x, float y)
+	{
+		const double l = LogD(CopySign(x, 1.0f)) * 1.4426950408889634;
+		return PowSpecial(x, y, (float)Exp2D((double)y * l));
+	}
+	template<> inline float Pow<Balanced>(float x, float y) { return Pow<Precise>(x, y); }
+	template<> inline float Pow<Fast>(float x, float y)
+	{
+		return PowSpecial(x, y, Exp2<Fast>(y * Log2<Fast>(CopySign(x, 1.0f))));
+	}
+
+	// correctly rounded everywhere
+	template<int A> inline float Sqrt(float x) { return std::sqrt(x); }
+
+	/// Trigonometry
+
+	// the sign of x flipped where bit 1 of quadrant is set
+	inline float FlipSign(float x, uint32_t quadrant) { return FromBits(Bits(x) ^ ((quadrant & 2) << 30)); }
+	inline double FlipSign(double x, uint32_t quadrant) { return FromBits(Bits(x) ^ ((uint64_t)(quadrant & 2) << 62)); }
+
+	template<int A> inline float Sin(float x);
+	template<> inline float Sin<Standard>(float x) { return std::sin(x); }
+	template<> inline float Sin<Precise>(float x)
+	{
+		uint32_t quadrant;
+		const double r = ReduceHalfPi((double)x, quadrant);
+		return (float)FlipSign((quadrant & 1) ? CosKernel(r) : SinKernel(r), quadrant);
+	}
+	template<> inline float Sin<Balanced>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		return FlipSign((quadrant & 1) ? CosKernel(r) : SinKernel(r), quadrant);
+	}
+	template<> inline float Sin<Fast>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		return FlipSign((quadrant & 1) ? CosFastKernel(r) : SinFastKernel(r), quadrant);
+	}
+
+	template<int A> inline float Cos(float x);
+	template<> inline float Cos<Standard>(float x) { return std::cos(x); }
+	template<> inline float Cos<Precise>(float x)
+	{
+		uint32_t quadrant;
+		const double r = ReduceHalfPi((double)x, quadrant);
+		return (float)FlipSign((quadrant & 1) ? SinKernel(r) : CosKernel(r), quadrant + 1);
+	}
+	template<> inline float Cos<Balanced>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		return FlipSign((quadrant & 1) ? SinKernel(r) : CosKernel(r), quadrant + 1);
+	}
+	template<> inline float Cos<Fast>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		return FlipSign((quadrant & 1) ? SinFastKernel(r) : CosFastKernel(r), quadrant + 1);
+	}
+
+	// sin / cos, or -cos / sin in the odd quadrants
+	template<int A> inline float Tan(float x);
+	template<> inline float Tan<Standard>(float x) { return std::tan(x); }
+	template<> inline float Tan<Precise>(float x)
+	{
+		uint32_t quadrant;
+		const double r = ReduceHalfPi((double)x, quadrant);
+		const double s = SinKernel(r);
+		const double c = CosKernel(r);
+		return (float)((quadrant & 1) ? -c / s : s / c);
+	}
+	template<> inline float Tan<Balanced>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		const float s = SinKernel(r);
+		const float c = CosKernel(r);
+		return (quadrant & 1) ? -c / s : s / c;
+	}
+	template<> inline float Tan<Fast>(float x)
+	{
+		uint32_t quadrant;
+		const float r = ReduceHalfPi(x, quadrant);
+		const float s = SinFastKernel(r);
+		const float c = CosFastKernel(r);
+		return (quadrant & 1) ? -c / s : s / c;
+	}
+
+	// atan(a) = pi / 2 + atan(-1 / a) = pi / 4 + atan((a - 1) / (a + 1)),
+	// the constants are split in two
+	template<int A> inline float ATan(float x);
+	template<> inline float ATan<Standard>(float x) { return std::atan(x); }
+	template<> inline float ATan<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		const bool big = a > 2.4142135623730950;
+		const bool mid = a > 0.41421356237309503;
+		const double y = big ? -1.0 / a : (mid ? (a - 1.0) / (a + 1.0) : a);
+		const double offset = big ? 1.5707963267948966 : (mid ? 0.78539816339744831 : 0.0);
+		return (float)CopySign(offset + ATanKernel(y), x);
+	}
+	template<> inline float ATan<Balanced>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 2.41421356f;
+		const bool mid = a > 0.414213562f;
+		const float y = big ? -1.0f / a : (mid ? (a - 1.0f) / (a + 1.0f) : a);
+		const float hi = big ? 1.57079637f : (mid ? 0.785398185f : 0.0f);
+		const float lo = big ? -4.37113883e-8f : (mid ? -2.18556941e-8f : 0.0f);
+		return CopySign(hi + (ATanKernel(y) + lo), x);
+	}
+	template<> inline float ATan<Fast>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 1.0f;
+		const float y = big ? -1.0f / a : a;
+		return CopySign((big ? 1.57079633f : 0.0f) + ATanFastKernel(y), x);
+	}
+
+	// asin(a) = pi / 2 - 2 asin(sqrt((1 - a) / 2)) for a > 1 / 2, where the
+	// square root also makes |x| > 1 NaN
+	template<int A> inline float ASin(float x);
+	template<> inline float ASin<Standard>(float x) { return std::asin(x); }
+	template<> inline float ASin<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		const bool big = a > 0.5;
+		const double z = big ? 0.5 * (1.0 - a) : a * a;
+		const double p = ASinKernel(big ? std::sqrt(z) : a, z);
+		return (float)CopySign(big ? 1.5707963267948966 - 2.0 * p : p, x);
+	}
+	template<> inline float ASin<Balanced>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 0.5f;
+		const float z = big ? 0.5f * (1.0f - a) : a * a;
+		const float p = ASinKernel(big ? std::sqrt(z) : a, z);
+		return CopySign(big ? (1.57079637f - 2.0f * p) + -4.37113883e-8f : p, x);
+	}
+	template<> inline float ASin<Fast>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 0.5f;
+		const float z = big ? 0.5f * (1.0f - a) : a * a;
+		const float p = ASinFastKernel(big ? std::sqrt(z) : a, z);
+		return CopySign(big ? 1.57079633f - 2.0f * p : p, x);
+	}
+
+	// pi / 2 - asin(x), or 2 asin(sqrt((1 - |x|) / 2)) and pi minus that
+	template<int A> inline float ACos(float x);
+	template<> inline float ACos<Standard>(float x) { return std::acos(x); }
+	template<> inline float ACos<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		const bool big = a > 0.5;
+		const double z = big ? 0.5 * (1.0 - a) : a * a;
+		const double p = ASinKernel(big ? std::sqrt(z) : a, z);
+		const double small = 1.5707963267948966 - CopySign(p, x);
+		return (float)(big ? (x < 0.0f ? 3.1415926535897932 - 2.0 * p : 2.0 * p) : small);
+	}
+	template<> inline float ACos<Balanced>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 0.5f;
+		const float z = big ? 0.5f * (1.0f - a) : a * a;
+		const float p = ASinKernel(big ? std::sqrt(z) : a, z);
+		const float small = (1.57079637f - CopySign(p, x)) + -4.37113883e-8f;
+		return big ? (x < 0.0f ? (3.14159274f - 2.0f * p) + -8.74227766e-8f : 2.0f * p) : small;
+	}
+	template<> inline float ACos<Fast>(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 0.5f;
+		const float z = big ? 0.5f * (1.0f - a) : a * a;
+		const float p = ASinFastKernel(big ? std::sqrt(z) : a, z);
+		return big ? (x < 0.0f ? 3.14159265f - 2.0f * p : 2.0f * p) : 1.57079633f - CopySign(p, x);
+	}
+
+	/// Hyperbolic functions
+
+	// a polynomial near 0, (e^a - e^-a) / 2 elsewhere; past 88 e^a overflows
+	// a float so it is taken as e^(a / 2) squared
+	template<int A> inline float SinH(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool huge = a > 88.0f;
+		const float e = Exp<A>(huge ? 0.5f * a : a);
+		const float r = huge ? (0.5f * e) * e : 0.5f * e - 0.5f / e;
+		return CopySign(a < 1.0f ? SinHKernel(a) : r, x);
+	}
+	template<> inline float SinH<Standard>(float x) { return std::sinh(x); }
+	template<> inline float SinH<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		const double e = ExpD(a);
+		return (float)CopySign(a < 0.5 ? SinHKernel(a) : 0.5 * e - 0.5 / e, x);
+	}
+
+	template<int A> inline float CosH(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool huge = a > 88.0f;
+		const float e = Exp<A>(huge ? 0.5f * a : a);
+		return huge ? (0.5f * e) * e : 0.5f * e + 0.5f / e;
+	}
+	template<> inline float CosH<Standard>(float x) { return std::cosh(x); }
+	template<> inline float CosH<Precise>(float x)
+	{
+		const double e = ExpD(CopySign((double)x, 1.0f));
+		return (float)(0.5 * e + 0.5 / e);
+	}
+
+	// a polynomial near 0, 1 - 2 / (e^2a + 1) elsewhere
+	template<int A> inline float TanH(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const float r = 1.0f - 2.0f / (Exp<A>(2.0f * a) + 1.0f);
+		return CopySign(a < 0.625f ? TanHKernel(a) : r, x);
+	}
+	template<> inline float TanH<Standard>(float x) { return std::tanh(x); }
+	template<> inline float TanH<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		const double r = 1.0 - 2.0 / (ExpD(2.0 * a) + 1.0);
+		return (float)CopySign(a < 0.625 ? TanHKernel(a) : r, x);
+	}
+
+	// ln(1 + v) without the rounding of 1 + v
+	template<int A> inline float Log1p(float v)
+	{
+		const float u = 1.0f + v;
+		const float r = Log<A>(u) * (v / (u - 1.0f));
+		return u == 1.0f ? v : (v < Infinity() ? r : v);
+	}
+
+	// asinh(a) = ln(1 + a + a^2 / (1 + sqrt(1 + a^2))), and ln(a) + ln(2)
+	// once a^2 could overflow, from the same log so there is only one to
+	// vectorize
+	template<int A> inline float ASinH(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		const bool big = a > 4096.0f;
+		const float b = big ? 1.0f : a;
+		const float r = Log1p<A>(big ? a - 1.0f : b + b * b / (1.0f + std::sqrt(1.0f + b * b)));
+		return CopySign(big ? r + 0.693147181f : r, x);
+	}
+	template<> inline float ASinH<Standard>(float x) { return std::asinh(x); }
+	template<> inline float ASinH<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		return (float)CopySign(Log1pD(a + a * a / (1.0 + std::sqrt(1.0 + a * a))), x);
+	}
+
+	// acosh(x) = ln(1 + (x - 1) + sqrt((x - 1) (x + 1)))
+	template<int A> inline float ACosH(float x)
+	{
+		const bool big = x > 4096.0f;
+		const float b = big ? 1.0f : x;
+		const float r = Log1p<A>(big ? x - 1.0f : (b - 1.0f) + std::sqrt((b - 1.0f) * (b + 1.0f)));
+		return x < 1.0f ? NaN() : (big ? r + 0.693147181f : r);
+	}
+	template<> inline float ACosH<Standard>(float x) { return std::acosh(x); }
+	template<> inline float ACosH<Precise>(float x)
+	{
+		const double d = (double)x;
+		const double r = Log1pD((d - 1.0) + std::sqrt((d - 1.0) * (d + 1.0)));
+		return x < 1.0f ? NaN() : (float)r;
+	}
+
+	// atanh(a) = ln(1 + 2 a / (1 - a)) / 2
+	template<int A> inline float ATanH(float x)
+	{
+		const float a = CopySign(x, 1.0f);
+		return CopySign(0.5f * Log1p<A>(2.0f * a / (1.0f - a)), x);
+	}
+	template<> inline float ATanH<Standard>(float x) { return std::atanh(x); }
+	template<> inline float ATanH<Precise>(float x)
+	{
+		const double a = CopySign((double)x, 1.0f);
+		return (float)CopySign(0.5 * Log1pD(2.0 * a / (1.0 - a)), x);
+	}
+
+)
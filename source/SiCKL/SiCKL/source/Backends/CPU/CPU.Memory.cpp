@@ -0,0 +1,171 @@
+#include "CPU.Memory.h"
+#include "CPU.Scheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#	include <malloc.h>
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// the huge page size of x86-64 and most arm64 kernels
+		static const size_t HugePage = 2 << 20;
+		// smaller buffers come from the heap, a mapping of their own would
+		// mostly be waste
+		static const size_t LargeBuffer = HugePage;
+
+		static size_t round_up(size_t bytes, size_t multiple)
+		{
+			return (bytes + multiple - 1) / multiple * multiple;
+		}
+
+		static void* allocate_small(size_t bytes)
+		{
+#if defined(_WIN32)
+			return _aligned_malloc(bytes, BufferAlignment);
+#else
+			void* result = nullptr;
+			return posix_memalign(&result, BufferAlignment, bytes) == 0 ? result : nullptr;
+#endif
+		}
+
+		static void free_small(void* data)
+		{
+#if defined(_WIN32)
+			_aligned_free(data);
+#else
+			free(data);
+#endif
+		}
+
+#if defined(_WIN32)
+		static void* allocate_large(size_t bytes, CPUHugePages::Type huge_pages)
+		{
+			// large pages need the lock pages privilege, without it the
+			// allocation fails and regular pages have to do
+			const size_t large_page = GetLargePageMinimum();
+			if(huge_pages == CPUHugePages::Explicit && large_page != 0)
+			{
+				void* result = VirtualAlloc(nullptr, round_up(bytes, large_page), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if(result != nullptr)
+				{
+					return result;
+				}
+			}
+			return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		}
+
+		static void free_large(void* data, size_t)
+		{
+			VirtualFree(data, 0, MEM_RELEASE);
+		}
+#else
+		static void* allocate_large(size_t bytes, CPUHugePages::Type huge_pages)
+		{
+			const size_t length = round_up(bytes, HugePage);
+#	if defined(MAP_HUGETLB)
+			if(huge_pages == CPUHugePages::Explicit)
+			{
+				void* result = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+				if(result != MAP_FAILED)
+				{
+					return result;
+				}
+			}
+#	endif
+
+			// map a huge page more than needed and trim both ends so the
+			// buffer starts on a huge page boundary, where the OS can back it
+			// with huge pages from the first byte
+			uint8_t* mapping = (uint8_t*)mmap(nullptr, length + HugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(mapping == (uint8_t*)MAP_FAILED)
+			{
+				return nullptr;
+			}
+			uint8_t* result = (uint8_t*)round_up((size_t)mapping, HugePage);
+			const size_t head = result - mapping;
+			if(head > 0)
+			{
+				munmap(mapping, head);
+			}
+			if(head < HugePage)
+			{
+				munmap(result + length, HugePage - head);
+			}
+
+#	if defined(MADV_HUGEPAGE)
+			madvise(result, length, huge_pages == CPUHugePages::None ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#	endif
+			return result;
+		}
+
+		static void free_large(void* data, size_t bytes)
+		{
+			munmap(data, round_up(bytes, HugePage));
+		}
+#endif
+
+		void* AllocateBuffer(size_t bytes, CPUHugePages::Type huge_pages, bool& out_zeroed)
+		{
+			void* result = nullptr;
+			// fresh mappings are always zero filled
+			out_zeroed = bytes >= LargeBuffer;
+			if(bytes >= LargeBuffer)
+			{
+				result = allocate_large(bytes, huge_pages);
+			}
+			else
+			{
+				result = allocate_small(bytes);
+			}
+			COMPUTE_ASSERT(result != nullptr);
+			return result;
+		}
+
+		void FreeBuffer(void* data, size_t bytes)
+		{
+			if(data == nullptr)
+			{
+				return;
+			}
+
+			if(bytes >= LargeBuffer)
+			{
+				free_large(data, bytes);
+			}
+			else
+			{
+				free_small(data);
+			}
+		}
+
+		void FillBuffer(Scheduler* scheduler, void* data, bool zeroed, const void* source, size_t row_bytes, uint32_t rows)
+		{
+			if(source == nullptr && zeroed)
+			{
+				return;
+			}
+
+			// waking the pool only pays for buffers with pages to place
+			if(scheduler != nullptr && row_bytes * rows >= LargeBuffer)
+			{
+				scheduler->Fill((uint8_t*)data, (const uint8_t*)source, row_bytes, rows);
+			}
+			else if(source == nullptr)
+			{
+				memset(data, 0x00, row_bytes * rows);
+			}
+			else
+			{
+				memcpy(data, source, row_bytes * rows);
+			}
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Backends/CPU.h"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		class Scheduler;
+
+		// every buffer starts on a cache line, so no texel straddles two
+		const size_t BufferAlignment = 64;
+
+		// memory for the contents of a CPU buffer, aligned to BufferAlignment.
+		// Large buffers get their own mapping, backed by huge pages as asked;
+		// out_zeroed tells whether the memory came zero filled, in which case
+		// none of its pages is touched yet
+		void* AllocateBuffer(size_t bytes, CPUHugePages::Type, bool& out_zeroed);
+		// bytes must be what the buffer was allocated with
+		void FreeBuffer(void* data, size_t bytes);
+
+		// copies source into a new buffer of rows x row_bytes, or zeroes it
+		// without a source. On a scheduler each thread writes the rows it
+		// starts a Run with, so first touch puts their pages on its node;
+		// zeroed memory is left for the kernel's threads to touch
+		void FillBuffer(Scheduler*, void* data, bool zeroed, const void* source, size_t row_bytes, uint32_t rows);
+	}
+}
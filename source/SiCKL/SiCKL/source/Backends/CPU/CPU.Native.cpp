@@ -0,0 +1,256 @@
+#include "CPU.Native.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#	include <dlfcn.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// the generated code declares its own copies of these
+		static_assert(sizeof(Value) == 16, "sickl::value layout mismatch");
+		static_assert(sizeof(ReturnType::Type) == sizeof(uint32_t), "sickl::buffer layout mismatch");
+		static_assert(offsetof(Buffer, width) == sizeof(void*) &&
+			offsetof(Buffer, row_pitch) == sizeof(void*) + 8 &&
+			offsetof(Buffer, element_stride) == sizeof(void*) + 8 + sizeof(size_t) &&
+			offsetof(Buffer, type) == sizeof(void*) + 8 + 2 * sizeof(size_t), "sickl::buffer layout mismatch");
+
+#if !defined(_WIN32)
+		// a * b + c is not contracted so the results match the other
+		// executors bit for bit; errno is never read so libm calls can be
+		// replaced by instructions and vectorized
+		static const char* CompilerFlags = "-std=c++11 -O3 -ffp-contract=off -fno-math-errno -fno-trapping-math -fPIC -shared";
+
+		// the target of each instruction set; objects built for one are
+		// cached apart from the others so hosts of different generations can
+		// share a cache directory
+		static const char* TargetFlags(CPUInstructionSet::Type isa)
+		{
+#if defined(__x86_64__) || defined(__i386__)
+			switch(isa)
+			{
+			case CPUInstructionSet::Generic:
+				return "-march=x86-64 -mtune=generic";
+			case CPUInstructionSet::SSE42:
+				return "-march=nehalem -mtune=generic";
+			case CPUInstructionSet::AVX2:
+				return "-march=haswell -mtune=generic";
+			case CPUInstructionSet::AVX512:
+				return "-march=skylake-avx512 -mtune=generic";
+			}
+			COMPUTE_ASSERT(false);
+			return "";
+#else
+			// only Generic exists here
+			(void)isa;
+			return "-march=native";
+#endif
+		}
+
+		// FNV-1a
+		static uint64_t hash(const std::string& str, uint64_t h = 14695981039346656037ull)
+		{
+			for(size_t i = 0; i < str.size(); i++)
+			{
+				h ^= (uint8_t)str[i];
+				h *= 1099511628211ull;
+			}
+			return h;
+		}
+
+		// shared objects are loaded from the cache, so it must be a directory
+		// no one else could have put files in
+		static bool private_directory(const std::string& path)
+		{
+			struct stat info;
+			return lstat(path.c_str(), &info) == 0 &&
+				S_ISDIR(info.st_mode) &&
+				info.st_uid == getuid() &&
+				(info.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+		}
+
+		static std::string temp_directory()
+		{
+			const char* tmp = getenv("TMPDIR");
+			return (tmp != nullptr && *tmp != 0) ? tmp : "/tmp";
+		}
+
+		// a fresh directory for this process alone, empty if none can be made
+		static std::string make_process_directory()
+		{
+			std::string result = temp_directory() + "/sickl-XXXXXX";
+			if(mkdtemp(&result[0]) == nullptr)
+			{
+				printf("Failed to create a cache directory in %s\n", temp_directory().c_str());
+				return std::string();
+			}
+			return result;
+		}
+
+		std::string CacheDirectory()
+		{
+			std::stringstream ss;
+			const char* dir = getenv("SICKL_CACHE_DIR");
+			if(dir != nullptr && *dir != 0)
+			{
+				ss << dir;
+			}
+			else
+			{
+				ss << temp_directory() << "/sickl-" << getuid();
+			}
+			const std::string result = ss.str();
+			// fails harmlessly if it already exists, whoever made it is checked
+			// below
+			mkdir(result.c_str(), 0700);
+			if(private_directory(result))
+			{
+				return result;
+			}
+
+			// another user may have made it first; nothing is shared with
+			// other processes then
+			static const std::string fallback = make_process_directory();
+			return fallback;
+		}
+
+		static bool write_file(const std::string& path, const std::string& contents)
+		{
+			FILE* f = fopen(path.c_str(), "wb");
+			if(f == nullptr)
+			{
+				return false;
+			}
+			const bool written = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+			return (fclose(f) == 0) && written;
+		}
+
+		static std::string read_file(const std::string& path)
+		{
+			std::string result;
+			FILE* f = fopen(path.c_str(), "rb");
+			if(f != nullptr)
+			{
+				char buffer[1024];
+				size_t read;
+				while((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+				{
+					result.append(buffer, read);
+				}
+				fclose(f);
+			}
+			return result;
+		}
+
+		// builds source into the shared object at path
+		static bool compile(const char* compiler, const std::string& flags, const std::string& source, const std::string& path)
+		{
+			// build next to the final object and move it into place when done so
+			// other processes never load a half written file
+			std::stringstream base;
+			base << path << "." << getpid();
+			const std::string source_path = base.str() + ".cpp";
+			const std::string object_path = base.str() + ".so";
+			const std::string log_path = base.str() + ".log";
+
+			if(!write_file(source_path, source))
+			{
+				printf("Failed to write %s\n", source_path.c_str());
+				return false;
+			}
+
+			std::stringstream command;
+			command << compiler << " " << flags << " -o '" << object_path << "' '" << source_path << "' > '" << log_path << "' 2>&1";
+			const int status = system(command.str().c_str());
+
+			bool result = status == 0 && rename(object_path.c_str(), path.c_str()) == 0;
+			if(!result)
+			{
+				printf("Failed to Compile:\n\n%s\n%s", command.str().c_str(), read_file(log_path).c_str());
+				remove(object_path.c_str());
+			}
+
+			remove(log_path.c_str());
+			remove(source_path.c_str());
+			return result;
+		}
+#endif
+
+		NativeKernel* NativeKernel::Load(const std::string& source, const std::string& entry_point, CPUInstructionSet::Type isa)
+		{
+#if defined(_WIN32)
+			(void)source;
+			(void)entry_point;
+			(void)isa;
+			printf("Native kernels are not supported on this platform\n");
+			return nullptr;
+#else
+			// SICKL_CXX picks the compiler, c++ from the path by default
+			const char* compiler = getenv("SICKL_CXX");
+			if(compiler == nullptr || *compiler == 0)
+			{
+				compiler = "c++";
+			}
+
+			const std::string directory = CacheDirectory();
+			if(directory.empty())
+			{
+				return nullptr;
+			}
+
+			// the same source built by another compiler or with other flags
+			// is a different object
+			const std::string flags = std::string(CompilerFlags) + " " + TargetFlags(isa) + (PerfEnabled() ? " -g" : "");
+			std::stringstream ss;
+			ss << directory << "/" << std::hex << hash(source, hash(std::string(compiler) + " " + flags)) << ".so";
+			const std::string path = ss.str();
+
+			if(access(path.c_str(), R_OK) != 0 && !compile(compiler, flags, source, path))
+			{
+				return nullptr;
+			}
+
+			void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if(library == nullptr)
+			{
+				printf("Failed to load %s: %s\n", path.c_str(), dlerror());
+				return nullptr;
+			}
+
+			CompiledKernel function = (CompiledKernel)dlsym(library, entry_point.c_str());
+			if(function == nullptr)
+			{
+				printf("Failed to find %s in %s\n", entry_point.c_str(), path.c_str());
+				dlclose(library);
+				return nullptr;
+			}
+
+			return new NativeKernel(library, function);
+#endif
+		}
+
+		NativeKernel::NativeKernel(void* library, CompiledKernel entry_point)
+			: _library(library)
+			, _entry_point(entry_point)
+		{ }
+
+		NativeKernel::~NativeKernel()
+		{
+#if !defined(_WIN32)
+			dlclose(_library);
+#endif
+		}
+
+		void NativeKernel::Run(const Invocation& invocation, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			_entry_point(invocation.symbols, invocation.buffers, invocation.outputs, invocation.size, x0, y0, x1, y1);
+		}
+	}
+}
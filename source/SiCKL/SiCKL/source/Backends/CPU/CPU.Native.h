@@ -0,0 +1,84 @@
+#pragma once
+
+#include "CPU.Analysis.h"
+#include "CPU.Perf.h"
+
+#include <set>
+#include <sstream>
+#include <string>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// prints a program as a self contained C++ translation unit exporting
+		// the listing's symbol; the generated function loops over the
+		// index domain with the uniforms loaded once up front, and with the
+		// values of an InvarianceAnalysis computed once per run, row or column
+		class NativeCompiler
+		{
+		public:
+			// with a listing path, every statement gets a #line of its AST node
+			static void Print(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUMathAccuracy::Type accuracy, const KernelListing& listing, std::string& out_source);
+		private:
+			NativeCompiler();
+
+			// the T, N of a vec<T, N>
+			void print_type_arguments(Kind::Type, uint32_t count);
+			void print_type(Kind::Type, uint32_t count);
+			void print_type(ReturnType::Type);
+			void print_var(symbol_id_t);
+			void print_indent();
+			void print_line(const ASTNode*);
+			void print_declarations(const ASTNode*);
+			void print_block(const ASTNode* block, uint32_t first_child);
+			void print_statement(const ASTNode*);
+			void print_code(const ASTNode*);
+			// prints node converted to count components of the given kind
+			void print_operand(const ASTNode*, Kind::Type, uint32_t count);
+			void print_call(const char* name, const ASTNode* node);
+			void print_function(const ASTNode*);
+			void print_sample(const ASTNode*);
+			// the local of GetHoisted()[index] and the code computing it
+			void print_hoisted_name(uint32_t index);
+			void print_hoisted_type(uint32_t index);
+			void print_hoisted_value(uint32_t index);
+
+			std::stringstream _ss;
+			uint32_t _indent;
+			// symbols that already have a local
+			std::set<symbol_id_t> _declared;
+			const InvarianceAnalysis* _invariance;
+			// set while printing the hoisted values themselves
+			bool _hoisting;
+			const KernelListing* _listing;
+		};
+
+		// SICKL_CACHE_DIR or a per user directory under TMPDIR, created if
+		// missing. Unless it is a directory of this user's that no one else
+		// can access, a new one for this process only, or empty if even that
+		// fails; not on Windows
+		std::string CacheDirectory();
+
+		// a program compiled by the system C++ compiler into a shared object;
+		// objects are cached on disk by a hash of their source and build flags
+		// so each program is only compiled once per machine and instruction
+		// set. They keep their symbols, and get debug line info with perf
+		// enabled, so profilers see each kernel by name
+		class NativeKernel : public Kernel
+		{
+		public:
+			// builds for isa and looks up entry_point; returns null if the
+			// source could not be compiled or loaded
+			static NativeKernel* Load(const std::string& source, const std::string& entry_point, CPUInstructionSet::Type isa);
+			virtual ~NativeKernel();
+
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+		private:
+			NativeKernel(void* library, CompiledKernel entry_point);
+
+			void* _library;
+			CompiledKernel _entry_point;
+		};
+	}
+}
@@ -0,0 +1,1295 @@
+#include "CPU.Native.h"
+#include "CPU.Math.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// everything the generated code needs; values are fixed size vectors and
+		// every operation is a small inline function with the same semantics as
+		// the other CPU executors, so the compiler is left with plain scalar
+		// code to vectorize
+		static const char* Prelude = R"(#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace sickl
+{
+	// same layout as SiCKL::Internal::Value and SiCKL::Internal::Buffer
+	union value
+	{
+		int32_t i[4];
+		uint32_t u[4];
+		float f[4];
+	};
+
+	struct buffer
+	{
+		uint8_t* data;
+		int32_t width;
+		int32_t height;
+		size_t row_pitch;
+		size_t element_stride;
+		uint32_t type;
+	};
+
+	// bools are stored as 0 or 1 in an int32_t
+	template<typename T, int N>
+	struct vec
+	{
+		T v[N];
+	};
+
+	inline vec<int32_t, 1> lit(int32_t a) { vec<int32_t, 1> r = {{a}}; return r; }
+	inline vec<uint32_t, 1> lit(uint32_t a) { vec<uint32_t, 1> r = {{a}}; return r; }
+	inline vec<float, 1> lit(float a) { vec<float, 1> r = {{a}}; return r; }
+
+	template<typename T>
+	inline vec<T, 2> pair(T a, T b) { vec<T, 2> r = {{a, b}}; return r; }
+
+	template<typename T, int N>
+	inline vec<T, N> load(const value& s) { vec<T, N> r; memcpy(r.v, &s, sizeof(r.v)); return r; }
+
+	template<typename T, int N>
+	inline void store(uint8_t* row, size_t stride, int32_t x, const vec<T, N>& a) { memcpy(row + x * stride, a.v, sizeof(a.v)); }
+
+	/// Conversion
+
+	// converts each component, broadcasting scalars
+	template<typename T, int N, typename S, int M>
+	inline vec<T, N> cvt(const vec<S, M>& a)
+	{
+		vec<T, N> r;
+		for(int k = 0; k < N; k++)
+		{
+			r.v[k] = (T)a.v[M == 1 ? 0 : k];
+		}
+		return r;
+	}
+
+	template<typename T, int N>
+	inline vec<T, 1> get(const vec<T, N>& a, int k) { return lit(a.v[k]); }
+
+	// the components in mask from a, the others from b
+	template<typename T, int N>
+	inline vec<T, N> pick(uint32_t mask, const vec<T, N>& a, const vec<T, N>& b)
+	{
+		vec<T, N> r;
+		for(int k = 0; k < N; k++)
+		{
+			r.v[k] = ((mask >> k) & 1) ? a.v[k] : b.v[k];
+		}
+		return r;
+	}
+
+	template<typename T, int N, int M>
+	inline vec<T, N + M> cat(const vec<T, N>& a, const vec<T, M>& b)
+	{
+		vec<T, N + M> r;
+		memcpy(r.v, a.v, sizeof(a.v));
+		memcpy(r.v + N, b.v, sizeof(b.v));
+		return r;
+	}
+
+	/// Logic, on the bits of the first component
+
+	template<typename T, int N>
+	inline bool truth(const vec<T, N>& a) { int32_t i; memcpy(&i, a.v, sizeof(i)); return i != 0; }
+
+	template<typename A, typename B>
+	inline vec<int32_t, 1> land(const A& a, const B& b) { return lit((int32_t)(truth(a) & truth(b))); }
+	template<typename A, typename B>
+	inline vec<int32_t, 1> lor(const A& a, const B& b) { return lit((int32_t)(truth(a) | truth(b))); }
+	template<typename A>
+	inline vec<int32_t, 1> lnot(const A& a) { return lit((int32_t)!truth(a)); }
+	inline vec<int32_t, 1> tobool(const vec<int32_t, 1>& a) { return lit((int32_t)(a.v[0] != 0)); }
+
+	/// Comparison
+
+#define SICKL_COMPARISON(NAME, OP)\
+	template<typename T>\
+	inline vec<int32_t, 1> NAME(const vec<T, 1>& a, const vec<T, 1>& b) { return lit((int32_t)(a.v[0] OP b.v[0])); }
+
+	SICKL_COMPARISON(eq, ==)
+	SICKL_COMPARISON(ne, !=)
+	SICKL_COMPARISON(gt, >)
+	SICKL_COMPARISON(ge, >=)
+	SICKL_COMPARISON(lt, <)
+	SICKL_COMPARISON(le, <=)
+
+	/// Arithmetic, signed overflow wraps and division by 0 gives 0
+
+	inline int32_t add(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+	inline uint32_t add(uint32_t a, uint32_t b) { return a + b; }
+	inline float add(float a, float b) { return a + b; }
+	inline int32_t sub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+	inline uint32_t sub(uint32_t a, uint32_t b) { return a - b; }
+	inline float sub(float a, float b) { return a - b; }
+	inline int32_t mul(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+	inline uint32_t mul(uint32_t a, uint32_t b) { return a * b; }
+	inline float mul(float a, float b) { return a * b; }
+	inline int32_t quo(int32_t a, int32_t b) { return (b == 0 || (b == -1 && a == INT32_MIN)) ? 0 : a / b; }
+	inline uint32_t quo(uint32_t a, uint32_t b) { return b == 0 ? 0 : a / b; }
+	inline float quo(float a, float b) { return a / b; }
+	inline int32_t rem(int32_t a, int32_t b) { return (b == 0 || b == -1) ? 0 : a % b; }
+	inline uint32_t rem(uint32_t a, uint32_t b) { return b == 0 ? 0 : a % b; }
+	inline float rem(float a, float b) { return std::fmod(a, b); }
+	inline int32_t neg(int32_t a) { return (int32_t)(0u - (uint32_t)a); }
+	inline uint32_t neg(uint32_t a) { return 0u - a; }
+	inline float neg(float a) { return -a; }
+
+	/// Bitwise, shifts are masked to the width of the type
+
+	inline int32_t band(int32_t a, int32_t b) { return a & b; }
+	inline uint32_t band(uint32_t a, uint32_t b) { return a & b; }
+	inline int32_t bor(int32_t a, int32_t b) { return a | b; }
+	inline uint32_t bor(uint32_t a, uint32_t b) { return a | b; }
+	inline int32_t bxor(int32_t a, int32_t b) { return a ^ b; }
+	inline uint32_t bxor(uint32_t a, uint32_t b) { return a ^ b; }
+	inline int32_t bnot(int32_t a) { return ~a; }
+	inline uint32_t bnot(uint32_t a) { return ~a; }
+	inline int32_t shl(int32_t a, int32_t b) { return (int32_t)((uint32_t)a << (b & 31)); }
+	inline uint32_t shl(uint32_t a, uint32_t b) { return a << (b & 31); }
+	inline int32_t shr(int32_t a, int32_t b) { return a >> (b & 31); }
+	inline uint32_t shr(uint32_t a, uint32_t b) { return a >> (b & 31); }
+
+#define SICKL_COMPONENTWISE_1(NAME)\
+	template<typename T, int N>\
+	inline vec<T, N> NAME(const vec<T, N>& a)\
+	{\
+		vec<T, N> r;\
+		for(int k = 0; k < N; k++)\
+		{\
+			r.v[k] = NAME(a.v[k]);\
+		}\
+		return r;\
+	}
+
+#define SICKL_COMPONENTWISE_2(NAME)\
+	template<typename T, int N>\
+	inline vec<T, N> NAME(const vec<T, N>& a, const vec<T, N>& b)\
+	{\
+		vec<T, N> r;\
+		for(int k = 0; k < N; k++)\
+		{\
+			r.v[k] = NAME(a.v[k], b.v[k]);\
+		}\
+		return r;\
+	}
+
+	SICKL_COMPONENTWISE_2(add)
+	SICKL_COMPONENTWISE_2(sub)
+	SICKL_COMPONENTWISE_2(mul)
+	SICKL_COMPONENTWISE_2(quo)
+	SICKL_COMPONENTWISE_2(rem)
+	SICKL_COMPONENTWISE_1(neg)
+	SICKL_COMPONENTWISE_2(band)
+	SICKL_COMPONENTWISE_2(bor)
+	SICKL_COMPONENTWISE_2(bxor)
+	SICKL_COMPONENTWISE_1(bnot)
+	SICKL_COMPONENTWISE_2(shl)
+	SICKL_COMPONENTWISE_2(shr)
+
+	/// Functions, from the math library at the program's accuracy
+
+#define SICKL_FUNCTION_1(NAME, EXPR)\
+	inline vec<float, 1> NAME(const vec<float, 1>& a) { const float x = a.v[0]; return lit((float)(EXPR)); }
+#define SICKL_FUNCTION_2(NAME, EXPR)\
+	inline vec<float, 1> NAME(const vec<float, 1>& a, const vec<float, 1>& b) { const float x = a.v[0]; const float y = b.v[0]; return lit((float)(EXPR)); }
+
+	SICKL_FUNCTION_1(sin, math::Sin<accuracy>(x))
+	SICKL_FUNCTION_1(cos, math::Cos<accuracy>(x))
+	SICKL_FUNCTION_1(tan, math::Tan<accuracy>(x))
+	SICKL_FUNCTION_1(asin, math::ASin<accuracy>(x))
+	SICKL_FUNCTION_1(acos, math::ACos<accuracy>(x))
+	SICKL_FUNCTION_1(atan, math::ATan<accuracy>(x))
+	SICKL_FUNCTION_1(sinh, math::SinH<accuracy>(x))
+	SICKL_FUNCTION_1(cosh, math::CosH<accuracy>(x))
+	SICKL_FUNCTION_1(tanh, math::TanH<accuracy>(x))
+	SICKL_FUNCTION_1(asinh, math::ASinH<accuracy>(x))
+	SICKL_FUNCTION_1(acosh, math::ACosH<accuracy>(x))
+	SICKL_FUNCTION_1(atanh, math::ATanH<accuracy>(x))
+	SICKL_FUNCTION_2(pow, math::Pow<accuracy>(x, y))
+	SICKL_FUNCTION_1(exp, math::Exp<accuracy>(x))
+	SICKL_FUNCTION_1(log, math::Log<accuracy>(x))
+	SICKL_FUNCTION_1(exp2, math::Exp2<accuracy>(x))
+	SICKL_FUNCTION_1(log2, math::Log2<accuracy>(x))
+	SICKL_FUNCTION_1(sqrt, std::sqrt(x))
+	SICKL_FUNCTION_1(abs, std::fabs(x))
+	SICKL_FUNCTION_1(sign, (x > 0.0f) - (x < 0.0f))
+	SICKL_FUNCTION_1(floor, std::floor(x))
+	SICKL_FUNCTION_1(ceil, std::ceil(x))
+	SICKL_FUNCTION_2(min, y < x ? y : x)
+	SICKL_FUNCTION_2(max, x < y ? y : x)
+	SICKL_FUNCTION_1(isnan, std::isnan(x) ? 1.0f : 0.0f)
+	SICKL_FUNCTION_1(isinf, std::isinf(x) ? 1.0f : 0.0f)
+
+	inline vec<float, 1> clamp(const vec<float, 1>& a, const vec<float, 1>& lo, const vec<float, 1>& hi)
+	{
+		const float v = a.v[0] < lo.v[0] ? lo.v[0] : a.v[0];
+		return lit(hi.v[0] < v ? hi.v[0] : v);
+	}
+
+	inline vec<int32_t, 1> abs(const vec<int32_t, 1>& a) { const int32_t x = a.v[0]; return lit(x < 0 ? (int32_t)(0u - (uint32_t)x) : x); }
+	inline vec<int32_t, 1> sign(const vec<int32_t, 1>& a) { const int32_t x = a.v[0]; return lit((int32_t)((x > 0) - (x < 0))); }
+
+	template<int N>
+	inline vec<float, 1> length(const vec<float, N>& a)
+	{
+		float sum = 0.0f;
+		for(int k = 0; k < N; k++)
+		{
+			sum += a.v[k] * a.v[k];
+		}
+		return lit(std::sqrt(sum));
+	}
+
+	template<int N>
+	inline vec<float, 1> distance(const vec<float, N>& a, const vec<float, N>& b)
+	{
+		float sum = 0.0f;
+		for(int k = 0; k < N; k++)
+		{
+			sum += (a.v[k] - b.v[k]) * (a.v[k] - b.v[k]);
+		}
+		return lit(std::sqrt(sum));
+	}
+
+	template<int N>
+	inline vec<float, 1> dot(const vec<float, N>& a, const vec<float, N>& b)
+	{
+		float sum = 0.0f;
+		for(int k = 0; k < N; k++)
+		{
+			sum += a.v[k] * b.v[k];
+		}
+		return lit(sum);
+	}
+
+	inline vec<float, 3> cross(const vec<float, 3>& a, const vec<float, 3>& b)
+	{
+		vec<float, 3> r;
+		r.v[0] = a.v[1] * b.v[2] - a.v[2] * b.v[1];
+		r.v[1] = a.v[2] * b.v[0] - a.v[0] * b.v[2];
+		r.v[2] = a.v[0] * b.v[1] - a.v[1] * b.v[0];
+		return r;
+	}
+
+	template<int N>
+	inline vec<float, N> normalize(const vec<float, N>& a)
+	{
+		float sum = 0.0f;
+		for(int k = 0; k < N; k++)
+		{
+			sum += a.v[k] * a.v[k];
+		}
+		const float scale = 1.0f / std::sqrt(sum);
+		vec<float, N> r;
+		for(int k = 0; k < N; k++)
+		{
+			r.v[k] = a.v[k] * scale;
+		}
+		return r;
+	}
+
+	/// Memory, out of range samples are clamped to the edge
+
+	inline int32_t clamp_index(int32_t i, int32_t count) { return i < 0 ? 0 : (i >= count ? count - 1 : i); }
+
+	template<typename T, int N>
+	inline vec<T, N> sample(const buffer& b, const vec<int32_t, 1>& x, const vec<int32_t, 1>& y)
+	{
+		vec<T, N> r;
+		memcpy(r.v, b.data + clamp_index(y.v[0], b.height) * b.row_pitch + clamp_index(x.v[0], b.width) * b.element_stride, sizeof(r.v));
+		return r;
+	}
+
+	template<typename T, int N>
+	inline vec<T, N> sample(const buffer& b, const vec<int32_t, 2>& xy)
+	{
+		return sample<T, N>(b, lit(xy.v[0]), lit(xy.v[1]));
+	}
+
+)";
+
+		NativeCompiler::NativeCompiler()
+			: _indent(0)
+			, _invariance(nullptr)
+			, _hoisting(false)
+			, _listing(nullptr)
+		{ }
+
+		void NativeCompiler::Print(const ASTNode* uniforms, const ASTNode* outputs, const ASTNode* main, CPUMathAccuracy::Type accuracy, const KernelListing& listing, std::string& out_source)
+		{
+			NativeCompiler nc;
+			std::stringstream& ss = nc._ss;
+			nc._listing = &listing;
+
+			// the math library goes first, in its own namespace
+			ss << "#include <cmath>\n#include <cstdint>\n#include <cstring>\n\n";
+			ss << "namespace sickl\n{\n\tnamespace math\n\t{\n\t\t" << Math::Source << "\n\t}\n\n";
+			ss << "\tconst int accuracy = " << (int)accuracy << ";\n}\n\n";
+			ss << Prelude;
+			ss << "\textern \"C\" void " << listing.symbol << "(const value* symbols, const buffer* buffers, const buffer* outputs, const int32_t* size, int32_t x0, int32_t y0, int32_t x1, int32_t y1)" << std::endl;
+			ss << "\t{" << std::endl;
+			nc._indent = 2;
+			// the loops and loads belong to main as a whole
+			nc.print_line(main);
+
+			// uniforms are loaded once for the whole run
+			for(uint32_t i = 0; i < uniforms->_count; i++)
+			{
+				const ASTNode* n = uniforms->_children[i];
+				nc.print_indent();
+				if(n->_return_type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+				{
+					ss << "const buffer& ";
+					nc.print_var(n->_u.sid);
+					ss << " = buffers[" << n->_u.sid << "];" << std::endl;
+				}
+				else
+				{
+					ss << "const ";
+					nc.print_type(n->_return_type);
+					ss << " ";
+					nc.print_var(n->_u.sid);
+					ss << " = load<";
+					nc.print_type_arguments(ComponentKind(n->_return_type), ComponentCount(n->_return_type));
+					ss << ">(symbols[" << n->_u.sid << "]);" << std::endl;
+				}
+				nc._declared.insert(n->_u.sid);
+			}
+			nc.print_indent();
+			ss << "const int32_t width = size[0];" << std::endl;
+			nc.print_indent();
+			ss << "const int32_t height = size[1];" << std::endl;
+
+			InvarianceAnalysis invariance(uniforms, main);
+			const std::vector<HoistedValue>& hoisted = invariance.GetHoisted();
+			nc._invariance = &invariance;
+			nc._hoisting = true;
+			bool columns = false;
+			bool rows = false;
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				columns |= hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split;
+				rows |= hoisted[k].invariance == Invariance::Row || hoisted[k].invariance == Invariance::Split;
+				if(hoisted[k].node->_node_type == NodeType::Assignment)
+				{
+					nc._declared.insert(hoisted[k].node->_children[0]->_u.sid);
+				}
+			}
+
+			// values the same in every element
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				if(hoisted[k].invariance == Invariance::Run)
+				{
+					nc.print_line(hoisted[k].node);
+					nc.print_indent();
+					ss << "const ";
+					nc.print_hoisted_type(k);
+					ss << " ";
+					nc.print_hoisted_name(k);
+					ss << " = ";
+					nc.print_hoisted_value(k);
+					ss << ";" << std::endl;
+				}
+			}
+
+			// values of Index().X alone go into a table with an entry per column,
+			// the Vars they read are computed along
+			if(columns)
+			{
+				nc.print_line(main);
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					if(hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split)
+					{
+						nc.print_indent();
+						ss << "std::vector<";
+						nc.print_hoisted_type(k);
+						ss << " > column_";
+						nc.print_hoisted_name(k);
+						ss << "(x1 - x0);" << std::endl;
+					}
+				}
+				nc.print_indent();
+				ss << "for(int32_t x = x0; x < x1; x++)" << std::endl;
+				nc.print_indent();
+				ss << "{" << std::endl;
+				nc._indent++;
+				nc.print_indent();
+				ss << "const int32_t y = y0;" << std::endl;
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					const bool var = hoisted[k].node->_node_type == NodeType::Assignment;
+					const bool column = hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split;
+					if(var || column)
+					{
+						nc.print_line(hoisted[k].node);
+					}
+					if(var && hoisted[k].invariance != Invariance::Run)
+					{
+						nc.print_indent();
+						ss << "const ";
+						nc.print_hoisted_type(k);
+						ss << " ";
+						nc.print_hoisted_name(k);
+						ss << " = ";
+						nc.print_hoisted_value(k);
+						ss << ";" << std::endl;
+					}
+					if(column)
+					{
+						nc.print_indent();
+						ss << "column_";
+						nc.print_hoisted_name(k);
+						ss << "[x - x0] = ";
+						if(var)
+						{
+							nc.print_hoisted_name(k);
+						}
+						else
+						{
+							nc.print_hoisted_value(k);
+						}
+						ss << ";" << std::endl;
+					}
+				}
+				nc._indent--;
+				nc.print_indent();
+				ss << "}" << std::endl;
+			}
+
+			nc.print_line(main);
+			nc.print_indent();
+			ss << "for(int32_t y = y0; y < y1; y++)" << std::endl;
+			nc.print_indent();
+			ss << "{" << std::endl;
+			nc._indent++;
+			for(uint32_t i = 0; i < outputs->_count; i++)
+			{
+				nc.print_indent();
+				ss << "uint8_t* out" << i << " = outputs[" << i << "].data + y * outputs[" << i << "].row_pitch;" << std::endl;
+			}
+
+			// and the values of Index().Y alone once per row
+			if(rows)
+			{
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					if(hoisted[k].invariance == Invariance::Row || hoisted[k].invariance == Invariance::Split)
+					{
+						nc.print_indent();
+						nc.print_hoisted_type(k);
+						ss << (hoisted[k].invariance == Invariance::Split ? " row_" : " ");
+						nc.print_hoisted_name(k);
+						ss << ";" << std::endl;
+					}
+				}
+				nc.print_indent();
+				ss << "{" << std::endl;
+				nc._indent++;
+				nc.print_indent();
+				ss << "const int32_t x = x0;" << std::endl;
+				for(uint32_t k = 0; k < hoisted.size(); k++)
+				{
+					const bool var = hoisted[k].node->_node_type == NodeType::Assignment;
+					if(hoisted[k].invariance == Invariance::Run || (!var && hoisted[k].invariance != Invariance::Row))
+					{
+						continue;
+					}
+					nc.print_line(hoisted[k].node);
+					nc.print_indent();
+					if(hoisted[k].invariance != Invariance::Row)
+					{
+						ss << "const ";
+						nc.print_hoisted_type(k);
+						ss << " ";
+					}
+					nc.print_hoisted_name(k);
+					ss << " = ";
+					nc.print_hoisted_value(k);
+					ss << ";" << std::endl;
+					if(hoisted[k].invariance == Invariance::Split)
+					{
+						nc.print_indent();
+						ss << "row_";
+						nc.print_hoisted_name(k);
+						ss << " = ";
+						nc.print_hoisted_name(k);
+						ss << ";" << std::endl;
+					}
+				}
+				nc._indent--;
+				nc.print_indent();
+				ss << "}" << std::endl;
+			}
+
+			nc.print_line(main);
+			nc.print_indent();
+			ss << "for(int32_t x = x0; x < x1; x++)" << std::endl;
+			nc.print_indent();
+			ss << "{" << std::endl;
+			nc._indent++;
+			nc._hoisting = false;
+
+			for(uint32_t k = 0; k < hoisted.size(); k++)
+			{
+				if(hoisted[k].invariance == Invariance::Column || hoisted[k].invariance == Invariance::Split)
+				{
+					nc.print_line(hoisted[k].node);
+					nc.print_indent();
+					ss << "const ";
+					nc.print_hoisted_type(k);
+					ss << " ";
+					nc.print_hoisted_name(k);
+					ss << " = ";
+					if(hoisted[k].invariance == Invariance::Split)
+					{
+						ss << "pick(" << hoisted[k].column_components << "u, column_";
+						nc.print_hoisted_name(k);
+						ss << "[x - x0], row_";
+						nc.print_hoisted_name(k);
+						ss << ")";
+					}
+					else
+					{
+						ss << "column_";
+						nc.print_hoisted_name(k);
+						ss << "[x - x0]";
+					}
+					ss << ";" << std::endl;
+				}
+			}
+
+			// every element starts with its variables and outputs at 0
+			nc.print_line(main);
+			nc.print_declarations(outputs);
+			nc.print_declarations(main);
+
+			nc.print_block(main, 0);
+
+			nc.print_line(main);
+			for(uint32_t i = 0; i < outputs->_count; i++)
+			{
+				nc.print_indent();
+				ss << "store(out" << i << ", outputs[" << i << "].element_stride, x, ";
+				nc.print_var(outputs->_children[i]->_u.sid);
+				ss << ");" << std::endl;
+			}
+
+			nc._indent--;
+			nc.print_indent();
+			ss << "}" << std::endl;
+			nc._indent--;
+			nc.print_indent();
+			ss << "}" << std::endl;
+			ss << "\t}" << std::endl;
+			ss << "}" << std::endl;
+
+			out_source = ss.str();
+		}
+
+		void NativeCompiler::print_type_arguments(Kind::Type kind, uint32_t count)
+		{
+			switch(kind)
+			{
+			case Kind::Bool:
+			case Kind::Int:
+				_ss << "int32_t, " << count;
+				break;
+			case Kind::UInt:
+				_ss << "uint32_t, " << count;
+				break;
+			case Kind::Float:
+				_ss << "float, " << count;
+				break;
+			}
+		}
+
+		void NativeCompiler::print_type(Kind::Type kind, uint32_t count)
+		{
+			_ss << "vec<";
+			print_type_arguments(kind, count);
+			_ss << ">";
+		}
+
+		void NativeCompiler::print_type(ReturnType::Type type)
+		{
+			print_type(ComponentKind(type), ComponentCount(type));
+		}
+
+		void NativeCompiler::print_var(symbol_id_t sid)
+		{
+			_ss << "v" << sid;
+		}
+
+		void NativeCompiler::print_indent()
+		{
+			for(uint32_t i = 0; i < _indent; i++)
+			{
+				_ss << "\t";
+			}
+		}
+
+		void NativeCompiler::print_line(const ASTNode* node)
+		{
+			if(!_listing->path.empty())
+			{
+				_ss << "#line " << _listing->Line(node) << " \"" << _listing->path << "\"" << std::endl;
+			}
+		}
+
+		void NativeCompiler::print_declarations(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+				if(_declared.find(node->_u.sid) == _declared.end())
+				{
+					print_indent();
+					print_type(node->_return_type);
+					_ss << " ";
+					print_var(node->_u.sid);
+					_ss << " = {};" << std::endl;
+					_declared.insert(node->_u.sid);
+				}
+				break;
+			default:
+				break;
+			}
+
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				print_declarations(node->_children[i]);
+			}
+		}
+
+		void NativeCompiler::print_block(const ASTNode* block, uint32_t first_child)
+		{
+			for(uint32_t i = first_child; i < block->_count; i++)
+			{
+				// hoisted Vars are already set
+				const ASTNode* node = block->_children[i];
+				if(node->_node_type == NodeType::Assignment && _invariance->Find(node) >= 0)
+				{
+					continue;
+				}
+				print_line(node);
+				print_indent();
+				print_statement(block->_children[i]);
+			}
+		}
+
+		void NativeCompiler::print_statement(const ASTNode* node)
+		{
+			switch(node->_node_type)
+			{
+			case NodeType::Block:
+				_ss << "{" << std::endl;
+				_indent++;
+				print_block(node, 0);
+				_indent--;
+				print_indent();
+				_ss << "}" << std::endl;
+				break;
+			case NodeType::If:
+			case NodeType::ElseIf:
+			case NodeType::While:
+				COMPUTE_ASSERT(node->_count >= 1);
+				_ss << (node->_node_type == NodeType::If ? "if" : (node->_node_type == NodeType::ElseIf ? "else if" : "while"));
+				_ss << "(truth(";
+				print_code(node->_children[0]);
+				_ss << "))" << std::endl;
+				print_indent();
+				_ss << "{" << std::endl;
+				_indent++;
+				print_block(node, 1);
+				_indent--;
+				print_indent();
+				_ss << "}" << std::endl;
+				break;
+			case NodeType::Else:
+				_ss << "else" << std::endl;
+				print_indent();
+				_ss << "{" << std::endl;
+				_indent++;
+				print_block(node, 0);
+				_indent--;
+				print_indent();
+				_ss << "}" << std::endl;
+				break;
+			case NodeType::ForInRange:
+				COMPUTE_ASSERT(node->_count >= 3);
+				COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+				COMPUTE_ASSERT(node->_children[2]->_node_type == NodeType::Literal);
+				{
+					const symbol_id_t sid = node->_children[0]->_u.sid;
+					_ss << "for(";
+					print_var(sid);
+					_ss << ".v[0] = " << *(int32_t*)node->_children[1]->_u.literal.data << "; ";
+					print_var(sid);
+					_ss << ".v[0] < " << *(int32_t*)node->_children[2]->_u.literal.data << "; ";
+					print_var(sid);
+					_ss << ".v[0]++)" << std::endl;
+				}
+				print_indent();
+				_ss << "{" << std::endl;
+				_indent++;
+				print_block(node, 3);
+				_indent--;
+				print_indent();
+				_ss << "}" << std::endl;
+				break;
+			case NodeType::Assignment:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					const ASTNode* dest = node->_children[0];
+					const Kind::Type kind = ComponentKind(dest->_return_type);
+					switch(dest->_node_type)
+					{
+					case NodeType::Var:
+					case NodeType::OutVar:
+						print_var(dest->_u.sid);
+						_ss << " = ";
+						print_operand(node->_children[1], kind, ComponentCount(dest->_return_type));
+						break;
+					case NodeType::Member:
+						COMPUTE_ASSERT(dest->_children[0]->_node_type == NodeType::Var);
+						COMPUTE_ASSERT(dest->_children[1]->_node_type == NodeType::Literal);
+						print_var(dest->_children[0]->_u.sid);
+						_ss << ".v[" << *(int32_t*)dest->_children[1]->_u.literal.data << "] = ";
+						print_operand(node->_children[1], kind, 1);
+						_ss << ".v[0]";
+						break;
+					default:
+						// can't assign to this
+						COMPUTE_ASSERT(false);
+					}
+				}
+				_ss << ";" << std::endl;
+				break;
+			default:
+				// expression statement
+				_ss << "(void)";
+				print_code(node);
+				_ss << ";" << std::endl;
+				break;
+			}
+		}
+
+		void NativeCompiler::print_operand(const ASTNode* node, Kind::Type kind, uint32_t count)
+		{
+			const Kind::Type node_kind = ComponentKind(node->_return_type);
+			const uint32_t node_count = ComponentCount(node->_return_type);
+
+			// bools and ints are both stored as int32_t
+			const bool same_storage = (node_kind == kind) ||
+				((node_kind == Kind::Bool || node_kind == Kind::Int) && (kind == Kind::Bool || kind == Kind::Int));
+			if(same_storage && node_count == count)
+			{
+				print_code(node);
+				return;
+			}
+			COMPUTE_ASSERT(node_count == 1 || node_count == count);
+
+			_ss << "cvt<";
+			print_type_arguments(kind, count);
+			_ss << ">(";
+			print_code(node);
+			_ss << ")";
+		}
+
+		// prints name(a, b, ...) with every child converted to the type of node
+		void NativeCompiler::print_call(const char* name, const ASTNode* node)
+		{
+			const Kind::Type kind = ComponentKind(node->_return_type);
+			const uint32_t count = ComponentCount(node->_return_type);
+
+			_ss << name << "(";
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				if(i > 0)
+				{
+					_ss << ", ";
+				}
+				print_operand(node->_children[i], kind, count);
+			}
+			_ss << ")";
+		}
+
+		void NativeCompiler::print_code(const ASTNode* node)
+		{
+			const int32_t hoisted = _hoisting ? -1 : _invariance->Find(node);
+			if(hoisted >= 0)
+			{
+				print_hoisted_name(hoisted);
+				return;
+			}
+
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::OutVar:
+			case NodeType::ConstVar:
+				print_var(node->_u.sid);
+				break;
+			case NodeType::Literal:
+				switch(node->_return_type)
+				{
+				case ReturnType::Bool:
+					_ss << "lit(" << (*(bool*)node->_u.literal.data ? 1 : 0) << ")";
+					break;
+				case ReturnType::Int:
+					{
+						const int32_t val = *(int32_t*)node->_u.literal.data;
+						if(val == INT_MIN)
+						{
+							// -2147483648 is the negation of a literal too large for an int
+							_ss << "lit(-2147483647 - 1)";
+						}
+						else
+						{
+							_ss << "lit(" << val << ")";
+						}
+					}
+					break;
+				case ReturnType::UInt:
+					_ss << "lit(" << *(uint32_t*)node->_u.literal.data << "u)";
+					break;
+				case ReturnType::Float:
+					{
+						const float val = *(float*)node->_u.literal.data;
+						if(isnan(val))
+						{
+							_ss << "lit(NAN)";
+						}
+						else if(isinf(val))
+						{
+							_ss << (val < 0.0f ? "lit(-INFINITY)" : "lit(INFINITY)");
+						}
+						else
+						{
+							char buffer[24] = {0};
+							sprintf(buffer, "%.9e", val);
+							_ss << "lit(" << buffer << "f)";
+						}
+					}
+					break;
+				default:
+					COMPUTE_ASSERT(false);
+				}
+				break;
+			case NodeType::Member:
+				COMPUTE_ASSERT(node->_count == 2);
+				COMPUTE_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+				_ss << "get(";
+				print_code(node->_children[0]);
+				_ss << ", " << *(int32_t*)node->_children[1]->_u.literal.data << ")";
+				break;
+			/// Comparison
+			case NodeType::Equal:
+			case NodeType::NotEqual:
+			case NodeType::Greater:
+			case NodeType::GreaterEqual:
+			case NodeType::Less:
+			case NodeType::LessEqual:
+				COMPUTE_ASSERT(node->_count == 2);
+				{
+					const ASTNode* left = node->_children[0];
+					const ASTNode* right = node->_children[1];
+					const Kind::Type kind = PromotedKind(ComponentKind(left->_return_type), ComponentKind(right->_return_type));
+					switch(node->_node_type)
+					{
+					case NodeType::Equal:
+						_ss << "eq(";
+						break;
+					case NodeType::NotEqual:
+						_ss << "ne(";
+						break;
+					case NodeType::Greater:
+						_ss << "gt(";
+						break;
+					case NodeType::GreaterEqual:
+						_ss << "ge(";
+						break;
+					case NodeType::Less:
+						_ss << "lt(";
+						break;
+					default:
+						_ss << "le(";
+						break;
+					}
+					print_operand(left, kind, 1);
+					_ss << ", ";
+					print_operand(right, kind, 1);
+					_ss << ")";
+				}
+				break;
+			/// Logical, both sides are evaluated like the GPU would
+			case NodeType::LogicalAnd:
+				COMPUTE_ASSERT(node->_count == 2);
+				_ss << "land(";
+				print_code(node->_children[0]);
+				_ss << ", ";
+				print_code(node->_children[1]);
+				_ss << ")";
+				break;
+			case NodeType::LogicalOr:
+				COMPUTE_ASSERT(node->_count == 2);
+				_ss << "lor(";
+				print_code(node->_children[0]);
+				_ss << ", ";
+				print_code(node->_children[1]);
+				_ss << ")";
+				break;
+			case NodeType::LogicalNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				_ss << "lnot(";
+				print_code(node->_children[0]);
+				_ss << ")";
+				break;
+			/// Bitwise
+			case NodeType::BitwiseAnd:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("band", node);
+				break;
+			case NodeType::BitwiseOr:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("bor", node);
+				break;
+			case NodeType::BitwiseXor:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("bxor", node);
+				break;
+			case NodeType::BitwiseNot:
+				COMPUTE_ASSERT(node->_count == 1);
+				_ss << "bnot(";
+				print_code(node->_children[0]);
+				_ss << ")";
+				break;
+			case NodeType::LeftShift:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("shl", node);
+				break;
+			case NodeType::RightShift:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("shr", node);
+				break;
+			/// Arithmetic
+			case NodeType::UnaryMinus:
+				COMPUTE_ASSERT(node->_count == 1);
+				_ss << "neg(";
+				print_code(node->_children[0]);
+				_ss << ")";
+				break;
+			case NodeType::Add:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("add", node);
+				break;
+			case NodeType::Subtract:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("sub", node);
+				break;
+			case NodeType::Multiply:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("mul", node);
+				break;
+			case NodeType::Divide:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("quo", node);
+				break;
+			case NodeType::Modulo:
+				COMPUTE_ASSERT(node->_count == 2);
+				print_call("rem", node);
+				break;
+			/// Functions
+			case NodeType::Constructor:
+				{
+					const Kind::Type kind = ComponentKind(node->_return_type);
+					const uint32_t count = ComponentCount(node->_return_type);
+					if(node->_count == 1 && ComponentCount(node->_children[0]->_return_type) == 1)
+					{
+						// broadcast a single scalar
+						print_operand(node->_children[0], kind, count);
+						break;
+					}
+					// concatenate the components of each child
+					for(uint32_t i = 1; i < node->_count; i++)
+					{
+						_ss << "cat(";
+					}
+					for(uint32_t i = 0; i < node->_count; i++)
+					{
+						const ASTNode* child = node->_children[i];
+						if(i > 0)
+						{
+							_ss << ", ";
+						}
+						print_operand(child, kind, ComponentCount(child->_return_type));
+						if(i > 0)
+						{
+							_ss << ")";
+						}
+					}
+				}
+				break;
+			case NodeType::Cast:
+				COMPUTE_ASSERT(node->_count == 1);
+				if(node->_return_type == ReturnType::Bool)
+				{
+					_ss << "tobool(";
+					print_operand(node->_children[0], Kind::Bool, 1);
+					_ss << ")";
+				}
+				else
+				{
+					print_operand(node->_children[0], ComponentKind(node->_return_type), ComponentCount(node->_return_type));
+				}
+				break;
+			case NodeType::Function:
+				COMPUTE_ASSERT(node->_count >= 1);
+				print_function(node);
+				break;
+			case NodeType::Sample1D:
+			case NodeType::Sample2D:
+				print_sample(node);
+				break;
+			case NodeType::GetIndex:
+				_ss << "pair(x, y)";
+				break;
+			case NodeType::GetNormalizedIndex:
+				// sampled at the center of each element like the OpenGL backend
+				_ss << "pair((x + 0.5f) / width, (y + 0.5f) / height)";
+				break;
+			default:
+				// unknown AST node type
+				COMPUTE_ASSERT(false);
+			}
+		}
+
+		void NativeCompiler::print_function(const ASTNode* node)
+		{
+			COMPUTE_ASSERT(node->_children[0]->_node_type == NodeType::Literal);
+			COMPUTE_ASSERT(node->_children[0]->_return_type == ReturnType::Int);
+			const int32_t func_id = (*(int32_t*)node->_children[0]->_u.literal.data);
+
+			// the vector math functions work on the width of their first argument
+			const uint32_t arg_count = node->_count > 1 ? ComponentCount(node->_children[1]->_return_type) : 0;
+			Kind::Type arg_kind = Kind::Float;
+
+			const char* name = nullptr;
+			switch(func_id)
+			{
+			case BuiltinFunction::Index:
+				COMPUTE_ASSERT(node->_count == 1);
+				_ss << "pair(x, y)";
+				return;
+			case BuiltinFunction::NormalizedIndex:
+				COMPUTE_ASSERT(node->_count == 1);
+				_ss << "pair((x + 0.5f) / width, (y + 0.5f) / height)";
+				return;
+			case BuiltinFunction::Sin:
+				name = "sin";
+				break;
+			case BuiltinFunction::Cos:
+				name = "cos";
+				break;
+			case BuiltinFunction::Tan:
+				name = "tan";
+				break;
+			case BuiltinFunction::ASin:
+				name = "asin";
+				break;
+			case BuiltinFunction::ACos:
+				name = "acos";
+				break;
+			case BuiltinFunction::ATan:
+				name = "atan";
+				break;
+			case BuiltinFunction::SinH:
+				name = "sinh";
+				break;
+			case BuiltinFunction::CosH:
+				name = "cosh";
+				break;
+			case BuiltinFunction::TanH:
+				name = "tanh";
+				break;
+			case BuiltinFunction::ASinH:
+				name = "asinh";
+				break;
+			case BuiltinFunction::ACosH:
+				name = "acosh";
+				break;
+			case BuiltinFunction::ATanH:
+				name = "atanh";
+				break;
+			case BuiltinFunction::Pow:
+				COMPUTE_ASSERT(node->_count == 3);
+				name = "pow";
+				break;
+			case BuiltinFunction::Exp:
+				name = "exp";
+				break;
+			case BuiltinFunction::Log:
+				name = "log";
+				break;
+			case BuiltinFunction::Exp2:
+				name = "exp2";
+				break;
+			case BuiltinFunction::Log2:
+				name = "log2";
+				break;
+			case BuiltinFunction::Sqrt:
+				name = "sqrt";
+				break;
+			case BuiltinFunction::Abs:
+			case BuiltinFunction::Sign:
+				COMPUTE_ASSERT(node->_count == 2);
+				name = func_id == BuiltinFunction::Abs ? "abs" : "sign";
+				// integer versions
+				if(ComponentKind(node->_return_type) == Kind::Int)
+				{
+					arg_kind = Kind::Int;
+				}
+				break;
+			case BuiltinFunction::Floor:
+				name = "floor";
+				break;
+			case BuiltinFunction::Ceiling:
+				name = "ceil";
+				break;
+			case BuiltinFunction::Min:
+				COMPUTE_ASSERT(node->_count == 3);
+				name = "min";
+				break;
+			case BuiltinFunction::Max:
+				COMPUTE_ASSERT(node->_count == 3);
+				name = "max";
+				break;
+			case BuiltinFunction::Clamp:
+				COMPUTE_ASSERT(node->_count == 4);
+				name = "clamp";
+				break;
+			case BuiltinFunction::IsNan:
+				name = "isnan";
+				break;
+			case BuiltinFunction::IsInf:
+				name = "isinf";
+				break;
+			case BuiltinFunction::Length:
+				name = "length";
+				break;
+			case BuiltinFunction::Distance:
+				COMPUTE_ASSERT(node->_count == 3);
+				name = "distance";
+				break;
+			case BuiltinFunction::Dot:
+				COMPUTE_ASSERT(node->_count == 3);
+				name = "dot";
+				break;
+			case BuiltinFunction::Cross:
+				COMPUTE_ASSERT(node->_count == 3);
+				COMPUTE_ASSERT(arg_count == 3);
+				name = "cross";
+				break;
+			case BuiltinFunction::Normalize:
+				name = "normalize";
+				break;
+			default:
+				// unknown function
+				COMPUTE_ASSERT(false);
+				return;
+			}
+
+			_ss << name << "(";
+			for(uint32_t i = 1; i < node->_count; i++)
+			{
+				if(i > 1)
+				{
+					_ss << ", ";
+				}
+				print_operand(node->_children[i], arg_kind, arg_kind == Kind::Int ? 1 : arg_count);
+			}
+			_ss << ")";
+		}
+
+		void NativeCompiler::print_sample(const ASTNode* node)
+		{
+			const ASTNode* source = node->_children[0];
+			COMPUTE_ASSERT(source->_node_type == NodeType::ConstVar);
+
+			_ss << "sample<";
+			print_type_arguments(ComponentKind(source->_return_type), ComponentCount(source->_return_type));
+			_ss << ">(";
+			print_var(source->_u.sid);
+			_ss << ", ";
+			if(node->_node_type == NodeType::Sample1D)
+			{
+				COMPUTE_ASSERT(node->_count == 2);
+				print_operand(node->_children[1], Kind::Int, 1);
+				_ss << ", lit(0)";
+			}
+			else if(node->_count == 2)
+			{
+				COMPUTE_ASSERT(node->_children[1]->_return_type == ReturnType::Int2);
+				print_code(node->_children[1]);
+			}
+			else
+			{
+				COMPUTE_ASSERT(node->_count == 3);
+				print_operand(node->_children[1], Kind::Int, 1);
+				_ss << ", ";
+				print_operand(node->_children[2], Kind::Int, 1);
+			}
+			_ss << ")";
+		}
+
+		void NativeCompiler::print_hoisted_name(uint32_t index)
+		{
+			const ASTNode* node = _invariance->GetHoisted()[index].node;
+			if(node->_node_type == NodeType::Assignment)
+			{
+				print_var(node->_children[0]->_u.sid);
+			}
+			else
+			{
+				_ss << "h" << index;
+			}
+		}
+
+		void NativeCompiler::print_hoisted_type(uint32_t index)
+		{
+			const ASTNode* node = _invariance->GetHoisted()[index].node;
+			print_type(node->_node_type == NodeType::Assignment ? node->_children[0]->_return_type : node->_return_type);
+		}
+
+		void NativeCompiler::print_hoisted_value(uint32_t index)
+		{
+			const ASTNode* node = _invariance->GetHoisted()[index].node;
+			if(node->_node_type == NodeType::Assignment)
+			{
+				const ASTNode* dest = node->_children[0];
+				print_operand(node->_children[1], ComponentKind(dest->_return_type), ComponentCount(dest->_return_type));
+			}
+			else
+			{
+				print_code(node);
+			}
+		}
+	}
+}
@@ -0,0 +1,200 @@
+#include "CPU.Perf.h"
+#include "CPU.Native.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <typeinfo>
+
+#if defined(__GNUC__)
+#	include <cxxabi.h>
+#endif
+#if !defined(_WIN32)
+#	include <unistd.h>
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		uint32_t KernelListing::Line(const ASTNode* node) const
+		{
+			std::map<const ASTNode*, uint32_t>::const_iterator it = lines.find(node);
+			return it != lines.end() ? it->second : 1;
+		}
+
+		bool PerfEnabled()
+		{
+#if defined(_WIN32)
+			return false;
+#else
+			const char* perf = getenv("SICKL_PERF");
+			return perf != nullptr && *perf != 0 && strcmp(perf, "0") != 0;
+#endif
+		}
+
+		// the class name as written, made an identifier
+		static std::string class_name(const Source& source)
+		{
+			std::string name = typeid(source).name();
+#if defined(__GNUC__)
+			int status = 0;
+			char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+			if(demangled != nullptr)
+			{
+				name = demangled;
+				free(demangled);
+			}
+#else
+			// MSVC names are readable already, "class Mandelbrot"
+			if(name.compare(0, 6, "class ") == 0)
+			{
+				name = name.substr(6);
+			}
+			else if(name.compare(0, 7, "struct ") == 0)
+			{
+				name = name.substr(7);
+			}
+#endif
+
+			std::string result;
+			for(size_t i = 0; i < name.size(); i++)
+			{
+				const char c = name[i];
+				const bool identifier = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+				if(identifier)
+				{
+					result += c;
+				}
+				else if(c == ':' && i + 1 < name.size() && name[i + 1] == ':')
+				{
+					// Namespace::Class is Namespace_Class
+					result += '_';
+					i++;
+				}
+				else if(c != ' ')
+				{
+					result += '_';
+				}
+			}
+			return result;
+		}
+
+		// a line for node and each of its children, indented by depth
+		static void list(const ASTNode* node, uint32_t depth, std::stringstream& ss, KernelListing& out_listing)
+		{
+			out_listing.lines[node] = (uint32_t)out_listing.lines.size() + 1;
+
+			for(uint32_t i = 0; i < depth; i++)
+			{
+				ss << "  ";
+			}
+			ss << NodeTypes[node->_node_type + 1] << " -> " << GetReturnType(node->_return_type);
+			switch(node->_node_type)
+			{
+			case NodeType::Var:
+			case NodeType::ConstVar:
+			case NodeType::OutVar:
+				ss << ", symbol = " << node->_u.sid;
+				if(node->_name != nullptr)
+				{
+					ss << ", name = " << node->_name;
+				}
+				break;
+			case NodeType::Literal:
+				switch(node->_return_type)
+				{
+				case ReturnType::Bool:
+					ss << ", val = " << (*(bool*)node->_u.literal.data ? "true" : "false");
+					break;
+				case ReturnType::Int:
+					ss << ", val = " << *(int32_t*)node->_u.literal.data;
+					break;
+				case ReturnType::UInt:
+					ss << ", val = " << *(uint32_t*)node->_u.literal.data;
+					break;
+				case ReturnType::Float:
+					ss << ", val = " << *(float*)node->_u.literal.data;
+					break;
+				default:
+					break;
+				}
+				break;
+			default:
+				break;
+			}
+			ss << "\n";
+
+			for(uint32_t i = 0; i < node->_count; i++)
+			{
+				list(node->_children[i], depth + 1, ss, out_listing);
+			}
+		}
+
+		void ListKernel(const Source& source, const ASTNode* main, KernelListing& out_listing)
+		{
+			const std::string name = class_name(source);
+			out_listing.symbol = "sickl_" + name;
+			out_listing.path.clear();
+			out_listing.lines.clear();
+
+			std::stringstream ss;
+			list(main, 0, ss, out_listing);
+
+			if(!PerfEnabled())
+			{
+				return;
+			}
+
+#if !defined(_WIN32)
+			const std::string directory = CacheDirectory();
+			if(directory.empty())
+			{
+				return;
+			}
+
+			const std::string contents = ss.str();
+			std::stringstream path;
+			path << directory << "/" << name << "." << std::hex << std::hash<std::string>()(contents) << ".sickl";
+			out_listing.path = path.str();
+
+			// written once, the name already says what is in it
+			if(access(out_listing.path.c_str(), R_OK) != 0)
+			{
+				FILE* f = fopen(out_listing.path.c_str(), "wb");
+				if(f != nullptr)
+				{
+					fwrite(contents.data(), 1, contents.size(), f);
+					fclose(f);
+				}
+			}
+#endif
+		}
+
+		void AddPerfMapSymbol(uint64_t address, uint64_t size, const std::string& name)
+		{
+#if defined(_WIN32)
+			(void)address;
+			(void)size;
+			(void)name;
+#else
+			// kernels may be built on several threads at once
+			static std::mutex lock;
+			std::lock_guard<std::mutex> guard(lock);
+
+			char path[64];
+			snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+			FILE* f = fopen(path, "a");
+			if(f != nullptr)
+			{
+				fprintf(f, "%llx %llx %s\n", (unsigned long long)address, (unsigned long long)size, name.c_str());
+				fclose(f);
+			}
+#endif
+		}
+	}
+}
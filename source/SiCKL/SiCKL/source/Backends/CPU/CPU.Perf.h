@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CPU.Internal.h"
+
+#include <map>
+#include <string>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// what a profiler needs to put a name and lines on a Native or JIT
+		// kernel: its symbol carries the Source's class name and, with
+		// SICKL_PERF set, its debug line info points at a listing of main
+		// with a line per AST node
+		struct KernelListing
+		{
+			// "sickl_" and the Source's class name
+			std::string symbol;
+			// empty unless SICKL_PERF is set
+			std::string path;
+			std::map<const ASTNode*, uint32_t> lines;
+
+			// line of the node, 1 for main itself
+			uint32_t Line(const ASTNode*) const;
+		};
+
+		// true if the SICKL_PERF environment variable is set and not 0
+		bool PerfEnabled();
+		// names the kernel of source and, if perf is enabled, writes the
+		// listing of main to the CacheDirectory; listings are named by their
+		// contents so programs of one class built differently don't share one
+		void ListKernel(const Source&, const ASTNode* main, KernelListing& out_listing);
+		// appends a symbol to /tmp/perf-<pid>.map, where perf looks up
+		// addresses of anonymous executable memory
+		void AddPerfMapSymbol(uint64_t address, uint64_t size, const std::string& name);
+	}
+}
@@ -0,0 +1,487 @@
+#include "Backends/CPU.h"
+#include "CPU.Internal.h"
+#include "CPU.Scheduler.h"
+#include "CPU.Traversal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace SiCKL
+{
+	CPUProgram::CPUProgram(const ASTNode* uniforms, const ASTNode* outputs, uint32_t symbol_count, Internal::Kernel* kernel, const std::string& source, const Internal::IndexAnalysis& analysis)
+		: _traversal(CPUTraversal::Automatic)
+		, _automatic_traversal(analysis.GetTraversal())
+		, _reach_count(0)
+		, _reach(nullptr)
+		, _uniform_count(-1)
+		, _uniforms(nullptr)
+		, _output_count(-1)
+		, _outputs(nullptr)
+		, _symbol_count(symbol_count)
+		, _kernel(kernel)
+		, _source(source)
+	{
+		_size[0] = 0;
+		_size[1] = 0;
+		// a few SIMD rows wide and high enough to cover hand out costs
+		_tile_size[0] = 64;
+		_tile_size[1] = 8;
+
+		std::vector<Internal::Reach> reach;
+		analysis.GetReach(reach);
+		_reach_count = (int32_t)reach.size();
+		_reach = new Internal::Reach[_reach_count];
+		for(int32_t i = 0; i < _reach_count; i++)
+		{
+			_reach[i] = reach[i];
+		}
+
+		/// Get the Uniforms
+
+		_uniform_count = uniforms->_count;
+		_uniforms = new Uniform[_uniform_count];
+
+		for(uint32_t i = 0; i < uniforms->_count; i++)
+		{
+			ASTNode* n = uniforms->_children[i];
+			Uniform& in = _uniforms[i];
+
+			in._name = n->_name;
+			in._type = n->_return_type;
+			in._sid = n->_u.sid;
+			memset(&in._ivec, 0x00, sizeof(in._ivec));
+
+			switch(Internal::ElementType(n->_return_type))
+			{
+			case ReturnType::Bool:
+			case ReturnType::Int:
+			case ReturnType::Int2:
+			case ReturnType::Int3:
+			case ReturnType::Int4:
+			case ReturnType::UInt:
+			case ReturnType::UInt2:
+			case ReturnType::UInt3:
+			case ReturnType::UInt4:
+			case ReturnType::Float:
+			case ReturnType::Float2:
+			case ReturnType::Float3:
+			case ReturnType::Float4:
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+			if(n->_return_type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+			{
+				in._buffer.data = nullptr;
+				in._buffer.width = 0;
+				in._buffer.height = 0;
+				in._buffer.row_pitch = 0;
+				in._buffer.element_stride = 0;
+			}
+		}
+
+		/// And Get Outputs
+
+		_output_count = outputs->_count;
+		_outputs = new Output[_output_count];
+
+		for(uint32_t i = 0; i < outputs->_count; i++)
+		{
+			ASTNode* n = outputs->_children[i];
+			Output& out = _outputs[i];
+
+			out._name = n->_name;
+			out._sid = n->_u.sid;
+			out._data = nullptr;
+			out._row_pitch = 0;
+			out._element_stride = 0;
+
+			switch(n->_return_type)
+			{
+			case ReturnType::Int:
+			case ReturnType::UInt:
+			case ReturnType::Float:
+			case ReturnType::Int2:
+			case ReturnType::UInt2:
+			case ReturnType::Float2:
+			case ReturnType::Int3:
+			case ReturnType::UInt3:
+			case ReturnType::Float3:
+			case ReturnType::Int4:
+			case ReturnType::UInt4:
+			case ReturnType::Float4:
+				out._type = n->_return_type;
+				break;
+			default:
+				COMPUTE_ASSERT(false);
+			}
+		}
+	}
+
+	void CPUProgram::Initialize(int32_t in_width, int32_t in_height)
+	{
+		// make sure the passed in size is ok
+		COMPUTE_ASSERT(in_width > 0 && in_height > 0);
+
+		_size[0] = in_width;
+		_size[1] = in_height;
+	}
+
+	void CPUProgram::SetTileSize(int32_t in_width, int32_t in_height)
+	{
+		COMPUTE_ASSERT(in_width > 0 && in_height > 0);
+
+		_tile_size[0] = in_width;
+		_tile_size[1] = in_height;
+	}
+
+	void CPUProgram::SetTraversal(CPUTraversal::Type traversal)
+	{
+		_traversal = traversal;
+	}
+
+	CPUTraversal::Type CPUProgram::GetTraversal() const
+	{
+		return _traversal == CPUTraversal::Automatic ? _automatic_traversal : _traversal;
+	}
+
+	CPUProgram::~CPUProgram()
+	{
+		delete _kernel;
+
+		delete[] _outputs;
+		delete[] _uniforms;
+		delete[] _reach;
+	}
+
+	input_t CPUProgram::GetInputHandle(const char* in_name)
+	{
+		for(int32_t i = 0; i < _uniform_count; i++)
+		{
+			if(strcmp(in_name, _uniforms[i]._name.c_str()) == 0)
+			{
+				return (input_t)i;
+			}
+		}
+
+		return -1;
+	}
+
+	output_t CPUProgram::GetOutputHandle(const char* in_name)
+	{
+		for(int32_t i = 0; i < _output_count; i++)
+		{
+			if(strcmp(in_name, _outputs[i]._name.c_str()) == 0)
+			{
+				return (output_t)i;
+			}
+		}
+
+		return -1;
+	}
+
+	// setup inputs for kernel
+
+#define SET_UNIFORM_HEADER(return_type)\
+	COMPUTE_ASSERT(index >= 0);\
+	COMPUTE_ASSERT(_uniform_count > index);\
+	COMPUTE_ASSERT(_uniforms[index]._type == return_type);\
+
+#define SET_UNIFORM1(type_t, return_type, u)\
+	void CPUProgram::SetInput(int32_t index, type_t val0)\
+	{\
+		SET_UNIFORM_HEADER(return_type)\
+		_uniforms[index].u = val0;\
+	}
+
+#define SET_UNIFORM2(type_t, return_type, u)\
+	void CPUProgram::SetInput(int32_t index, type_t val0, type_t val1)\
+	{\
+		SET_UNIFORM_HEADER(return_type)\
+		_uniforms[index].u.x = val0;\
+		_uniforms[index].u.y = val1;\
+	}
+
+#define SET_UNIFORM3(type_t, return_type, u)\
+	void CPUProgram::SetInput(int32_t index, type_t val0, type_t val1, type_t val2)\
+	{\
+		SET_UNIFORM_HEADER(return_type)\
+		_uniforms[index].u.x = val0;\
+		_uniforms[index].u.y = val1;\
+		_uniforms[index].u.z = val2;\
+	}
+
+#define SET_UNIFORM4(type_t, return_type, u)\
+	void CPUProgram::SetInput(int32_t index, type_t val0, type_t val1, type_t val2, type_t val3)\
+	{\
+		SET_UNIFORM_HEADER(return_type)\
+		_uniforms[index].u.x = val0;\
+		_uniforms[index].u.y = val1;\
+		_uniforms[index].u.z = val2;\
+		_uniforms[index].u.w = val3;\
+	}
+
+	SET_UNIFORM1(int32_t, ReturnType::Int, _int)
+	SET_UNIFORM1(uint32_t, ReturnType::UInt, _uint)
+	SET_UNIFORM1(float, ReturnType::Float, _float)
+
+	SET_UNIFORM2(int32_t, ReturnType::Int2, _ivec)
+	SET_UNIFORM2(uint32_t, ReturnType::UInt2, _uvec)
+	SET_UNIFORM2(float, ReturnType::Float2, _fvec)
+
+	SET_UNIFORM3(int32_t, ReturnType::Int3, _ivec)
+	SET_UNIFORM3(uint32_t, ReturnType::UInt3, _uvec)
+	SET_UNIFORM3(float, ReturnType::Float3, _fvec)
+
+	SET_UNIFORM4(int32_t, ReturnType::Int4, _ivec)
+	SET_UNIFORM4(uint32_t, ReturnType::UInt4, _uvec)
+	SET_UNIFORM4(float, ReturnType::Float4, _fvec)
+
+	// bools are stored the way the kernel reads them
+	void CPUProgram::SetInput(int32_t index, bool val0)
+	{
+		SET_UNIFORM_HEADER(ReturnType::Bool)
+		_uniforms[index]._int = val0 ? 1 : 0;
+	}
+
+	/// Buffer Setters
+	void CPUProgram::SetInput(int32_t index, const CPUBuffer1D& val)
+	{
+		COMPUTE_ASSERT(index >= 0);
+		COMPUTE_ASSERT(_uniform_count > index);
+		COMPUTE_ASSERT(_uniforms[index]._type & ReturnType::Buffer1D);
+		COMPUTE_ASSERT((_uniforms[index]._type ^ ReturnType::Buffer1D) == val.Type);
+
+		const ReturnType::Type element = (ReturnType::Type)(_uniforms[index]._type ^ ReturnType::Buffer1D);
+		_uniforms[index]._buffer.data = val._data;
+		_uniforms[index]._buffer.width = val.Length;
+		_uniforms[index]._buffer.height = 1;
+		_uniforms[index]._buffer.row_pitch = CPURuntime::RequiredBufferSpace(val.Length, 1, element);
+		_uniforms[index]._buffer.element_stride = CPURuntime::RequiredBufferSpace(1, 1, element);
+	}
+
+	void CPUProgram::SetInput(int32_t index, const CPUBuffer2D& val)
+	{
+		COMPUTE_ASSERT(index >= 0);
+		COMPUTE_ASSERT(_uniform_count > index);
+		COMPUTE_ASSERT(_uniforms[index]._type & ReturnType::Buffer2D);
+		COMPUTE_ASSERT((_uniforms[index]._type ^ ReturnType::Buffer2D) == val.Type);
+
+		const ReturnType::Type element = (ReturnType::Type)(_uniforms[index]._type ^ ReturnType::Buffer2D);
+		_uniforms[index]._buffer.data = val._data;
+		_uniforms[index]._buffer.width = val.Width;
+		_uniforms[index]._buffer.height = val.Height;
+		_uniforms[index]._buffer.row_pitch = CPURuntime::RequiredBufferSpace(val.Width, 1, element);
+		_uniforms[index]._buffer.element_stride = CPURuntime::RequiredBufferSpace(1, 1, element);
+	}
+
+	// the components are read 4 bytes at a time, so every element has to
+	// start on a multiple of 4
+	static void check_layout(const void* data, int32_t width, int32_t height, size_t& in_out_row_pitch, size_t& in_out_element_stride, ReturnType::Type element)
+	{
+		COMPUTE_ASSERT(data != nullptr);
+		COMPUTE_ASSERT(width > 0 && height > 0);
+
+		const size_t element_size = CPURuntime::RequiredBufferSpace(1, 1, element);
+		in_out_element_stride = in_out_element_stride == 0 ? element_size : in_out_element_stride;
+		in_out_row_pitch = in_out_row_pitch == 0 ? width * in_out_element_stride : in_out_row_pitch;
+
+		COMPUTE_ASSERT(((uintptr_t)data & 3) == 0);
+		COMPUTE_ASSERT(in_out_element_stride >= element_size && (in_out_element_stride & 3) == 0);
+		COMPUTE_ASSERT(height == 1 || (in_out_row_pitch >= (width - 1) * in_out_element_stride + element_size && (in_out_row_pitch & 3) == 0));
+	}
+
+	void CPUProgram::SetInput(int32_t index, const void* data, int32_t width, int32_t height, size_t row_pitch, size_t element_stride)
+	{
+		COMPUTE_ASSERT(index >= 0);
+		COMPUTE_ASSERT(_uniform_count > index);
+		COMPUTE_ASSERT(_uniforms[index]._type & (ReturnType::Buffer1D | ReturnType::Buffer2D));
+		COMPUTE_ASSERT((_uniforms[index]._type & ReturnType::Buffer2D) || height == 1);
+
+		check_layout(data, width, height, row_pitch, element_stride, Internal::ElementType(_uniforms[index]._type));
+		_uniforms[index]._buffer.data = data;
+		_uniforms[index]._buffer.width = width;
+		_uniforms[index]._buffer.height = height;
+		_uniforms[index]._buffer.row_pitch = row_pitch;
+		_uniforms[index]._buffer.element_stride = element_stride;
+	}
+
+	void CPUProgram::BindOutput(int32_t index, const CPUBuffer2D& output)
+	{
+		COMPUTE_ASSERT(index >= 0);
+		COMPUTE_ASSERT(_output_count > index);
+
+		COMPUTE_ASSERT(output.Type == _outputs[index]._type);
+		COMPUTE_ASSERT(output.Width == _size[0]);
+		COMPUTE_ASSERT(output.Height == _size[1]);
+
+		_outputs[index]._data = output._data;
+		_outputs[index]._row_pitch = CPURuntime::RequiredBufferSpace(output.Width, 1, output.Type);
+		_outputs[index]._element_stride = CPURuntime::RequiredBufferSpace(1, 1, output.Type);
+	}
+
+	void CPUProgram::BindOutput(int32_t index, void* data, size_t row_pitch, size_t element_stride)
+	{
+		COMPUTE_ASSERT(index >= 0);
+		COMPUTE_ASSERT(_output_count > index);
+
+		check_layout(data, _size[0], _size[1], row_pitch, element_stride, _outputs[index]._type);
+		_outputs[index]._data = data;
+		_outputs[index]._row_pitch = row_pitch;
+		_outputs[index]._element_stride = element_stride;
+	}
+
+	void CPUProgram::Run()
+	{
+		COMPUTE_ASSERT(_size[0] > 0 && _size[1] > 0);
+
+		Internal::Value* symbols = new Internal::Value[_symbol_count];
+		Internal::Buffer* buffers = new Internal::Buffer[_symbol_count];
+		Internal::Buffer* outputs = new Internal::Buffer[_output_count];
+		symbol_id_t* output_symbols = new symbol_id_t[_output_count];
+
+		memset(symbols, 0x00, sizeof(Internal::Value) * _symbol_count);
+		memset(buffers, 0x00, sizeof(Internal::Buffer) * _symbol_count);
+
+		// fill in the symbol table
+		for(int32_t i = 0; i < _uniform_count; i++)
+		{
+			const Uniform& u = _uniforms[i];
+			if(u._type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+			{
+				// every buffer input must be set
+				COMPUTE_ASSERT(u._buffer.data != nullptr);
+
+				Internal::Buffer& b = buffers[u._sid];
+				b.data = (uint8_t*)u._buffer.data;
+				b.width = u._buffer.width;
+				b.height = u._buffer.height;
+				b.row_pitch = u._buffer.row_pitch;
+				b.element_stride = u._buffer.element_stride;
+				b.type = Internal::ElementType(u._type);
+			}
+			else
+			{
+				memcpy(&symbols[u._sid], &u._ivec, sizeof(u._ivec));
+			}
+		}
+
+		for(int32_t i = 0; i < _output_count; i++)
+		{
+			const Output& o = _outputs[i];
+			// every output must be bound
+			COMPUTE_ASSERT(o._data != nullptr);
+
+			Internal::Buffer& b = outputs[i];
+			b.data = (uint8_t*)o._data;
+			b.width = _size[0];
+			b.height = _size[1];
+			b.row_pitch = o._row_pitch;
+			b.element_stride = o._element_stride;
+			b.type = o._type;
+
+			output_symbols[i] = o._sid;
+		}
+
+		Internal::Invocation invocation;
+		invocation.size[0] = _size[0];
+		invocation.size[1] = _size[1];
+		invocation.symbols = symbols;
+		invocation.symbol_count = _symbol_count;
+		invocation.buffers = buffers;
+		invocation.outputs = outputs;
+		invocation.output_symbols = output_symbols;
+		invocation.output_count = _output_count;
+
+		_kernel->ResetStatistics();
+		const Internal::Traversal traversal(GetTraversal(), invocation, _tile_size[0], _tile_size[1], _reach, (uint32_t)_reach_count);
+		if(CPURuntime::_scheduler != nullptr)
+		{
+			CPURuntime::_scheduler->Run(*_kernel, traversal);
+		}
+		else if(traversal.GetOrder() == CPUTraversal::Rows)
+		{
+			// on one thread the rows are a single band
+			_kernel->Run(invocation, 0, 0, _size[0], _size[1]);
+		}
+		else
+		{
+			for(uint32_t t = 0; t < traversal.TileCount(); t++)
+			{
+				traversal.RunTile(*_kernel, t);
+			}
+		}
+
+		delete[] output_symbols;
+		delete[] outputs;
+		delete[] buffers;
+		delete[] symbols;
+	}
+
+	float CPUProgram::GetLaneUtilization() const
+	{
+		return _kernel->GetLaneUtilization();
+	}
+
+	void CPUProgram::PrintProfile() const
+	{
+		std::vector<NodeCost> costs;
+		const ASTNode* main = _kernel->GetProfile(costs);
+		if(main != nullptr)
+		{
+			main->Print(costs.data());
+		}
+	}
+
+	void CPUProgram::PrintProfileDot() const
+	{
+		std::vector<NodeCost> costs;
+		const ASTNode* main = _kernel->GetProfile(costs);
+		if(main != nullptr)
+		{
+			main->PrintDot(costs.data());
+		}
+	}
+
+	void CPUProgram::get_output(output_t i, int32_t offset_x, int32_t offset_y, int32_t width, int32_t height, void** in_out_buffer)
+	{
+		// make sure it's a valid output handle
+		COMPUTE_ASSERT(i >= 0 && i < _output_count);
+		COMPUTE_ASSERT(_outputs[i]._data != nullptr);
+
+		// make sure it's a valid width, offset
+		COMPUTE_ASSERT(offset_x + width <= _size[0]);
+		COMPUTE_ASSERT(offset_y + height <= _size[1]);
+		COMPUTE_ASSERT(offset_x >= 0);
+		COMPUTE_ASSERT(offset_y >= 0);
+		COMPUTE_ASSERT(width >= 0);
+		COMPUTE_ASSERT(height >= 0);
+
+		if(*in_out_buffer == nullptr)
+		{
+			*in_out_buffer = malloc(CPURuntime::RequiredBufferSpace(width, height, _outputs[i]._type));
+		}
+
+		const Output& o = _outputs[i];
+		const uint32_t element_size = CPURuntime::RequiredBufferSpace(1, 1, o._type);
+		const uint32_t dest_pitch = CPURuntime::RequiredBufferSpace(width, 1, o._type);
+
+		const uint8_t* src = (const uint8_t*)o._data + offset_y * o._row_pitch + offset_x * o._element_stride;
+		uint8_t* dest = (uint8_t*)*in_out_buffer;
+		// copy out row by row, element by element if the output isn't packed
+		for(int32_t y = 0; y < height; y++)
+		{
+			if(o._element_stride == element_size)
+			{
+				memcpy(dest + y * dest_pitch, src + y * o._row_pitch, dest_pitch);
+				continue;
+			}
+			for(int32_t x = 0; x < width; x++)
+			{
+				memcpy(dest + y * dest_pitch + x * element_size, src + y * o._row_pitch + x * o._element_stride, element_size);
+			}
+		}
+	}
+}
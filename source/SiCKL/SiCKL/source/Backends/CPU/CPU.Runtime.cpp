@@ -0,0 +1,397 @@
+#include "Backends/CPU.h"
+#include "CPU.Memory.h"
+#include "CPU.Scheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define SICKL_X86
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+namespace SiCKL
+{
+	Internal::Scheduler* CPURuntime::_scheduler = nullptr;
+	int32_t CPURuntime::_instruction_set = -1;
+	CPUHugePages::Type CPURuntime::_huge_pages = CPUHugePages::Transparent;
+
+	bool CPURuntime::Initialize(uint32_t thread_count, bool pin_threads)
+	{
+		if(_scheduler != nullptr)
+		{
+			return true;
+		}
+
+		if(thread_count == 0)
+		{
+			thread_count = std::thread::hardware_concurrency();
+			// may not be known
+			if(thread_count == 0)
+			{
+				thread_count = 1;
+			}
+		}
+		_scheduler = new Internal::Scheduler(thread_count, pin_threads);
+		return true;
+	}
+
+	bool CPURuntime::Finalize()
+	{
+		if(_scheduler == nullptr)
+		{
+			return false;
+		}
+
+		delete _scheduler;
+		_scheduler = nullptr;
+		return true;
+	}
+
+	uint32_t CPURuntime::GetThreadCount()
+	{
+		return _scheduler != nullptr ? _scheduler->ThreadCount() : 1;
+	}
+
+	uint32_t CPURuntime::GetStealCount()
+	{
+		return _scheduler != nullptr ? _scheduler->StealCount() : 0;
+	}
+
+	void CPURuntime::SetHugePages(CPUHugePages::Type huge_pages)
+	{
+		_huge_pages = huge_pages;
+	}
+
+	CPUHugePages::Type CPURuntime::GetHugePages()
+	{
+		return _huge_pages;
+	}
+
+	/// Instruction Sets
+
+#if defined(SICKL_X86)
+	// eax, ebx, ecx and edx of a cpuid leaf
+	static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t out_regs[4])
+	{
+#	if defined(_MSC_VER)
+		__cpuidex((int*)out_regs, (int)leaf, (int)subleaf);
+#	else
+		__cpuid_count(leaf, subleaf, out_regs[0], out_regs[1], out_regs[2], out_regs[3]);
+#	endif
+	}
+
+	// the register state the OS saves on a context switch
+	static uint64_t xcr0()
+	{
+#	if defined(_MSC_VER)
+		return _xgetbv(0);
+#	else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64_t)edx << 32) | eax;
+#	endif
+	}
+
+	static inline bool bit(uint32_t reg, uint32_t i)
+	{
+		return ((reg >> i) & 1) != 0;
+	}
+#endif
+
+	CPUInstructionSet::Type CPURuntime::GetSupportedInstructionSet()
+	{
+		CPUInstructionSet::Type result = CPUInstructionSet::Generic;
+#if defined(SICKL_X86)
+		uint32_t regs[4];
+		cpuid(0, 0, regs);
+		const uint32_t max_leaf = regs[0];
+		if(max_leaf < 1)
+		{
+			return result;
+		}
+
+		cpuid(1, 0, regs);
+		const uint32_t ecx1 = regs[2];
+		if(!bit(ecx1, 19) || !bit(ecx1, 20) || !bit(ecx1, 23))
+		{
+			return result;
+		}
+		result = CPUInstructionSet::SSE42;
+
+		// AVX needs the OS to save the ymm registers, AVX-512 the zmm and
+		// mask registers as well
+		if(max_leaf < 7 || !bit(ecx1, 27) || !bit(ecx1, 28) || !bit(ecx1, 12))
+		{
+			return result;
+		}
+		const uint64_t xcr = xcr0();
+		cpuid(7, 0, regs);
+		const uint32_t ebx7 = regs[1];
+		if((xcr & 0x06) != 0x06 || !bit(ebx7, 5) || !bit(ebx7, 3) || !bit(ebx7, 8))
+		{
+			return result;
+		}
+		result = CPUInstructionSet::AVX2;
+
+		// F, DQ, CD, BW and VL
+		if((xcr & 0xE6) != 0xE6 || !bit(ebx7, 16) || !bit(ebx7, 17) || !bit(ebx7, 28) || !bit(ebx7, 30) || !bit(ebx7, 31))
+		{
+			return result;
+		}
+		result = CPUInstructionSet::AVX512;
+#endif
+		return result;
+	}
+
+	CPUInstructionSet::Type CPURuntime::GetInstructionSet()
+	{
+		if(_instruction_set < 0)
+		{
+			static const CPUInstructionSet::Type sets[] = {CPUInstructionSet::Generic, CPUInstructionSet::SSE42, CPUInstructionSet::AVX2, CPUInstructionSet::AVX512};
+
+			CPUInstructionSet::Type result = GetSupportedInstructionSet();
+			const char* name = getenv("SICKL_CPU_ISA");
+			if(name != nullptr && *name != 0)
+			{
+				uint32_t i = 0;
+				for(; i < sizeof(sets) / sizeof(sets[0]); i++)
+				{
+					if(strcmp(name, GetInstructionSetName(sets[i])) == 0)
+					{
+						break;
+					}
+				}
+
+				if(i == sizeof(sets) / sizeof(sets[0]))
+				{
+					printf("Unknown SICKL_CPU_ISA %s, using %s\n", name, GetInstructionSetName(result));
+				}
+				else if(sets[i] > result)
+				{
+					printf("SICKL_CPU_ISA %s is not supported, using %s\n", name, GetInstructionSetName(result));
+				}
+				else
+				{
+					result = sets[i];
+				}
+			}
+			_instruction_set = result;
+		}
+		return (CPUInstructionSet::Type)_instruction_set;
+	}
+
+	void CPURuntime::ForceInstructionSet(CPUInstructionSet::Type isa)
+	{
+		const CPUInstructionSet::Type supported = GetSupportedInstructionSet();
+		if(isa > supported)
+		{
+			printf("%s is not supported, using %s\n", GetInstructionSetName(isa), GetInstructionSetName(supported));
+			isa = supported;
+		}
+		_instruction_set = isa;
+	}
+
+	const char* CPURuntime::GetInstructionSetName(CPUInstructionSet::Type isa)
+	{
+		switch(isa)
+		{
+		case CPUInstructionSet::Generic:
+			return "generic";
+		case CPUInstructionSet::SSE42:
+			return "sse4.2";
+		case CPUInstructionSet::AVX2:
+			return "avx2";
+		case CPUInstructionSet::AVX512:
+			return "avx512";
+		}
+		COMPUTE_ASSERT(false);
+		return nullptr;
+	}
+
+	const char* CPURuntime::GetMathAccuracyName(CPUMathAccuracy::Type accuracy)
+	{
+		switch(accuracy)
+		{
+		case CPUMathAccuracy::Standard:
+			return "standard";
+		case CPUMathAccuracy::Precise:
+			return "precise";
+		case CPUMathAccuracy::Balanced:
+			return "balanced";
+		case CPUMathAccuracy::Fast:
+			return "fast";
+		}
+		COMPUTE_ASSERT(false);
+		return nullptr;
+	}
+
+	const char* CPURuntime::GetTraversalName(CPUTraversal::Type traversal)
+	{
+		switch(traversal)
+		{
+		case CPUTraversal::Automatic:
+			return "automatic";
+		case CPUTraversal::Rows:
+			return "rows";
+		case CPUTraversal::Tiles:
+			return "tiles";
+		case CPUTraversal::Morton:
+			return "morton";
+		}
+		COMPUTE_ASSERT(false);
+		return nullptr;
+	}
+
+	uint32_t CPURuntime::RequiredBufferSpace(uint32_t width, uint32_t height, ReturnType::Type type)
+	{
+		uint32_t buffer_size = width * height;
+		switch(type)
+		{
+		case ReturnType::Int:
+		case ReturnType::UInt:
+		case ReturnType::Float:
+			buffer_size *= 4;
+			break;
+		case ReturnType::Int2:
+		case ReturnType::UInt2:
+		case ReturnType::Float2:
+			buffer_size *= 8;
+			break;
+		case ReturnType::Int3:
+		case ReturnType::UInt3:
+		case ReturnType::Float3:
+			buffer_size *= 12;
+			break;
+		case ReturnType::Int4:
+		case ReturnType::UInt4:
+		case ReturnType::Float4:
+			buffer_size *= 16;
+			break;
+		default:
+			COMPUTE_ASSERT(false);
+		}
+
+		return buffer_size;
+	}
+
+	/// CPU Buffer Creation
+
+	CPUBuffer1D::CPUBuffer1D()
+		: Length(-1)
+		, Type(ReturnType::Invalid)
+		, _data(nullptr)
+	{ }
+
+	CPUBuffer1D::CPUBuffer1D(int32_t length, ReturnType::Type type, const void* data)
+		: Length(length)
+		, Type(type)
+		, _data(nullptr)
+	{
+		COMPUTE_ASSERT(length > 0);
+
+		const uint32_t buffer_size = GetBufferSize();
+		bool zeroed;
+		_data = Internal::AllocateBuffer(buffer_size, CPURuntime::_huge_pages, zeroed);
+		Internal::FillBuffer(CPURuntime::_scheduler, _data, zeroed, data, buffer_size / length, (uint32_t)length);
+	}
+
+	void CPUBuffer1D::Delete()
+	{
+		// default constructed buffers have no Type to size them by
+		if(_data == nullptr)
+		{
+			return;
+		}
+		Internal::FreeBuffer(_data, GetBufferSize());
+		_data = nullptr;
+	}
+
+	uint32_t CPUBuffer1D::GetBufferSize() const
+	{
+		return CPURuntime::RequiredBufferSpace(Length, 1, Type);
+	}
+
+	void CPUBuffer1D::SetData(const void* in_buffer)
+	{
+		memcpy(_data, in_buffer, GetBufferSize());
+	}
+
+	void CPUBuffer1D::get_data(void** in_out_buffer) const
+	{
+		if(*in_out_buffer == nullptr)
+		{
+			*in_out_buffer = malloc(GetBufferSize());
+		}
+		memcpy(*in_out_buffer, _data, GetBufferSize());
+	}
+
+	CPUBuffer2D::CPUBuffer2D()
+		: Width(-1)
+		, Height(-1)
+		, Type(ReturnType::Invalid)
+		, _data(nullptr)
+	{ }
+
+	CPUBuffer2D::CPUBuffer2D(int32_t width, int32_t height, ReturnType::Type type, const void* data)
+		: Width(width)
+		, Height(height)
+		, Type(type)
+		, _data(nullptr)
+	{
+		COMPUTE_ASSERT(width > 0 && height > 0);
+
+		const uint32_t buffer_size = GetBufferSize();
+		bool zeroed;
+		_data = Internal::AllocateBuffer(buffer_size, CPURuntime::_huge_pages, zeroed);
+		Internal::FillBuffer(CPURuntime::_scheduler, _data, zeroed, data, buffer_size / height, (uint32_t)height);
+	}
+
+	void CPUBuffer2D::Delete()
+	{
+		// default constructed buffers have no Type to size them by
+		if(_data == nullptr)
+		{
+			return;
+		}
+		Internal::FreeBuffer(_data, GetBufferSize());
+		_data = nullptr;
+	}
+
+	uint32_t CPUBuffer2D::GetBufferSize() const
+	{
+		return CPURuntime::RequiredBufferSpace(Width, Height, Type);
+	}
+
+	void CPUBuffer2D::SetData(const CPUBuffer2D& in_buffer)
+	{
+		COMPUTE_ASSERT(this != &in_buffer);
+
+		COMPUTE_ASSERT(this->Width == in_buffer.Width);
+		COMPUTE_ASSERT(this->Height == in_buffer.Height);
+		COMPUTE_ASSERT(this->Type == in_buffer.Type);
+
+		memcpy(_data, in_buffer._data, GetBufferSize());
+	}
+
+	void CPUBuffer2D::SetData(const void* in_buffer)
+	{
+		memcpy(_data, in_buffer, GetBufferSize());
+	}
+
+	void CPUBuffer2D::get_data(void** in_out_buffer) const
+	{
+		if(*in_out_buffer == nullptr)
+		{
+			*in_out_buffer = malloc(GetBufferSize());
+		}
+		memcpy(*in_out_buffer, _data, GetBufferSize());
+	}
+}
@@ -0,0 +1,32 @@
+// the SIMD executor built for AVX-512; everything outside the SIMDMachine
+// templates is included first so it keeps the library's own target
+#include "CPU.SIMD.h"
+#include "CPU.Math.h"
+
+#include <math.h>
+#include <string.h>
+
+// MSVC has no per function targets and builds this like CPU.SIMD.cpp
+// unless the file is given /arch:AVX512
+#if defined(__clang__)
+#	pragma clang attribute push(__attribute__((target("avx512f,avx512cd,avx512bw,avx512dq,avx512vl,bmi,bmi2,popcnt"))), apply_to = function)
+#elif defined(__GNUC__)
+#	pragma GCC push_options
+#	pragma GCC target("avx512f,avx512cd,avx512bw,avx512dq,avx512vl,bmi,bmi2,popcnt")
+#endif
+
+#include "CPU.SIMD.inl"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		template class SIMDMachine<16, CPUInstructionSet::AVX512>;
+	}
+}
+
+#if defined(__clang__)
+#	pragma clang attribute pop
+#elif defined(__GNUC__)
+#	pragma GCC pop_options
+#endif
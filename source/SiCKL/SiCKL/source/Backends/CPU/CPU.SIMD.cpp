@@ -0,0 +1,39 @@
+#include "CPU.SIMD.inl"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		template class SIMDMachine<8, CPUInstructionSet::Generic>;
+
+		// instantiated by CPU.SIMD.cpp and CPU.SIMD.<isa>.cpp only, so no
+		// code built for one target ends up in another
+		extern template class SIMDMachine<8, CPUInstructionSet::SSE42>;
+		extern template class SIMDMachine<8, CPUInstructionSet::AVX2>;
+		extern template class SIMDMachine<16, CPUInstructionSet::AVX512>;
+
+		bool CanRefillLanes(const Bytecode& bytecode)
+		{
+			uint32_t begin, exit;
+			return find_refill_loop(bytecode.code, begin, exit);
+		}
+
+		Kernel* NewSIMDMachine(const Bytecode& bytecode, bool refill_lanes, CPUInstructionSet::Type isa)
+		{
+			refill_lanes = refill_lanes && CanRefillLanes(bytecode);
+			switch(isa)
+			{
+			case CPUInstructionSet::Generic:
+				return new SIMDMachine<8, CPUInstructionSet::Generic>(bytecode, refill_lanes);
+			case CPUInstructionSet::SSE42:
+				return new SIMDMachine<8, CPUInstructionSet::SSE42>(bytecode, refill_lanes);
+			case CPUInstructionSet::AVX2:
+				return new SIMDMachine<8, CPUInstructionSet::AVX2>(bytecode, refill_lanes);
+			case CPUInstructionSet::AVX512:
+				return new SIMDMachine<16, CPUInstructionSet::AVX512>(bytecode, refill_lanes);
+			}
+			COMPUTE_ASSERT(false);
+			return nullptr;
+		}
+	}
+}
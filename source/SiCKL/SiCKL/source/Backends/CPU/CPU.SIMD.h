@@ -0,0 +1,17 @@
+#pragma once
+
+#include "CPU.Bytecode.h"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// whether there is a While at the top level to refill lanes around
+		bool CanRefillLanes(const Bytecode&);
+
+		// a SIMDMachine (see CPU.SIMD.inl) built for isa, with two vectors'
+		// worth of lanes below AVX-512 and one after; lanes are only refilled
+		// where CanRefillLanes
+		Kernel* NewSIMDMachine(const Bytecode&, bool refill_lanes, CPUInstructionSet::Type isa);
+	}
+}
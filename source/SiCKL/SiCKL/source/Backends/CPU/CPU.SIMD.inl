@@ -0,0 +1,948 @@
+// the SIMDMachine template, included by the translation unit of each
+// instruction set with its compiler target already set
+
+#include "CPU.SIMD.h"
+#include "CPU.Math.h"
+
+#include <atomic>
+#include <math.h>
+#include <string.h>
+
+// GCC and clang can jump straight from one handler to the next
+#if defined(__GNUC__)
+#	define SICKL_COMPUTED_GOTO
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// runs register bytecode on W consecutive elements of a row at once,
+		// one element per lane; every register holds W lanes so vectors are
+		// stored SoA. Divergent If and While blocks run under a lane mask and
+		// are skipped once no lane is left in them, the way a GPU does it.
+		//
+		// With refill_lanes the code is split around the first While at the
+		// top level of Main. Lanes are no longer tied to a batch of W elements:
+		// a lane whose loop is done runs the rest of Main, writes its outputs
+		// and starts over on the next element of the rectangle while the
+		// other lanes keep looping, so escape time kernels don't wait on the
+		// slowest element of every batch.
+		//
+		// Each instruction set gets its own instantiation, built in its own
+		// translation unit for that target. The class is declared there too,
+		// as GCC gives a member the target in effect where it is declared.
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		class SIMDMachine : public Kernel
+		{
+		public:
+			// refill_lanes needs CanRefillLanes
+			SIMDMachine(const Bytecode&, bool refill_lanes = false);
+
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+			// lanes active on each trip through a loop
+			virtual float GetLaneUtilization() const;
+			virtual void ResetStatistics();
+		private:
+			void run_rows(const Invocation&, Register* registers, uint32_t* masks, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+			void run_refill(const Invocation&, Register* registers, uint32_t* masks, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+
+			// masks holds the active lanes followed by room for the mask stack,
+			// the active lanes at the halt are written back to it. trips sums
+			// the active lanes and the lanes of every loop trip
+			static void execute(const Instruction* code, Register* registers, uint32_t* masks, const Invocation&, uint64_t* trips);
+			// the N component texels at x, y for every lane, y is null for a
+			// Buffer1D
+			template<uint32_t N>
+			static void load(const Buffer&, const Register* x, const Register* y, Register (*out_texels)[W]);
+
+			Bytecode _bytecode;
+			// deepest nesting of If and While blocks
+			uint32_t _mask_depth;
+
+			bool _refill_lanes;
+			// the code before the refilled loop, the loop run until half the
+			// lanes are free or until all of them are, ending with the lanes
+			// still in it active, and the code after it
+			std::vector<Instruction> _prologue;
+			std::vector<Instruction> _iteration;
+			std::vector<Instruction> _drain;
+			std::vector<Instruction> _epilogue;
+
+			// lanes busy in loops and lanes there were room for, summed over
+			// their trips
+			mutable std::atomic<uint64_t> _busy_lanes;
+			mutable std::atomic<uint64_t> _lane_slots;
+		};
+
+		// the lanes of a register start on a cache line
+		template<typename T>
+		static T* align_lanes(std::vector<T>& storage)
+		{
+			return (T*)(((uintptr_t)&storage[0] + 63) & ~(uintptr_t)63);
+		}
+
+		/// Lane helpers
+
+		// writes the active lanes of value to dest
+		template<uint32_t W>
+		static inline void blend(Register* dest, const Register* value, const uint32_t* mask)
+		{
+			// plain uints vectorize where the union doesn't
+			uint32_t* d = (uint32_t*)dest;
+			const uint32_t* v = (const uint32_t*)value;
+			for(uint32_t l = 0; l < W; l++)
+			{
+				d[l] = (v[l] & mask[l]) | (d[l] & ~mask[l]);
+			}
+		}
+
+		template<uint32_t W>
+		static inline bool any(const uint32_t* mask)
+		{
+			uint32_t result = 0;
+			for(uint32_t l = 0; l < W; l++)
+			{
+				result |= mask[l];
+			}
+			return result != 0;
+		}
+
+		template<uint32_t W>
+		static inline uint32_t count(const uint32_t* mask)
+		{
+			uint32_t result = 0;
+			for(uint32_t l = 0; l < W; l++)
+			{
+				result += mask[l] & 1;
+			}
+			return result;
+		}
+
+		/// Loads
+
+		// lanes reading consecutive texels of one row of a buffer with packed
+		// texels get them with a row of vector loads, anything else, like
+		// lanes past the edge or refilled lanes from different rows, is
+		// gathered one lane at a time
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		template<uint32_t N>
+		inline void SIMDMachine<W, ISA>::load(const Buffer& buffer, const Register* x, const Register* y, Register (*out_texels)[W])
+		{
+			const int32_t x0 = x[0].i;
+			const int32_t y0 = y != nullptr ? y[0].i : 0;
+
+			uint32_t apart = 0;
+			for(uint32_t l = 0; l < W; l++)
+			{
+				apart |= (x[l].u - x[0].u) ^ l;
+				apart |= y != nullptr ? (y[l].u ^ y[0].u) : 0;
+			}
+
+			if(apart == 0 && buffer.element_stride == sizeof(Register) * N &&
+				x0 >= 0 && x0 <= buffer.width - (int32_t)W && y0 >= 0 && y0 < buffer.height)
+			{
+				const Register* src = (const Register*)(buffer.data + y0 * buffer.row_pitch) + x0 * N;
+				for(uint32_t k = 0; k < N; k++)
+				{
+					for(uint32_t l = 0; l < W; l++)
+					{
+						out_texels[k][l] = src[l * N + k];
+					}
+				}
+				return;
+			}
+
+			for(uint32_t l = 0; l < W; l++)
+			{
+				const Register* src = (const Register*)SampleAddress(buffer, x[l].i, y != nullptr ? y[l].i : 0);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					out_texels[k][l] = src[k];
+				}
+			}
+		}
+
+		/// Lane refill
+
+		// finds the first While that isn't inside an If or another loop,
+		// begin is its loop_begin and exit its loop_exit
+		static bool find_refill_loop(const std::vector<Instruction>& code, uint32_t& out_begin, uint32_t& out_exit)
+		{
+			uint32_t depth = 0;
+			bool found = false;
+			for(uint32_t pc = 0; pc < code.size(); pc++)
+			{
+				switch(code[pc].op)
+				{
+				case Opcode::if_false:
+				case Opcode::loop_begin:
+					if(!found && depth == 0 && code[pc].op == Opcode::loop_begin && code[pc].a != 0)
+					{
+						out_begin = pc;
+						found = true;
+					}
+					depth++;
+					break;
+				case Opcode::end_if:
+				case Opcode::loop_exit:
+					depth--;
+					if(found && depth == 0 && code[pc].op == Opcode::loop_exit)
+					{
+						out_exit = pc;
+						return true;
+					}
+					break;
+				default:
+					break;
+				}
+			}
+			return false;
+		}
+
+		// copies the [begin, end) block of code and ends it with a halt; jumps
+		// past the end of the block go to the halt
+		static void extract(const std::vector<Instruction>& code, uint32_t begin, uint32_t end, std::vector<Instruction>& out_code)
+		{
+			out_code.assign(code.begin() + begin, code.begin() + end);
+			for(size_t pc = 0; pc < out_code.size(); pc++)
+			{
+				Instruction& in = out_code[pc];
+				switch(GetOperandFormat((Opcode::Type)in.op))
+				{
+				case OperandFormat::Branch:
+				case OperandFormat::Jump:
+					COMPUTE_ASSERT(in.c >= begin);
+					in.c = (uint16_t)((in.c < end ? in.c : end) - begin);
+					break;
+				default:
+					break;
+				}
+			}
+			Instruction halt = {Opcode::halt, 0, 0, 0, 0};
+			out_code.push_back(halt);
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		SIMDMachine<W, ISA>::SIMDMachine(const Bytecode& bytecode, bool refill_lanes)
+			: _bytecode(bytecode)
+			, _mask_depth(0)
+			, _refill_lanes(refill_lanes)
+			, _busy_lanes(0)
+			, _lane_slots(0)
+		{
+			// every If and While pushes one entry on the mask stack
+			uint32_t depth = 0;
+			for(size_t pc = 0; pc < _bytecode.code.size(); pc++)
+			{
+				switch(_bytecode.code[pc].op)
+				{
+				case Opcode::if_false:
+				case Opcode::loop_begin:
+					depth++;
+					_mask_depth = depth > _mask_depth ? depth : _mask_depth;
+					break;
+				case Opcode::end_if:
+				case Opcode::loop_exit:
+					COMPUTE_ASSERT(depth > 0);
+					depth--;
+					break;
+				default:
+					break;
+				}
+			}
+			COMPUTE_ASSERT(depth == 0);
+
+			if(_refill_lanes)
+			{
+				uint32_t begin = 0;
+				uint32_t exit = 0;
+				const bool found = find_refill_loop(_bytecode.code, begin, exit);
+				COMPUTE_ASSERT(found);
+				COMPUTE_ASSERT(_bytecode.code[exit - 1].op == Opcode::loop_end);
+				(void)found;
+
+				// the loop's own begin and exit are left out, the machine keeps
+				// track of which lanes are in it. Its loop_test is the first one
+				// in the body and jumps to the halt once no more than b lanes
+				// are left, so lanes are finished and refilled in bulk; the
+				// code around the loop costs as much for one lane as for all
+				extract(_bytecode.code, 0, begin, _prologue);
+				extract(_bytecode.code, begin + 1, exit, _drain);
+				extract(_bytecode.code, exit + 1, (uint32_t)_bytecode.code.size(), _epilogue);
+
+				_iteration = _drain;
+				for(size_t pc = 0; pc < _iteration.size(); pc++)
+				{
+					if(_iteration[pc].op == Opcode::loop_test)
+					{
+						_iteration[pc].b = W / 2;
+						break;
+					}
+				}
+			}
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		void SIMDMachine<W, ISA>::Run(const Invocation& invocation, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			std::vector<Register> register_storage(_bytecode.register_count * W + 64 / sizeof(Register));
+			Register* r = align_lanes(register_storage);
+			// the active lanes, then a saved and an else mask per stack entry
+			std::vector<uint32_t> mask_storage((1 + 2 * _mask_depth) * W + 64 / sizeof(uint32_t));
+			uint32_t* masks = align_lanes(mask_storage);
+
+			// constants and uniforms are the same in every lane for the whole run
+			for(size_t i = 0; i < _bytecode.constants.size(); i++)
+			{
+				const Bytecode::Constant& c = _bytecode.constants[i];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					r[c.slot * W + l] = c.value;
+				}
+			}
+			for(size_t i = 0; i < _bytecode.uniforms.size(); i++)
+			{
+				const Bytecode::Binding& b = _bytecode.uniforms[i];
+				for(uint32_t k = 0; k < b.count; k++)
+				{
+					for(uint32_t l = 0; l < W; l++)
+					{
+						r[(b.slot + k) * W + l].u = invocation.symbols[b.sid].u[k];
+					}
+				}
+			}
+
+			if(_refill_lanes)
+			{
+				run_refill(invocation, r, masks, x0, y0, x1, y1);
+			}
+			else
+			{
+				run_rows(invocation, r, masks, x0, y0, x1, y1);
+			}
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		void SIMDMachine<W, ISA>::run_rows(const Invocation& invocation, Register* r, uint32_t* masks, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			Register* index_x = r + ReservedRegister::IndexX * W;
+			Register* index_y = r + ReservedRegister::IndexY * W;
+			Register* normalized_x = r + ReservedRegister::NormalizedIndexX * W;
+			Register* normalized_y = r + ReservedRegister::NormalizedIndexY * W;
+
+			const Instruction* code = &_bytecode.code[0];
+			uint64_t trips[2] = {0, 0};
+			for(int32_t y = y0; y < y1; y++)
+			{
+				for(uint32_t l = 0; l < W; l++)
+				{
+					index_y[l].i = y;
+					// sampled at the center of each element like the OpenGL backend
+					normalized_y[l].f = (y + 0.5f) / invocation.size[1];
+				}
+
+				for(int32_t x = x0; x < x1; x += W)
+				{
+					// lanes past the end of the row start out inactive
+					for(uint32_t l = 0; l < W; l++)
+					{
+						index_x[l].i = x + (int32_t)l;
+						normalized_x[l].f = (x + (int32_t)l + 0.5f) / invocation.size[0];
+						masks[l] = (x + (int32_t)l < x1) ? ~0u : 0u;
+					}
+
+					// outputs nothing writes to are 0
+					for(size_t i = 0; i < _bytecode.outputs.size(); i++)
+					{
+						const Bytecode::Binding& b = _bytecode.outputs[i];
+						memset(r + b.slot * W, 0x00, sizeof(Register) * W * b.count);
+					}
+
+					execute(code, r, masks, invocation, trips);
+				}
+			}
+
+			_busy_lanes += trips[0];
+			_lane_slots += trips[1];
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		void SIMDMachine<W, ISA>::run_refill(const Invocation& invocation, Register* r, uint32_t* masks, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			Register* index_x = r + ReservedRegister::IndexX * W;
+			Register* index_y = r + ReservedRegister::IndexY * W;
+			Register* normalized_x = r + ReservedRegister::NormalizedIndexX * W;
+			Register* normalized_y = r + ReservedRegister::NormalizedIndexY * W;
+
+			// elements of the rectangle are handed out in row order
+			const int32_t width = x1 - x0;
+			const int32_t element_count = width * (y1 - y0);
+			int32_t next = 0;
+
+			// lanes in the loop, and lanes that left it waiting to finish their
+			// element together with the next ones that do
+			uint32_t looping[W];
+			uint32_t done[W];
+			memset(looping, 0x00, sizeof(looping));
+			memset(done, 0x00, sizeof(done));
+
+			uint64_t trips[2] = {0, 0};
+			for(;;)
+			{
+				if(any<W>(done))
+				{
+					memcpy(masks, done, sizeof(done));
+					execute(&_epilogue[0], r, masks, invocation, trips);
+					memset(done, 0x00, sizeof(done));
+				}
+
+				// start every free lane on the next element
+				bool started = false;
+				for(uint32_t l = 0; l < W; l++)
+				{
+					masks[l] = 0;
+					if(looping[l] == 0 && next < element_count)
+					{
+						const int32_t x = x0 + next % width;
+						const int32_t y = y0 + next / width;
+						next++;
+
+						index_x[l].i = x;
+						index_y[l].i = y;
+						normalized_x[l].f = (x + 0.5f) / invocation.size[0];
+						normalized_y[l].f = (y + 0.5f) / invocation.size[1];
+						for(size_t i = 0; i < _bytecode.outputs.size(); i++)
+						{
+							const Bytecode::Binding& b = _bytecode.outputs[i];
+							for(uint32_t k = 0; k < b.count; k++)
+							{
+								r[(b.slot + k) * W + l].u = 0;
+							}
+						}
+
+						masks[l] = ~0u;
+						started = true;
+					}
+				}
+				if(started)
+				{
+					execute(&_prologue[0], r, masks, invocation, trips);
+					for(uint32_t l = 0; l < W; l++)
+					{
+						looping[l] |= masks[l];
+					}
+				}
+
+				// nothing left to start and every loop is done
+				if(!any<W>(looping))
+				{
+					break;
+				}
+
+				// loop until half the lanes are free, or until the last lane is
+				// done once there is nothing left to start them on
+				memcpy(masks, looping, sizeof(looping));
+				execute(next < element_count ? &_iteration[0] : &_drain[0], r, masks, invocation, trips);
+				for(uint32_t l = 0; l < W; l++)
+				{
+					done[l] |= looping[l] & ~masks[l];
+					looping[l] = masks[l];
+				}
+			}
+
+			_busy_lanes += trips[0];
+			_lane_slots += trips[1];
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		float SIMDMachine<W, ISA>::GetLaneUtilization() const
+		{
+			const uint64_t slots = _lane_slots.load();
+			return slots > 0 ? (float)((double)_busy_lanes.load() / (double)slots) : 1.0f;
+		}
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		void SIMDMachine<W, ISA>::ResetStatistics()
+		{
+			_busy_lanes = 0;
+			_lane_slots = 0;
+		}
+
+		/// Dispatch
+
+#ifdef SICKL_COMPUTED_GOTO
+#	define HANDLER(OP) op_##OP:
+#	define DISPATCH() goto *labels[ip->op]
+#else
+#	define HANDLER(OP) case Opcode::OP:
+#	define DISPATCH() continue
+#endif
+
+#define NEXT() ++ip; DISPATCH()
+#define JUMP(TARGET) ip = code + (TARGET); DISPATCH()
+
+		// lanes of operand register k of the current instruction
+#define LANES_D(K) (r + (ip->dst + (K)) * W)
+#define LANES_A(K) (r + (ip->a + (K)) * W)
+#define LANES_B(K) (r + (ip->b + (K)) * W)
+#define LANES_C(K) (r + (ip->c + (K)) * W)
+		// lane l of operand register k
+#define A(K) LANES_A(K)[l]
+#define B(K) LANES_B(K)[l]
+#define C(K) LANES_C(K)[l]
+
+		// computes EXPR for every lane of component k of a W wide register,
+		// then blends the result into the destination under the active mask
+#define COMPONENTWISE_N(NAME, N, FIELD, EXPR)\
+		HANDLER(NAME##_##N)\
+		{\
+			for(uint32_t k = 0; k < N; k++)\
+			{\
+				Register v[W];\
+				for(uint32_t l = 0; l < W; l++)\
+				{\
+					v[l].FIELD = (EXPR);\
+				}\
+				blend<W>(LANES_D(k), v, mask);\
+			}\
+		}\
+		NEXT();
+
+#define COMPONENTWISE(NAME, FIELD, EXPR)\
+		COMPONENTWISE_N(NAME, 1, FIELD, EXPR)\
+		COMPONENTWISE_N(NAME, 2, FIELD, EXPR)\
+		COMPONENTWISE_N(NAME, 3, FIELD, EXPR)\
+		COMPONENTWISE_N(NAME, 4, FIELD, EXPR)
+
+		// scalar opcodes are componentwise with a width of 1
+#define SCALAR(NAME, FIELD, EXPR)\
+		HANDLER(NAME)\
+		{\
+			Register v[W];\
+			for(uint32_t l = 0; l < W; l++)\
+			{\
+				v[l].FIELD = (EXPR);\
+			}\
+			blend<W>(LANES_D(0), v, mask);\
+		}\
+		NEXT();
+
+		// a library function of A(0) and B(0), with the accuracy in c picked
+		// outside the lane loops so each of them vectorizes
+#define MATH_LANES(FUNCTION, ACCURACY, ARGUMENTS)\
+			for(uint32_t l = 0; l < W; l++)\
+			{\
+				v[l].f = Math::FUNCTION<Math::ACCURACY>ARGUMENTS;\
+			}\
+			break;
+#define MATH(NAME, FUNCTION, ARGUMENTS)\
+		HANDLER(NAME)\
+		{\
+			Register v[W];\
+			switch(ip->c)\
+			{\
+			case CPUMathAccuracy::Precise: MATH_LANES(FUNCTION, Precise, ARGUMENTS)\
+			case CPUMathAccuracy::Balanced: MATH_LANES(FUNCTION, Balanced, ARGUMENTS)\
+			case CPUMathAccuracy::Fast: MATH_LANES(FUNCTION, Fast, ARGUMENTS)\
+			default: MATH_LANES(FUNCTION, Standard, ARGUMENTS)\
+			}\
+			blend<W>(LANES_D(0), v, mask);\
+		}\
+		NEXT();
+
+		// handlers that get the width as N
+#define VECTOR_N(NAME, N_, BODY)\
+		HANDLER(NAME##_##N_)\
+		{\
+			const uint32_t N = N_;\
+			BODY\
+		}\
+		NEXT();
+
+#define VECTOR(NAME, BODY)\
+		VECTOR_N(NAME, 1, BODY)\
+		VECTOR_N(NAME, 2, BODY)\
+		VECTOR_N(NAME, 3, BODY)\
+		VECTOR_N(NAME, 4, BODY)
+
+		template<uint32_t W, CPUInstructionSet::Type ISA>
+		void SIMDMachine<W, ISA>::execute(const Instruction* code, Register* r, uint32_t* masks, const Invocation& invocation, uint64_t* trips)
+		{
+			const Instruction* ip = code;
+			// the active lanes, kept local so the compiler knows the register
+			// file can't alias it
+			uint32_t mask[W];
+			memcpy(mask, masks, sizeof(mask));
+			// top of the mask stack, each entry is the mask to restore at the
+			// end of the block followed by the lanes waiting on the Else
+			uint32_t* stack = masks + W;
+
+#ifdef SICKL_COMPUTED_GOTO
+#	define VECTOR_LABEL(NAME, TYPE, FORMAT) &&op_##NAME##_1, &&op_##NAME##_2, &&op_##NAME##_3, &&op_##NAME##_4,
+#	define SCALAR_LABEL(NAME, FORMAT) &&op_##NAME,
+			static const void* const labels[] =
+			{
+				SICKL_VECTOR_OPCODES(VECTOR_LABEL)
+				SICKL_SCALAR_OPCODES(SCALAR_LABEL)
+			};
+#	undef SCALAR_LABEL
+#	undef VECTOR_LABEL
+
+			DISPATCH();
+#else
+			for(;;)
+			{
+				switch(ip->op)
+				{
+#endif
+			/// Moves
+			COMPONENTWISE(mov, u, A(k).u)
+			VECTOR(splat,
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), LANES_A(0), mask);
+				})
+
+			/// Float arithmetic
+			COMPONENTWISE(fadd, f, A(k).f + B(k).f)
+			COMPONENTWISE(fsub, f, A(k).f - B(k).f)
+			COMPONENTWISE(fmul, f, A(k).f * B(k).f)
+			COMPONENTWISE(fdiv, f, A(k).f / B(k).f)
+			COMPONENTWISE(fmod, f, fmodf(A(k).f, B(k).f))
+			COMPONENTWISE(fneg, f, -A(k).f)
+			COMPONENTWISE(fmuladd, f, A(k).f * B(k).f + C(k).f)
+			COMPONENTWISE(fmulsub, f, A(k).f * B(k).f - C(k).f)
+
+			/// Integer arithmetic, signed overflow wraps like it does on the GPU
+			COMPONENTWISE(iadd, u, A(k).u + B(k).u)
+			COMPONENTWISE(isub, u, A(k).u - B(k).u)
+			COMPONENTWISE(imul, u, A(k).u * B(k).u)
+			COMPONENTWISE(idiv, i, IntDivide(A(k).i, B(k).i))
+			COMPONENTWISE(imod, i, IntModulo(A(k).i, B(k).i))
+			COMPONENTWISE(udiv, u, UIntDivide(A(k).u, B(k).u))
+			COMPONENTWISE(umod, u, UIntModulo(A(k).u, B(k).u))
+			COMPONENTWISE(ineg, u, 0u - A(k).u)
+
+			/// Bitwise
+			COMPONENTWISE(band, u, A(k).u & B(k).u)
+			COMPONENTWISE(bor, u, A(k).u | B(k).u)
+			COMPONENTWISE(bxor, u, A(k).u ^ B(k).u)
+			COMPONENTWISE(bnot, u, ~A(k).u)
+			COMPONENTWISE(shl, u, A(k).u << (B(k).u & 31))
+			COMPONENTWISE(ishr, i, IntShiftRight(A(k).i, B(k).i))
+			COMPONENTWISE(ushr, u, A(k).u >> (B(k).u & 31))
+
+			/// Conversions
+			COMPONENTWISE(i2f, f, (float)A(k).i)
+			COMPONENTWISE(u2f, f, (float)A(k).u)
+			COMPONENTWISE(f2i, i, (int32_t)A(k).f)
+			COMPONENTWISE(f2u, u, (uint32_t)A(k).f)
+
+			/// Vector math
+			VECTOR(length,
+				Register v[W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					float sum = 0.0f;
+					for(uint32_t k = 0; k < N; k++)
+					{
+						sum += A(k).f * A(k).f;
+					}
+					v[l].f = sqrtf(sum);
+				}
+				blend<W>(LANES_D(0), v, mask);)
+			VECTOR(distance,
+				Register v[W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					float sum = 0.0f;
+					for(uint32_t k = 0; k < N; k++)
+					{
+						sum += (A(k).f - B(k).f) * (A(k).f - B(k).f);
+					}
+					v[l].f = sqrtf(sum);
+				}
+				blend<W>(LANES_D(0), v, mask);)
+			VECTOR(dot,
+				Register v[W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					float sum = 0.0f;
+					for(uint32_t k = 0; k < N; k++)
+					{
+						sum += A(k).f * B(k).f;
+					}
+					v[l].f = sum;
+				}
+				blend<W>(LANES_D(0), v, mask);)
+			VECTOR(normalize,
+				Register v[4][W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					float sum = 0.0f;
+					for(uint32_t k = 0; k < N; k++)
+					{
+						sum += A(k).f * A(k).f;
+					}
+					const float scale = 1.0f / sqrtf(sum);
+					for(uint32_t k = 0; k < N; k++)
+					{
+						v[k][l].f = A(k).f * scale;
+					}
+				}
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				})
+
+			/// Memory, one gather per lane
+			VECTOR(sample1d,
+				const Buffer& buffer = invocation.buffers[ip->c];
+				Register v[4][W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					const Register* src = (const Register*)SampleAddress(buffer, A(0).i, 0);
+					for(uint32_t k = 0; k < N; k++)
+					{
+						v[k][l] = src[k];
+					}
+				}
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				})
+			VECTOR(sample2d,
+				const Buffer& buffer = invocation.buffers[ip->c];
+				Register v[4][W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					const Register* src = (const Register*)SampleAddress(buffer, A(0).i, B(0).i);
+					for(uint32_t k = 0; k < N; k++)
+					{
+						v[k][l] = src[k];
+					}
+				}
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				})
+			/// Memory, a row of texels at once where the lanes read one
+			VECTOR(load1d,
+				Register v[4][W];
+				load<N>(invocation.buffers[ip->c], LANES_A(0), nullptr, v);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				})
+			VECTOR(load2d,
+				Register v[4][W];
+				load<N>(invocation.buffers[ip->c], LANES_A(0), LANES_B(0), v);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				})
+			VECTOR(store,
+				const Buffer& out = invocation.outputs[ip->c];
+				const Register* index_x = r + ReservedRegister::IndexX * W;
+				const Register* index_y = r + ReservedRegister::IndexY * W;
+				for(uint32_t l = 0; l < W; l++)
+				{
+					if(mask[l])
+					{
+						Register* dest = (Register*)(out.data + index_y[l].i * out.row_pitch + index_x[l].i * out.element_stride);
+						for(uint32_t k = 0; k < N; k++)
+						{
+							dest[k] = A(k);
+						}
+					}
+				})
+
+			/// Comparison
+			SCALAR(feq, i, A(0).f == B(0).f)
+			SCALAR(fne, i, A(0).f != B(0).f)
+			SCALAR(flt, i, A(0).f < B(0).f)
+			SCALAR(fle, i, A(0).f <= B(0).f)
+			SCALAR(ieq, i, A(0).i == B(0).i)
+			SCALAR(ine, i, A(0).i != B(0).i)
+			SCALAR(ilt, i, A(0).i < B(0).i)
+			SCALAR(ile, i, A(0).i <= B(0).i)
+			SCALAR(ult, i, A(0).u < B(0).u)
+			SCALAR(ule, i, A(0).u <= B(0).u)
+
+			/// Logical
+			SCALAR(land, i, (A(0).i != 0) & (B(0).i != 0))
+			SCALAR(lor, i, (A(0).i != 0) | (B(0).i != 0))
+			SCALAR(lnot, i, A(0).i == 0)
+			SCALAR(tobool, i, A(0).i != 0)
+
+			/// Functions
+			MATH(fsin, Sin, (A(0).f))
+			MATH(fcos, Cos, (A(0).f))
+			MATH(ftan, Tan, (A(0).f))
+			MATH(fasin, ASin, (A(0).f))
+			MATH(facos, ACos, (A(0).f))
+			MATH(fatan, ATan, (A(0).f))
+			MATH(fsinh, SinH, (A(0).f))
+			MATH(fcosh, CosH, (A(0).f))
+			MATH(ftanh, TanH, (A(0).f))
+			MATH(fasinh, ASinH, (A(0).f))
+			MATH(facosh, ACosH, (A(0).f))
+			MATH(fatanh, ATanH, (A(0).f))
+			// Balanced pow is Precise pow, which is too big to inline twice
+			HANDLER(fpow)
+			{
+				Register v[W];
+				switch(ip->c)
+				{
+				case CPUMathAccuracy::Precise: case CPUMathAccuracy::Balanced: MATH_LANES(Pow, Precise, (A(0).f, B(0).f))
+				case CPUMathAccuracy::Fast: MATH_LANES(Pow, Fast, (A(0).f, B(0).f))
+				default: MATH_LANES(Pow, Standard, (A(0).f, B(0).f))
+				}
+				blend<W>(LANES_D(0), v, mask);
+			}
+			NEXT();
+			MATH(fexp, Exp, (A(0).f))
+			MATH(flog, Log, (A(0).f))
+			MATH(fexp2, Exp2, (A(0).f))
+			MATH(flog2, Log2, (A(0).f))
+			SCALAR(fsqrt, f, sqrtf(A(0).f))
+			SCALAR(fabs, f, fabsf(A(0).f))
+			SCALAR(fsign, f, (float)((A(0).f > 0.0f) - (A(0).f < 0.0f)))
+			SCALAR(iabs, i, A(0).i < 0 ? (int32_t)(0u - A(0).u) : A(0).i)
+			SCALAR(isign, i, (A(0).i > 0) - (A(0).i < 0))
+			SCALAR(ffloor, f, floorf(A(0).f))
+			SCALAR(fceil, f, ceilf(A(0).f))
+			SCALAR(fmin, f, B(0).f < A(0).f ? B(0).f : A(0).f)
+			SCALAR(fmax, f, A(0).f < B(0).f ? B(0).f : A(0).f)
+			HANDLER(fclamp)
+			{
+				Register v[W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					const float low = A(0).f < B(0).f ? B(0).f : A(0).f;
+					v[l].f = C(0).f < low ? C(0).f : low;
+				}
+				blend<W>(LANES_D(0), v, mask);
+			}
+			NEXT();
+			SCALAR(fisnan, f, isnan(A(0).f) ? 1.0f : 0.0f)
+			SCALAR(fisinf, f, isinf(A(0).f) ? 1.0f : 0.0f)
+			HANDLER(cross)
+			{
+				Register v[3][W];
+				for(uint32_t l = 0; l < W; l++)
+				{
+					v[0][l].f = A(1).f * B(2).f - A(2).f * B(1).f;
+					v[1][l].f = A(2).f * B(0).f - A(0).f * B(2).f;
+					v[2][l].f = A(0).f * B(1).f - A(1).f * B(0).f;
+				}
+				for(uint32_t k = 0; k < 3; k++)
+				{
+					blend<W>(LANES_D(k), v[k], mask);
+				}
+			}
+			NEXT();
+
+			/// Control flow
+			HANDLER(if_false)
+			{
+				uint32_t* saved = stack;
+				uint32_t* waiting = stack + W;
+				stack += 2 * W;
+
+				const int32_t* cond = (const int32_t*)LANES_A(0);
+				for(uint32_t l = 0; l < W; l++)
+				{
+					const uint32_t taken = cond[l] != 0 ? ~0u : 0u;
+					saved[l] = mask[l];
+					waiting[l] = mask[l] & ~taken;
+					mask[l] &= taken;
+				}
+
+				// no lane wants the If block; the target is either the start of
+				// the Else block or the end_if
+				if(!any<W>(mask))
+				{
+					memcpy(mask, waiting, sizeof(uint32_t) * W);
+					JUMP(ip->c);
+				}
+			}
+			NEXT();
+			HANDLER(else_jump)
+			{
+				memcpy(mask, stack - W, sizeof(uint32_t) * W);
+				if(!any<W>(mask))
+				{
+					JUMP(ip->c);
+				}
+			}
+			NEXT();
+			HANDLER(end_if)
+			HANDLER(loop_exit)
+			{
+				stack -= 2 * W;
+				memcpy(mask, stack, sizeof(uint32_t) * W);
+			}
+			NEXT();
+			HANDLER(loop_begin)
+			{
+				memcpy(stack, mask, sizeof(uint32_t) * W);
+				stack += 2 * W;
+			}
+			NEXT();
+			HANDLER(loop_test)
+			{
+				// lanes leave the loop for good once their condition fails
+				const int32_t* cond = (const int32_t*)LANES_A(0);
+				for(uint32_t l = 0; l < W; l++)
+				{
+					mask[l] &= cond[l] != 0 ? ~0u : 0u;
+				}
+				const uint32_t active = count<W>(mask);
+				if(active <= ip->b)
+				{
+					JUMP(ip->c);
+				}
+				trips[0] += active;
+				trips[1] += W;
+			}
+			NEXT();
+			HANDLER(loop_end)
+			{
+				JUMP(ip->c);
+			}
+			HANDLER(halt)
+			{
+				memcpy(masks, mask, sizeof(mask));
+				return;
+			}
+#ifndef SICKL_COMPUTED_GOTO
+				default:
+					COMPUTE_ASSERT(false);
+					return;
+				}
+			}
+#endif
+		}
+
+#undef VECTOR
+#undef VECTOR_N
+#undef MATH
+#undef MATH_LANES
+#undef SCALAR
+#undef COMPONENTWISE
+#undef COMPONENTWISE_N
+#undef C
+#undef B
+#undef A
+#undef LANES_C
+#undef LANES_B
+#undef LANES_A
+#undef LANES_D
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef HANDLER
+	}
+}
@@ -0,0 +1,264 @@
+#include "CPU.Scheduler.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// binds the calling thread to one core, quietly does nothing where
+		// that isn't supported
+		static void pin_to_core(uint32_t core)
+		{
+			const uint32_t cores = std::thread::hardware_concurrency();
+			if(cores == 0)
+			{
+				return;
+			}
+			core %= cores;
+#if defined(_WIN32)
+			SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+		}
+
+		Scheduler::Scheduler(uint32_t thread_count, bool pin_threads)
+			: _pin_threads(pin_threads)
+			, _generation(0)
+			, _finished(0)
+			, _quit(false)
+			, _kernel(nullptr)
+			, _traversal(nullptr)
+			, _fill_data(nullptr)
+			, _fill_source(nullptr)
+			, _fill_row_bytes(0)
+			, _fill_rows(0)
+			, _steals(0)
+		{
+			COMPUTE_ASSERT(thread_count > 0);
+
+			// queue 0 belongs to whichever thread calls Run
+			for(uint32_t i = 0; i < thread_count; i++)
+			{
+				_queues.push_back(new Queue());
+			}
+			for(uint32_t i = 1; i < thread_count; i++)
+			{
+				_threads.push_back(std::thread(&Scheduler::work, this, i));
+			}
+		}
+
+		Scheduler::~Scheduler()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_quit = true;
+			}
+			_wake.notify_all();
+			for(size_t i = 0; i < _threads.size(); i++)
+			{
+				_threads[i].join();
+			}
+			for(size_t i = 0; i < _queues.size(); i++)
+			{
+				delete _queues[i];
+			}
+		}
+
+		void Scheduler::Run(const Kernel& kernel, const Traversal& traversal)
+		{
+			std::lock_guard<std::mutex> run_guard(_run_lock);
+
+			const uint32_t tile_count = traversal.TileCount();
+
+			_steals = 0;
+			// nothing to share
+			if(tile_count <= 1 || _threads.empty())
+			{
+				for(uint32_t t = 0; t < tile_count; t++)
+				{
+					traversal.RunTile(kernel, t);
+				}
+				return;
+			}
+
+			// every thread starts with a contiguous run of tiles in traversal
+			// order so neighbouring tiles share caches until stealing kicks in
+			const uint32_t thread_count = ThreadCount();
+			for(uint32_t i = 0; i < thread_count; i++)
+			{
+				const uint32_t begin = (uint32_t)((uint64_t)tile_count * i / thread_count);
+				const uint32_t end = (uint32_t)((uint64_t)tile_count * (i + 1) / thread_count);
+
+				std::lock_guard<std::mutex> guard(_queues[i]->lock);
+				COMPUTE_ASSERT(_queues[i]->tiles.empty());
+				for(uint32_t t = begin; t < end; t++)
+				{
+					_queues[i]->tiles.push_back(t);
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_kernel = &kernel;
+				_traversal = &traversal;
+			}
+			dispatch();
+			_kernel = nullptr;
+			_traversal = nullptr;
+		}
+
+		void Scheduler::Fill(uint8_t* data, const uint8_t* source, size_t row_bytes, uint32_t rows)
+		{
+			std::lock_guard<std::mutex> run_guard(_run_lock);
+
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_fill_data = data;
+				_fill_source = source;
+				_fill_row_bytes = row_bytes;
+				_fill_rows = rows;
+			}
+			dispatch();
+			_fill_data = nullptr;
+			_fill_source = nullptr;
+		}
+
+		void Scheduler::dispatch()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_finished = 0;
+				_generation++;
+			}
+			_wake.notify_all();
+
+			if(_fill_data != nullptr)
+			{
+				fill_rows(0);
+			}
+			else
+			{
+				run_tiles(0);
+			}
+
+			// our share is done but the workers may still be busy with theirs.
+			// Waiting for all of them, even those that only wake up now, also
+			// keeps any from picking up the next job with this one's state
+			std::unique_lock<std::mutex> lock(_lock);
+			while(_finished != _threads.size())
+			{
+				_done.wait(lock);
+			}
+		}
+
+		void Scheduler::work(uint32_t index)
+		{
+			if(_pin_threads)
+			{
+				pin_to_core(index);
+			}
+
+			uint64_t generation = 0;
+			for(;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_lock);
+					while(!_quit && _generation == generation)
+					{
+						_wake.wait(lock);
+					}
+					if(_quit)
+					{
+						return;
+					}
+					generation = _generation;
+				}
+
+				if(_fill_data != nullptr)
+				{
+					fill_rows(index);
+				}
+				else
+				{
+					run_tiles(index);
+				}
+
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_finished++;
+					_done.notify_all();
+				}
+			}
+		}
+
+		void Scheduler::run_tiles(uint32_t index)
+		{
+			uint32_t tile;
+			while(pop(index, tile) || steal(index, tile))
+			{
+				_traversal->RunTile(*_kernel, tile);
+			}
+		}
+
+		// the same split as the deal of the tiles in Run
+		void Scheduler::fill_rows(uint32_t index)
+		{
+			const uint32_t thread_count = ThreadCount();
+			const size_t begin = (size_t)((uint64_t)_fill_rows * index / thread_count) * _fill_row_bytes;
+			const size_t end = (size_t)((uint64_t)_fill_rows * (index + 1) / thread_count) * _fill_row_bytes;
+			if(_fill_source != nullptr)
+			{
+				memcpy(_fill_data + begin, _fill_source + begin, end - begin);
+			}
+			else
+			{
+				memset(_fill_data + begin, 0x00, end - begin);
+			}
+		}
+
+		bool Scheduler::pop(uint32_t index, uint32_t& out_tile)
+		{
+			Queue& queue = *_queues[index];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if(queue.tiles.empty())
+			{
+				return false;
+			}
+			out_tile = queue.tiles.front();
+			queue.tiles.pop_front();
+			return true;
+		}
+
+		// takes the tile furthest from where the victim is working, tiles are
+		// never added during a Run so empty everywhere means done
+		bool Scheduler::steal(uint32_t index, uint32_t& out_tile)
+		{
+			const uint32_t thread_count = ThreadCount();
+			for(uint32_t i = 1; i < thread_count; i++)
+			{
+				Queue& victim = *_queues[(index + i) % thread_count];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				if(!victim.tiles.empty())
+				{
+					out_tile = victim.tiles.back();
+					victim.tiles.pop_back();
+					_steals++;
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CPU.Traversal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// runs the tiles of a Traversal on a pool of worker threads; the
+		// calling thread works too. Every thread owns
+		// a deque of tiles, takes work from its front and steals from the
+		// back of the others once it runs dry, so uneven kernels keep every
+		// thread busy until the last tile
+		class Scheduler
+		{
+		public:
+			// thread_count includes the calling thread, pin_threads binds each
+			// worker to its own core
+			Scheduler(uint32_t thread_count, bool pin_threads);
+			~Scheduler();
+
+			uint32_t ThreadCount() const {return (uint32_t)_queues.size();}
+			// tiles taken from another thread's deque by the last Run
+			uint32_t StealCount() const {return _steals.load();}
+
+			// returns once every tile of the traversal has run
+			void Run(const Kernel&, const Traversal&);
+			// copies rows x row_bytes from source to data, or zeroes them
+			// without a source; each thread takes the rows of the tiles it
+			// starts a row ordered Run with
+			void Fill(uint8_t* data, const uint8_t* source, size_t row_bytes, uint32_t rows);
+		private:
+			Scheduler(const Scheduler&);
+			Scheduler& operator=(const Scheduler&);
+
+			// indices of the tiles in traversal order owned by one thread
+			struct Queue
+			{
+				std::mutex lock;
+				std::deque<uint32_t> tiles;
+			};
+
+			void work(uint32_t index);
+			// wakes the workers on the job set under _lock, does the calling
+			// thread's share and waits for theirs
+			void dispatch();
+			// runs tiles until there are none left anywhere
+			void run_tiles(uint32_t index);
+			void fill_rows(uint32_t index);
+			bool pop(uint32_t index, uint32_t& out_tile);
+			bool steal(uint32_t index, uint32_t& out_tile);
+
+			// one Run at a time
+			std::mutex _run_lock;
+			std::vector<Queue*> _queues;
+			std::vector<std::thread> _threads;
+			bool _pin_threads;
+
+			// the current Run, set under _lock before _generation changes
+			std::mutex _lock;
+			std::condition_variable _wake;
+			std::condition_variable _done;
+			uint64_t _generation;
+			// workers done with the current Run
+			uint32_t _finished;
+			bool _quit;
+			const Kernel* _kernel;
+			const Traversal* _traversal;
+			// or the current Fill, when _fill_data is set
+			uint8_t* _fill_data;
+			const uint8_t* _fill_source;
+			size_t _fill_row_bytes;
+			uint32_t _fill_rows;
+
+			std::atomic<uint32_t> _steals;
+		};
+	}
+}
@@ -0,0 +1,169 @@
+#include "CPU.Traversal.h"
+
+#if defined(_MSC_VER)
+#	include <xmmintrin.h>
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// a tile that reads more than this many cache lines is left to the
+		// hardware prefetcher, prefetching it would push out the tile running
+		static const uint32_t PrefetchBudget = 2048;
+		static const uint32_t CacheLine = 64;
+
+		static inline void prefetch(const uint8_t* address)
+		{
+#if defined(_MSC_VER)
+			_mm_prefetch((const char*)address, _MM_HINT_T0);
+#else
+			__builtin_prefetch(address);
+#endif
+		}
+
+		static uint32_t ceil_log2(uint32_t x)
+		{
+			uint32_t bits = 0;
+			while(((uint64_t)1 << bits) < x)
+			{
+				bits++;
+			}
+			return bits;
+		}
+
+		static int32_t clamp(int32_t x, int32_t count)
+		{
+			return x < 0 ? 0 : (x >= count ? count - 1 : x);
+		}
+
+		Traversal::Traversal(CPUTraversal::Type order, const Invocation& invocation, int32_t tile_width, int32_t tile_height, const Reach* reach, uint32_t reach_count)
+			: _order(order)
+			, _invocation(invocation)
+			, _reach(reach)
+			, _reach_count(reach_count)
+		{
+			COMPUTE_ASSERT(order != CPUTraversal::Automatic);
+			COMPUTE_ASSERT(tile_width > 0 && tile_height > 0);
+
+			const int32_t width = invocation.size[0];
+			const int32_t height = invocation.size[1];
+			if(order == CPUTraversal::Rows)
+			{
+				const int64_t rows = (int64_t)tile_width * tile_height / width;
+				tile_height = rows < 1 ? 1 : (rows > height ? height : (int32_t)rows);
+				tile_width = width;
+			}
+
+			_tile_size[0] = tile_width;
+			_tile_size[1] = tile_height;
+			_columns = (width + tile_width - 1) / tile_width;
+			const int32_t rows = (height + tile_height - 1) / tile_height;
+			_tile_count = (uint32_t)(_columns * rows);
+
+			if(order == CPUTraversal::Morton)
+			{
+				// walks the Z curve over a power of two grid covering the tiles,
+				// the bits of the longer axis past the shorter one's on top,
+				// and keeps the tiles that exist
+				const uint32_t x_bits = ceil_log2((uint32_t)_columns);
+				const uint32_t y_bits = ceil_log2((uint32_t)rows);
+				const uint32_t shared = x_bits < y_bits ? x_bits : y_bits;
+
+				_tiles.reserve(2 * _tile_count);
+				for(uint64_t code = 0; code < ((uint64_t)1 << (x_bits + y_bits)); code++)
+				{
+					uint32_t x = 0;
+					uint32_t y = 0;
+					for(uint32_t b = 0; b < shared; b++)
+					{
+						x |= (uint32_t)((code >> (2 * b)) & 1) << b;
+						y |= (uint32_t)((code >> (2 * b + 1)) & 1) << b;
+					}
+					const uint32_t rest = (uint32_t)(code >> (2 * shared)) << shared;
+					x |= x_bits > y_bits ? rest : 0;
+					y |= x_bits > y_bits ? 0 : rest;
+
+					if(x < (uint32_t)_columns && y < (uint32_t)rows)
+					{
+						_tiles.push_back(x);
+						_tiles.push_back(y);
+					}
+				}
+				COMPUTE_ASSERT(_tiles.size() == 2 * _tile_count);
+			}
+		}
+
+		void Traversal::GetTile(uint32_t tile, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const
+		{
+			COMPUTE_ASSERT(tile < _tile_count);
+			if(_order == CPUTraversal::Morton)
+			{
+				x0 = (int32_t)_tiles[2 * tile] * _tile_size[0];
+				y0 = (int32_t)_tiles[2 * tile + 1] * _tile_size[1];
+			}
+			else
+			{
+				x0 = (int32_t)(tile % _columns) * _tile_size[0];
+				y0 = (int32_t)(tile / _columns) * _tile_size[1];
+			}
+			x1 = x0 + _tile_size[0] < _invocation.size[0] ? x0 + _tile_size[0] : _invocation.size[0];
+			y1 = y0 + _tile_size[1] < _invocation.size[1] ? y0 + _tile_size[1] : _invocation.size[1];
+		}
+
+		void Traversal::Prefetch(uint32_t tile) const
+		{
+			// whole rows stream in fine on their own
+			if(_order == CPUTraversal::Rows || _reach_count == 0)
+			{
+				return;
+			}
+
+			int32_t x0, y0, x1, y1;
+			GetTile(tile, x0, y0, x1, y1);
+
+			uint32_t lines = 0;
+			for(uint32_t i = 0; i < _reach_count; i++)
+			{
+				const Reach& r = _reach[i];
+				const Buffer& b = _invocation.buffers[r.buffer];
+				const uint32_t texel = sizeof(Value::i[0]) * ComponentCount(b.type);
+				const uint32_t row_bytes = (uint32_t)(clamp(x1 - 1 + r.x1, b.width) - clamp(x0 + r.x0, b.width)) * (uint32_t)b.element_stride + texel;
+				lines += (uint32_t)(clamp(y1 - 1 + r.y1, b.height) - clamp(y0 + r.y0, b.height) + 1) * ((row_bytes + CacheLine - 1) / CacheLine + 1);
+			}
+			if(lines > PrefetchBudget)
+			{
+				return;
+			}
+
+			for(uint32_t i = 0; i < _reach_count; i++)
+			{
+				const Reach& r = _reach[i];
+				const Buffer& b = _invocation.buffers[r.buffer];
+				const uint32_t texel = sizeof(Value::i[0]) * ComponentCount(b.type);
+				const int32_t last_row = clamp(y1 - 1 + r.y1, b.height);
+				for(int32_t y = clamp(y0 + r.y0, b.height); y <= last_row; y++)
+				{
+					const uint8_t* begin = SampleAddress(b, x0 + r.x0, y);
+					const uint8_t* end = SampleAddress(b, x1 - 1 + r.x1, y) + texel - 1;
+					for(uintptr_t line = (uintptr_t)begin & ~(uintptr_t)(CacheLine - 1); line <= (uintptr_t)end; line += CacheLine)
+					{
+						prefetch((const uint8_t*)line);
+					}
+				}
+			}
+		}
+
+		void Traversal::RunTile(const Kernel& kernel, uint32_t tile) const
+		{
+			if(tile + 1 < _tile_count)
+			{
+				Prefetch(tile + 1);
+			}
+
+			int32_t x0, y0, x1, y1;
+			GetTile(tile, x0, y0, x1, y1);
+			kernel.Run(_invocation, x0, y0, x1, y1);
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CPU.Analysis.h"
+
+#include <vector>
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// splits the index domain of one Run into tiles and puts them in the
+		// order of a CPUTraversal; running a tile first prefetches the texel
+		// rows the next one samples, so they arrive while this one computes
+		class Traversal
+		{
+		public:
+			// Tiles and Morton cut the domain into tile_width x tile_height
+			// tiles; Rows into bands of whole rows with about as many elements
+			Traversal(CPUTraversal::Type, const Invocation&, int32_t tile_width, int32_t tile_height, const Reach* reach, uint32_t reach_count);
+
+			CPUTraversal::Type GetOrder() const {return _order;}
+			uint32_t TileCount() const {return _tile_count;}
+			// the [x0,x1) x [y0,y1) rectangle of the tile'th tile in order
+			void GetTile(uint32_t tile, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const;
+			// starts loading the texels tile reads from each buffer in reach
+			void Prefetch(uint32_t tile) const;
+			// prefetches the tile after this one, then runs this one
+			void RunTile(const Kernel&, uint32_t tile) const;
+		private:
+			CPUTraversal::Type _order;
+			const Invocation& _invocation;
+			const Reach* _reach;
+			uint32_t _reach_count;
+
+			int32_t _tile_size[2];
+			int32_t _columns;
+			uint32_t _tile_count;
+			// for Morton, the column and row of each tile in visiting order,
+			// interleaved: tile i is at _tiles[2 * i], _tiles[2 * i + 1]
+			std::vector<uint32_t> _tiles;
+		};
+	}
+}
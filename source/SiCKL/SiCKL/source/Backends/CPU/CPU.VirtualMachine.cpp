@@ -0,0 +1,369 @@
+#include "CPU.VirtualMachine.h"
+#include "CPU.Math.h"
+
+#include <math.h>
+#include <string.h>
+
+// GCC and clang can jump straight from one handler to the next
+#if defined(__GNUC__)
+#	define SICKL_COMPUTED_GOTO
+#endif
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		VirtualMachine::VirtualMachine(const Bytecode& bytecode)
+			: _bytecode(bytecode)
+		{ }
+
+		void VirtualMachine::Run(const Invocation& invocation, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const
+		{
+			Register* registers = new Register[_bytecode.register_count];
+			memset(registers, 0x00, sizeof(Register) * _bytecode.register_count);
+
+			// constants and uniforms stay put for the whole run
+			for(size_t i = 0; i < _bytecode.constants.size(); i++)
+			{
+				registers[_bytecode.constants[i].slot] = _bytecode.constants[i].value;
+			}
+			for(size_t i = 0; i < _bytecode.uniforms.size(); i++)
+			{
+				const Bytecode::Binding& b = _bytecode.uniforms[i];
+				memcpy(registers + b.slot, &invocation.symbols[b.sid], sizeof(Register) * b.count);
+			}
+
+			const Instruction* code = &_bytecode.code[0];
+			for(int32_t y = y0; y < y1; y++)
+			{
+				registers[ReservedRegister::IndexY].i = y;
+				if(_bytecode.uses_normalized_index)
+				{
+					// sampled at the center of each element like the OpenGL backend
+					registers[ReservedRegister::NormalizedIndexY].f = (y + 0.5f) / invocation.size[1];
+				}
+
+				for(int32_t x = x0; x < x1; x++)
+				{
+					registers[ReservedRegister::IndexX].i = x;
+					if(_bytecode.uses_normalized_index)
+					{
+						registers[ReservedRegister::NormalizedIndexX].f = (x + 0.5f) / invocation.size[0];
+					}
+
+					// outputs nothing writes to are 0
+					for(size_t i = 0; i < _bytecode.outputs.size(); i++)
+					{
+						const Bytecode::Binding& b = _bytecode.outputs[i];
+						memset(registers + b.slot, 0x00, sizeof(Register) * b.count);
+					}
+
+					execute(code, registers, invocation);
+				}
+			}
+
+			delete[] registers;
+		}
+
+		/// Dispatch
+
+#ifdef SICKL_COMPUTED_GOTO
+#	define HANDLER(OP) op_##OP:
+#	define DISPATCH() goto *labels[ip->op]
+#else
+#	define HANDLER(OP) case Opcode::OP:
+#	define DISPATCH() continue
+#endif
+
+#define NEXT() ++ip; DISPATCH()
+#define JUMP(TARGET) ip = code + (TARGET); DISPATCH()
+
+		// operand registers of the current instruction
+#define D(K) r[ip->dst + (K)]
+#define A(K) r[ip->a + (K)]
+#define B(K) r[ip->b + (K)]
+#define C(K) r[ip->c + (K)]
+
+		// handlers for each width of a vector opcode; STATEMENT runs for every
+		// component k and may read component k of its operands after writing
+		// component k - 1 of the destination, since the destination either
+		// matches an operand exactly or doesn't overlap it
+#define COMPONENTWISE_N(NAME, N, STATEMENT)\
+		HANDLER(NAME##_##N)\
+		{\
+			for(uint32_t k = 0; k < N; k++)\
+			{\
+				STATEMENT;\
+			}\
+		}\
+		NEXT();
+
+#define COMPONENTWISE(NAME, STATEMENT)\
+		COMPONENTWISE_N(NAME, 1, STATEMENT)\
+		COMPONENTWISE_N(NAME, 2, STATEMENT)\
+		COMPONENTWISE_N(NAME, 3, STATEMENT)\
+		COMPONENTWISE_N(NAME, 4, STATEMENT)
+
+		// handlers that get the width as N
+#define VECTOR_N(NAME, N_, BODY)\
+		HANDLER(NAME##_##N_)\
+		{\
+			const uint32_t N = N_;\
+			BODY\
+		}\
+		NEXT();
+
+#define VECTOR(NAME, BODY)\
+		VECTOR_N(NAME, 1, BODY)\
+		VECTOR_N(NAME, 2, BODY)\
+		VECTOR_N(NAME, 3, BODY)\
+		VECTOR_N(NAME, 4, BODY)
+
+#define SCALAR(NAME, STATEMENT)\
+		HANDLER(NAME)\
+		{\
+			STATEMENT;\
+		}\
+		NEXT();
+
+		void VirtualMachine::execute(const Instruction* code, Register* r, const Invocation& invocation)
+		{
+			const Instruction* ip = code;
+
+#ifdef SICKL_COMPUTED_GOTO
+#	define VECTOR_LABEL(NAME, TYPE, FORMAT) &&op_##NAME##_1, &&op_##NAME##_2, &&op_##NAME##_3, &&op_##NAME##_4,
+#	define SCALAR_LABEL(NAME, FORMAT) &&op_##NAME,
+			static const void* const labels[] =
+			{
+				SICKL_VECTOR_OPCODES(VECTOR_LABEL)
+				SICKL_SCALAR_OPCODES(SCALAR_LABEL)
+			};
+#	undef SCALAR_LABEL
+#	undef VECTOR_LABEL
+
+			DISPATCH();
+#else
+			for(;;)
+			{
+				switch(ip->op)
+				{
+#endif
+			/// Moves
+			COMPONENTWISE(mov, D(k) = A(k))
+			VECTOR(splat,
+				const Register s = A(0);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k) = s;
+				})
+
+			/// Float arithmetic
+			COMPONENTWISE(fadd, D(k).f = A(k).f + B(k).f)
+			COMPONENTWISE(fsub, D(k).f = A(k).f - B(k).f)
+			COMPONENTWISE(fmul, D(k).f = A(k).f * B(k).f)
+			COMPONENTWISE(fdiv, D(k).f = A(k).f / B(k).f)
+			COMPONENTWISE(fmod, D(k).f = fmodf(A(k).f, B(k).f))
+			COMPONENTWISE(fneg, D(k).f = -A(k).f)
+			COMPONENTWISE(fmuladd, const float m = A(k).f * B(k).f; D(k).f = m + C(k).f)
+			COMPONENTWISE(fmulsub, const float m = A(k).f * B(k).f; D(k).f = m - C(k).f)
+
+			/// Integer arithmetic, signed overflow wraps like it does on the GPU
+			COMPONENTWISE(iadd, D(k).u = A(k).u + B(k).u)
+			COMPONENTWISE(isub, D(k).u = A(k).u - B(k).u)
+			COMPONENTWISE(imul, D(k).u = A(k).u * B(k).u)
+			COMPONENTWISE(idiv, D(k).i = IntDivide(A(k).i, B(k).i))
+			COMPONENTWISE(imod, D(k).i = IntModulo(A(k).i, B(k).i))
+			COMPONENTWISE(udiv, D(k).u = UIntDivide(A(k).u, B(k).u))
+			COMPONENTWISE(umod, D(k).u = UIntModulo(A(k).u, B(k).u))
+			COMPONENTWISE(ineg, D(k).u = 0u - A(k).u)
+
+			/// Bitwise
+			COMPONENTWISE(band, D(k).u = A(k).u & B(k).u)
+			COMPONENTWISE(bor, D(k).u = A(k).u | B(k).u)
+			COMPONENTWISE(bxor, D(k).u = A(k).u ^ B(k).u)
+			COMPONENTWISE(bnot, D(k).u = ~A(k).u)
+			COMPONENTWISE(shl, D(k).u = A(k).u << (B(k).u & 31))
+			COMPONENTWISE(ishr, D(k).i = IntShiftRight(A(k).i, B(k).i))
+			COMPONENTWISE(ushr, D(k).u = A(k).u >> (B(k).u & 31))
+
+			/// Conversions
+			COMPONENTWISE(i2f, D(k).f = (float)A(k).i)
+			COMPONENTWISE(u2f, D(k).f = (float)A(k).u)
+			COMPONENTWISE(f2i, D(k).i = (int32_t)A(k).f)
+			COMPONENTWISE(f2u, D(k).u = (uint32_t)A(k).f)
+
+			/// Vector math
+			VECTOR(length,
+				float sum = 0.0f;
+				for(uint32_t k = 0; k < N; k++)
+				{
+					sum += A(k).f * A(k).f;
+				}
+				D(0).f = sqrtf(sum);)
+			VECTOR(distance,
+				float sum = 0.0f;
+				for(uint32_t k = 0; k < N; k++)
+				{
+					sum += (A(k).f - B(k).f) * (A(k).f - B(k).f);
+				}
+				D(0).f = sqrtf(sum);)
+			VECTOR(dot,
+				float sum = 0.0f;
+				for(uint32_t k = 0; k < N; k++)
+				{
+					sum += A(k).f * B(k).f;
+				}
+				D(0).f = sum;)
+			VECTOR(normalize,
+				float sum = 0.0f;
+				for(uint32_t k = 0; k < N; k++)
+				{
+					sum += A(k).f * A(k).f;
+				}
+				const float scale = 1.0f / sqrtf(sum);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k).f = A(k).f * scale;
+				})
+
+			/// Memory
+			VECTOR(sample1d,
+				const Register* src = (const Register*)SampleAddress(invocation.buffers[ip->c], A(0).i, 0);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k) = src[k];
+				})
+			VECTOR(sample2d,
+				const Register* src = (const Register*)SampleAddress(invocation.buffers[ip->c], A(0).i, B(0).i);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k) = src[k];
+				})
+			// one element at a time a load is a sample
+			VECTOR(load1d,
+				const Register* src = (const Register*)SampleAddress(invocation.buffers[ip->c], A(0).i, 0);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k) = src[k];
+				})
+			VECTOR(load2d,
+				const Register* src = (const Register*)SampleAddress(invocation.buffers[ip->c], A(0).i, B(0).i);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					D(k) = src[k];
+				})
+			VECTOR(store,
+				const Buffer& out = invocation.outputs[ip->c];
+				Register* dest = (Register*)(out.data + r[ReservedRegister::IndexY].i * out.row_pitch + r[ReservedRegister::IndexX].i * out.element_stride);
+				for(uint32_t k = 0; k < N; k++)
+				{
+					dest[k] = A(k);
+				})
+
+			/// Comparison
+			SCALAR(feq, D(0).i = A(0).f == B(0).f)
+			SCALAR(fne, D(0).i = A(0).f != B(0).f)
+			SCALAR(flt, D(0).i = A(0).f < B(0).f)
+			SCALAR(fle, D(0).i = A(0).f <= B(0).f)
+			SCALAR(ieq, D(0).i = A(0).i == B(0).i)
+			SCALAR(ine, D(0).i = A(0).i != B(0).i)
+			SCALAR(ilt, D(0).i = A(0).i < B(0).i)
+			SCALAR(ile, D(0).i = A(0).i <= B(0).i)
+			SCALAR(ult, D(0).i = A(0).u < B(0).u)
+			SCALAR(ule, D(0).i = A(0).u <= B(0).u)
+
+			/// Logical
+			SCALAR(land, D(0).i = (A(0).i != 0) & (B(0).i != 0))
+			SCALAR(lor, D(0).i = (A(0).i != 0) | (B(0).i != 0))
+			SCALAR(lnot, D(0).i = A(0).i == 0)
+			SCALAR(tobool, D(0).i = A(0).i != 0)
+
+			/// Functions, at the accuracy in c
+			SCALAR(fsin, D(0).f = Math::Sin(ip->c, A(0).f))
+			SCALAR(fcos, D(0).f = Math::Cos(ip->c, A(0).f))
+			SCALAR(ftan, D(0).f = Math::Tan(ip->c, A(0).f))
+			SCALAR(fasin, D(0).f = Math::ASin(ip->c, A(0).f))
+			SCALAR(facos, D(0).f = Math::ACos(ip->c, A(0).f))
+			SCALAR(fatan, D(0).f = Math::ATan(ip->c, A(0).f))
+			SCALAR(fsinh, D(0).f = Math::SinH(ip->c, A(0).f))
+			SCALAR(fcosh, D(0).f = Math::CosH(ip->c, A(0).f))
+			SCALAR(ftanh, D(0).f = Math::TanH(ip->c, A(0).f))
+			SCALAR(fasinh, D(0).f = Math::ASinH(ip->c, A(0).f))
+			SCALAR(facosh, D(0).f = Math::ACosH(ip->c, A(0).f))
+			SCALAR(fatanh, D(0).f = Math::ATanH(ip->c, A(0).f))
+			SCALAR(fpow, D(0).f = Math::Pow(ip->c, A(0).f, B(0).f))
+			SCALAR(fexp, D(0).f = Math::Exp(ip->c, A(0).f))
+			SCALAR(flog, D(0).f = Math::Log(ip->c, A(0).f))
+			SCALAR(fexp2, D(0).f = Math::Exp2(ip->c, A(0).f))
+			SCALAR(flog2, D(0).f = Math::Log2(ip->c, A(0).f))
+			SCALAR(fsqrt, D(0).f = sqrtf(A(0).f))
+			SCALAR(fabs, D(0).f = fabsf(A(0).f))
+			SCALAR(fsign, D(0).f = (float)((A(0).f > 0.0f) - (A(0).f < 0.0f)))
+			SCALAR(iabs, D(0).i = A(0).i < 0 ? (int32_t)(0u - A(0).u) : A(0).i)
+			SCALAR(isign, D(0).i = (A(0).i > 0) - (A(0).i < 0))
+			SCALAR(ffloor, D(0).f = floorf(A(0).f))
+			SCALAR(fceil, D(0).f = ceilf(A(0).f))
+			SCALAR(fmin, D(0).f = B(0).f < A(0).f ? B(0).f : A(0).f)
+			SCALAR(fmax, D(0).f = A(0).f < B(0).f ? B(0).f : A(0).f)
+			SCALAR(fclamp,
+				float v = A(0).f < B(0).f ? B(0).f : A(0).f;
+				D(0).f = C(0).f < v ? C(0).f : v)
+			SCALAR(fisnan, D(0).f = isnan(A(0).f) ? 1.0f : 0.0f)
+			SCALAR(fisinf, D(0).f = isinf(A(0).f) ? 1.0f : 0.0f)
+			SCALAR(cross,
+				const float x = A(1).f * B(2).f - A(2).f * B(1).f;
+				const float y = A(2).f * B(0).f - A(0).f * B(2).f;
+				const float z = A(0).f * B(1).f - A(1).f * B(0).f;
+				D(0).f = x;
+				D(1).f = y;
+				D(2).f = z)
+
+			/// Control flow, run by a single element the structure markers do nothing
+			HANDLER(if_false)
+			HANDLER(loop_test)
+			{
+				if(A(0).i == 0)
+				{
+					JUMP(ip->c);
+				}
+			}
+			NEXT();
+			HANDLER(else_jump)
+			HANDLER(loop_end)
+			{
+				JUMP(ip->c);
+			}
+			HANDLER(end_if)
+			HANDLER(loop_begin)
+			HANDLER(loop_exit)
+			{
+			}
+			NEXT();
+			HANDLER(halt)
+			{
+				return;
+			}
+#ifndef SICKL_COMPUTED_GOTO
+				default:
+					COMPUTE_ASSERT(false);
+					return;
+				}
+			}
+#endif
+		}
+
+#undef SCALAR
+#undef VECTOR
+#undef VECTOR_N
+#undef COMPONENTWISE
+#undef COMPONENTWISE_N
+#undef C
+#undef B
+#undef A
+#undef D
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef HANDLER
+	}
+}
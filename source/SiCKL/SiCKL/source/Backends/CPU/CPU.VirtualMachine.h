@@ -0,0 +1,22 @@
+#pragma once
+
+#include "CPU.Bytecode.h"
+
+namespace SiCKL
+{
+	namespace Internal
+	{
+		// runs register bytecode one element at a time
+		class VirtualMachine : public Kernel
+		{
+		public:
+			VirtualMachine(const Bytecode&);
+
+			virtual void Run(const Invocation&, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+		private:
+			static void execute(const Instruction* code, Register* registers, const Invocation&);
+
+			Bytecode _bytecode;
+		};
+	}
+}
@@ -0,0 +1,260 @@
+// C
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   include <utime.h>
+#endif
+
+// C++
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+// local
+#include "OpenCL.Cache.h"
+#include "../CPU/CPU.Native.h"
+
+namespace SiCKL
+{
+    namespace Internal
+    {
+        static const size_t DefaultCacheSize = 64 << 20;
+
+        // FNV-1a
+        static uint64_t hash(const char* str, uint64_t h)
+        {
+            for(; *str; str++)
+            {
+                h ^= (uint8_t)*str;
+                h *= 1099511628211ull;
+            }
+            // so "ab", "c" and "a", "bc" differ
+            h ^= 0xff;
+            h *= 1099511628211ull;
+            return h;
+        }
+
+        uint64_t ProgramKey(const char* source, const char* options, const OpenCLDevice& device)
+        {
+            uint64_t h = 14695981039346656037ull;
+            h = hash(source, h);
+            h = hash(options, h);
+            h = hash(device.PlatformName, h);
+            h = hash(device.PlatformVendor, h);
+            h = hash(device.Name, h);
+            h = hash(device.Vendor, h);
+            h = hash(device.Version, h);
+            h = hash(device.DriverVersion, h);
+            return h;
+        }
+
+#if !defined(_WIN32)
+        FILE* OpenCacheFile(const std::string& path)
+        {
+            const int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+            if(fd < 0)
+            {
+                return nullptr;
+            }
+
+            struct stat info;
+            if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_uid != getuid())
+            {
+                close(fd);
+                return nullptr;
+            }
+
+            FILE* f = fdopen(fd, "rb");
+            if(f == nullptr)
+            {
+                close(fd);
+            }
+            return f;
+        }
+
+        static bool cache_enabled()
+        {
+            const char* cache = getenv("SICKL_OPENCL_CACHE");
+            return cache == nullptr || strcmp(cache, "0") != 0;
+        }
+
+        static size_t cache_size()
+        {
+            const char* size = getenv("SICKL_OPENCL_CACHE_SIZE");
+            if(size != nullptr && *size != 0)
+            {
+                return (size_t)strtoull(size, nullptr, 10);
+            }
+            return DefaultCacheSize;
+        }
+
+        static std::string binary_path(const std::string& directory, uint64_t key)
+        {
+            std::stringstream ss;
+            ss << directory << "/" << std::hex << key << ".clbin";
+            return ss.str();
+        }
+
+        struct CachedBinary
+        {
+            std::string path;
+            size_t size;
+            struct timespec used;
+
+            // binaries used within the same second still go in order, the
+            // path breaks the rest of the ties
+            bool operator<(const CachedBinary& right) const
+            {
+                if(used.tv_sec != right.used.tv_sec)
+                {
+                    return used.tv_sec < right.used.tv_sec;
+                }
+                if(used.tv_nsec != right.used.tv_nsec)
+                {
+                    return used.tv_nsec < right.used.tv_nsec;
+                }
+                return path < right.path;
+            }
+        };
+
+        // removes the least recently used binaries until the rest fit, but
+        // never keep_path
+        static void trim_cache(const std::string& directory, const std::string& keep_path, size_t limit)
+        {
+            DIR* dir = opendir(directory.c_str());
+            if(dir == nullptr)
+            {
+                return;
+            }
+
+            std::vector<CachedBinary> binaries;
+            size_t total = 0;
+            while(dirent* entry = readdir(dir))
+            {
+                const size_t length = strlen(entry->d_name);
+                if(length < 6 || strcmp(entry->d_name + length - 6, ".clbin") != 0)
+                {
+                    continue;
+                }
+
+                CachedBinary binary;
+                binary.path = directory + "/" + entry->d_name;
+                struct stat info;
+                if(stat(binary.path.c_str(), &info) != 0)
+                {
+                    continue;
+                }
+                binary.size = (size_t)info.st_size;
+                binary.used = info.st_mtim;
+                total += binary.size;
+                binaries.push_back(binary);
+            }
+            closedir(dir);
+
+            std::sort(binaries.begin(), binaries.end());
+            for(size_t i = 0; i < binaries.size() && total > limit; i++)
+            {
+                if(binaries[i].path == keep_path)
+                {
+                    continue;
+                }
+                // another process may have removed it already
+                if(remove(binaries[i].path.c_str()) == 0)
+                {
+                    total -= binaries[i].size;
+                }
+            }
+        }
+#endif
+
+        bool LoadProgramBinary(uint64_t key, std::string& out_binary)
+        {
+            out_binary.clear();
+#if defined(_WIN32)
+            (void)key;
+            return false;
+#else
+            if(!cache_enabled())
+            {
+                return false;
+            }
+
+            const std::string directory = CacheDirectory();
+            if(directory.empty())
+            {
+                return false;
+            }
+
+            const std::string path = binary_path(directory, key);
+            FILE* f = OpenCacheFile(path);
+            if(f == nullptr)
+            {
+                return false;
+            }
+            char buffer[4096];
+            size_t read;
+            while((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+            {
+                out_binary.append(buffer, read);
+            }
+            fclose(f);
+
+            // the last use decides which binaries go first
+            utime(path.c_str(), nullptr);
+            return !out_binary.empty();
+#endif
+        }
+
+        void StoreProgramBinary(uint64_t key, const std::string& binary)
+        {
+#if defined(_WIN32)
+            (void)key;
+            (void)binary;
+#else
+            if(!cache_enabled() || binary.empty())
+            {
+                return;
+            }
+
+            const size_t limit = cache_size();
+            if(binary.size() > limit)
+            {
+                return;
+            }
+
+            const std::string directory = CacheDirectory();
+            if(directory.empty())
+            {
+                return;
+            }
+
+            // write next to the final file and move it into place when done
+            // so other processes never load a half written binary
+            const std::string path = binary_path(directory, key);
+            std::stringstream ss;
+            ss << path << "." << getpid();
+            const std::string temp_path = ss.str();
+
+            FILE* f = fopen(temp_path.c_str(), "wb");
+            if(f == nullptr)
+            {
+                return;
+            }
+            const bool written = fwrite(binary.data(), 1, binary.size(), f) == binary.size();
+            if((fclose(f) != 0) || !written || rename(temp_path.c_str(), path.c_str()) != 0)
+            {
+                remove(temp_path.c_str());
+                return;
+            }
+
+            // the binary just stored is the one about to be used
+            trim_cache(directory, path, limit);
+#endif
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// C
+#include <stdio.h>
+
+// C++
+#include <string>
+
+// local
+#include "SiCKL.h"
+
+namespace SiCKL
+{
+    namespace Internal
+    {
+        // program binaries are kept in the CacheDirectory as <key>.clbin; the
+        // least recently used are removed once the files add up to more than
+        // SICKL_OPENCL_CACHE_SIZE bytes (64MB by default), and
+        // SICKL_OPENCL_CACHE=0 turns the cache off. Not on Windows
+
+        // identifies the binary of source built with options for device; a
+        // new driver gives new keys
+        uint64_t ProgramKey(const char* source, const char* options, const OpenCLDevice& device);
+        // false if there is no binary for key
+        bool LoadProgramBinary(uint64_t key, std::string& out_binary);
+        void StoreProgramBinary(uint64_t key, const std::string& binary);
+#if !defined(_WIN32)
+        // opens path for reading unless it is anything but a regular file of
+        // this user's, which no one else could have put in its place
+        FILE* OpenCacheFile(const std::string& path);
+#endif
+    }
+}
@@ -1,9 +1,23 @@
 // C
+#include <float.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+// C++
+#include <set>
+#include <string>
+
 // local
 #include "SiCKL.h"
+#include "OpenCL.Cache.h"
+#include "OpenCL.Internal.h"
+
+#undef If
+#undef ElseIf
+#undef Else
+#undef While
+#undef ForInRange
 
 namespace SiCKL
 {
@@ -216,21 +230,805 @@ namespace SiCKL
             size_t _allocated;
         };
         
-        sickl_int print_code(StringBuffer& sb, const ASTNode* node, size_t indent)
+        /// Type helpers
+        
+        // number of components in a scalar, vector or buffer element type
+        static uint32_t component_count(ReturnType_t type)
         {
-            switch(node->_node_type)
+            switch(type & ~(ReturnType::Buffer1D | ReturnType::Buffer2D))
+            {
+            case ReturnType::Int2:
+            case ReturnType::UInt2:
+            case ReturnType::Float2:
+                return 2;
+            case ReturnType::Int3:
+            case ReturnType::UInt3:
+            case ReturnType::Float3:
+                return 3;
+            case ReturnType::Int4:
+            case ReturnType::UInt4:
+            case ReturnType::Float4:
+                return 4;
+            default:
+                return 1;
+            }
+        }
+        
+        // the scalar type of each component
+        static ReturnType_t component_type(ReturnType_t type)
+        {
+            switch(type & ~(ReturnType::Buffer1D | ReturnType::Buffer2D))
+            {
+            case ReturnType::Bool:
+                return ReturnType::Bool;
+            case ReturnType::Int:
+            case ReturnType::Int2:
+            case ReturnType::Int3:
+            case ReturnType::Int4:
+                return ReturnType::Int;
+            case ReturnType::UInt:
+            case ReturnType::UInt2:
+            case ReturnType::UInt3:
+            case ReturnType::UInt4:
+                return ReturnType::UInt;
+            case ReturnType::Float:
+            case ReturnType::Float2:
+            case ReturnType::Float3:
+            case ReturnType::Float4:
+                return ReturnType::Float;
+            default:
+                SICKL_ASSERT(false);
+                return ReturnType::Invalid;
+            }
+        }
+        
+        // count components of the given scalar type
+        static ReturnType_t vector_type(ReturnType_t scalar, uint32_t count)
+        {
+            SICKL_ASSERT(count >= 1 && count <= 4);
+            SICKL_ASSERT(scalar != ReturnType::Bool || count == 1);
+            
+            const ReturnType_t ints[] = {ReturnType::Int, ReturnType::Int2, ReturnType::Int3, ReturnType::Int4};
+            const ReturnType_t uints[] = {ReturnType::UInt, ReturnType::UInt2, ReturnType::UInt3, ReturnType::UInt4};
+            const ReturnType_t floats[] = {ReturnType::Float, ReturnType::Float2, ReturnType::Float3, ReturnType::Float4};
+            switch(scalar)
+            {
+            case ReturnType::Int:
+                return ints[count - 1];
+            case ReturnType::UInt:
+                return uints[count - 1];
+            case ReturnType::Float:
+                return floats[count - 1];
+            default:
+                return scalar;
+            }
+        }
+        
+        static void print_indent(StringBuffer& sb, size_t indent)
+        {
+            for(size_t i = 0; i < indent; i++)
             {
+                sb << "    ";
+            }
+        }
+        
+        // functions the kernel body calls. Integer division and modulo by 0
+        // give 0 like on the other backends rather than trapping on CPU
+        // devices, and samples outside of a buffer are clamped to its edge
+        static void print_prelude(StringBuffer& sb)
+        {
+            const char* types[] = {"int", "int2", "int3", "int4", "uint", "uint2", "uint3", "uint4"};
+            const char* masks[] = {"int", "int2", "int3", "int4", "int", "int2", "int3", "int4"};
             
+            for(uint32_t i = 0; i < count_of(types); i++)
+            {
+                const char* t = types[i];
+                const bool is_signed = i < 4;
+                
+                for(uint32_t op = 0; op < 2; op++)
+                {
+                    sb << t << " sickl_" << (op == 0 ? "quo" : "rem") << '_' << t << '(' << t << " a, " << t << " b)" << newline;
+                    sb << '{' << newline;
+                    sb << "    const " << masks[i] << " bad = (b == (" << t << ")(0))";
+                    if(is_signed)
+                    {
+                        // INT_MIN / -1 overflows, and anything % -1 is 0 anyway
+                        if(op == 0)
+                        {
+                            sb << " | ((b == (" << t << ")(-1)) & (a == (" << t << ")(INT_MIN)))";
+                        }
+                        else
+                        {
+                            sb << " | (b == (" << t << ")(-1))";
+                        }
+                    }
+                    sb << ';' << newline;
+                    sb << "    return select(a " << (op == 0 ? '/' : '%') << " select(b, (" << t << ")(1), bad), (" << t << ")(0), bad);" << newline;
+                    sb << '}' << newline << newline;
+                }
             }
             
-            return SICKL_SUCCESS;
+            sb << "#ifndef SICKL_WIDTH" << newline;
+            sb << "#define SICKL_WIDTH 1" << newline;
+            sb << "#endif" << newline << newline;
+            
+            sb << "int sickl_sign_int(int a)" << newline;
+            sb << '{' << newline;
+            sb << "    return (a > 0) - (a < 0);" << newline;
+            sb << '}' << newline << newline;
+            
+            sb << "int sickl_element(int x, uint length)" << newline;
+            sb << '{' << newline;
+            sb << "    return clamp(x, 0, (int)length - 1);" << newline;
+            sb << '}' << newline << newline;
+            
+            sb << "int sickl_texel(int x, int y, uint width, uint height)" << newline;
+            sb << '{' << newline;
+            sb << "    return clamp(y, 0, (int)height - 1) * (int)width + clamp(x, 0, (int)width - 1);" << newline;
+            sb << '}' << newline << newline;
+            
+            sb << "int sickl_texel_xy(int2 xy, uint width, uint height)" << newline;
+            sb << '{' << newline;
+            sb << "    return sickl_texel(xy.x, xy.y, width, height);" << newline;
+            sb << '}' << newline << newline;
+            
+            // 3 component buffers are passed as scalars in the layout the
+            // host picked, count is the number of elements
+            const char* scalars[] = {"int", "uint", "float"};
+            for(uint32_t i = 0; i < count_of(scalars); i++)
+            {
+                const char* t = scalars[i];
+                
+                sb << t << "3 sickl_load_" << t << "3(const __global " << t << "* p, int i, uint layout, int count)" << newline;
+                sb << '{' << newline;
+                sb << "    if(layout == " << char('0' + OpenCLLayout::Padded) << ')' << newline;
+                sb << "    {" << newline;
+                sb << "        return ((const __global " << t << "4*)p)[i].xyz;" << newline;
+                sb << "    }" << newline;
+                sb << "    if(layout == " << char('0' + OpenCLLayout::Planar) << ')' << newline;
+                sb << "    {" << newline;
+                sb << "        return (" << t << "3)(p[i], p[count + i], p[2 * count + i]);" << newline;
+                sb << "    }" << newline;
+                sb << "    return vload3(i, p);" << newline;
+                sb << '}' << newline << newline;
+                
+                sb << "void sickl_store_" << t << "3(__global " << t << "* p, int i, uint layout, int count, " << t << "3 v)" << newline;
+                sb << '{' << newline;
+                sb << "    if(layout == " << char('0' + OpenCLLayout::Padded) << ')' << newline;
+                sb << "    {" << newline;
+                sb << "        ((__global " << t << "4*)p)[i] = (" << t << "4)(v, 0);" << newline;
+                sb << "    }" << newline;
+                sb << "    else if(layout == " << char('0' + OpenCLLayout::Planar) << ')' << newline;
+                sb << "    {" << newline;
+                sb << "        p[i] = v.x;" << newline;
+                sb << "        p[count + i] = v.y;" << newline;
+                sb << "        p[2 * count + i] = v.z;" << newline;
+                sb << "    }" << newline;
+                sb << "    else" << newline;
+                sb << "    {" << newline;
+                sb << "        vstore3(v, i, p);" << newline;
+                sb << "    }" << newline;
+                sb << '}' << newline << newline;
+            }
+        }
+        
+        /// Expressions
+        
+        static void print_code(StringBuffer& sb, const ASTNode* node);
+        
+        // prints node converted to type, scalars are broadcast to vectors
+        static void print_operand(StringBuffer& sb, const ASTNode* node, ReturnType_t type)
+        {
+            const ReturnType_t node_type = node->_return_type;
+            if(node_type == type)
+            {
+                print_code(sb, node);
+                return;
+            }
+            
+            const uint32_t count = component_count(type);
+            const uint32_t node_count = component_count(node_type);
+            SICKL_ASSERT(node_count == 1 || node_count == count);
+            
+            if(node_count == 1)
+            {
+                // convert the scalar then broadcast it
+                if(count > 1)
+                {
+                    sb << '(' << type << ")(";
+                }
+                const ReturnType_t scalar = component_type(type);
+                if(scalar != node_type)
+                {
+                    sb << '(' << scalar << ")(";
+                    print_code(sb, node);
+                    sb << ')';
+                }
+                else
+                {
+                    print_code(sb, node);
+                }
+                if(count > 1)
+                {
+                    sb << ')';
+                }
+            }
+            else
+            {
+                sb << "convert_" << type << '(';
+                print_code(sb, node);
+                sb << ')';
+            }
+        }
+        
+        // prints (left op right) in the component type of node, a scalar side
+        // is left for OpenCL to broadcast
+        static void print_operator(StringBuffer& sb, const char* op, const ASTNode* node)
+        {
+            SICKL_ASSERT(node->_count == 2);
+            const ReturnType_t scalar = component_type(node->_return_type);
+            const ASTNode* left = node->_children[0];
+            const ASTNode* right = node->_children[1];
+            
+            sb << '(';
+            print_operand(sb, left, vector_type(scalar, component_count(left->_return_type)));
+            sb << ' ' << op << ' ';
+            print_operand(sb, right, vector_type(scalar, component_count(right->_return_type)));
+            sb << ')';
+        }
+        
+        // prints name(a, b, ...) with every child after the first converted to
+        // type
+        static void print_call(StringBuffer& sb, const char* name, const ASTNode* node, uint32_t first_child, ReturnType_t type)
+        {
+            sb << name << '(';
+            for(uint32_t i = first_child; i < node->_count; i++)
+            {
+                if(i > first_child)
+                {
+                    sb << ", ";
+                }
+                print_operand(sb, node->_children[i], type);
+            }
+            sb << ')';
+        }
+        
+        // comparisons are scalar, both sides are promoted to a common type
+        static void print_comparison(StringBuffer& sb, const char* op, const ASTNode* node)
+        {
+            SICKL_ASSERT(node->_count == 2);
+            const ReturnType_t left = component_type(node->_children[0]->_return_type);
+            const ReturnType_t right = component_type(node->_children[1]->_return_type);
+            
+            ReturnType_t promoted = ReturnType::Int;
+            if(left == ReturnType::Float || right == ReturnType::Float)
+            {
+                promoted = ReturnType::Float;
+            }
+            else if(left == ReturnType::UInt || right == ReturnType::UInt)
+            {
+                promoted = ReturnType::UInt;
+            }
+            
+            sb << '(';
+            print_operand(sb, node->_children[0], promoted);
+            sb << ' ' << op << ' ';
+            print_operand(sb, node->_children[1], promoted);
+            sb << ')';
+        }
+        
+        static void print_index(StringBuffer& sb)
+        {
+            sb << "sickl_index";
+        }
+        
+        static void print_normalized_index(StringBuffer& sb)
+        {
+            // sampled at the center of each element like the OpenGL backend
+            sb << "((convert_float2(sickl_index) + 0.5f) / convert_float2(sickl_size))";
+        }
+        
+        static void print_function(StringBuffer& sb, const ASTNode* node)
+        {
+            SICKL_ASSERT(node->_children[0]->_node_type == NodeType::Literal);
+            SICKL_ASSERT(node->_children[0]->_return_type == ReturnType::Int);
+            const int32_t func_id = *(int32_t*)node->_children[0]->_u.literal.data;
+            
+            // the vector math functions work on the width of their first argument
+            const ReturnType_t args = node->_count > 1 ? vector_type(ReturnType::Float, component_count(node->_children[1]->_return_type)) : ReturnType::Float;
+            
+            switch(func_id)
+            {
+            case BuiltinFunction::Index:
+                SICKL_ASSERT(node->_count == 1);
+                print_index(sb);
+                return;
+            case BuiltinFunction::NormalizedIndex:
+                SICKL_ASSERT(node->_count == 1);
+                print_normalized_index(sb);
+                return;
+            case BuiltinFunction::Abs:
+                if(component_type(node->_return_type) == ReturnType::Int)
+                {
+                    // abs of an int is a uint in OpenCL
+                    sb << "((int)";
+                    print_call(sb, "abs", node, 1, ReturnType::Int);
+                    sb << ')';
+                    return;
+                }
+                break;
+            case BuiltinFunction::Sign:
+                if(component_type(node->_return_type) == ReturnType::Int)
+                {
+                    print_call(sb, "sickl_sign_int", node, 1, ReturnType::Int);
+                    return;
+                }
+                break;
+            case BuiltinFunction::IsNan:
+            case BuiltinFunction::IsInf:
+                // an int in OpenCL
+                sb << '(' << node->_return_type << ')';
+                print_call(sb, func_id == BuiltinFunction::IsNan ? "isnan" : "isinf", node, 1, args);
+                return;
+            default:
+                break;
+            }
+            
+            const char* function_names[] =
+            {
+                nullptr,
+                nullptr,
+                "sin",
+                "cos",
+                "tan",
+                "asin",
+                "acos",
+                "atan",
+                "sinh",
+                "cosh",
+                "tanh",
+                "asinh",
+                "acosh",
+                "atanh",
+                "pow",
+                "exp",
+                "log",
+                "exp2",
+                "log2",
+                "sqrt",
+                "fabs",
+                "sign",
+                "floor",
+                "ceil",
+                "min",
+                "max",
+                "clamp",
+                nullptr,
+                nullptr,
+                "length",
+                "distance",
+                "dot",
+                "cross",
+                "normalize",
+            };
+            SICKL_ASSERT(func_id >= 0 && func_id < (int32_t)count_of(function_names));
+            SICKL_ASSERT(function_names[func_id] != nullptr);
+            
+            print_call(sb, function_names[func_id], node, 1, args);
+        }
+        
+        // buffers are indexed by a clamped element, 3 component ones go
+        // through their layout
+        static void print_sample(StringBuffer& sb, const ASTNode* node)
+        {
+            const ASTNode* buffer = node->_children[0];
+            SICKL_ASSERT(buffer->_node_type == NodeType::ConstVar);
+            const symbol_id_t sid = buffer->_u.sid;
+            const bool vector3 = component_count(buffer->_return_type) == 3;
+            
+            if(vector3)
+            {
+                sb << "sickl_load_" << vector_type(component_type(buffer->_return_type), 3) << '(' << sid << ", ";
+            }
+            else
+            {
+                sb << sid << '[';
+            }
+            if(node->_node_type == NodeType::Sample1D)
+            {
+                SICKL_ASSERT(node->_count == 2);
+                sb << "sickl_element(";
+                print_operand(sb, node->_children[1], ReturnType::Int);
+                sb << ", " << sid << "_length)";
+            }
+            else if(node->_count == 2)
+            {
+                sb << "sickl_texel_xy(";
+                print_operand(sb, node->_children[1], ReturnType::Int2);
+                sb << ", " << sid << "_width, " << sid << "_height)";
+            }
+            else
+            {
+                SICKL_ASSERT(node->_count == 3);
+                sb << "sickl_texel(";
+                print_operand(sb, node->_children[1], ReturnType::Int);
+                sb << ", ";
+                print_operand(sb, node->_children[2], ReturnType::Int);
+                sb << ", " << sid << "_width, " << sid << "_height)";
+            }
+            
+            if(vector3)
+            {
+                sb << ", " << sid << "_layout, ";
+                if(node->_node_type == NodeType::Sample1D)
+                {
+                    sb << "(int)" << sid << "_length)";
+                }
+                else
+                {
+                    sb << "(int)(" << sid << "_width * " << sid << "_height))";
+                }
+            }
+            else
+            {
+                sb << ']';
+            }
+        }
+        
+        static void print_literal(StringBuffer& sb, const ASTNode* node)
+        {
+            char buffer[32] = {0};
+            switch(node->_return_type)
+            {
+            case ReturnType::Bool:
+                sb << (*(bool*)node->_u.literal.data ? "true" : "false");
+                break;
+            case ReturnType::Int:
+                {
+                    const int32_t val = *(int32_t*)node->_u.literal.data;
+                    if(val == INT32_MIN)
+                    {
+                        // -2147483648 is the negation of a literal too large for an int
+                        sb << "(-2147483647 - 1)";
+                    }
+                    else
+                    {
+                        snprintf(buffer, sizeof(buffer), "%i", val);
+                        sb << buffer;
+                    }
+                }
+                break;
+            case ReturnType::UInt:
+                snprintf(buffer, sizeof(buffer), "%uu", *(uint32_t*)node->_u.literal.data);
+                sb << buffer;
+                break;
+            case ReturnType::Float:
+                {
+                    const float val = *(float*)node->_u.literal.data;
+                    if(val != val)
+                    {
+                        sb << "NAN";
+                    }
+                    else if(val > FLT_MAX || val < -FLT_MAX)
+                    {
+                        sb << (val < 0.0f ? "(-INFINITY)" : "INFINITY");
+                    }
+                    else
+                    {
+                        snprintf(buffer, sizeof(buffer), "%.9ef", val);
+                        sb << buffer;
+                    }
+                }
+                break;
+            default:
+                SICKL_ASSERT(false);
+            }
+        }
+        
+        static void print_code(StringBuffer& sb, const ASTNode* node)
+        {
+            switch(node->_node_type)
+            {
+            case NodeType::Var:
+            case NodeType::OutVar:
+            case NodeType::ConstVar:
+                sb << node->_u.sid;
+                break;
+            case NodeType::Literal:
+                print_literal(sb, node);
+                break;
+            case NodeType::Member:
+                SICKL_ASSERT(node->_count == 2);
+                SICKL_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+                sb << '(';
+                print_code(sb, node->_children[0]);
+                sb << ")." << "xyzw"[*(int32_t*)node->_children[1]->_u.literal.data];
+                break;
+            /// Comparison
+            case NodeType::Equal:
+                print_comparison(sb, "==", node);
+                break;
+            case NodeType::NotEqual:
+                print_comparison(sb, "!=", node);
+                break;
+            case NodeType::Greater:
+                print_comparison(sb, ">", node);
+                break;
+            case NodeType::GreaterEqual:
+                print_comparison(sb, ">=", node);
+                break;
+            case NodeType::Less:
+                print_comparison(sb, "<", node);
+                break;
+            case NodeType::LessEqual:
+                print_comparison(sb, "<=", node);
+                break;
+            /// Logical
+            case NodeType::LogicalAnd:
+                SICKL_ASSERT(node->_count == 2);
+                sb << '(';
+                print_code(sb, node->_children[0]);
+                sb << " && ";
+                print_code(sb, node->_children[1]);
+                sb << ')';
+                break;
+            case NodeType::LogicalOr:
+                SICKL_ASSERT(node->_count == 2);
+                sb << '(';
+                print_code(sb, node->_children[0]);
+                sb << " || ";
+                print_code(sb, node->_children[1]);
+                sb << ')';
+                break;
+            case NodeType::LogicalNot:
+                SICKL_ASSERT(node->_count == 1);
+                sb << "!(";
+                print_code(sb, node->_children[0]);
+                sb << ')';
+                break;
+            /// Bitwise
+            case NodeType::BitwiseAnd:
+                print_operator(sb, "&", node);
+                break;
+            case NodeType::BitwiseOr:
+                print_operator(sb, "|", node);
+                break;
+            case NodeType::BitwiseXor:
+                print_operator(sb, "^", node);
+                break;
+            case NodeType::BitwiseNot:
+                SICKL_ASSERT(node->_count == 1);
+                sb << "~(";
+                print_code(sb, node->_children[0]);
+                sb << ')';
+                break;
+            // shift counts are taken modulo the width like on the GPU
+            case NodeType::LeftShift:
+                print_operator(sb, "<<", node);
+                break;
+            case NodeType::RightShift:
+                print_operator(sb, ">>", node);
+                break;
+            /// Arithmetic
+            case NodeType::UnaryMinus:
+                SICKL_ASSERT(node->_count == 1);
+                sb << "-(";
+                print_code(sb, node->_children[0]);
+                sb << ')';
+                break;
+            case NodeType::Add:
+                print_operator(sb, "+", node);
+                break;
+            case NodeType::Subtract:
+                print_operator(sb, "-", node);
+                break;
+            case NodeType::Multiply:
+                print_operator(sb, "*", node);
+                break;
+            case NodeType::Divide:
+            case NodeType::Modulo:
+                SICKL_ASSERT(node->_count == 2);
+                if(component_type(node->_return_type) == ReturnType::Float)
+                {
+                    if(node->_node_type == NodeType::Divide)
+                    {
+                        print_operator(sb, "/", node);
+                    }
+                    else
+                    {
+                        print_call(sb, "fmod", node, 0, node->_return_type);
+                    }
+                }
+                else
+                {
+                    sb << "sickl_" << (node->_node_type == NodeType::Divide ? "quo" : "rem") << '_' << node->_return_type;
+                    print_call(sb, "", node, 0, node->_return_type);
+                }
+                break;
+            /// Functions
+            case NodeType::Constructor:
+                if(node->_count == 1 && component_count(node->_children[0]->_return_type) == 1)
+                {
+                    // broadcast a single scalar
+                    print_operand(sb, node->_children[0], node->_return_type);
+                }
+                else
+                {
+                    // concatenate the components of each child
+                    const ReturnType_t scalar = component_type(node->_return_type);
+                    sb << '(' << node->_return_type << ")(";
+                    for(uint32_t i = 0; i < node->_count; i++)
+                    {
+                        const ASTNode* child = node->_children[i];
+                        if(i > 0)
+                        {
+                            sb << ", ";
+                        }
+                        print_operand(sb, child, vector_type(scalar, component_count(child->_return_type)));
+                    }
+                    sb << ')';
+                }
+                break;
+            case NodeType::Cast:
+                SICKL_ASSERT(node->_count == 1);
+                if(node->_return_type == ReturnType::Bool)
+                {
+                    // floats are truncated to an int first like on the CPU
+                    sb << '(';
+                    print_operand(sb, node->_children[0], ReturnType::Int);
+                    sb << " != 0)";
+                }
+                else
+                {
+                    print_operand(sb, node->_children[0], node->_return_type);
+                }
+                break;
+            case NodeType::Function:
+                SICKL_ASSERT(node->_count >= 1);
+                print_function(sb, node);
+                break;
+            case NodeType::Sample1D:
+            case NodeType::Sample2D:
+                print_sample(sb, node);
+                break;
+            case NodeType::GetIndex:
+                print_index(sb);
+                break;
+            case NodeType::GetNormalizedIndex:
+                print_normalized_index(sb);
+                break;
+            default:
+                // unknown AST node type
+                SICKL_ASSERT(false);
+            }
+        }
+        
+        /// Statements
+        
+        static void print_statement(StringBuffer& sb, const ASTNode* node, size_t indent);
+        
+        static void print_block(StringBuffer& sb, const ASTNode* block, uint32_t first_child, size_t indent)
+        {
+            print_indent(sb, indent);
+            sb << '{' << newline;
+            for(uint32_t i = first_child; i < block->_count; i++)
+            {
+                print_statement(sb, block->_children[i], indent + 1);
+            }
+            print_indent(sb, indent);
+            sb << '}' << newline;
+        }
+        
+        static void print_statement(StringBuffer& sb, const ASTNode* node, size_t indent)
+        {
+            switch(node->_node_type)
+            {
+            case NodeType::Block:
+                print_block(sb, node, 0, indent);
+                break;
+            case NodeType::If:
+            case NodeType::ElseIf:
+            case NodeType::While:
+                SICKL_ASSERT(node->_count >= 1);
+                print_indent(sb, indent);
+                sb << (node->_node_type == NodeType::If ? "if(" : (node->_node_type == NodeType::ElseIf ? "else if(" : "while("));
+                print_code(sb, node->_children[0]);
+                sb << ')' << newline;
+                print_block(sb, node, 1, indent);
+                break;
+            case NodeType::Else:
+                print_indent(sb, indent);
+                sb << "else" << newline;
+                print_block(sb, node, 0, indent);
+                break;
+            case NodeType::ForInRange:
+                {
+                    SICKL_ASSERT(node->_count >= 3);
+                    SICKL_ASSERT(node->_children[1]->_node_type == NodeType::Literal);
+                    SICKL_ASSERT(node->_children[2]->_node_type == NodeType::Literal);
+                    const symbol_id_t it = node->_children[0]->_u.sid;
+                    print_indent(sb, indent);
+                    sb << "for(" << it << " = ";
+                    print_literal(sb, node->_children[1]);
+                    sb << "; " << it << " < ";
+                    print_literal(sb, node->_children[2]);
+                    sb << "; " << it << "++)" << newline;
+                    print_block(sb, node, 3, indent);
+                }
+                break;
+            case NodeType::Assignment:
+                {
+                    SICKL_ASSERT(node->_count == 2);
+                    const ASTNode* dest = node->_children[0];
+                    print_indent(sb, indent);
+                    switch(dest->_node_type)
+                    {
+                    case NodeType::Var:
+                    case NodeType::OutVar:
+                        sb << dest->_u.sid << " = ";
+                        print_operand(sb, node->_children[1], dest->_return_type);
+                        break;
+                    case NodeType::Member:
+                        SICKL_ASSERT(dest->_children[0]->_node_type == NodeType::Var);
+                        SICKL_ASSERT(dest->_children[1]->_node_type == NodeType::Literal);
+                        sb << dest->_children[0]->_u.sid << '.' << "xyzw"[*(int32_t*)dest->_children[1]->_u.literal.data] << " = ";
+                        print_operand(sb, node->_children[1], dest->_return_type);
+                        break;
+                    default:
+                        // can't assign to this
+                        SICKL_ASSERT(false);
+                    }
+                    sb << ';' << newline;
+                }
+                break;
+            default:
+                // expression statement
+                print_indent(sb, indent);
+                print_code(sb, node);
+                sb << ';' << newline;
+                break;
+            }
+        }
+        
+        // every variable is declared zeroed at the top of the kernel, like the
+        // outputs nothing writes to
+        static void print_declarations(StringBuffer& sb, const ASTNode* node, std::set<int32_t>& declared, size_t indent)
+        {
+            switch(node->_node_type)
+            {
+            case NodeType::Var:
+            case NodeType::OutVar:
+                if(declared.insert(node->_u.sid).second)
+                {
+                    print_indent(sb, indent);
+                    sb << node->_return_type << ' ' << node->_u.sid << " = (" << node->_return_type << ")(0);" << newline;
+                }
+                break;
+            default:
+                break;
+            }
+            
+            for(uint32_t i = 0; i < node->_count; i++)
+            {
+                print_declarations(sb, node->_children[i], declared, indent);
+            }
+        }
+        
+        // parameters are lined up after the opening parenthesis
+        static void print_parameter_separator(StringBuffer& sb, bool& first)
+        {
+            if(!first)
+            {
+                sb << ',' << newline << "                         ";
+            }
+            first = false;
         }
         
         sickl_int print_kernel_source(StringBuffer& out_buffer, const ASTNode& in_root)
         {
             // main, const data and out data            
             SICKL_ASSERT(in_root._count == 3);
-    		const ASTNode* const_data = nullptr;
+            const ASTNode* const_data = nullptr;
             const ASTNode* out_data = nullptr;
             const ASTNode* main = nullptr;
     
@@ -253,9 +1051,15 @@ namespace SiCKL
                     break;
                 }
             }
+            ReturnErrorIfNull(const_data, SICKL_INVALID_KERNEL_ARG);
+            ReturnErrorIfNull(out_data, SICKL_INVALID_KERNEL_ARG);
+            ReturnErrorIfNull(main, SICKL_INVALID_KERNEL_ARG);
+            
+            print_prelude(out_buffer);
         
             // function decleration
             out_buffer << "__kernel void KernelMain(";
+            bool first = true;
             
             for(size_t i = 0; i < const_data->_count; i++)
             {
@@ -263,89 +1067,300 @@ namespace SiCKL
                 ReturnType_t type = child->_return_type;
                 symbol_id_t sid = child->_u.sid;
                 
-                out_buffer << newline;
-                
                 if(type & ReturnType::Buffer1D)
                 {
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_length," << newline;
+                    print_parameter_separator(out_buffer, first);
+                    out_buffer << ReturnType::UInt << ' ' << sid << "_length";
                 }
                 else if(type & ReturnType::Buffer2D)
                 {
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_width" << newline;
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_height" << newline;
+                    print_parameter_separator(out_buffer, first);
+                    out_buffer << ReturnType::UInt << ' ' << sid << "_width";
+                    print_parameter_separator(out_buffer, first);
+                    out_buffer << ReturnType::UInt << ' ' << sid << "_height";
                 }
                 
-                out_buffer << "                         ";
-                out_buffer << "const ";
-                if(type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+                const bool buffer = (type & (ReturnType::Buffer1D | ReturnType::Buffer2D)) != 0;
+                if(buffer && component_count(type) == 3)
                 {
-                    out_buffer << "__global ";
+                    print_parameter_separator(out_buffer, first);
+                    out_buffer << ReturnType::UInt << ' ' << sid << "_layout";
                 }
-                out_buffer << type << ' ' << sid << ',';
-                
                 
+                print_parameter_separator(out_buffer, first);
+                if(buffer && component_count(type) == 3)
+                {
+                    out_buffer << "const __global " << component_type(type) << "* " << sid;
+                }
+                else if(buffer)
+                {
+                    out_buffer << "const __global " << type << ' ' << sid;
+                }
+                else if(type == ReturnType::Bool)
+                {
+                    // kernels can't take a bool, the host passes a byte
+                    out_buffer << "const uchar " << sid;
+                }
+                else
+                {
+                    out_buffer << "const " << type << ' ' << sid;
+                }
             }
             
+            // every output is written to a 2D buffer
             for(size_t i = 0; i < out_data->_count; i++)
             {
                 ASTNode* child = out_data->_children[i];
                 ReturnType_t type = child->_return_type;
                 symbol_id_t sid = child->_u.sid;
                 
-                out_buffer << newline;
-                
-                if(type & ReturnType::Buffer1D)
+                print_parameter_separator(out_buffer, first);
+                out_buffer << ReturnType::UInt << ' ' << sid << "_width";
+                print_parameter_separator(out_buffer, first);
+                out_buffer << ReturnType::UInt << ' ' << sid << "_height";
+                print_parameter_separator(out_buffer, first);
+                if(component_count(type) == 3)
                 {
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_length," << newline;
+                    out_buffer << ReturnType::UInt << ' ' << sid << "_layout";
+                    print_parameter_separator(out_buffer, first);
+                    out_buffer << "__global " << component_type(type) << "* " << sid << "_out";
                 }
-                else if(type & ReturnType::Buffer2D)
+                else
                 {
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_width" << newline;
-                    out_buffer << "                         ";
-                    out_buffer << ReturnType::UInt << ' ' << sid << "_height" << newline;
+                    out_buffer << "__global " << (ReturnType_t)(type | ReturnType::Buffer2D) << ' ' << sid << "_out";
                 }
-                
-                out_buffer << "                         ";
-                if(type & (ReturnType::Buffer1D | ReturnType::Buffer2D))
+            }
+            
+            // the size of the index domain, set by the program after the
+            // arguments above
+            print_parameter_separator(out_buffer, first);
+            out_buffer << "const int2 sickl_size";
+            out_buffer << ')' << newline;
+            out_buffer << '{' << newline;
+            
+            // each work item runs SICKL_WIDTH consecutive elements of a row,
+            // the autotuner builds variants with wider ones
+            out_buffer << "    for(int sickl_lane = 0; sickl_lane < SICKL_WIDTH; sickl_lane++)" << newline;
+            out_buffer << "    {" << newline;
+            out_buffer << "        const int2 sickl_index = (int2)((int)get_global_id(0) * SICKL_WIDTH + sickl_lane, (int)get_global_id(1));" << newline;
+            // work items past the end of the domain have nothing to do
+            out_buffer << "        if(sickl_index.x >= sickl_size.x || sickl_index.y >= sickl_size.y)" << newline;
+            out_buffer << "        {" << newline;
+            out_buffer << "            break;" << newline;
+            out_buffer << "        }" << newline << newline;
+            
+            // const data are kernel parameters already
+            std::set<int32_t> declared;
+            for(size_t i = 0; i < const_data->_count; i++)
+            {
+                declared.insert(const_data->_children[i]->_u.sid);
+            }
+            print_declarations(out_buffer, out_data, declared, 2);
+            print_declarations(out_buffer, main, declared, 2);
+            out_buffer << newline;
+            
+            for(uint32_t i = 0; i < main->_count; i++)
+            {
+                print_statement(out_buffer, main->_children[i], 2);
+            }
+            out_buffer << newline;
+            
+            // write out results
+            for(size_t i = 0; i < out_data->_count; i++)
+            {
+                ReturnType_t type = out_data->_children[i]->_return_type;
+                symbol_id_t sid = out_data->_children[i]->_u.sid;
+                out_buffer << "        if(sickl_index.x < (int)" << sid << "_width && sickl_index.y < (int)" << sid << "_height)" << newline;
+                out_buffer << "        {" << newline;
+                if(component_count(type) == 3)
                 {
-                    out_buffer << "__global ";
+                    out_buffer << "            sickl_store_" << type << '(' << sid << "_out, sickl_index.y * (int)" << sid << "_width + sickl_index.x, " << sid << "_layout, (int)(" << sid << "_width * " << sid << "_height), " << sid << ");" << newline;
                 }
-                out_buffer << type << ' ' << sid;
-                if(i < (out_data->_count - 1))
+                else
                 {
-                    out_buffer << ',';
+                    out_buffer << "            " << sid << "_out[sickl_index.y * (int)" << sid << "_width + sickl_index.x] = " << sid << ';' << newline;
                 }
+                out_buffer << "        }" << newline;
             }
-            out_buffer << ')' << newline;
-            out_buffer << '{' << newline;
-            
+            out_buffer << "    }" << newline;
             
             out_buffer << '}' << newline;
+        
+            return SICKL_SUCCESS;
+        }
+        
+        // a program built from the binary cached for key, null if there is
+        // none or the driver won't take it
+        static cl_program build_from_binary(cl_context context, cl_device_id device, uint64_t key, const char* options)
+        {
+            std::string binary;
+            if(!LoadProgramBinary(key, binary))
+            {
+                return nullptr;
+            }
             
+            const size_t length = binary.size();
+            const unsigned char* data = (const unsigned char*)binary.data();
+            cl_int status = CL_SUCCESS;
+            cl_int err = CL_SUCCESS;
+            cl_program program = clCreateProgramWithBinary(context, 1, &device, &length, &data, &status, &err);
+            if(err != CL_SUCCESS || status != CL_SUCCESS)
+            {
+                return nullptr;
+            }
             
+            // binaries still have to be built
+            if(clBuildProgram(program, 1, &device, options, nullptr, nullptr) != CL_SUCCESS)
+            {
+                clReleaseProgram(program);
+                return nullptr;
+            }
+            return program;
+        }
         
-            return SICKL_SUCCESS;
+        // prints the source and build log on failure
+        static cl_program build_from_source(cl_context context, cl_device_id device, const char* source, const char* options, cl_int& out_err)
+        {
+            cl_program program = clCreateProgramWithSource(context, 1, &source, nullptr, &out_err);
+            if(out_err != CL_SUCCESS)
+            {
+                return nullptr;
+            }
+            
+            out_err = clBuildProgram(program, 1, &device, options, nullptr, nullptr);
+            if(out_err != CL_SUCCESS)
+            {
+                size_t log_size = 0;
+                clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+                char* log = new char[log_size + 1];
+                log[0] = 0;
+                clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, nullptr);
+                log[log_size] = 0;
+                printf("%s\n%s\n", source, log);
+                fflush(stdout);
+                delete[] log;
+                
+                clReleaseProgram(program);
+                return nullptr;
+            }
+            return program;
+        }
+        
+        // a program built for one device has one binary
+        static void store_binary(cl_program program, uint64_t key)
+        {
+            size_t length = 0;
+            if(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(length), &length, nullptr) != CL_SUCCESS || length == 0)
+            {
+                return;
+            }
+            
+            std::string binary(length, '\0');
+            unsigned char* data = (unsigned char*)&binary[0];
+            if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, nullptr) != CL_SUCCESS)
+            {
+                return;
+            }
+            StoreProgramBinary(key, binary);
+        }
+        
+        sickl_int BuildKernel(cl_context context, cl_device_id device, const OpenCLDevice& device_info, const char* source, const char* options, cl_kernel& out_kernel)
+        {
+            // build it for our device, or load what an earlier build left in
+            // the cache
+            const uint64_t key = ProgramKey(source, options, device_info);
+            cl_int err = CL_SUCCESS;
+            cl_program program = build_from_binary(context, device, key, options);
+            if(program == nullptr)
+            {
+                program = build_from_source(context, device, source, options, err);
+                ReturnIfError(err);
+                store_binary(program, key);
+            }
+            
+            // the kernel keeps the program alive
+            out_kernel = clCreateKernel(program, "KernelMain", &err);
+            clReleaseProgram(program);
+            return err;
         }
     }
 
-    
-
     sickl_int OpenCLCompiler::Build(Source& in_source, OpenCLProgram& out_program)
     {
+        return Build(OpenCLRuntime::GetDefault(), in_source, out_program);
+    }
+
+    sickl_int OpenCLCompiler::Build(OpenCLRuntime& in_runtime, Source& in_source, OpenCLProgram& out_program)
+    {
+        ReturnErrorIfNull(in_runtime._context, CL_INVALID_CONTEXT);
+        
         in_source.Parse();
         
+        const ASTNode& root = in_source.GetRoot();
         Internal::StringBuffer sb;
-        ReturnIfError(Internal::print_kernel_source(sb, in_source.GetRoot()));
-       
-        printf("%s\n", (const char*)sb);
-        fflush(stdout);
+        ReturnIfError(Internal::print_kernel_source(sb, root));
+        
+        const char* source = sb;
+        cl_kernel kernel = nullptr;
+        ReturnIfError(Internal::BuildKernel(in_runtime._context, in_runtime._device, in_runtime._device_info, source, "", kernel));
+        
+        cl_uint arg_count = 0;
+        cl_int err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(arg_count), &arg_count, nullptr);
+        if(err != CL_SUCCESS)
+        {
+            clReleaseKernel(kernel);
+            return err;
+        }
+        
+        out_program.Delete();
+        out_program._runtime = &in_runtime;
+        out_program._kernel = kernel;
+        out_program._variants[0] = kernel;
+        out_program._arg_count = arg_count;
+        out_program._arg_values = new OpenCLProgram::ArgValue[arg_count];
+        out_program.ClearArgValues();
+        out_program._key = Internal::ProgramKey(source, "", in_runtime._device_info);
+        
+        // the arguments the program expects, in order: the const data then a
+        // 2D buffer for each output
+        const ASTNode* const_data = nullptr;
+        const ASTNode* out_data = nullptr;
+        for(uint32_t i = 0; i < root._count; i++)
+        {
+            switch(root._children[i]->_node_type)
+            {
+            case NodeType::ConstData:
+                const_data = root._children[i];
+                break;
+            case NodeType::OutData:
+                out_data = root._children[i];
+                break;
+            default:
+                break;
+            }
+        }
+        
+        out_program._type_count = const_data->_count + out_data->_count;
+        out_program._output_count = out_data->_count;
+        out_program._types = new ReturnType_t[out_program._type_count];
+        out_program._buffer_events = new Internal::BufferEvents*[out_program._type_count];
+        for(uint32_t i = 0; i < out_program._type_count; i++)
+        {
+            out_program._buffer_events[i] = nullptr;
+        }
+        for(uint32_t i = 0; i < const_data->_count; i++)
+        {
+            out_program._types[i] = const_data->_children[i]->_return_type;
+        }
+        for(uint32_t i = 0; i < out_data->_count; i++)
+        {
+            out_program._types[const_data->_count + i] = (ReturnType_t)(out_data->_children[i]->_return_type | ReturnType::Buffer2D);
+        }
+        
+        const size_t length = strlen(source);
+        out_program._source = new char[length + 1];
+        memcpy(out_program._source, source, length + 1);
         
         return SICKL_SUCCESS;
     }
 }
-
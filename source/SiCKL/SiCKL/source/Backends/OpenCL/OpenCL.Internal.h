@@ -0,0 +1,62 @@
+#pragma once
+
+// C++
+#include <vector>
+
+// local
+#include "SiCKL.h"
+
+namespace SiCKL
+{
+    namespace Internal
+    {
+        // builds the KernelMain of source with options, through the binary
+        // cache
+        sickl_int BuildKernel(cl_context context, cl_device_id device, const OpenCLDevice& device_info, const char* source, const char* options, cl_kernel& out_kernel);
+
+        // how a kernel is launched
+        struct LaunchConfig
+        {
+            // elements of a row each work item runs, a power of 2 up to
+            // MaxLaunchWidth
+            uint32_t width;
+            // 0 leaves the work group size to the driver
+            size_t local_size[2];
+        };
+        const uint32_t MaxLaunchWidth = 8;
+
+        // the configs the autotuner times; GetTuningCandidate is false for
+        // those that don't fit the work dimensions or max_group_size
+        uint32_t TuningCandidateCount();
+        bool GetTuningCandidate(uint32_t index, size_t dimension_count, size_t max_group_size, LaunchConfig& out_config);
+
+        // the tuning database remembers the fastest config of each program
+        // (by the key of its source and device) and domain size in
+        // opencl-tuning.txt in the CacheDirectory
+        bool LoadTuning(uint64_t key, size_t width, size_t height, LaunchConfig& out_config);
+        void StoreTuning(uint64_t key, size_t width, size_t height, const LaunchConfig& config);
+        
+        // the commands using a buffer that haven't been waited on, kept by
+        // runtimes whose queues may run commands in any order. Copies of a
+        // buffer share them
+        struct BufferEvents
+        {
+            BufferEvents();
+            ~BufferEvents();
+            
+            // adds what a command reading (or writing) the buffer has to
+            // wait on to out_wait_list
+            void GetHazards(bool write, std::vector<cl_event>& out_wait_list) const;
+            // take a reference to event
+            void AddReader(cl_event event);
+            void SetWriter(cl_event event);
+            // every command so far is done
+            void Clear();
+            
+            // the last command writing the buffer
+            cl_event writer;
+            // and the ones reading it since
+            std::vector<cl_event> readers;
+        };
+    }
+}
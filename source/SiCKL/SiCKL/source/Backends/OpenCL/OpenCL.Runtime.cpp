@@ -1,15 +1,22 @@
 // C
+#include <ctype.h>
+#include <float.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// C++
+#include <algorithm>
+#include <chrono>
 
 // local
 #include "SiCKL.h"
+#include "OpenCL.Internal.h"
 
 
 namespace SiCKL
 {
-    cl_context OpenCLRuntime::_context = nullptr;
-    cl_device_id OpenCLRuntime::_device = nullptr;
-    cl_command_queue OpenCLRuntime::_command_queue = nullptr;
+    OpenCLRuntime OpenCLRuntime::_default;
     
     namespace Internal
     {
@@ -45,81 +52,602 @@ namespace SiCKL
             return type_size;
         }
     
-        static size_t BufferSize(ReturnType::Type type, size_t count)
+        static bool IsVector3(ReturnType_t type)
+        {
+            return type == ReturnType::Int3 || type == ReturnType::UInt3 || type == ReturnType::Float3;
+        }
+    
+        static size_t BufferSize(ReturnType::Type type, size_t count, OpenCLLayout::Type layout)
         {
+            if(IsVector3(type) && layout == OpenCLLayout::Padded)
+            {
+                return count * 16;
+            }
             return count * TypeSize(type);
         }
     }
 
-    sickl_int OpenCLRuntime::Initialize()
+    //
+    // OpenCLDevice
+    //
+    
+    OpenCLDevice::OpenCLDevice()
+        : Platform(nullptr)
+        , Id(nullptr)
+        , Type(0)
+        , ComputeUnits(0)
+        , ClockFrequency(0)
+        , GlobalMemorySize(0)
+        , LocalMemorySize(0)
+        , MaxAllocationSize(0)
+        , MaxWorkGroupSize(0)
+        , HostUnifiedMemory(false)
     {
-        cl_int err = CL_SUCCESS;
-        cl_platform_id platform_id;
-
-        // get our plafrom id
-        err = clGetPlatformIDs(1, &platform_id, nullptr);
-        if(err == CL_SUCCESS)
+        Name[0] = 0;
+        Vendor[0] = 0;
+        PlatformName[0] = 0;
+        PlatformVendor[0] = 0;
+        Version[0] = 0;
+        DriverVersion[0] = 0;
+        MaxWorkItemSizes[0] = 0;
+        MaxWorkItemSizes[1] = 0;
+        MaxWorkItemSizes[2] = 0;
+    }
+    
+    OpenCLDeviceFilter::OpenCLDeviceFilter()
+        : Type(CL_DEVICE_TYPE_ALL)
+        , Vendor(nullptr)
+        , Index(0)
+    { }
+    
+    namespace Internal
+    {
+        // strings too long for the field are cut short
+        template<size_t N>
+        static void get_string(cl_platform_id platform, cl_platform_info param, char (&out_string)[N])
+        {
+            size_t length = 0;
+            clGetPlatformInfo(platform, param, 0, nullptr, &length);
+            char* buffer = new char[length + 1];
+            buffer[0] = 0;
+            clGetPlatformInfo(platform, param, length, buffer, nullptr);
+            buffer[length] = 0;
+            strncpy(out_string, buffer, N - 1);
+            out_string[N - 1] = 0;
+            delete[] buffer;
+        }
+        
+        template<size_t N>
+        static void get_string(cl_device_id device, cl_device_info param, char (&out_string)[N])
+        {
+            size_t length = 0;
+            clGetDeviceInfo(device, param, 0, nullptr, &length);
+            char* buffer = new char[length + 1];
+            buffer[0] = 0;
+            clGetDeviceInfo(device, param, length, buffer, nullptr);
+            buffer[length] = 0;
+            strncpy(out_string, buffer, N - 1);
+            out_string[N - 1] = 0;
+            delete[] buffer;
+        }
+        
+        template<typename T>
+        static void get_value(cl_device_id device, cl_device_info param, T& out_value)
         {
-            cl_context_properties properties[] =
+            if(clGetDeviceInfo(device, param, sizeof(T), &out_value, nullptr) != CL_SUCCESS)
             {
-                CL_CONTEXT_PLATFORM,
-                (cl_context_properties)platform_id,
-                0,
-            };
-            // create our context
-            _context = clCreateContextFromType(properties, CL_DEVICE_TYPE_GPU, nullptr, nullptr, &err);
-
-            size_t device_buffer_size;
-            err = clGetContextInfo(OpenCLRuntime::_context, CL_CONTEXT_DEVICES, 0, nullptr, &device_buffer_size);
-            if(err == CL_SUCCESS)
+                out_value = T();
+            }
+        }
+        
+        static void query_device(cl_platform_id platform, cl_device_id device, OpenCLDevice& out_device)
+        {
+            out_device.Platform = platform;
+            out_device.Id = device;
+            
+            get_string(platform, CL_PLATFORM_NAME, out_device.PlatformName);
+            get_string(platform, CL_PLATFORM_VENDOR, out_device.PlatformVendor);
+            get_string(device, CL_DEVICE_NAME, out_device.Name);
+            get_string(device, CL_DEVICE_VENDOR, out_device.Vendor);
+            get_string(device, CL_DEVICE_VERSION, out_device.Version);
+            get_string(device, CL_DRIVER_VERSION, out_device.DriverVersion);
+            
+            get_value(device, CL_DEVICE_TYPE, out_device.Type);
+            get_value(device, CL_DEVICE_MAX_COMPUTE_UNITS, out_device.ComputeUnits);
+            get_value(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, out_device.ClockFrequency);
+            get_value(device, CL_DEVICE_GLOBAL_MEM_SIZE, out_device.GlobalMemorySize);
+            get_value(device, CL_DEVICE_LOCAL_MEM_SIZE, out_device.LocalMemorySize);
+            get_value(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, out_device.MaxAllocationSize);
+            get_value(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, out_device.MaxWorkGroupSize);
+            
+            cl_uint dimensions = 0;
+            get_value(device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, dimensions);
+            if(dimensions >= 3)
             {
-                cl_device_id devices[device_buffer_size / sizeof(cl_device_id)];
-                err = clGetContextInfo(OpenCLRuntime::_context, CL_CONTEXT_DEVICES, device_buffer_size, devices, nullptr);
-                if(err == CL_SUCCESS)
+                size_t* sizes = new size_t[dimensions];
+                if(clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, dimensions * sizeof(size_t), sizes, nullptr) == CL_SUCCESS)
                 {
-                    _command_queue = clCreateCommandQueue(OpenCLRuntime::_context, devices[0], 0, nullptr);
-                    _device = devices[0];
+                    out_device.MaxWorkItemSizes[0] = sizes[0];
+                    out_device.MaxWorkItemSizes[1] = sizes[1];
+                    out_device.MaxWorkItemSizes[2] = sizes[2];
                 }
+                delete[] sizes;
             }
+            
+            cl_bool unified = CL_FALSE;
+            get_value(device, CL_DEVICE_HOST_UNIFIED_MEMORY, unified);
+            out_device.HostUnifiedMemory = unified != CL_FALSE;
+        }
+        
+        // whether part is in string, ignoring case
+        static bool contains(const char* string, const char* part)
+        {
+            const size_t length = strlen(part);
+            for(; *string; string++)
+            {
+                size_t i = 0;
+                while(i < length && string[i] && tolower((unsigned char)string[i]) == tolower((unsigned char)part[i]))
+                {
+                    i++;
+                }
+                if(i == length)
+                {
+                    return true;
+                }
+            }
+            return length == 0;
         }
-        return err;
+    }
+    
+    //
+    // OpenCLRuntime
+    //
+    
+    sickl_int OpenCLRuntime::GetDevices(std::vector<OpenCLDevice>& out_devices)
+    {
+        out_devices.clear();
+        
+        cl_uint platform_count = 0;
+        ReturnIfError(clGetPlatformIDs(0, nullptr, &platform_count));
+        ReturnErrorIfTrue(platform_count == 0, CL_DEVICE_NOT_FOUND);
+        
+        std::vector<cl_platform_id> platforms(platform_count);
+        ReturnIfError(clGetPlatformIDs(platform_count, &platforms[0], nullptr));
+        
+        for(cl_uint i = 0; i < platform_count; i++)
+        {
+            // a platform without devices isn't an error
+            cl_uint device_count = 0;
+            if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, nullptr, &device_count) != CL_SUCCESS || device_count == 0)
+            {
+                continue;
+            }
+            
+            std::vector<cl_device_id> devices(device_count);
+            if(clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, device_count, &devices[0], nullptr) != CL_SUCCESS)
+            {
+                continue;
+            }
+            
+            for(cl_uint j = 0; j < device_count; j++)
+            {
+                OpenCLDevice device;
+                Internal::query_device(platforms[i], devices[j], device);
+                out_devices.push_back(device);
+            }
+        }
+        
+        ReturnErrorIfTrue(out_devices.empty(), CL_DEVICE_NOT_FOUND);
+        return SICKL_SUCCESS;
+    }
+    
+    sickl_int OpenCLRuntime::SelectDevice(const OpenCLDeviceFilter& filter, OpenCLDevice& out_device)
+    {
+        std::vector<OpenCLDevice> devices;
+        ReturnIfError(GetDevices(devices));
+        
+        uint32_t index = 0;
+        for(size_t i = 0; i < devices.size(); i++)
+        {
+            const OpenCLDevice& device = devices[i];
+            if((device.Type & filter.Type) == 0)
+            {
+                continue;
+            }
+            if(filter.Vendor != nullptr && !Internal::contains(device.Vendor, filter.Vendor) && !Internal::contains(device.PlatformVendor, filter.Vendor))
+            {
+                continue;
+            }
+            if(index++ == filter.Index)
+            {
+                out_device = device;
+                return SICKL_SUCCESS;
+            }
+        }
+        return CL_DEVICE_NOT_FOUND;
+    }
+
+    OpenCLQueueOptions::OpenCLQueueOptions()
+        : QueueCount(1)
+        , OutOfOrder(false)
+    { }
+
+    sickl_int OpenCLRuntime::Initialize()
+    {
+        // GPUs first, anything else will do on hosts without one
+        OpenCLDeviceFilter filter;
+        filter.Type = CL_DEVICE_TYPE_GPU;
+        
+        OpenCLDevice device;
+        if(SelectDevice(filter, device) != SICKL_SUCCESS)
+        {
+            filter.Type = CL_DEVICE_TYPE_ALL;
+            ReturnIfError(SelectDevice(filter, device));
+        }
+        return Initialize(device);
+    }
+    
+    sickl_int OpenCLRuntime::Initialize(const OpenCLDevice& device, const OpenCLQueueOptions& options)
+    {
+        return _default.Create(device, options);
     }
 
     sickl_int OpenCLRuntime::Finalize()
     {
+        return _default.Release();
+    }
+    
+    OpenCLRuntime::OpenCLRuntime()
+        : _context(nullptr)
+        , _device(nullptr)
+        , _queue_count(0)
+        , _next_queue(0)
+        , _track_hazards(false)
+    {
+        for(uint32_t i = 0; i < OpenCLQueueOptions::MaxQueueCount; i++)
+        {
+            _command_queues[i] = nullptr;
+        }
+    }
+    
+    OpenCLRuntime::~OpenCLRuntime()
+    {
+        Release();
+    }
+    
+    sickl_int OpenCLRuntime::Create(const OpenCLDevice& device, const OpenCLQueueOptions& options)
+    {
+        ReturnErrorIfNull(device.Id, CL_DEVICE_NOT_FOUND);
+        ReturnErrorIfTrue(options.QueueCount == 0 || options.QueueCount > OpenCLQueueOptions::MaxQueueCount, CL_INVALID_VALUE);
+        ReturnIfError(Release());
+        
+        cl_int err = CL_SUCCESS;
+        cl_context_properties properties[] =
+        {
+            CL_CONTEXT_PLATFORM,
+            (cl_context_properties)device.Platform,
+            0,
+        };
+        // create our context
+        cl_context context = clCreateContext(properties, 1, &device.Id, nullptr, nullptr, &err);
+        ReturnIfError(err);
+        
+        // devices that can't run commands out of order get in order
+        // queues, which still overlap each other
+        bool out_of_order = false;
+        if(options.OutOfOrder)
+        {
+            cl_command_queue_properties properties = 0;
+            err = clGetDeviceInfo(device.Id, CL_DEVICE_QUEUE_PROPERTIES, sizeof(properties), &properties, nullptr);
+            out_of_order = err == CL_SUCCESS && (properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+        }
+        
+        _context = context;
+        for(uint32_t i = 0; i < options.QueueCount; i++)
+        {
+            _command_queues[i] = clCreateCommandQueue(context, device.Id, out_of_order ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0, &err);
+            if(err != CL_SUCCESS)
+            {
+                Release();
+                return err;
+            }
+            _queue_count++;
+        }
+        
+        _device_info = device;
+        _device = device.Id;
+        _next_queue = 0;
+        _track_hazards = out_of_order || _queue_count > 1;
+        return SICKL_SUCCESS;
+    }
+    
+    sickl_int OpenCLRuntime::Release()
+    {
+        for(uint32_t i = 0; i < _queue_count; i++)
+        {
+            clReleaseCommandQueue(_command_queues[i]);
+            _command_queues[i] = nullptr;
+        }
+        _queue_count = 0;
+        _next_queue = 0;
+        _track_hazards = false;
         if(_context != nullptr)
         {
             clReleaseContext(_context);
-            clReleaseCommandQueue(_command_queue);
+            _context = nullptr;
+        }
+        _device = nullptr;
+        _device_info = OpenCLDevice();
+        return SICKL_SUCCESS;
+    }
+    
+    sickl_int OpenCLRuntime::Finish()
+    {
+        for(uint32_t i = 0; i < _queue_count; i++)
+        {
+            ReturnIfError(clFinish(_command_queues[i]));
         }
         return SICKL_SUCCESS;
     }
+    
+    cl_command_queue OpenCLRuntime::NextQueue()
+    {
+        if(_queue_count == 0)
+        {
+            return nullptr;
+        }
+        cl_command_queue queue = _command_queues[_next_queue];
+        _next_queue = (_next_queue + 1) % _queue_count;
+        return queue;
+    }
 
+    namespace Internal
+    {
+        //
+        // BufferEvents
+        //
+        
+        // readers are pruned once there are this many
+        static const size_t ReaderPruneCount = 16;
+        
+        BufferEvents::BufferEvents()
+            : writer(nullptr)
+        { }
+        
+        BufferEvents::~BufferEvents()
+        {
+            Clear();
+        }
+        
+        void BufferEvents::GetHazards(bool write, std::vector<cl_event>& out_wait_list) const
+        {
+            if(writer != nullptr)
+            {
+                out_wait_list.push_back(writer);
+            }
+            // reads can run alongside each other
+            if(write)
+            {
+                out_wait_list.insert(out_wait_list.end(), readers.begin(), readers.end());
+            }
+        }
+        
+        void BufferEvents::AddReader(cl_event event)
+        {
+            // buffers only ever read, like lookup tables, would pile up
+            // readers otherwise
+            if(readers.size() >= ReaderPruneCount)
+            {
+                size_t kept = 0;
+                for(size_t i = 0; i < readers.size(); i++)
+                {
+                    cl_int status = CL_COMPLETE;
+                    clGetEventInfo(readers[i], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+                    if(status == CL_COMPLETE)
+                    {
+                        clReleaseEvent(readers[i]);
+                    }
+                    else
+                    {
+                        readers[kept++] = readers[i];
+                    }
+                }
+                readers.resize(kept);
+            }
+            clRetainEvent(event);
+            readers.push_back(event);
+        }
+        
+        void BufferEvents::SetWriter(cl_event event)
+        {
+            // it waited on everything before it
+            clRetainEvent(event);
+            Clear();
+            writer = event;
+        }
+        
+        void BufferEvents::Clear()
+        {
+            if(writer != nullptr)
+            {
+                clReleaseEvent(writer);
+                writer = nullptr;
+            }
+            for(size_t i = 0; i < readers.size(); i++)
+            {
+                clReleaseEvent(readers[i]);
+            }
+            readers.clear();
+        }
+        
+        static cl_uint wait_count(const std::vector<cl_event>& wait_list)
+        {
+            return (cl_uint)wait_list.size();
+        }
+        
+        static const cl_event* wait_events(const std::vector<cl_event>& wait_list)
+        {
+            return wait_list.empty() ? nullptr : &wait_list[0];
+        }
+        
+        // transfers block, so what they waited on is done when they return
+        
+        static sickl_int write_buffer(cl_command_queue queue, cl_mem memory_object, size_t size, const void* data, BufferEvents* events)
+        {
+            std::vector<cl_event> wait_list;
+            if(events != nullptr)
+            {
+                events->GetHazards(true, wait_list);
+            }
+            ReturnIfError(clEnqueueWriteBuffer(queue, memory_object, true, 0, size, data, wait_count(wait_list), wait_events(wait_list), nullptr));
+            if(events != nullptr)
+            {
+                events->Clear();
+            }
+            return SICKL_SUCCESS;
+        }
+        
+        static sickl_int read_buffer(cl_command_queue queue, cl_mem memory_object, size_t size, void* data, BufferEvents* events)
+        {
+            std::vector<cl_event> wait_list;
+            if(events != nullptr)
+            {
+                events->GetHazards(false, wait_list);
+            }
+            return clEnqueueReadBuffer(queue, memory_object, true, 0, size, data, wait_count(wait_list), wait_events(wait_list), nullptr);
+        }
+        
+        static cl_mem create_buffer(cl_context context, size_t size, void* data, OpenCLMemory::Type memory, cl_int& out_err)
+        {
+            cl_mem_flags flags = CL_MEM_READ_WRITE;
+            switch(memory)
+            {
+            case OpenCLMemory::Device:
+                flags |= data != nullptr ? CL_MEM_COPY_HOST_PTR : 0;
+                break;
+            case OpenCLMemory::UseHostPointer:
+                if(data == nullptr)
+                {
+                    out_err = CL_INVALID_HOST_PTR;
+                    return nullptr;
+                }
+                flags |= CL_MEM_USE_HOST_PTR;
+                break;
+            case OpenCLMemory::AllocHostPointer:
+                flags |= CL_MEM_ALLOC_HOST_PTR | (data != nullptr ? CL_MEM_COPY_HOST_PTR : 0);
+                break;
+            default:
+                out_err = CL_INVALID_VALUE;
+                return nullptr;
+            }
+            return clCreateBuffer(context, flags, size, data, &out_err);
+        }
+        
+        static sickl_int map_buffer(cl_command_queue queue, cl_mem memory_object, size_t size, OpenCLMapAccess::Type access, BufferEvents* events, void*& in_out_mapped, void** out_data)
+        {
+            ReturnErrorIfNull(out_data, CL_INVALID_VALUE);
+            *out_data = nullptr;
+            ReturnErrorIfNull(memory_object, CL_INVALID_MEM_OBJECT);
+            ReturnErrorIfFalse(in_out_mapped == nullptr, CL_INVALID_OPERATION);
+            
+            cl_map_flags flags;
+            switch(access)
+            {
+            case OpenCLMapAccess::Read:
+                flags = CL_MAP_READ;
+                break;
+            case OpenCLMapAccess::Write:
+                flags = CL_MAP_WRITE;
+                break;
+            case OpenCLMapAccess::ReadWrite:
+                flags = CL_MAP_READ | CL_MAP_WRITE;
+                break;
+            default:
+                return CL_INVALID_VALUE;
+            }
+            
+            std::vector<cl_event> wait_list;
+            if(events != nullptr)
+            {
+                events->GetHazards(access != OpenCLMapAccess::Read, wait_list);
+            }
+            
+            cl_int err;
+            void* mapped = clEnqueueMapBuffer(queue, memory_object, true, flags, 0, size, wait_count(wait_list), wait_events(wait_list), nullptr, &err);
+            ReturnIfError(err);
+            
+            in_out_mapped = mapped;
+            *out_data = mapped;
+            return SICKL_SUCCESS;
+        }
+        
+        static sickl_int unmap_buffer(cl_command_queue queue, cl_mem memory_object, BufferEvents* events, void*& in_out_mapped)
+        {
+            ReturnErrorIfNull(in_out_mapped, CL_INVALID_OPERATION);
+            // an in order queue runs it before anything enqueued after,
+            // otherwise whatever uses the buffer next waits on it like it
+            // wrote the buffer
+            cl_event event = nullptr;
+            cl_int err = clEnqueueUnmapMemObject(queue, memory_object, in_out_mapped, 0, nullptr, events != nullptr ? &event : nullptr);
+            in_out_mapped = nullptr;
+            if(event != nullptr)
+            {
+                events->SetWriter(event);
+                clReleaseEvent(event);
+            }
+            return err;
+        }
+    }
+    
     //
     // OpenCLBuffer1D
     //
     
     OpenCLBuffer1D::OpenCLBuffer1D()
         : Type(ReturnType::Invalid)
+        , Layout(OpenCLLayout::Packed)
         , Length(0)
         , BufferSize(0)
+        , _runtime(nullptr)
         , _memory_object(nullptr)
+        , _mapped(nullptr)
+        , _events(nullptr)
     { }
 
-    sickl_int OpenCLBuffer1D::Initialize(size_t length, ReturnType_t type, void* data)
+    sickl_int OpenCLBuffer1D::Initialize(size_t length, ReturnType_t type, void* data, OpenCLMemory::Type memory, OpenCLLayout::Type layout)
     {
+        return Initialize(OpenCLRuntime::GetDefault(), length, type, data, memory, layout);
+    }
+
+    sickl_int OpenCLBuffer1D::Initialize(OpenCLRuntime& runtime, size_t length, ReturnType_t type, void* data, OpenCLMemory::Type memory, OpenCLLayout::Type layout)
+    {
+        ReturnErrorIfNull(runtime._context, CL_INVALID_CONTEXT);
+        ReturnErrorIfFalse(layout >= OpenCLLayout::Packed && layout <= OpenCLLayout::Planar, CL_INVALID_VALUE);
+        if(!Internal::IsVector3(type))
+        {
+            layout = OpenCLLayout::Packed;
+        }
+        
         cl_int err;
-        size_t buffer_size = Internal::BufferSize(type, length);
+        size_t buffer_size = Internal::BufferSize(type, length, layout);
 
-        _memory_object = clCreateBuffer(OpenCLRuntime::_context, CL_MEM_READ_WRITE, buffer_size, data, &err);
+        _memory_object = Internal::create_buffer(runtime._context, buffer_size, data, memory, err);
 
         if(err == CL_SUCCESS)
         {
+            _runtime = &runtime;
+            if(runtime._track_hazards)
+            {
+                _events = new Internal::BufferEvents();
+            }
+
             ReturnType_t* pType = const_cast<ReturnType_t*>(&Type);
+            OpenCLLayout::Type* pLayout = const_cast<OpenCLLayout::Type*>(&Layout);
             cl_ulong* pLength = const_cast<cl_ulong*>(&Length);
             size_t* pBufferSize = const_cast<size_t*>(&BufferSize);
 
             *pType = type;
+            *pLayout = layout;
             *pLength = length;
             *pBufferSize = buffer_size;
         }
@@ -129,16 +657,36 @@ namespace SiCKL
 
     sickl_int OpenCLBuffer1D::SetData(void* in_buffer)
     {
-        return clEnqueueWriteBuffer(OpenCLRuntime::_command_queue, _memory_object, true, 0, BufferSize, in_buffer, 0, nullptr, nullptr);
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::write_buffer(_runtime->NextQueue(), _memory_object, BufferSize, in_buffer, _events);
     }
 
     sickl_int OpenCLBuffer1D::GetData(void* out_buffer)
     {
-        return clEnqueueReadBuffer(OpenCLRuntime::_command_queue, _memory_object, true, 0, BufferSize, out_buffer, 0, nullptr, nullptr);
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::read_buffer(_runtime->NextQueue(), _memory_object, BufferSize, out_buffer, _events);
+    }
+    
+    sickl_int OpenCLBuffer1D::map(OpenCLMapAccess::Type access, void** out_data)
+    {
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::map_buffer(_runtime->NextQueue(), _memory_object, BufferSize, access, _events, _mapped, out_data);
+    }
+    
+    sickl_int OpenCLBuffer1D::Unmap()
+    {
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::unmap_buffer(_runtime->NextQueue(), _memory_object, _events, _mapped);
     }
 
     void OpenCLBuffer1D::Delete()
     {
+        if(_mapped != nullptr)
+        {
+            Unmap();
+        }
+        delete _events;
+        _events = nullptr;
         clReleaseMemObject(_memory_object);
         _memory_object = nullptr;
     }
@@ -149,27 +697,51 @@ namespace SiCKL
     
     OpenCLBuffer2D::OpenCLBuffer2D()
         : Type(ReturnType::Invalid)
+        , Layout(OpenCLLayout::Packed)
         , Width(0)
         , Height(0)
         , BufferSize(0)
+        , _runtime(nullptr)
         , _memory_object(nullptr)
+        , _mapped(nullptr)
+        , _events(nullptr)
     { }
     
-    sickl_int OpenCLBuffer2D::Initialize(size_t width, size_t height, ReturnType_t type, void *data)
+    sickl_int OpenCLBuffer2D::Initialize(size_t width, size_t height, ReturnType_t type, void *data, OpenCLMemory::Type memory, OpenCLLayout::Type layout)
     {
+        return Initialize(OpenCLRuntime::GetDefault(), width, height, type, data, memory, layout);
+    }
+    
+    sickl_int OpenCLBuffer2D::Initialize(OpenCLRuntime& runtime, size_t width, size_t height, ReturnType_t type, void *data, OpenCLMemory::Type memory, OpenCLLayout::Type layout)
+    {
+        ReturnErrorIfNull(runtime._context, CL_INVALID_CONTEXT);
+        ReturnErrorIfFalse(layout >= OpenCLLayout::Packed && layout <= OpenCLLayout::Planar, CL_INVALID_VALUE);
+        if(!Internal::IsVector3(type))
+        {
+            layout = OpenCLLayout::Packed;
+        }
+        
         cl_int err;
-        size_t buffer_size = Internal::BufferSize(type, width * height);
+        size_t buffer_size = Internal::BufferSize(type, width * height, layout);
 
-        _memory_object = clCreateBuffer(OpenCLRuntime::_context, CL_MEM_READ_WRITE, buffer_size, data, &err);
+        _memory_object = Internal::create_buffer(runtime._context, buffer_size, data, memory, err);
 
         if(err == CL_SUCCESS)
         {
+            _runtime = &runtime;
+            if(runtime._track_hazards)
+            {
+                _events = new Internal::BufferEvents();
+            }
+
             ReturnType_t* pType = const_cast<ReturnType_t*>(&Type);
+            OpenCLLayout::Type* pLayout = const_cast<OpenCLLayout::Type*>(&Layout);
             cl_ulong* pWidth = const_cast<cl_ulong*>(&Width);
             cl_ulong* pHeight = const_cast<cl_ulong*>(&Height);
             size_t* pBufferSize = const_cast<size_t*>(&BufferSize);
 
             *pType = type;
+            *pLayout = layout;
             *pWidth = width;
             *pHeight = height;
             *pBufferSize = buffer_size;
@@ -180,40 +752,503 @@ namespace SiCKL
     
     sickl_int OpenCLBuffer2D::SetData(void* in_buffer)
     {
-        return clEnqueueWriteBuffer(OpenCLRuntime::_command_queue, _memory_object, true, 0, BufferSize, in_buffer, 0, nullptr, nullptr);
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::write_buffer(_runtime->NextQueue(), _memory_object, BufferSize, in_buffer, _events);
     }
 
     sickl_int OpenCLBuffer2D::GetData(void* out_buffer)
     {
-        return clEnqueueReadBuffer(OpenCLRuntime::_command_queue, _memory_object, true, 0, BufferSize, out_buffer, 0, nullptr, nullptr);
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::read_buffer(_runtime->NextQueue(), _memory_object, BufferSize, out_buffer, _events);
+    }
+    
+    sickl_int OpenCLBuffer2D::map(OpenCLMapAccess::Type access, void** out_data)
+    {
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::map_buffer(_runtime->NextQueue(), _memory_object, BufferSize, access, _events, _mapped, out_data);
+    }
+    
+    sickl_int OpenCLBuffer2D::Unmap()
+    {
+        ReturnErrorIfNull(_runtime, CL_INVALID_MEM_OBJECT);
+        return Internal::unmap_buffer(_runtime->NextQueue(), _memory_object, _events, _mapped);
+    }
+
+    void OpenCLBuffer2D::Delete()
+    {
+        if(_mapped != nullptr)
+        {
+            Unmap();
+        }
+        delete _events;
+        _events = nullptr;
+        clReleaseMemObject(_memory_object);
+        _memory_object = nullptr;
+    }
+    
+    //
+    // OpenCLEvent
+    //
+    
+    OpenCLEvent::OpenCLEvent()
+        : _event(nullptr)
+    { }
+    
+    OpenCLEvent::OpenCLEvent(cl_event event)
+        : _event(event)
+    {
+        if(_event != nullptr)
+        {
+            clRetainEvent(_event);
+        }
+    }
+    
+    sickl_int OpenCLEvent::Wait() const
+    {
+        if(_event == nullptr)
+        {
+            return SICKL_SUCCESS;
+        }
+        return clWaitForEvents(1, &_event);
+    }
+    
+    bool OpenCLEvent::IsComplete() const
+    {
+        if(_event == nullptr)
+        {
+            return true;
+        }
+        
+        cl_int status = CL_COMPLETE;
+        if(clGetEventInfo(_event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr) != CL_SUCCESS)
+        {
+            return true;
+        }
+        // negative on error, which is done as well
+        return status <= CL_COMPLETE;
+    }
+    
+    void OpenCLEvent::Delete()
+    {
+        if(_event != nullptr)
+        {
+            clReleaseEvent(_event);
+            _event = nullptr;
+        }
     }
     
     //
     // OpenCLProgram
     //
     
+    // a work group size covers every axis of the domain, or leaves all
+    // of them to the driver
+    static bool valid_local_size(const size_t local_size[2], size_t dimension_count)
+    {
+        if(dimension_count == 1)
+        {
+            return true;
+        }
+        return (local_size[0] == 0) == (local_size[1] == 0);
+    }
+    
     OpenCLProgram::OpenCLProgram()
         : _types(nullptr)
         , _type_count(0)
+        , _output_count(0)
+        , _buffer_events(nullptr)
         , _param_index(0) 
+        , _arg_index(0)
+        , _arg_values(nullptr)
+        , _arg_count(0)
+        , _runtime(nullptr)
         , _kernel(nullptr)
+        , _source(nullptr)
+        , _key(0)
         , _dimension_count(0)
+        , _blocking(true)
+        , _width(1)
+        , _autotune(false)
+        , _tuning(false)
+        , _trial(0)
+        , _best_trial(0)
+        , _best_time(DBL_MAX)
+        , _relaunch(false)
+        , _wait_list(nullptr)
+        , _wait_count(0)
+        , _event(nullptr)
     { 
         _work_dimensions[0] = 0;
         _work_dimensions[1] = 0;
         _work_dimensions[2] = 0;
+        for(uint32_t i = 0; i < count_of(_variants); i++)
+        {
+            _variants[i] = nullptr;
+        }
+        _local_size[0] = 0;
+        _local_size[1] = 0;
+        _user_local_size[0] = 0;
+        _user_local_size[1] = 0;
+        _tuned_dimensions[0] = 0;
+        _tuned_dimensions[1] = 0;
+    }
+    
+    sickl_int OpenCLProgram::SetWorkDimensions(size_t length)
+    {
+        return SetWorkDimensions(length, 1, 1);
+    }
+    
+    sickl_int OpenCLProgram::SetWorkDimensions(size_t length, size_t width)
+    {
+        return SetWorkDimensions(length, width, 1);
+    }
+    
+    sickl_int OpenCLProgram::SetWorkDimensions(size_t length, size_t width, size_t height)
+    {
+        // kernels index a 2D domain
+        ReturnErrorIfTrue(length == 0 || width == 0 || height == 0, CL_INVALID_GLOBAL_WORK_SIZE);
+        ReturnErrorIfFalse(height == 1, CL_INVALID_WORK_DIMENSION);
+        ReturnErrorIfTrue(length > INT32_MAX || width > INT32_MAX, CL_INVALID_GLOBAL_WORK_SIZE);
+        
+        _work_dimensions[0] = length;
+        _work_dimensions[1] = width;
+        _work_dimensions[2] = height;
+        _dimension_count = width > 1 ? 2 : 1;
+        return SICKL_SUCCESS;
+    }
+    
+    void OpenCLProgram::SetBlocking(bool blocking)
+    {
+        _blocking = blocking;
+    }
+    
+    void OpenCLProgram::SetLocalWorkSize(size_t x, size_t y)
+    {
+        _user_local_size[0] = x;
+        _user_local_size[1] = y;
+        if(!_autotune)
+        {
+            _local_size[0] = x;
+            _local_size[1] = y;
+        }
+    }
+    
+    void OpenCLProgram::SetAutotune(bool autotune)
+    {
+        _autotune = autotune;
+        _tuning = false;
+        _relaunch = false;
+        _tuned_dimensions[0] = 0;
+        _tuned_dimensions[1] = 0;
+        
+        // back to the plain kernel until the autotuner picks one
+        if(_kernel != _variants[0])
+        {
+            _kernel = _variants[0];
+            ClearArgValues();
+        }
+        _width = 1;
+        _local_size[0] = _user_local_size[0];
+        _local_size[1] = _user_local_size[1];
+    }
+    
+    OpenCLEvent OpenCLProgram::GetEvent() const
+    {
+        return OpenCLEvent(_event);
+    }
+    
+    sickl_int OpenCLProgram::UseLaunchConfig(uint32_t width, const size_t local_size[2], bool& out_fits)
+    {
+        out_fits = false;
+        
+        uint32_t index = 0;
+        while((1u << index) < width)
+        {
+            index++;
+        }
+        ReturnErrorIfFalse(index < count_of(_variants) && (1u << index) == width, CL_INVALID_VALUE);
+        
+        if(_variants[index] == nullptr)
+        {
+            char options[32];
+            snprintf(options, sizeof(options), "-DSICKL_WIDTH=%u", width);
+            ReturnIfError(Internal::BuildKernel(_runtime->_context, _runtime->_device, _runtime->_device_info, _source, options, _variants[index]));
+        }
+        
+        // the tuning database may hold anything
+        if(!valid_local_size(local_size, _dimension_count))
+        {
+            return SICKL_SUCCESS;
+        }
+        
+        // wider kernels use more registers, so may not fit as many work
+        // items in a group
+        if(local_size[0] > 0)
+        {
+            size_t max_group_size = 0;
+            ReturnIfError(clGetKernelWorkGroupInfo(_variants[index], _runtime->_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, nullptr));
+            const size_t* max_sizes = _runtime->_device_info.MaxWorkItemSizes;
+            if(local_size[0] * local_size[1] > max_group_size || 
+               (max_sizes[0] > 0 && local_size[0] > max_sizes[0]) ||
+               (max_sizes[1] > 0 && local_size[1] > max_sizes[1]))
+            {
+                return SICKL_SUCCESS;
+            }
+        }
+        
+        if(_kernel != _variants[index])
+        {
+            _kernel = _variants[index];
+            ClearArgValues();
+        }
+        _width = width;
+        _local_size[0] = local_size[0];
+        _local_size[1] = local_size[1];
+        out_fits = true;
+        return SICKL_SUCCESS;
+    }
+    
+    cl_int OpenCLProgram::Launch(cl_command_queue queue, const cl_event* wait_events, cl_uint wait_count, cl_event* event)
+    {
+        // each work item runs _width elements of a row, the kernel skips
+        // those past the end
+        size_t global_size[2] = {(_work_dimensions[0] + _width - 1) / _width, _work_dimensions[1]};
+        const size_t* local_size = nullptr;
+        if(_local_size[0] > 0)
+        {
+            ReturnErrorIfFalse(valid_local_size(_local_size, _dimension_count), CL_INVALID_WORK_GROUP_SIZE);
+            for(size_t i = 0; i < _dimension_count; i++)
+            {
+                global_size[i] = (global_size[i] + _local_size[i] - 1) / _local_size[i] * _local_size[i];
+            }
+            local_size = _local_size;
+        }
+        
+        return clEnqueueNDRangeKernel(queue, _kernel, (cl_uint)_dimension_count, nullptr, global_size, local_size, wait_count, wait_count > 0 ? wait_events : nullptr, event);
+    }
+    
+    sickl_int OpenCLProgram::Tune(cl_command_queue queue, const cl_event* wait_events, cl_uint wait_count, bool first)
+    {
+        if(!first)
+        {
+            // best of a few runs, the first one may pay for the upload of
+            // the inputs
+            double time = DBL_MAX;
+            for(uint32_t run = 0; run < 3; run++)
+            {
+                const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                cl_event event = nullptr;
+                cl_int err = Launch(queue, wait_events, wait_count, &event);
+                if(err == CL_SUCCESS)
+                {
+                    err = clWaitForEvents(1, &event);
+                    clReleaseEvent(event);
+                }
+                if(err != CL_SUCCESS)
+                {
+                    _tuning = false;
+                    return err;
+                }
+                const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                time = std::min(time, std::chrono::duration<double>(end - begin).count());
+            }
+            
+            if(time < _best_time)
+            {
+                _best_time = time;
+                _best_trial = _trial;
+            }
+            _trial++;
+        }
+        
+        // on to the next config that fits
+        Internal::LaunchConfig config;
+        for(; _trial < Internal::TuningCandidateCount(); _trial++)
+        {
+            if(!Internal::GetTuningCandidate(_trial, _dimension_count, _runtime->_device_info.MaxWorkGroupSize, config))
+            {
+                continue;
+            }
+            
+            bool fits;
+            ReturnIfError(UseLaunchConfig(config.width, config.local_size, fits));
+            if(fits)
+            {
+                _relaunch = true;
+                return SICKL_SUCCESS;
+            }
+        }
+        
+        // the first config leaves the work group size to the driver, so
+        // always fits
+        _tuning = false;
+        ReturnErrorIfTrue(_best_time == DBL_MAX, CL_INVALID_WORK_GROUP_SIZE);
+        SICKL_ASSERT(Internal::GetTuningCandidate(_best_trial, _dimension_count, _runtime->_device_info.MaxWorkGroupSize, config));
+        
+        bool fits;
+        ReturnIfError(UseLaunchConfig(config.width, config.local_size, fits));
+        SICKL_ASSERT(fits);
+        
+        Internal::StoreTuning(_key, _work_dimensions[0], _work_dimensions[1], config);
+        _tuned_dimensions[0] = _work_dimensions[0];
+        _tuned_dimensions[1] = _work_dimensions[1];
+        _relaunch = true;
+        return SICKL_SUCCESS;
+    }
+    
+    sickl_int OpenCLProgram::Run()
+    {
+        _relaunch = false;
+        ReturnErrorIfNull(_kernel, CL_INVALID_KERNEL);
+        ReturnErrorIfFalse(_runtime->_queue_count > 0, CL_INVALID_COMMAND_QUEUE);
+        ReturnErrorIfFalse(_param_index == _type_count, SICKL_INVALID_KERNEL_ARG);
+        ReturnErrorIfFalse(_dimension_count > 0, CL_INVALID_WORK_DIMENSION);
+        ReturnErrorIfFalse(_autotune || valid_local_size(_local_size, _dimension_count), CL_INVALID_WORK_GROUP_SIZE);
+        ReturnErrorIfTrue(_wait_list == nullptr && _wait_count > 0, CL_INVALID_EVENT_WAIT_LIST);
+        
+        // the size of the domain follows the args
+        cl_int size[2] = {(cl_int)_work_dimensions[0], (cl_int)_work_dimensions[1]};
+        ReturnIfError(SetArgValue(size, sizeof(size)));
+        
+        if(_autotune && !_tuning && 
+           (_tuned_dimensions[0] != _work_dimensions[0] || _tuned_dimensions[1] != _work_dimensions[1]))
+        {
+            // the tuning database may already know the answer
+            Internal::LaunchConfig config;
+            bool fits = false;
+            const cl_kernel kernel = _kernel;
+            if(Internal::LoadTuning(_key, _work_dimensions[0], _work_dimensions[1], config))
+            {
+                ReturnIfError(UseLaunchConfig(config.width, config.local_size, fits));
+            }
+            
+            if(fits)
+            {
+                _tuned_dimensions[0] = _work_dimensions[0];
+                _tuned_dimensions[1] = _work_dimensions[1];
+                if(_kernel != kernel)
+                {
+                    _relaunch = true;
+                    return SICKL_SUCCESS;
+                }
+            }
+            else
+            {
+                _tuning = true;
+                _trial = 0;
+                _best_trial = 0;
+                _best_time = DBL_MAX;
+                return Tune(nullptr, nullptr, 0, true);
+            }
+        }
+        
+        // events that never ran anything are already complete
+        std::vector<cl_event> wait_events;
+        for(size_t i = 0; i < _wait_count; i++)
+        {
+            if(_wait_list[i]._event != nullptr)
+            {
+                wait_events.push_back(_wait_list[i]._event);
+            }
+        }
+        
+        // the inputs wait on whatever writes them, the outputs on whatever
+        // uses them
+        const size_t first_output = _type_count - _output_count;
+        if(_runtime->_track_hazards)
+        {
+            for(size_t i = 0; i < _type_count; i++)
+            {
+                if(_buffer_events[i] != nullptr)
+                {
+                    _buffer_events[i]->GetHazards(i >= first_output, wait_events);
+                }
+            }
+        }
+        const cl_uint wait_count = (cl_uint)wait_events.size();
+        const cl_event* wait_list = wait_count > 0 ? &wait_events[0] : nullptr;
+        
+        cl_command_queue queue = _runtime->NextQueue();
+        if(_tuning)
+        {
+            return Tune(queue, wait_list, wait_count, false);
+        }
+        _wait_list = nullptr;
+        _wait_count = 0;
+        
+        cl_event event = nullptr;
+        ReturnIfError(Launch(queue, wait_list, wait_count, &event));
+        
+        if(_event != nullptr)
+        {
+            clReleaseEvent(_event);
+        }
+        _event = event;
+        
+        if(_runtime->_track_hazards)
+        {
+            // reads first, a buffer passed as an output as well ends up
+            // with the kernel as its writer
+            for(size_t i = 0; i < first_output; i++)
+            {
+                if(_buffer_events[i] != nullptr)
+                {
+                    _buffer_events[i]->AddReader(_event);
+                }
+            }
+            for(size_t i = first_output; i < _type_count; i++)
+            {
+                if(_buffer_events[i] != nullptr)
+                {
+                    _buffer_events[i]->SetWriter(_event);
+                }
+            }
+        }
+        
+        if(_blocking)
+        {
+            return clWaitForEvents(1, &_event);
+        }
+        // make sure the kernel starts while the host goes on
+        return clFlush(queue);
     }
     
     void OpenCLProgram::Delete()
     {
-        if(_kernel != nullptr)
+        // _kernel is one of the variants
+        for(uint32_t i = 0; i < count_of(_variants); i++)
         {
-            SICKL_ASSERT(clReleaseKernel(_kernel) == CL_SUCCESS);
-            _kernel = nullptr;
+            if(_variants[i] != nullptr)
+            {
+                SICKL_ASSERT(clReleaseKernel(_variants[i]) == CL_SUCCESS);
+                _variants[i] = nullptr;
+            }
         }
+        _kernel = nullptr;
+        delete[] _arg_values;
+        _arg_values = nullptr;
+        _arg_count = 0;
+        _key = 0;
+        _width = 1;
+        _local_size[0] = _user_local_size[0];
+        _local_size[1] = _user_local_size[1];
+        _tuning = false;
+        _relaunch = false;
+        _tuned_dimensions[0] = 0;
+        _tuned_dimensions[1] = 0;
         delete[] _types;
         _types = nullptr;
         _type_count = 0;
+        _output_count = 0;
+        delete[] _buffer_events;
+        _buffer_events = nullptr;
+        delete[] _source;
+        _source = nullptr;
+        if(_event != nullptr)
+        {
+            clReleaseEvent(_event);
+            _event = nullptr;
+        }
         _dimension_count = 0;
         _work_dimensions[0] = 0;
         _work_dimensions[1] = 0;
@@ -257,6 +1292,7 @@ namespace SiCKL
         SICKL_ASSERT((type ^ BUFF_TYPE) == buff.Type); \
         ReturnErrorIfFalse(type & BUFF_TYPE, SICKL_INVALID_KERNEL_ARG); \
         ReturnErrorIfFalse((type ^ BUFF_TYPE) == buff.Type, SICKL_INVALID_KERNEL_ARG); \
+        ReturnErrorIfFalse(buff._runtime == _runtime, CL_INVALID_CONTEXT); \
         return SICKL_SUCCESS; \
     }
     
@@ -265,23 +1301,85 @@ namespace SiCKL
     
 #undef VALIDATE_BUFFER_ARG 
    
-    template<>
-    sickl_int OpenCLProgram::SetArg<OpenCLBuffer1D>(const OpenCLBuffer1D& buffer)
+    bool OpenCLProgram::HasArgValue(cl_uint index, const void* value, size_t size) const
     {
-        ReturnIfError(clSetKernelArg(_kernel, _arg_index++, sizeof(cl_uint), &buffer.Length));
-        ReturnIfError(clSetKernelArg(_kernel, _arg_index++, sizeof(cl_mem), &buffer._memory_object));
+        return index < _arg_count && _arg_values[index].size == size && memcmp(_arg_values[index].value, value, size) == 0;
+    }
+    
+    sickl_int OpenCLProgram::SetArgValue(const void* value, size_t size)
+    {
+        ReturnErrorIfFalse(_arg_index < _arg_count, SICKL_INVALID_KERNEL_ARG);
+        
+        // 3 component vectors take up as much room as 4 component ones
+        uint8_t padded[16];
+        if(size == 3 * sizeof(uint32_t))
+        {
+            memcpy(padded, value, size);
+            memset(padded + size, 0x00, sizeof(uint32_t));
+            value = padded;
+            size = sizeof(padded);
+        }
+        
+        ArgValue& arg = _arg_values[_arg_index];
+        SICKL_ASSERT(size <= sizeof(arg.value));
+        if(!HasArgValue(_arg_index, value, size))
+        {
+            ReturnIfError(clSetKernelArg(_kernel, _arg_index, size, value));
+            arg.size = size;
+            memcpy(arg.value, value, size);
+        }
+        _arg_index++;
         return SICKL_SUCCESS;
     }
     
+    void OpenCLProgram::ClearArgValues()
+    {
+        for(cl_uint i = 0; i < _arg_count; i++)
+        {
+            _arg_values[i].size = 0;
+        }
+    }
+   
     template<>
-    sickl_int OpenCLProgram::SetArg<OpenCLBuffer2D>(const OpenCLBuffer2D& buffer)
+    sickl_int OpenCLProgram::SetArg<OpenCLBuffer1D>(const OpenCLBuffer1D& buffer, const ReturnType_t type)
     {
-        ReturnIfError(clSetKernelArg(_kernel, _arg_index++, sizeof(cl_uint), &buffer.Width));
-        ReturnIfError(clSetKernelArg(_kernel, _arg_index++, sizeof(cl_uint), &buffer.Height));
-        ReturnIfError(clSetKernelArg(_kernel, _arg_index++, sizeof(cl_mem), &buffer._memory_object));
+        // memory objects are reused once released, so one bound before
+        // may be a different buffer by now
+        ReturnIfError(ValidateArg(buffer, type));
+        const bool vector3 = Internal::IsVector3((ReturnType_t)(type & ~ReturnType::Buffer1D));
+        _buffer_events[_param_index] = buffer._events;
         
+        // the kernel takes 32 bit sizes
+        const cl_uint length = (cl_uint)buffer.Length;
+        ReturnIfError(SetArgValue(&length, sizeof(cl_uint)));
+        // 3 component buffers say how they are laid out
+        if(vector3)
+        {
+            const cl_uint layout = (cl_uint)buffer.Layout;
+            ReturnIfError(SetArgValue(&layout, sizeof(cl_uint)));
+        }
+        ReturnIfError(SetArgValue(&buffer._memory_object, sizeof(cl_mem)));
         return SICKL_SUCCESS;
     }
+    
+    template<>
+    sickl_int OpenCLProgram::SetArg<OpenCLBuffer2D>(const OpenCLBuffer2D& buffer, const ReturnType_t type)
+    {
+        ReturnIfError(ValidateArg(buffer, type));
+        const bool vector3 = Internal::IsVector3((ReturnType_t)(type & ~ReturnType::Buffer2D));
+        _buffer_events[_param_index] = buffer._events;
         
-
+        const cl_uint width = (cl_uint)buffer.Width;
+        const cl_uint height = (cl_uint)buffer.Height;
+        ReturnIfError(SetArgValue(&width, sizeof(cl_uint)));
+        ReturnIfError(SetArgValue(&height, sizeof(cl_uint)));
+        if(vector3)
+        {
+            const cl_uint layout = (cl_uint)buffer.Layout;
+            ReturnIfError(SetArgValue(&layout, sizeof(cl_uint)));
+        }
+        ReturnIfError(SetArgValue(&buffer._memory_object, sizeof(cl_mem)));
+        
+        return SICKL_SUCCESS;
+    }
 }
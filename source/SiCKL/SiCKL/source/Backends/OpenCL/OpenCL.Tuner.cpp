@@ -0,0 +1,178 @@
+// C
+#include <stdio.h>
+#include <stdlib.h>
+
+// C++
+#include <map>
+#include <mutex>
+#include <string>
+
+// local
+#include "OpenCL.Cache.h"
+#include "OpenCL.Internal.h"
+#include "../CPU/CPU.Native.h"
+
+namespace SiCKL
+{
+    namespace Internal
+    {
+        // work group shapes worth trying on GPUs and CPU runtimes alike
+        static const size_t LocalSizes[][2] =
+        {
+            {0, 0},
+            {8, 8},
+            {16, 8},
+            {16, 16},
+            {32, 4},
+            {32, 8},
+            {64, 1},
+            {64, 4},
+            {128, 1},
+            {256, 1},
+        };
+        static const uint32_t LocalSizeCount = count_of(LocalSizes);
+        // 1, 2, 4 and 8 elements per work item
+        static const uint32_t WidthCount = 4;
+
+        uint32_t TuningCandidateCount()
+        {
+            return WidthCount * LocalSizeCount;
+        }
+
+        bool GetTuningCandidate(uint32_t index, size_t dimension_count, size_t max_group_size, LaunchConfig& out_config)
+        {
+            SICKL_ASSERT(index < TuningCandidateCount());
+            const size_t* local_size = LocalSizes[index % LocalSizeCount];
+
+            out_config.width = 1u << (index / LocalSizeCount);
+            out_config.local_size[0] = local_size[0];
+            out_config.local_size[1] = local_size[1];
+
+            // 1D domains only have rows of work groups
+            if(dimension_count == 1)
+            {
+                if(local_size[1] > 1)
+                {
+                    return false;
+                }
+                out_config.local_size[1] = local_size[0] == 0 ? 0 : 1;
+            }
+            return local_size[0] * local_size[1] <= max_group_size;
+        }
+
+#if !defined(_WIN32)
+        struct TuningKey
+        {
+            uint64_t key;
+            size_t width;
+            size_t height;
+
+            bool operator<(const TuningKey& right) const
+            {
+                if(key != right.key)
+                {
+                    return key < right.key;
+                }
+                if(width != right.width)
+                {
+                    return width < right.width;
+                }
+                return height < right.height;
+            }
+        };
+
+        static std::mutex tuning_lock;
+        static std::map<TuningKey, LaunchConfig>* tuning = nullptr;
+
+        // empty without a cache directory
+        static std::string tuning_path()
+        {
+            const std::string directory = CacheDirectory();
+            return directory.empty() ? directory : directory + "/opencl-tuning.txt";
+        }
+
+        // one line per result, later lines win
+        static void load_tuning()
+        {
+            if(tuning != nullptr)
+            {
+                return;
+            }
+            tuning = new std::map<TuningKey, LaunchConfig>();
+
+            FILE* f = OpenCacheFile(tuning_path());
+            if(f == nullptr)
+            {
+                return;
+            }
+
+            unsigned long long key, width, height, local_x, local_y;
+            unsigned int config_width;
+            while(fscanf(f, "%llx %llu %llu %u %llu %llu", &key, &width, &height, &config_width, &local_x, &local_y) == 6)
+            {
+                // skip anything this version wouldn't write
+                if(config_width == 0 || config_width > MaxLaunchWidth || (config_width & (config_width - 1)) != 0)
+                {
+                    continue;
+                }
+
+                TuningKey tuning_key = {key, (size_t)width, (size_t)height};
+                LaunchConfig config;
+                config.width = config_width;
+                config.local_size[0] = (size_t)local_x;
+                config.local_size[1] = (size_t)local_y;
+                (*tuning)[tuning_key] = config;
+            }
+            fclose(f);
+        }
+#endif
+
+        bool LoadTuning(uint64_t key, size_t width, size_t height, LaunchConfig& out_config)
+        {
+#if defined(_WIN32)
+            (void)key;
+            (void)width;
+            (void)height;
+            (void)out_config;
+            return false;
+#else
+            std::lock_guard<std::mutex> guard(tuning_lock);
+            load_tuning();
+
+            TuningKey tuning_key = {key, width, height};
+            std::map<TuningKey, LaunchConfig>::const_iterator it = tuning->find(tuning_key);
+            if(it == tuning->end())
+            {
+                return false;
+            }
+            out_config = it->second;
+            return true;
+#endif
+        }
+
+        void StoreTuning(uint64_t key, size_t width, size_t height, const LaunchConfig& config)
+        {
+#if defined(_WIN32)
+            (void)key;
+            (void)width;
+            (void)height;
+            (void)config;
+#else
+            std::lock_guard<std::mutex> guard(tuning_lock);
+            load_tuning();
+
+            TuningKey tuning_key = {key, width, height};
+            (*tuning)[tuning_key] = config;
+
+            // lines this short are appended whole even with several
+            // processes tuning at once
+            FILE* f = fopen(tuning_path().c_str(), "a");
+            if(f != nullptr)
+            {
+                fprintf(f, "%llx %llu %llu %u %llu %llu\n", (unsigned long long)key, (unsigned long long)width, (unsigned long long)height, config.width, (unsigned long long)config.local_size[0], (unsigned long long)config.local_size[1]);
+                fclose(f);
+            }
+#endif
+        }
+    }
+}
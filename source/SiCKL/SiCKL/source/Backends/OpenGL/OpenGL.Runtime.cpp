@@ -216,9 +216,9 @@ namespace SiCKL
 		if(data == nullptr)
 		{
 			const uint32_t buffer_size = GetBufferSize();
-			initial_data = malloc(buffer_size);
+			// large blocks come straight from the OS already zeroed
+			initial_data = calloc(buffer_size, 1);
 			COMPUTE_ASSERT(initial_data != nullptr);
-			memset(initial_data, 0x00, buffer_size);
 		}
 
 		// create buffer, allocate space and copy in data
@@ -328,9 +328,9 @@ namespace SiCKL
 		if(data == nullptr)
 		{
 			const uint32_t buffer_size = GetBufferSize();
-			initial_data = malloc(buffer_size);
+			// large blocks come straight from the OS already zeroed
+			initial_data = calloc(buffer_size, 1);
 			COMPUTE_ASSERT(initial_data != nullptr);
-			memset(initial_data, 0x00, buffer_size);
 		}
 
 		switch(type)